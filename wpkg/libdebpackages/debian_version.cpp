@@ -37,7 +37,6 @@
 #include    <string>
 #include    <memory>
 //#include  <iostream> // used for debug purposes
-#include    <sstream>
 #include    <algorithm>
 #include    <vector>
 #include    <stdexcept>
@@ -45,387 +44,657 @@
 #include    <string.h>
 #include    <stdio.h>
 
-/// Structure used to hold all the sub-parts of a part (numbers/alpha)
-struct debian_version_part_t
+
+namespace
+{
+
+/** \brief Canonicalize one character of a version.
+ *
+ * Note: using lowercase for all letters is NOT Debian compatible
+ *       however, MS-Windows makes use of case insensitive filenames
+ *       so it is viewed as safer to have such a test of versions
+ *
+ * \param[in] c  The character to canonicalize.
+ *
+ * \return The lowercase letter or ':' for ';', or \p c as is.
+ */
+char fix_version(char c)
 {
-    debian_version_part_t()
-        //: f_str -- auto-init
-        : f_val(-1)
+    if(c >= 'A' && c <= 'Z')
     {
+        return static_cast<char>(c | 0x020);
     }
+    if(c == ';')
+    {
+        return ':';
+    }
+    return c;
+}
+
+
+bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
 
-    static int cmp(char a, char b)
+
+/** \brief Weight of a character in the non-digit parts of a version.
+ *
+ * The tilde sorts before anything, even the end of the part (represented
+ * by '\0'), then letters, then all the other characters. This way two
+ * non-digit parts are compared by comparing the weights of their
+ * characters one by one.
+ *
+ * \param[in] c  The character to weight.
+ *
+ * \return The weight of the character.
+ */
+int char_order(char c)
+{
+    if(c == '~')
     {
-        if(a == b) 
-        {
-            return 0;
-        }
-        if(a == '\0') 
-        {
-            return b == '~' ? 1 : -1;
-        }
-        if(b == '\0') 
-        {
-            return a == '~' ? -1 : 1;
-        }
-        if(a >= 'a' && a <= 'z') 
+        return -1;
+    }
+    if(c == '\0' || (c >= 'a' && c <= 'z'))
+    {
+        return static_cast<unsigned char>(c);
+    }
+    return static_cast<unsigned char>(c) + 256;
+}
+
+
+/// One part of a version (a string of digits or of non-digits)
+struct part_t
+{
+    part_t()
+        : f_start(NULL)
+        , f_end(NULL)
+        , f_number(false)
+    {
+    }
+
+    const char *    f_start;
+    const char *    f_end;
+    bool            f_number;
+
+    bool is_zero() const
+    {
+        if(f_number)
         {
-            if(b >= 'a' && b <= 'z') 
+            // all zeroes
+            for(const char *s(f_start); s < f_end; ++s)
             {
-                if(a < b) 
+                if(*s != '0')
                 {
-                    return -1;
+                    return false;
                 }
-                if(a > b) 
-                {
-                    return 1;
-                }
-                return 0;
             }
-            // letters are earlier than non-letters except '~'
-            return b == '~' ? 1 : -1;
+            return true;
         }
-        if(b >= 'a' && b <= 'z') 
-        {
-            return a == '~' ? -1 : 1;
-        }
-        if(a == '~') 
-        {
-            return -1;
-        }
-        if(b == '~') 
-        {
-            return 1;
-        }
-        if(a < b) 
-        {
-            return -1;
-        }
-        if(a > b) 
-        {
-            return 1;
-        }
-        return 0;
+        // ".0" is also viewed as zero
+        return f_start == f_end || (f_end - f_start == 1 && *f_start == '.');
     }
 
-    int compare(const debian_version_part_t& rhs) const
+    int compare(const part_t& rhs) const
     {
-        // value comparison?
-        if(f_val != -1) 
+        if(f_number != rhs.f_number)
+        {
+            // this is a bug
+            throw std::logic_error("comparing parts that are not of the same type");
+        }
+
+        if(f_number)
         {
-            if(rhs.f_val == -1) 
+            // compare the numbers as decimal strings so they cannot overflow
+            const char *a(f_start);
+            while(a < f_end && *a == '0')
             {
-                // this is a bug
-                throw std::logic_error("comparing parts that are not of the same type (1)");
+                ++a;
             }
-            if(f_val < rhs.f_val) 
+            const char *b(rhs.f_start);
+            while(b < rhs.f_end && *b == '0')
             {
-                return -1;
+                ++b;
             }
-            if(f_val > rhs.f_val) 
+            if(f_end - a != rhs.f_end - b)
             {
-                return 1;
+                return f_end - a < rhs.f_end - b ? -1 : 1;
             }
-            return 0;
-        }
-        if(rhs.f_val != -1) 
-        {
-            // this is a bug
-            throw std::logic_error("comparing parts that are not of the same type (2)");
+            const int r(memcmp(a, b, f_end - a));
+            return (r > 0) - (r < 0);
         }
 
         // string comparison is complicated!
-        const char *a(f_str.c_str());
-        const char *b(rhs.f_str.c_str());
-        while(*a != '\0' && *b != '\0') 
+        const char *a(f_start);
+        const char *b(rhs.f_start);
+        for(;;)
         {
-            int r(cmp(*a, *b));
-            if(r != 0) 
+            const int ca(char_order(a < f_end ? *a : '\0'));
+            const int cb(char_order(b < rhs.f_end ? *b : '\0'));
+            if(ca != cb)
             {
-                return r;
+                return ca < cb ? -1 : 1;
+            }
+            if(ca == 0)
+            {
+                return 0;
             }
             ++a;
             ++b;
         }
-        // one or the other or both are '\0' which needs
-        // to be compared properly against '~'
-        return cmp(*a, *b);
     }
+};
 
-    bool is_zero() const
+
+/** \brief Break up a string into version parts (string, number, string, ...)
+ *
+ * The first part is always a string part, even if empty. The parts are
+ * read directly from the version string, nothing gets copied.
+ */
+class part_iterator
+{
+public:
+    part_iterator(const char *start, const char *end)
+        : f_pos(start)
+        , f_end(end)
+        , f_number(false)
+        , f_done(start == end)
     {
-        // ".0" is also viewed as zero
-        return f_val == -1 ? f_str == "." || f_str == "" : f_val == 0;
     }
 
-    std::string f_str;
-    /// If -1, then f_str is the ASCII data, otherwise f_val is the decimal value
-    int         f_val;
+    bool next(part_t& part)
+    {
+        if(f_done)
+        {
+            return false;
+        }
+        part.f_start = f_pos;
+        part.f_number = f_number;
+        while(f_pos < f_end && is_digit(*f_pos) == f_number)
+        {
+            ++f_pos;
+        }
+        part.f_end = f_pos;
+        f_done = f_pos == f_end;
+        f_number = !f_number;
+        return true;
+    }
+
+private:
+    const char *    f_pos;
+    const char *    f_end;
+    bool            f_number;
+    bool            f_done;
 };
 
 
-namespace
-{
-int fix_version(int c)
+/// Compare the parts of two version strings
+int compare_parts(part_iterator a, part_iterator b)
 {
-    if(c >= 'A' && c <= 'Z')
+    part_t pa, pb;
+    bool has_a(a.next(pa));
+    bool has_b(b.next(pb));
+    for(; has_a && has_b; has_a = a.next(pa), has_b = b.next(pb))
     {
-        return c | 0x020;
+        const int r(pa.compare(pb));
+        if(r != 0)
+        {
+            return r;
+        }
     }
-    if(c == ';')
+    // test a's if a is longer
+    for(; has_a; has_a = a.next(pa))
     {
-        return ':';
+        if(!pa.is_zero())
+        {
+            return 1;
+        }
     }
-    return c;
-}
+    // test b's if b is longer
+    for(; has_b; has_b = b.next(pb))
+    {
+        if(!pb.is_zero())
+        {
+            return -1;
+        }
+    }
+    return 0;  // equal!
 }
 
 
-/// Private declaration of the Debian version object
-struct debian_version_t
+/// Concatenate the parts of a version except the ending zeroes
+std::string parts_to_string(const char *start, const char *end)
 {
-    /// Initializes the Debian version object
-    debian_version_t(std::string version, std::string& error_msg)
-        : f_epoch(0)
-        //, f_version_parts -- auto-init
-        //, f_revision_parts -- auto-init
-    {
-        // Note: using uppercase for all letters is NOT Debian compatible
-        //       however, MS-Windows makes use of case insensitive filenames
-        //       so it is viewed as safer to have such a test of versions
-        std::transform(version.begin(), version.end(), version.begin(), fix_version);
-
-        // first ":" separate the epoch from the rest
-        std::string::size_type p(version.find_first_of(":"));
-        if(p != std::string::npos)
-        {
-            if(p == 0)
-            {
-                error_msg = "empty epoch";
-                return;
-            }
-            std::string epoch(version.substr(0, p));
-            // remove the epoch
-            version = version.substr(p + 1);
-            p = epoch.find_first_not_of("0123456789");
-            if(p != std::string::npos)
-            {
-                error_msg = "non-decimal epoch";
-                return;
-            }
-            f_epoch = 0;
-            for(const char *e(epoch.c_str()); *e != '\0'; ++e)
-            {
-                // note: we already checked whether all characters were digits
-                const int old(f_epoch);
-                f_epoch = f_epoch * 10 + *e - '0';
-                if(f_epoch < old)
-                {
-                    // this happens on overflows
-                    error_msg = "invalid decimal epoch";
-                    return;
-                }
-            }
-        }
+    std::vector<part_t> parts;
+    part_iterator it(start, end);
+    part_t part;
+    while(it.next(part))
+    {
+        parts.push_back(part);
+    }
 
-        // now check for a revision
-        p = version.find_last_of("-");
-        if(p != std::string::npos)
+    // remove the .0 at the end (i.e. 1.0.0 -> 1.0)
+    std::vector<part_t>::size_type count(parts.size());
+    while(count > 2 && parts[count - 1].is_zero())
+    {
+        --count;
+    }
+
+    std::string result;
+    for(std::vector<part_t>::size_type i(0); i < count; ++i)
+    {
+        const char *s(parts[i].f_start);
+        if(parts[i].f_number)
         {
-            if(p + 1 == version.length())
-            {
-                error_msg = "empty revision";
-                return;
-            }
-            std::string revision(version.substr(p + 1));
-            // This is not actually true for revisions even though it says so
-            // however they want to support things such as -alpha, -beta, -rc1
-            //if(revision[0] < '0' || revision[0] > '9')
-            //{
-            //    error_msg = "invalid revision, digit expected as first character";
-            //    return;
-            //}
-            version = version.substr(0, p);
-            // revisions do not support colons, use '-' which cannot
-            // be included in that string
-            if(string_to_parts(revision, f_revision_parts, '-') != 0)
+            // numbers are written without their leading zeroes
+            while(s + 1 < parts[i].f_end && *s == '0')
             {
-                error_msg = "invalid character in revision";
-                return;
+                ++s;
             }
         }
+        result.append(s, parts[i].f_end - s);
+    }
+    return result;
+}
 
-        // now transform the version into parts
-        if(version[0] < '0' || version[0] > '9')
-        {
-            error_msg = "invalid version, digit expected as first character";
-            return;
-        }
-        if(string_to_parts(version, f_version_parts) != 0)
+
+/// Count the number of parts of a version
+int count_parts(const char *start, const char *end, part_t *first_two)
+{
+    int count(0);
+    part_iterator it(start, end);
+    part_t part;
+    while(it.next(part))
+    {
+        if(count < 2)
         {
-            error_msg = "invalid character in version";
-            return;
+            first_two[count] = part;
         }
+        ++count;
     }
+    return count;
+}
+
+} // no name namespace
+
+
+/// Private declaration of the Debian version object
+struct debian_version_t
+{
+    debian_version::value       f_value;
+};
 
-    /// Break up a string into version parts (number, string, number, ...)
-    int string_to_parts(const std::string& v, std::vector<debian_version_part_t>& parts, char colon = ':')
+
+namespace debian_version
+{
+
+
+/** \class value
+ * \brief A parsed Debian version.
+ *
+ * This class holds a canonicalized copy of a version string (lowercase
+ * letters, semi-colons replaced by colons) and the positions of its
+ * epoch, version, and revision. The copy is saved in a buffer inside
+ * the object unless it is BUFFER_SIZE characters or more, so parsing,
+ * copying, and comparing versions generally does not allocate memory.
+ *
+ * The parts of the version (numbers and strings) are found while
+ * comparing, directly from that buffer.
+ *
+ * The rules are the same as with the string_to_debian_version()
+ * function.
+ */
+
+
+const size_t value::BUFFER_SIZE;
+const size_t value::npos;
+
+
+/** \brief Initialize an invalid version.
+ *
+ * Call set() to give the version a value.
+ */
+value::value()
+    //: f_buffer() -- initialized below
+    //, f_long_version() -- auto-init
+    : f_length(0)
+    , f_epoch(0)
+    , f_version_start(0)
+    , f_version_end(0)
+    , f_revision_start(0)
+    , f_valid(false)
+{
+    f_buffer[0] = '\0';
+}
+
+
+/** \brief Parse a version.
+ *
+ * This function parses the specified version and saves the result in
+ * this object. If the version is invalid, the function returns false
+ * and the object is marked as invalid.
+ *
+ * \param[in] version  The version to parse.
+ * \param[out] error_msg  If not NULL, set to a static string describing
+ *                        the error when the function returns false.
+ *
+ * \return true if the version is valid.
+ */
+bool value::set(const char *version, const char **error_msg)
+{
+    return parse(version, strlen(version), error_msg);
+}
+
+
+/** \brief Parse a version.
+ *
+ * This function parses the specified version and saves the result in
+ * this object. If the version is invalid, the function returns false
+ * and the object is marked as invalid.
+ *
+ * \param[in] version  The version to parse.
+ * \param[out] error_msg  If not NULL, set to a static string describing
+ *                        the error when the function returns false.
+ *
+ * \return true if the version is valid.
+ */
+bool value::set(const std::string& version, const char **error_msg)
+{
+    // like with a C string, stop at the first '\0'
+    return parse(version.c_str(), strlen(version.c_str()), error_msg);
+}
+
+
+/** \brief Check whether the last call to set() succeeded.
+ *
+ * \return true if this object represents a valid version.
+ */
+bool value::is_valid() const
+{
+    return f_valid;
+}
+
+
+/** \brief Compare two versions.
+ *
+ * Both versions are expected to be valid.
+ *
+ * \param[in] rhs  The version to compare against.
+ *
+ * \return -1, 0 or 1 whether this version is smaller, equal or larger
+ *         than \p rhs.
+ */
+int value::compare(const value& rhs) const
+{
+    // compare the epoch first
+    if(f_epoch != rhs.f_epoch)
     {
-        for(const char *s = v.c_str(); *s != '\0';)
-        {
-            // read the string
-            const char *start(s);
-            for(; *s != '\0' && (*s < '0' || *s > '9'); ++s)
-            {
-                // digits will not be included here so no need to test them
-                // characters have been transformed to lowercase
-                if((*s < 'a' || *s > 'z')
-                && *s != '-' && *s != '.' && *s != '~' && *s != '+' && *s != colon)
-                {
-                    return -1;
-                }
-            }
-            debian_version_part_t ps;
-            ps.f_str.assign(start, s - start);
-            parts.push_back(ps);
-            if(*s == '\0')
-            {
-                break;
-            }
+        return f_epoch < rhs.f_epoch ? -1 : 1;
+    }
 
-            // read the number
-            debian_version_part_t pv;
-            pv.f_val = 0;
-            while(*s >= '0' && *s <= '9')
-            {
-                pv.f_val = pv.f_val * 10 + *s - '0';
-                ++s;
-            }
-            parts.push_back(pv);
-        }
-        return 0;
+    // compare version sub-parts
+    const char *a(data());
+    const char *b(rhs.data());
+    const int r(compare_parts(part_iterator(a + f_version_start, a + f_version_end),
+                              part_iterator(b + rhs.f_version_start, b + rhs.f_version_end)));
+    if(r != 0)
+    {
+        return r;
     }
 
-    /// compare two versions against each others
-    int compare(const debian_version_t& rhs) const
+    // now compare revision sub-parts
+    return compare_parts(part_iterator(a + f_revision_start, a + f_length),
+                         part_iterator(b + rhs.f_revision_start, b + rhs.f_length));
+}
+
+
+/** \brief Convert the version back to a canonicalized string.
+ *
+ * The epoch is removed if zero (unless the version includes a colon),
+ * the ending zeroes are removed (i.e. "1.0.0" becomes "1.0"), numbers
+ * lose their leading zeroes, and a revision of zero is removed.
+ *
+ * \return The canonicalized version.
+ */
+std::string value::to_string() const
+{
+    const char *d(data());
+
+    // version parts, mandatory
+    const std::string ver(parts_to_string(d + f_version_start, d + f_version_end));
+
+    std::string result;
+
+    // put the epoch if there is one (i.e. not "0:")
+    if(f_epoch > 0 || ver.find(':') != std::string::npos)
     {
-        int    r;
+        char epoch[16];
+        snprintf(epoch, sizeof(epoch), "%u:", static_cast<unsigned int>(f_epoch));
+        result = epoch;
+    }
 
-        // compare the epoch first
-        r = f_epoch - rhs.f_epoch;
-        if(r != 0)
-        {
-            return r < 0 ? -1 : 1;
-        }
+    result += ver;
 
-        // compare version sub-parts
-        r = compare_parts(f_version_parts, rhs.f_version_parts);
-        if(r != 0)
+    // revision parts, optional
+    part_t first_two[2];
+    const int count(count_parts(d + f_revision_start, d + f_length, first_two));
+    if(count > 0)
+    {
+        // avoid "-0" which is the default
+        if(count != 2
+        || !first_two[0].is_zero()
+        || !first_two[1].is_zero())
         {
-            return r;
+            result += '-';
+            result += parts_to_string(d + f_revision_start, d + f_length);
         }
-
-        // now compare revision sub-parts
-        return compare_parts(f_revision_parts, rhs.f_revision_parts);
     }
 
-    static int compare_parts(const std::vector<debian_version_part_t>& a, const std::vector<debian_version_part_t>& b)
-    {
-        std::vector<debian_version_part_t>::size_type idx;
-        for(idx = 0; idx < a.size() && idx < b.size(); ++idx)
+    return result;
+}
+
+
+/** \brief Parse and canonicalize a version.
+ *
+ * The errors are checked in the same order as the parts get parsed:
+ * epoch, revision, and finally the version itself.
+ *
+ * \param[in] version  The version to parse.
+ * \param[in] length  The number of characters in \p version.
+ * \param[out] error_msg  If not NULL, receives the error message.
+ *
+ * \return true if the version is valid.
+ */
+bool value::parse(const char *version, size_t length, const char **error_msg)
+{
+    f_valid = false;
+    f_epoch = 0;
+
+    auto error = [error_msg](const char *msg)
         {
-            int r(a[idx].compare(b[idx]));
-            if(r != 0)
+            if(error_msg != NULL)
             {
-                return r;
+                *error_msg = msg;
             }
+            return false;
+        };
+
+    char *d;
+    if(length < BUFFER_SIZE)
+    {
+        f_long_version.clear();
+        d = f_buffer;
+    }
+    else
+    {
+        f_long_version.resize(length);
+        d = &f_long_version[0];
+    }
+    std::transform(version, version + length, d, fix_version);
+    d[length] = '\0';
+    f_length = static_cast<uint32_t>(length);
+    const char *end(d + length);
+
+    // first ":" separate the epoch from the rest
+    const char *start(d);
+    const char *colon(static_cast<const char *>(memchr(d, ':', length)));
+    if(colon != NULL)
+    {
+        if(colon == d)
+        {
+            return error("empty epoch");
         }
-        // test a's if a is longer
-        for(; idx < a.size(); ++idx)
+        uint64_t epoch(0);
+        for(const char *e(d); e < colon; ++e)
         {
-            if(!a[idx].is_zero())
+            if(!is_digit(*e))
+            {
+                return error("non-decimal epoch");
+            }
+            epoch = epoch * 10 + *e - '0';
+            if(epoch > 0x7FFFFFFF)
             {
-                return 1;
+                // the epoch must fit in an int
+                return error("invalid decimal epoch");
             }
         }
-        // test b's if b is longer
-        for(; idx < b.size(); ++idx)
+        f_epoch = static_cast<uint32_t>(epoch);
+        start = colon + 1;
+    }
+    f_version_start = static_cast<uint32_t>(start - d);
+
+    // now check for a revision
+    const char *dash(end);
+    while(dash > start && dash[-1] != '-')
+    {
+        --dash;
+    }
+    if(dash > start)
+    {
+        if(dash == end)
+        {
+            return error("empty revision");
+        }
+        // revisions do not support colons
+        for(const char *r(dash); r < end; ++r)
         {
-            if(!b[idx].is_zero())
+            if(!is_digit(*r) && (*r < 'a' || *r > 'z')
+            && *r != '.' && *r != '~' && *r != '+')
             {
-                return -1;
+                return error("invalid character in revision");
             }
         }
-        return 0;  // equal!
+        f_version_end = static_cast<uint32_t>(dash - 1 - d);
+        f_revision_start = static_cast<uint32_t>(dash - d);
     }
-
-    std::string to_string() const
+    else
     {
-        std::stringstream str;
-        std::stringstream ver;
-
-        // version parts, mandatory
-        parts_to_string(ver, f_version_parts);
+        f_version_end = f_length;
+        f_revision_start = f_length;
+    }
 
-        // put the epoch if there is one (i.e. not "0:")
-        if(f_epoch > 0 || ver.str().find(":") != std::string::npos)
+    // now check the version
+    if(f_version_start == f_version_end || !is_digit(d[f_version_start]))
+    {
+        return error("invalid version, digit expected as first character");
+    }
+    for(const char *v(d + f_version_start); v < d + f_version_end; ++v)
+    {
+        if(!is_digit(*v) && (*v < 'a' || *v > 'z')
+        && *v != '-' && *v != '.' && *v != '~' && *v != '+' && *v != ':')
         {
-            str << f_epoch << ":";
+            return error("invalid character in version");
         }
+    }
+
+    f_valid = true;
+    return true;
+}
+
+
+/** \brief Get the canonicalized version string.
+ *
+ * \return A pointer to the buffer or to the long version string.
+ */
+const char *value::data() const
+{
+    return f_length < BUFFER_SIZE ? f_buffer : f_long_version.c_str();
+}
 
-        str << ver.str();
 
-        // revision parts, optional
-        if(f_revision_parts.size() > 0)
+/** \brief Sort a list of versions from the smallest to the largest.
+ *
+ * The versions are sorted in place and without allocating memory.
+ * All the versions must be valid.
+ *
+ * \param[in,out] versions  The versions to sort.
+ */
+void sort(std::vector<value>& versions)
+{
+    std::sort(versions.begin(), versions.end());
+}
+
+
+/** \brief Search the largest version in a list.
+ *
+ * All the versions must be valid. If several versions are equal, the
+ * first one is returned.
+ *
+ * \param[in] versions  The versions to search.
+ *
+ * \return The index of the largest version, or value::npos if the list
+ *         is empty.
+ */
+size_t find_max(const std::vector<value>& versions)
+{
+    size_t result(value::npos);
+    for(size_t i(0); i < versions.size(); ++i)
+    {
+        if(result == value::npos || versions[i] > versions[result])
         {
-            // avoid "-0" which is the default
-            if(f_revision_parts.size() != 2
-            || !f_revision_parts[0].is_zero()
-            || !f_revision_parts[1].is_zero())
-            {
-                str << "-";
-                parts_to_string(str, f_revision_parts);
-            }
+            result = i;
         }
-
-        // results
-        return str.str();
     }
+    return result;
+}
 
-    static void parts_to_string(std::stringstream& str, const std::vector<debian_version_part_t>& parts)
+
+/** \brief Search the largest version in a list of strings.
+ *
+ * Each string gets parsed once. Unless some of them are very long,
+ * this does not allocate any memory.
+ *
+ * \exception std::invalid_argument
+ * The exception is raised if one of the versions is not valid.
+ *
+ * \param[in] versions  The versions to search.
+ *
+ * \return The index of the largest version, or value::npos if the list
+ *         is empty.
+ */
+size_t find_max(const std::vector<std::string>& versions)
+{
+    size_t result(value::npos);
+    value max_version;
+    value v;
+    for(size_t i(0); i < versions.size(); ++i)
     {
-        // remove the .0 at the end (i.e. 1.0.0 -> 1.0)
-        std::vector<debian_version_part_t>::size_type count(parts.size());
-        while(count > 2)
+        const char *error_msg(NULL);
+        if(!v.set(versions[i], &error_msg))
         {
-            if(parts[count - 1].is_zero())
-            {
-                --count;
-            }
-            else
-            {
-                break;
-            }
+            throw std::invalid_argument("version \"" + versions[i] + "\" is invalid (" + error_msg + ")");
         }
-        // concatenate all the parts except ending zeroes
-        for(std::vector<debian_version_part_t>::size_type i = 0; i < count; ++i)
+        if(result == value::npos || v > max_version)
         {
-            if(parts[i].f_val == -1)
-            {
-                str << parts[i].f_str;
-            }
-            else
-            {
-                str << parts[i].f_val;
-            }
+            result = i;
+            std::swap(max_version, v);
         }
     }
+    return result;
+}
 
-private:
-    int                                 f_epoch;
-    std::vector<debian_version_part_t>  f_version_parts;
-    std::vector<debian_version_part_t>  f_revision_parts;
-};
+
+}   // namespace debian_version
 
 
 
@@ -447,19 +716,17 @@ private:
  */
 int validate_debian_version(const char *string, char *error_string, size_t error_size)
 {
-    std::string error_msg;
-    const char *errmsg;
+    const char *errmsg(NULL);
 
     try
     {
-        debian_version_t version(string, error_msg);
-        if(error_msg.empty())
+        // very long versions are the only ones that allocate memory
+        debian_version::value version;
+        if(version.set(string, &errmsg))
         {
             // it is valid!
             return 1;
         }
-        // an error occurred
-        errmsg = error_msg.c_str();
     }
     catch(const std::bad_alloc&)
     {
@@ -536,21 +803,15 @@ int validate_debian_version(const char *string, char *error_string, size_t error
  */
 debian_version_handle_t string_to_debian_version(const char *string, char *error_string, size_t error_size)
 {
-    std::string error_msg;
-    debian_version_handle_t version;
-    const char *errmsg;
+    const char *errmsg(NULL);
 
     try
     {
-        version = new debian_version_t(string, error_msg);
-        if(error_msg.empty())
+        std::unique_ptr<debian_version_t> version(new debian_version_t);
+        if(version->f_value.set(string, &errmsg))
         {
-            return version;
+            return version.release();
         }
-        // an error occurred, get rid of the version
-        delete version;
-
-        errmsg = error_msg.c_str();
     }
     catch(const std::bad_alloc&)
     {
@@ -617,7 +878,7 @@ int debian_version_to_string(const debian_version_handle_t debian_version, char
         return -1;
     }
 
-    std::string str = debian_version->to_string();
+    std::string str = debian_version->f_value.to_string();
 
     // requesting the size only
     if(string == 0 || string_size == 0) 
@@ -657,7 +918,7 @@ int debian_versions_compare(const debian_version_handle_t left, const debian_ver
         return -1;
     }
 
-    return left->compare(*right);
+    return left->f_value.compare(right->f_value);
 }
 
 
@@ -24,8 +24,10 @@
 /** \file
  * \brief C functions used to parse and compare versions.
  *
- * The library supports ways to handle versions in C or C++. The C++ API
- * is not exposed. Outsiders are expected to make use of the C API.
+ * The library supports ways to handle versions in C or C++. The C API
+ * allocates a handle for each version. The C++ API offers a value type,
+ * debian_version::value, which parses and compares versions without
+ * allocating memory (unless the version is very long).
  *
  * This file describes the necessary functions to parse a version and then
  * compare two versions together.
@@ -52,6 +54,55 @@ DEBIAN_PACKAGE_EXPORT void delete_debian_version(debian_version_handle_t debian_
 
 #ifdef __cplusplus
 }
+
+#include    <string>
+#include    <vector>
+#include    <stdint.h>
+
+
+namespace debian_version
+{
+
+class DEBIAN_PACKAGE_EXPORT value
+{
+public:
+    static const size_t             BUFFER_SIZE = 64;
+    static const size_t             npos = static_cast<size_t>(-1);
+
+                                    value();
+
+    bool                            set(const char *version, const char **error_msg = NULL);
+    bool                            set(const std::string& version, const char **error_msg = NULL);
+    bool                            is_valid() const;
+    int                             compare(const value& rhs) const;
+    std::string                     to_string() const;
+
+    bool                            operator == (const value& rhs) const { return compare(rhs) == 0; }
+    bool                            operator != (const value& rhs) const { return compare(rhs) != 0; }
+    bool                            operator <  (const value& rhs) const { return compare(rhs) <  0; }
+    bool                            operator <= (const value& rhs) const { return compare(rhs) <= 0; }
+    bool                            operator >  (const value& rhs) const { return compare(rhs) >  0; }
+    bool                            operator >= (const value& rhs) const { return compare(rhs) >= 0; }
+
+private:
+    bool                            parse(const char *version, size_t length, const char **error_msg);
+    const char *                    data() const;
+
+    char                            f_buffer[BUFFER_SIZE];
+    std::string                     f_long_version;
+    uint32_t                        f_length;
+    uint32_t                        f_epoch;
+    uint32_t                        f_version_start;
+    uint32_t                        f_version_end;
+    uint32_t                        f_revision_start;
+    bool                            f_valid;
+};
+
+DEBIAN_PACKAGE_EXPORT void sort(std::vector<value>& versions);
+DEBIAN_PACKAGE_EXPORT size_t find_max(const std::vector<value>& versions);
+DEBIAN_PACKAGE_EXPORT size_t find_max(const std::vector<std::string>& versions);
+
+}   // namespace debian_version
 #endif
 
 #endif
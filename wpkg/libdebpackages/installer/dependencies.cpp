@@ -31,7 +31,9 @@
 #include    "libdebpackages/installer/dependencies.h"
 #include    "libdebpackages/debian_version.h"
 #include    "libdebpackages/debian_packages.h"
+#include    "libdebpackages/wpkg_metrics.h"
 #include    "libdebpackages/wpkg_util.h"
+#include    "libdebpackages/wpkgar_download_cache.h"
 #include    "libdebpackages/wpkgar_repository.h"
 //#include    <algorithm>
 //#include    <set>
@@ -428,7 +430,8 @@ bool dependencies::read_repository_index( const wpkg_filename::uri_filename& rep
                 .module(wpkg_output::module_validate_installation)
                 .package(index_filename);
 
-            compressed.read_file(index_filename);
+            // always download the index again unless offline
+            f_manager->get_download_cache()->read_file(index_filename, compressed, true);
             compressed.decompress(index_file);
         }
         catch(const memfile::memfile_exception&)
@@ -440,6 +443,16 @@ bool dependencies::read_repository_index( const wpkg_filename::uri_filename& rep
                 .package(index_filename);
             return false;
         }
+        catch(const wpkgar_exception_io&)
+        {
+            // offline and the index is not in the download cache
+            wpkg_output::log("skip remote repository %1 as its index.tar.gz file is not available offline.")
+                .quoted_arg(repo_filename)
+                .debug(wpkg_output::debug_flags::debug_detail_config)
+                .module(wpkg_output::module_validate_installation)
+                .package(index_filename);
+            return false;
+        }
     }
 
     return true;
@@ -2258,6 +2271,9 @@ void dependencies::output_tree(int file_count, const package_list::list_t& tree,
  */
 void dependencies::validate_dependencies()
 {
+    wpkg_metrics::phase_timer timer(wpkg_metrics::phase_dependencies);
+    wpkg_metrics::profile_scope profile("validate_dependencies");
+
     // self-contained with explicit and installed dependencies?
     if(validate_installed_dependencies() != validation_return_missing)
     {
@@ -31,6 +31,7 @@
  * functions.
  */
 #include    "libdebpackages/installer/package_item.h"
+#include    "libdebpackages/wpkgar_download_cache.h"
 #if defined(MO_CYGWIN)
 #   include    <Windows.h>
 #endif
@@ -116,6 +117,7 @@ void package_item_t::load( bool ctrl )
 
     if( load_state_full != f_loaded )
     {
+        prepare_download();
         f_manager->load_package(f_filename);
         if(load_state_control_file != f_loaded)
         {
@@ -128,6 +130,34 @@ void package_item_t::load( bool ctrl )
     }
 }
 
+/** \brief Prepare the download of a remote package.
+ *
+ * When the package comes from the index of a remote repository, the
+ * index tells us the md5sum, sha256sum, and size of the package. These
+ * are given to the download cache so it can reuse or verify its copy.
+ *
+ * \return true if the package still needs to be read from a remote
+ *         repository.
+ */
+bool package_item_t::prepare_download()
+{
+    if( !f_ctrl || f_filename.is_direct() || load_state_full == f_loaded )
+    {
+        return false;
+    }
+
+    load(true);
+    if( f_fields->field_is_defined("Package-md5sum") || f_fields->field_is_defined("Package-sha256sum") )
+    {
+        f_manager->get_download_cache()->set_expected(
+                f_filename,
+                f_fields->field_is_defined("Package-md5sum") ? f_fields->get_field("Package-md5sum") : "",
+                f_fields->field_is_defined("Package-Size") ? f_fields->get_field_integer("Package-Size") : 0,
+                f_fields->field_is_defined("Package-sha256sum") ? f_fields->get_field("Package-sha256sum") : "");
+    }
+    return true;
+}
+
 const wpkg_filename::uri_filename& package_item_t::get_filename() const
 {
     return f_filename;
@@ -303,6 +333,10 @@ void package_item_t::copy_package_in_database()
     // make sure the package was loaded (frankly, if not by now, wow!)
     load(false);
 
+    // readers must not see the package directory partially created
+    // or updated
+    wpkgar_database_lock database_lock(*f_manager, true);
+
     // first check whether it exists, if so make sure it is a directory
     wpkg_filename::uri_filename dir(f_manager->get_database_path().append_child(f_name));
     if(dir.exists())
@@ -101,6 +101,7 @@ public:
     void            copy_package_in_database();
 
     void            load( bool ctrl );
+    bool            prepare_download();
 
 private:
     enum loaded_state_t
@@ -21,6 +21,7 @@
  */
 
 #include "libdebpackages/installer/package_list.h"
+#include "libdebpackages/debian_version.h"
 
 #include <sstream>
 
@@ -145,7 +146,14 @@ void package_list::add_package( const std::string& package, const std::string& v
 
             if( version.empty() )
             {
-                auto greatest_version( version_map.rbegin()->first );
+                // the map is sorted alphabetically which is not the order
+                // of Debian versions (i.e. "1.10" is larger than "1.9")
+                std::vector<std::string> versions;
+                for( const auto& v : version_map )
+                {
+                    versions.push_back(v.first);
+                }
+                const std::string greatest_version( versions[debian_version::find_max(versions)] );
                 if( version_map.size() > 1 )
                 {
                     wpkg_output::log("package '%1' has multiple versions available in the selected repositories. Selected the greatest version '%2'.")
@@ -159,7 +167,7 @@ void package_list::add_package( const std::string& package, const std::string& v
 
                 // Select the greatest version
                 //
-                add_package( version_map.rbegin()->second, force_reinstall );
+                add_package( version_map[greatest_version], force_reinstall );
             }
             else
             {
@@ -12,10 +12,19 @@
  * The class allows for per file computations in binary or text hex forms.
  */
 #include    "libdebpackages/md5.h"
+#include    <algorithm>
 #include    <stdexcept>
+#include    <vector>
 #include    <string.h>
 #include    <stdio.h>
 
+// the multi-buffer implementations use the x86 vector extensions; SSE2
+// is always available on x86_64 and AVX2 is detected at runtime
+#if defined(__GNUC__) && defined(__x86_64__)
+#   define MD5_MULTI_X86
+#   include <immintrin.h>
+#endif
+
 namespace md5
 {
 
@@ -57,6 +66,20 @@ const uint32_t sin_fixed_32[64] =
 };
 
 
+/** \brief The size of one MD5 block in bytes.
+ *
+ * MD5 processes the data in blocks of 16 words of 32 bits.
+ */
+const size_t MD5_BLOCK_SIZE = 64;
+
+
+/** \brief The maximum number of buffers hashed in parallel.
+ *
+ * This is the number of 32 bit lanes in an AVX2 register.
+ */
+const int MD5_MAX_LANES = 8;
+
+
 
 
 
@@ -82,8 +105,30 @@ inline uint32_t rol(uint32_t value, uint32_t shift)
 }
 
 
-inline uint32_t F(uint32_t x, uint32_t y, uint32_t z) { return (x & y) | (~x & z); }
-inline uint32_t G(uint32_t x, uint32_t y, uint32_t z) { return (x & z) | (y & ~z); }
+/** \brief Read a little endian 32 bit value.
+ *
+ * MD5 works on little endian words. This function reads one such word
+ * whatever the endian of the processor and whatever the alignment of
+ * the pointer. Compilers transform it in a simple load on little endian
+ * processors.
+ *
+ * \param[in] p  The pointer to the 4 bytes to read.
+ *
+ * \return The 32 bit value.
+ */
+inline uint32_t load_le32(const uint8_t *p)
+{
+    return static_cast<uint32_t>(p[0])
+        | (static_cast<uint32_t>(p[1]) << 8)
+        | (static_cast<uint32_t>(p[2]) << 16)
+        | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+
+// these are equivalent to the functions found in RFC 1321, only
+// rewritten to use fewer operations
+inline uint32_t F(uint32_t x, uint32_t y, uint32_t z) { return z ^ (x & (y ^ z)); }
+inline uint32_t G(uint32_t x, uint32_t y, uint32_t z) { return y ^ (z & (x ^ y)); }
 inline uint32_t H(uint32_t x, uint32_t y, uint32_t z) { return x ^ y ^ z; }
 inline uint32_t I(uint32_t x, uint32_t y, uint32_t z) { return y ^ (x | ~z); }
 
@@ -108,6 +153,327 @@ static const uint32_t g_Rn = 10;
 static const uint32_t g_Ro = 15;
 static const uint32_t g_Rp = 21;
 
+
+/** \brief The 64 steps of one MD5 block.
+ *
+ * This macro expands to the 64 steps of the MD5 transformation. The
+ * STEP parameter is a macro doing one step, F, G, H, and I are the
+ * functions used by each one of the four rounds.
+ *
+ * The macro is used by the scalar and the vector implementations so
+ * the order of the words, shifts, and sinus values is only defined once.
+ * The steps expect the variables a, b, c, d, and x (the 16 words of the
+ * block) to be defined.
+ */
+#define MD5_ROUNDS(STEP, F, G, H, I) \
+    STEP(F, a, b, c, d,  0, g_Ra,  0); STEP(F, d, a, b, c,  1, g_Rb,  1); \
+    STEP(F, c, d, a, b,  2, g_Rc,  2); STEP(F, b, c, d, a,  3, g_Rd,  3); \
+    STEP(F, a, b, c, d,  4, g_Ra,  4); STEP(F, d, a, b, c,  5, g_Rb,  5); \
+    STEP(F, c, d, a, b,  6, g_Rc,  6); STEP(F, b, c, d, a,  7, g_Rd,  7); \
+    STEP(F, a, b, c, d,  8, g_Ra,  8); STEP(F, d, a, b, c,  9, g_Rb,  9); \
+    STEP(F, c, d, a, b, 10, g_Rc, 10); STEP(F, b, c, d, a, 11, g_Rd, 11); \
+    STEP(F, a, b, c, d, 12, g_Ra, 12); STEP(F, d, a, b, c, 13, g_Rb, 13); \
+    STEP(F, c, d, a, b, 14, g_Rc, 14); STEP(F, b, c, d, a, 15, g_Rd, 15); \
+    \
+    STEP(G, a, b, c, d,  1, g_Re, 16); STEP(G, d, a, b, c,  6, g_Rf, 17); \
+    STEP(G, c, d, a, b, 11, g_Rg, 18); STEP(G, b, c, d, a,  0, g_Rh, 19); \
+    STEP(G, a, b, c, d,  5, g_Re, 20); STEP(G, d, a, b, c, 10, g_Rf, 21); \
+    STEP(G, c, d, a, b, 15, g_Rg, 22); STEP(G, b, c, d, a,  4, g_Rh, 23); \
+    STEP(G, a, b, c, d,  9, g_Re, 24); STEP(G, d, a, b, c, 14, g_Rf, 25); \
+    STEP(G, c, d, a, b,  3, g_Rg, 26); STEP(G, b, c, d, a,  8, g_Rh, 27); \
+    STEP(G, a, b, c, d, 13, g_Re, 28); STEP(G, d, a, b, c,  2, g_Rf, 29); \
+    STEP(G, c, d, a, b,  7, g_Rg, 30); STEP(G, b, c, d, a, 12, g_Rh, 31); \
+    \
+    STEP(H, a, b, c, d,  5, g_Ri, 32); STEP(H, d, a, b, c,  8, g_Rj, 33); \
+    STEP(H, c, d, a, b, 11, g_Rk, 34); STEP(H, b, c, d, a, 14, g_Rl, 35); \
+    STEP(H, a, b, c, d,  1, g_Ri, 36); STEP(H, d, a, b, c,  4, g_Rj, 37); \
+    STEP(H, c, d, a, b,  7, g_Rk, 38); STEP(H, b, c, d, a, 10, g_Rl, 39); \
+    STEP(H, a, b, c, d, 13, g_Ri, 40); STEP(H, d, a, b, c,  0, g_Rj, 41); \
+    STEP(H, c, d, a, b,  3, g_Rk, 42); STEP(H, b, c, d, a,  6, g_Rl, 43); \
+    STEP(H, a, b, c, d,  9, g_Ri, 44); STEP(H, d, a, b, c, 12, g_Rj, 45); \
+    STEP(H, c, d, a, b, 15, g_Rk, 46); STEP(H, b, c, d, a,  2, g_Rl, 47); \
+    \
+    STEP(I, a, b, c, d,  0, g_Rm, 48); STEP(I, d, a, b, c,  7, g_Rn, 49); \
+    STEP(I, c, d, a, b, 14, g_Ro, 50); STEP(I, b, c, d, a,  5, g_Rp, 51); \
+    STEP(I, a, b, c, d, 12, g_Rm, 52); STEP(I, d, a, b, c,  3, g_Rn, 53); \
+    STEP(I, c, d, a, b, 10, g_Ro, 54); STEP(I, b, c, d, a,  1, g_Rp, 55); \
+    STEP(I, a, b, c, d,  8, g_Rm, 56); STEP(I, d, a, b, c, 15, g_Rn, 57); \
+    STEP(I, c, d, a, b,  6, g_Ro, 58); STEP(I, b, c, d, a, 13, g_Rp, 59); \
+    STEP(I, a, b, c, d,  4, g_Rm, 60); STEP(I, d, a, b, c, 11, g_Rn, 61); \
+    STEP(I, c, d, a, b,  2, g_Ro, 62); STEP(I, b, c, d, a,  9, g_Rp, 63)
+
+#define MD5_STEP(f, a, b, c, d, k, s, i) \
+    a += f(b, c, d) + x[k] + sin_fixed_32[i]; \
+    a = b + rol(a, s)
+
+
+/** \brief Apply the MD5 transformation on one block of words.
+ *
+ * This function runs the 64 steps of MD5 against the 16 words in \p x
+ * and adds the result to \p state.
+ *
+ * \param[in,out] state  The A, B, C, and D state of an md5sum.
+ * \param[in] x  The 16 words of the block.
+ */
+inline void transform(uint32_t state[4], const uint32_t x[16])
+{
+    uint32_t a(state[0]);
+    uint32_t b(state[1]);
+    uint32_t c(state[2]);
+    uint32_t d(state[3]);
+
+    MD5_ROUNDS(MD5_STEP, F, G, H, I);
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+
+/** \brief Apply the MD5 transformation on consecutive blocks of bytes.
+ *
+ * This function transforms \p count blocks of 64 bytes found at
+ * \p data. The data does not need to be aligned.
+ *
+ * \param[in,out] state  The A, B, C, and D state of an md5sum.
+ * \param[in] data  The bytes to transform.
+ * \param[in] count  The number of 64 bytes blocks in \p data.
+ */
+void transform_blocks(uint32_t state[4], const uint8_t *data, size_t count)
+{
+    uint32_t x[16];
+    for(; count > 0; --count, data += MD5_BLOCK_SIZE)
+    {
+        for(int k(0); k < 16; ++k)
+        {
+            x[k] = load_le32(data + k * 4);
+        }
+        transform(state, x);
+    }
+}
+
+
+#if defined(MD5_MULTI_X86)
+// SSE2 versions of the F, G, H, and I functions, 4 lanes at a time
+inline __m128i F_sse2(__m128i x, __m128i y, __m128i z) { return _mm_xor_si128(z, _mm_and_si128(x, _mm_xor_si128(y, z))); }
+inline __m128i G_sse2(__m128i x, __m128i y, __m128i z) { return _mm_xor_si128(y, _mm_and_si128(z, _mm_xor_si128(x, y))); }
+inline __m128i H_sse2(__m128i x, __m128i y, __m128i z) { return _mm_xor_si128(_mm_xor_si128(x, y), z); }
+inline __m128i I_sse2(__m128i x, __m128i y, __m128i z) { return _mm_xor_si128(y, _mm_or_si128(x, _mm_xor_si128(z, _mm_set1_epi32(-1)))); }
+
+#define MD5_STEP_SSE2(f, a, b, c, d, k, s, i) \
+    a = _mm_add_epi32(a, _mm_add_epi32(f(b, c, d), _mm_add_epi32(x[k], _mm_set1_epi32(static_cast<int>(sin_fixed_32[i]))))); \
+    a = _mm_add_epi32(b, _mm_or_si128(_mm_slli_epi32(a, s), _mm_srli_epi32(a, 32 - s)))
+
+
+/** \brief Transform the blocks of 4 buffers at once with SSE2.
+ *
+ * Each 32 bit lane of the SSE2 registers holds the state of one of the
+ * buffers. All the buffers must have at least \p count blocks available.
+ *
+ * \param[in,out] state  The state of each one of the 4 md5sums.
+ * \param[in] data  The pointers to the blocks of each buffer.
+ * \param[in] count  The number of blocks to transform in each buffer.
+ */
+void transform_blocks_sse2(uint32_t * const state[], const uint8_t * const data[], size_t count)
+{
+    __m128i a(_mm_set_epi32(static_cast<int>(state[3][0]), static_cast<int>(state[2][0]), static_cast<int>(state[1][0]), static_cast<int>(state[0][0])));
+    __m128i b(_mm_set_epi32(static_cast<int>(state[3][1]), static_cast<int>(state[2][1]), static_cast<int>(state[1][1]), static_cast<int>(state[0][1])));
+    __m128i c(_mm_set_epi32(static_cast<int>(state[3][2]), static_cast<int>(state[2][2]), static_cast<int>(state[1][2]), static_cast<int>(state[0][2])));
+    __m128i d(_mm_set_epi32(static_cast<int>(state[3][3]), static_cast<int>(state[2][3]), static_cast<int>(state[1][3]), static_cast<int>(state[0][3])));
+
+    __m128i x[16];
+    for(size_t offset(0); count > 0; --count, offset += MD5_BLOCK_SIZE)
+    {
+        for(int k(0); k < 16; ++k)
+        {
+            x[k] = _mm_set_epi32(static_cast<int>(load_le32(data[3] + offset + k * 4)),
+                                 static_cast<int>(load_le32(data[2] + offset + k * 4)),
+                                 static_cast<int>(load_le32(data[1] + offset + k * 4)),
+                                 static_cast<int>(load_le32(data[0] + offset + k * 4)));
+        }
+
+        const __m128i aa(a);
+        const __m128i bb(b);
+        const __m128i cc(c);
+        const __m128i dd(d);
+
+        MD5_ROUNDS(MD5_STEP_SSE2, F_sse2, G_sse2, H_sse2, I_sse2);
+
+        a = _mm_add_epi32(a, aa);
+        b = _mm_add_epi32(b, bb);
+        c = _mm_add_epi32(c, cc);
+        d = _mm_add_epi32(d, dd);
+    }
+
+    uint32_t result[4][4];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(result[0]), a);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(result[1]), b);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(result[2]), c);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(result[3]), d);
+    for(int lane(0); lane < 4; ++lane)
+    {
+        state[lane][0] = result[0][lane];
+        state[lane][1] = result[1][lane];
+        state[lane][2] = result[2][lane];
+        state[lane][3] = result[3][lane];
+    }
+}
+
+
+// AVX2 versions of the F, G, H, and I functions, 8 lanes at a time
+__attribute__((target("avx2"))) inline __m256i F_avx2(__m256i x, __m256i y, __m256i z) { return _mm256_xor_si256(z, _mm256_and_si256(x, _mm256_xor_si256(y, z))); }
+__attribute__((target("avx2"))) inline __m256i G_avx2(__m256i x, __m256i y, __m256i z) { return _mm256_xor_si256(y, _mm256_and_si256(z, _mm256_xor_si256(x, y))); }
+__attribute__((target("avx2"))) inline __m256i H_avx2(__m256i x, __m256i y, __m256i z) { return _mm256_xor_si256(_mm256_xor_si256(x, y), z); }
+__attribute__((target("avx2"))) inline __m256i I_avx2(__m256i x, __m256i y, __m256i z) { return _mm256_xor_si256(y, _mm256_or_si256(x, _mm256_xor_si256(z, _mm256_set1_epi32(-1)))); }
+
+#define MD5_STEP_AVX2(f, a, b, c, d, k, s, i) \
+    a = _mm256_add_epi32(a, _mm256_add_epi32(f(b, c, d), _mm256_add_epi32(x[k], _mm256_set1_epi32(static_cast<int>(sin_fixed_32[i]))))); \
+    a = _mm256_add_epi32(b, _mm256_or_si256(_mm256_slli_epi32(a, s), _mm256_srli_epi32(a, 32 - s)))
+
+#define MD5_LANES_AVX2(v) \
+    _mm256_set_epi32(static_cast<int>(v(7)), static_cast<int>(v(6)), static_cast<int>(v(5)), static_cast<int>(v(4)), \
+                     static_cast<int>(v(3)), static_cast<int>(v(2)), static_cast<int>(v(1)), static_cast<int>(v(0)))
+
+
+/** \brief Transform the blocks of 8 buffers at once with AVX2.
+ *
+ * This function is the AVX2 equivalent of transform_blocks_sse2(). It
+ * must only be called when the processor supports AVX2.
+ *
+ * \param[in,out] state  The state of each one of the 8 md5sums.
+ * \param[in] data  The pointers to the blocks of each buffer.
+ * \param[in] count  The number of blocks to transform in each buffer.
+ */
+__attribute__((target("avx2")))
+void transform_blocks_avx2(uint32_t * const state[], const uint8_t * const data[], size_t count)
+{
+#define MD5_STATE_A(lane) state[lane][0]
+#define MD5_STATE_B(lane) state[lane][1]
+#define MD5_STATE_C(lane) state[lane][2]
+#define MD5_STATE_D(lane) state[lane][3]
+    __m256i a(MD5_LANES_AVX2(MD5_STATE_A));
+    __m256i b(MD5_LANES_AVX2(MD5_STATE_B));
+    __m256i c(MD5_LANES_AVX2(MD5_STATE_C));
+    __m256i d(MD5_LANES_AVX2(MD5_STATE_D));
+#undef MD5_STATE_A
+#undef MD5_STATE_B
+#undef MD5_STATE_C
+#undef MD5_STATE_D
+
+    __m256i x[16];
+    for(size_t offset(0); count > 0; --count, offset += MD5_BLOCK_SIZE)
+    {
+        for(int k(0); k < 16; ++k)
+        {
+#define MD5_WORD(lane) load_le32(data[lane] + offset + k * 4)
+            x[k] = MD5_LANES_AVX2(MD5_WORD);
+#undef MD5_WORD
+        }
+
+        const __m256i aa(a);
+        const __m256i bb(b);
+        const __m256i cc(c);
+        const __m256i dd(d);
+
+        MD5_ROUNDS(MD5_STEP_AVX2, F_avx2, G_avx2, H_avx2, I_avx2);
+
+        a = _mm256_add_epi32(a, aa);
+        b = _mm256_add_epi32(b, bb);
+        c = _mm256_add_epi32(c, cc);
+        d = _mm256_add_epi32(d, dd);
+    }
+
+    uint32_t result[4][8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(result[0]), a);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(result[1]), b);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(result[2]), c);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(result[3]), d);
+    for(int lane(0); lane < 8; ++lane)
+    {
+        state[lane][0] = result[0][lane];
+        state[lane][1] = result[1][lane];
+        state[lane][2] = result[2][lane];
+        state[lane][3] = result[3][lane];
+    }
+}
+#endif
+
+
+/** \brief Determine the number of lanes supported by this processor.
+ *
+ * This function checks the processor capabilities and returns 8 if
+ * AVX2 is available, 4 on other x86_64 processors (SSE2 is always
+ * available there), and 1 otherwise.
+ *
+ * \return The number of buffers that can be hashed in parallel.
+ */
+int detect_lanes()
+{
+#if defined(MD5_MULTI_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return 8;
+    }
+    return 4;
+#else
+    return 1;
+#endif
+}
+
+
+/** \brief Transform one group of buffers.
+ *
+ * This function transforms \p count blocks of up to multi_lanes()
+ * buffers. The unused lanes are given a copy of the first buffer and
+ * their results are ignored.
+ *
+ * \param[in,out] state  The state of each one of the md5sums.
+ * \param[in] data  The pointers to the blocks of each buffer.
+ * \param[in] lanes  The number of buffers in this group.
+ * \param[in] count  The number of blocks to transform in each buffer.
+ */
+void transform_group(uint32_t * const state[], const uint8_t * const data[], int lanes, size_t count)
+{
+#if defined(MD5_MULTI_X86)
+    if(lanes > 1)
+    {
+        const int width(md5sum::multi_lanes());
+        uint32_t ignored[MD5_MAX_LANES][4];
+        uint32_t *group_state[MD5_MAX_LANES];
+        const uint8_t *group_data[MD5_MAX_LANES];
+        for(int lane(0); lane < width; ++lane)
+        {
+            if(lane < lanes)
+            {
+                group_state[lane] = state[lane];
+                group_data[lane] = data[lane];
+            }
+            else
+            {
+                group_state[lane] = ignored[lane];
+                group_data[lane] = data[0];
+            }
+        }
+        if(width == 8)
+        {
+            transform_blocks_avx2(group_state, group_data, count);
+        }
+        else
+        {
+            transform_blocks_sse2(group_state, group_data, count);
+        }
+        return;
+    }
+#endif
+    for(int lane(0); lane < lanes; ++lane)
+    {
+        transform_blocks(state[lane], data[lane], count);
+    }
+}
+
+
 void bin2hex(char *out, int in)
 {
     static char hex[16] = {
@@ -182,10 +548,10 @@ void md5sum::clear()
 {
     f_size = 0;
 
-    f_a = 0x67452301;
-    f_b = 0xefcdab89;
-    f_c = 0x98badcfe;
-    f_d = 0x10325476;
+    f_state[0] = 0x67452301;
+    f_state[1] = 0xefcdab89;
+    f_state[2] = 0x98badcfe;
+    f_state[3] = 0x10325476;
 
     f_pos = 0;
     //memset(f_buffer, 0, sizeof(f_buffer)); -- f_pos marks the buffer as undefined already
@@ -204,11 +570,34 @@ uint64_t md5sum::size() const
 }
 
 
+/** \brief Add data to the md5sum.
+ *
+ * This function adds \p data_size bytes to the md5sum. The function can
+ * be called any number of times. The result is the same whether the data
+ * is added all at once or in any number of smaller chunks.
+ *
+ * Whole blocks of 64 bytes are transformed directly from \p data; only
+ * the bytes of an incomplete block are copied in the internal buffer.
+ *
+ * \param[in] data  The bytes to add to the md5sum.
+ * \param[in] data_size  The number of bytes in \p data.
+ */
 void md5sum::push_back(const uint8_t *data, size_t data_size)
 {
     f_size += data_size;            // size in bytes
 
-    while(data_size > 0) {
+    for(;;) {
+        if(f_pos == 0 && data_size >= MD5_BLOCK_SIZE) {
+            // transform all the complete blocks without a copy
+            const size_t count(data_size / MD5_BLOCK_SIZE);
+            transform_blocks(f_state, data, count);
+            data += count * MD5_BLOCK_SIZE;
+            data_size -= count * MD5_BLOCK_SIZE;
+        }
+        if(data_size == 0) {
+            break;
+        }
+
         // buffer ready at once whatever the endian
         uint32_t byte = f_pos & 3;
         if(byte == 0) {
@@ -271,22 +660,22 @@ void md5sum::raw_sum(raw_md5sum& raw) const
 
     // return the raw md5sum
     // (the following works whatever the endian)
-    raw.f_sum[ 0] = static_cast<uint8_t>(copy.f_a);
-    raw.f_sum[ 1] = static_cast<uint8_t>(copy.f_a >> 8);
-    raw.f_sum[ 2] = static_cast<uint8_t>(copy.f_a >> 16);
-    raw.f_sum[ 3] = static_cast<uint8_t>(copy.f_a >> 24);
-    raw.f_sum[ 4] = static_cast<uint8_t>(copy.f_b);
-    raw.f_sum[ 5] = static_cast<uint8_t>(copy.f_b >> 8);
-    raw.f_sum[ 6] = static_cast<uint8_t>(copy.f_b >> 16);
-    raw.f_sum[ 7] = static_cast<uint8_t>(copy.f_b >> 24);
-    raw.f_sum[ 8] = static_cast<uint8_t>(copy.f_c);
-    raw.f_sum[ 9] = static_cast<uint8_t>(copy.f_c >> 8);
-    raw.f_sum[10] = static_cast<uint8_t>(copy.f_c >> 16);
-    raw.f_sum[11] = static_cast<uint8_t>(copy.f_c >> 24);
-    raw.f_sum[12] = static_cast<uint8_t>(copy.f_d);
-    raw.f_sum[13] = static_cast<uint8_t>(copy.f_d >> 8);
-    raw.f_sum[14] = static_cast<uint8_t>(copy.f_d >> 16);
-    raw.f_sum[15] = static_cast<uint8_t>(copy.f_d >> 24);
+    raw.f_sum[ 0] = static_cast<uint8_t>(copy.f_state[0]);
+    raw.f_sum[ 1] = static_cast<uint8_t>(copy.f_state[0] >> 8);
+    raw.f_sum[ 2] = static_cast<uint8_t>(copy.f_state[0] >> 16);
+    raw.f_sum[ 3] = static_cast<uint8_t>(copy.f_state[0] >> 24);
+    raw.f_sum[ 4] = static_cast<uint8_t>(copy.f_state[1]);
+    raw.f_sum[ 5] = static_cast<uint8_t>(copy.f_state[1] >> 8);
+    raw.f_sum[ 6] = static_cast<uint8_t>(copy.f_state[1] >> 16);
+    raw.f_sum[ 7] = static_cast<uint8_t>(copy.f_state[1] >> 24);
+    raw.f_sum[ 8] = static_cast<uint8_t>(copy.f_state[2]);
+    raw.f_sum[ 9] = static_cast<uint8_t>(copy.f_state[2] >> 8);
+    raw.f_sum[10] = static_cast<uint8_t>(copy.f_state[2] >> 16);
+    raw.f_sum[11] = static_cast<uint8_t>(copy.f_state[2] >> 24);
+    raw.f_sum[12] = static_cast<uint8_t>(copy.f_state[3]);
+    raw.f_sum[13] = static_cast<uint8_t>(copy.f_state[3] >> 8);
+    raw.f_sum[14] = static_cast<uint8_t>(copy.f_state[3] >> 16);
+    raw.f_sum[15] = static_cast<uint8_t>(copy.f_state[3] >> 24);
 }
 
 
@@ -316,80 +705,132 @@ std::string md5sum::sum() const
 
 
 
-uint32_t md5sum::round1(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t k, uint32_t s, uint32_t i)
-{
-    a += F(b, c, d) + f_buffer[k] + sin_fixed_32[i];
-    return b + rol(a, s);
-}
-
-uint32_t md5sum::round2(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t k, uint32_t s, uint32_t i)
+/** \brief Retrieve the number of buffers hashed in parallel.
+ *
+ * This function returns the number of md5sum objects that
+ * push_back_multi() transforms at once: 8 when the processor supports
+ * AVX2, 4 on other x86_64 processors, and 1 when no vector
+ * implementation is available.
+ *
+ * The processor capabilities are only checked on the first call.
+ *
+ * \return The number of lanes, 1, 4, or 8.
+ */
+int md5sum::multi_lanes()
 {
-    a += G(b, c, d) + f_buffer[k] + sin_fixed_32[i];
-    return b + rol(a, s);
+    static const int lanes(detect_lanes());
+    return lanes;
 }
 
-uint32_t md5sum::round3(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t k, uint32_t s, uint32_t i)
-{
-    a += H(b, c, d) + f_buffer[k] + sin_fixed_32[i];
-    return b + rol(a, s);
-}
 
-uint32_t md5sum::round4(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t k, uint32_t s, uint32_t i)
+/** \brief Add data to several independent md5sums at once.
+ *
+ * This function is equivalent to calling push_back() with each pair of
+ * \p data and \p sizes on each one of the \p sums. However, when the
+ * processor supports it (see multi_lanes()) the blocks of 4 or 8 of
+ * the md5sums are transformed in parallel using the vector unit.
+ *
+ * The md5sums are expected to all be at the same position within their
+ * current block (which is the case if they all started empty and were
+ * always given chunks of the same size) and the buffers should have
+ * similar sizes. Otherwise the function still works, only the part
+ * that cannot be processed in parallel is processed one md5sum at a time.
+ *
+ * The same md5sum object cannot appear more than once in \p sums.
+ *
+ * \param[in] sums  The md5sums to update.
+ * \param[in] data  The data to add to each md5sum.
+ * \param[in] sizes  The number of bytes to add to each md5sum.
+ * \param[in] count  The number of entries in \p sums, \p data, and \p sizes.
+ */
+void md5sum::push_back_multi(md5sum * const sums[], const uint8_t * const data[], const size_t sizes[], int count)
 {
-    a += I(b, c, d) + f_buffer[k] + sin_fixed_32[i];
-    return b + rol(a, s);
-}
+    struct lane_t
+    {
+        md5sum *        f_sum;
+        const uint8_t * f_data;
+        size_t          f_size;
+    };
+    std::vector<lane_t> lanes;
+    lanes.reserve(count);
+    for(int i(0); i < count; ++i)
+    {
+        lane_t l;
+        l.f_sum = sums[i];
+        l.f_data = data[i];
+        l.f_size = sizes[i];
+        if(l.f_sum->f_pos != 0)
+        {
+            // first complete the partial block of this md5sum
+            const size_t size(std::min(l.f_size, static_cast<size_t>(MD5_BLOCK_SIZE - l.f_sum->f_pos)));
+            l.f_sum->push_back(l.f_data, size);
+            l.f_data += size;
+            l.f_size -= size;
+        }
+        if(l.f_size > 0)
+        {
+            lanes.push_back(l);
+        }
+    }
 
+    const int width(multi_lanes());
+    while(!lanes.empty())
+    {
+        // all the remaining lanes are on a block boundary; transform the
+        // blocks that all of them have in common
+        size_t blocks(lanes[0].f_size / MD5_BLOCK_SIZE);
+        for(size_t i(1); i < lanes.size(); ++i)
+        {
+            blocks = std::min(blocks, lanes[i].f_size / MD5_BLOCK_SIZE);
+        }
+        if(blocks > 0)
+        {
+            for(size_t g(0); g < lanes.size(); g += width)
+            {
+                const int group(static_cast<int>(std::min(lanes.size() - g, static_cast<size_t>(width))));
+                uint32_t *state[MD5_MAX_LANES];
+                const uint8_t *group_data[MD5_MAX_LANES];
+                for(int lane(0); lane < group; ++lane)
+                {
+                    state[lane] = lanes[g + lane].f_sum->f_state;
+                    group_data[lane] = lanes[g + lane].f_data;
+                }
+                transform_group(state, group_data, group, blocks);
+            }
+            const size_t size(blocks * MD5_BLOCK_SIZE);
+            for(size_t i(0); i < lanes.size(); ++i)
+            {
+                lanes[i].f_sum->f_size += size;
+                lanes[i].f_data += size;
+                lanes[i].f_size -= size;
+            }
+        }
 
+        // lanes with less than one block left are done
+        for(size_t i(0); i < lanes.size();)
+        {
+            if(lanes[i].f_size < MD5_BLOCK_SIZE)
+            {
+                lanes[i].f_sum->push_back(lanes[i].f_data, lanes[i].f_size);
+                lanes.erase(lanes.begin() + i);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+}
 
 
+/** \brief Transform the internal buffer.
+ *
+ * This function is called once the internal buffer is full. It applies
+ * the MD5 transformation on the 64 bytes found in the buffer.
+ */
 void md5sum::calc()
 {
-    uint32_t a = f_a;
-    uint32_t b = f_b;
-    uint32_t c = f_c;
-    uint32_t d = f_d;
-
-    a = round1(a, b, c, d,  0, g_Ra,  0); d = round1(d, a, b, c,  1, g_Rb,  1);
-    c = round1(c, d, a, b,  2, g_Rc,  2); b = round1(b, c, d, a,  3, g_Rd,  3);
-    a = round1(a, b, c, d,  4, g_Ra,  4); d = round1(d, a, b, c,  5, g_Rb,  5);
-    c = round1(c, d, a, b,  6, g_Rc,  6); b = round1(b, c, d, a,  7, g_Rd,  7);
-    a = round1(a, b, c, d,  8, g_Ra,  8); d = round1(d, a, b, c,  9, g_Rb,  9);
-    c = round1(c, d, a, b, 10, g_Rc, 10); b = round1(b, c, d, a, 11, g_Rd, 11);
-    a = round1(a, b, c, d, 12, g_Ra, 12); d = round1(d, a, b, c, 13, g_Rb, 13);
-    c = round1(c, d, a, b, 14, g_Rc, 14); b = round1(b, c, d, a, 15, g_Rd, 15);
-
-    a = round2(a, b, c, d,  1, g_Re, 16); d = round2(d, a, b, c,  6, g_Rf, 17);
-    c = round2(c, d, a, b, 11, g_Rg, 18); b = round2(b, c, d, a,  0, g_Rh, 19);
-    a = round2(a, b, c, d,  5, g_Re, 20); d = round2(d, a, b, c, 10, g_Rf, 21);
-    c = round2(c, d, a, b, 15, g_Rg, 22); b = round2(b, c, d, a,  4, g_Rh, 23);
-    a = round2(a, b, c, d,  9, g_Re, 24); d = round2(d, a, b, c, 14, g_Rf, 25);
-    c = round2(c, d, a, b,  3, g_Rg, 26); b = round2(b, c, d, a,  8, g_Rh, 27);
-    a = round2(a, b, c, d, 13, g_Re, 28); d = round2(d, a, b, c,  2, g_Rf, 29);
-    c = round2(c, d, a, b,  7, g_Rg, 30); b = round2(b, c, d, a, 12, g_Rh, 31);
-
-    a = round3(a, b, c, d,  5, g_Ri, 32); d = round3(d, a, b, c,  8, g_Rj, 33);
-    c = round3(c, d, a, b, 11, g_Rk, 34); b = round3(b, c, d, a, 14, g_Rl, 35);
-    a = round3(a, b, c, d,  1, g_Ri, 36); d = round3(d, a, b, c,  4, g_Rj, 37);
-    c = round3(c, d, a, b,  7, g_Rk, 38); b = round3(b, c, d, a, 10, g_Rl, 39);
-    a = round3(a, b, c, d, 13, g_Ri, 40); d = round3(d, a, b, c,  0, g_Rj, 41);
-    c = round3(c, d, a, b,  3, g_Rk, 42); b = round3(b, c, d, a,  6, g_Rl, 43);
-    a = round3(a, b, c, d,  9, g_Ri, 44); d = round3(d, a, b, c, 12, g_Rj, 45);
-    c = round3(c, d, a, b, 15, g_Rk, 46); b = round3(b, c, d, a,  2, g_Rl, 47);
-
-    a = round4(a, b, c, d,  0, g_Rm, 48); d = round4(d, a, b, c,  7, g_Rn, 49);
-    c = round4(c, d, a, b, 14, g_Ro, 50); b = round4(b, c, d, a,  5, g_Rp, 51);
-    a = round4(a, b, c, d, 12, g_Rm, 52); d = round4(d, a, b, c,  3, g_Rn, 53);
-    c = round4(c, d, a, b, 10, g_Ro, 54); b = round4(b, c, d, a,  1, g_Rp, 55);
-    a = round4(a, b, c, d,  8, g_Rm, 56); d = round4(d, a, b, c, 15, g_Rn, 57);
-    c = round4(c, d, a, b,  6, g_Ro, 58); b = round4(b, c, d, a, 13, g_Rp, 59);
-    a = round4(a, b, c, d,  4, g_Rm, 60); d = round4(d, a, b, c, 11, g_Rn, 61);
-    c = round4(c, d, a, b,  2, g_Ro, 62); b = round4(b, c, d, a,  9, g_Rp, 63);
-
-    f_a += a;
-    f_b += b;
-    f_c += c;
-    f_d += d;
+    transform(f_state, f_buffer);
 }
 
 
@@ -62,6 +62,10 @@ struct DEBIAN_PACKAGE_EXPORT raw_md5sum
 //  empty() is used to know whether push_bash() has been called before
 //  size() returns the total length of data passed to push_back()
 //
+//  push_back_multi() feeds several independent md5sum objects at once;
+//  on processors with SSE2 or AVX2 the blocks of 4 or 8 of those objects
+//  are hashed in parallel (see multi_lanes())
+//
 class DEBIAN_PACKAGE_EXPORT md5sum
 {
 public:
@@ -76,19 +80,15 @@ public:
     std::string         sum() const;
     static std::string  sum(const raw_md5sum& raw);
 
+    static int          multi_lanes();
+    static void         push_back_multi(md5sum * const sums[], const uint8_t * const data[], const size_t sizes[], int count);
+
 private:
     void                calc();
-    uint32_t            round1(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t k, uint32_t s, uint32_t i);
-    uint32_t            round2(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t k, uint32_t s, uint32_t i);
-    uint32_t            round3(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t k, uint32_t s, uint32_t i);
-    uint32_t            round4(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t k, uint32_t s, uint32_t i);
 
     uint64_t            f_size;     // byte size
 
-    uint32_t            f_a;        // state
-    uint32_t            f_b;
-    uint32_t            f_c;
-    uint32_t            f_d;
+    uint32_t            f_state[4]; // A, B, C, D
 
     uint32_t            f_pos;      // buffer index
     uint32_t            f_buffer[16];   // 64 bytes
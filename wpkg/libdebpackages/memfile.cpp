@@ -40,12 +40,15 @@
 // WARNING: The tcp_client_server.h MUST be first to avoid tons of errors
 //          under MS-Windows (which apparently has quite a few problems
 //          with their headers and backward compatibility.)
+
 #include    "libdebpackages/tcp_client_server.h"
 
 #include    "libdebpackages/memfile.h"
+#include    "libdebpackages/wpkg_http.h"
 #include    "libdebpackages/wpkg_stream.h"
 #include    "libdebpackages/wpkgar_block.h"
 #include    "libdebpackages/case_insensitive_string.h"
+#include    "libdebpackages/wpkg_metrics.h"
 #include    "libdebpackages/wpkg_output.h"
 
 #ifdef debpackages_EXPORTS
@@ -64,6 +67,7 @@
 #include    <algorithm>
 #include    <iostream>
 #include    <memory>
+#include    <mutex>
 #if defined(MO_WINDOWS)
 #include    "libdebpackages/comptr.h"
 #include    <objidl.h>
@@ -127,6 +131,147 @@ CONTROLLED_VARS_STATIC_ASSERT(memory_file::block_manager::BLOCK_MANAGER_BUFFER_B
  */
 
 
+namespace
+{
+
+/** \brief The number of blocks kept by each thread.
+ *
+ * Each thread keeps up to this many free blocks without locking. The
+ * other blocks are returned to the global pool.
+ */
+const size_t LOCAL_POOL_SIZE = 16;
+
+/** \brief The high-water mark of the global pool.
+ *
+ * Blocks released when the global pool already holds that many blocks
+ * (16Mb) are returned to the system.
+ */
+const size_t GLOBAL_POOL_SIZE = 256;
+
+typedef std::vector<char *> block_list_t;
+
+
+/** \brief The pool of free blocks shared by all the threads.
+ *
+ * The global pool is protected by a mutex. It is never destroyed so
+ * memory files released while the process exits can still return
+ * their blocks.
+ */
+class global_block_pool
+{
+public:
+    static global_block_pool& instance()
+    {
+        static global_block_pool *pool(new global_block_pool);
+        return *pool;
+    }
+
+    char *allocate()
+    {
+        std::lock_guard<std::mutex> lock(f_mutex);
+        if(f_blocks.empty())
+        {
+            return NULL;
+        }
+        char *block(f_blocks.back());
+        f_blocks.pop_back();
+        return block;
+    }
+
+    void release(char *block)
+    {
+        {
+            std::lock_guard<std::mutex> lock(f_mutex);
+            if(f_blocks.size() < GLOBAL_POOL_SIZE)
+            {
+                f_blocks.push_back(block);
+                return;
+            }
+        }
+        delete [] block;
+    }
+
+private:
+    std::mutex          f_mutex;
+    block_list_t        f_blocks;
+};
+
+
+/** \brief Whether the local pool of this thread was destroyed.
+ *
+ * Once a thread exits, its local pool is gone and the blocks go
+ * directly to the global pool.
+ */
+thread_local bool g_local_pool_destroyed(false);
+
+
+/** \brief The pool of free blocks of one thread.
+ *
+ * The local pool is used without locking. When the thread exits, its
+ * blocks are returned to the global pool.
+ */
+class local_block_pool
+{
+public:
+    ~local_block_pool()
+    {
+        g_local_pool_destroyed = true;
+        for(block_list_t::const_iterator it(f_blocks.begin()); it != f_blocks.end(); ++it)
+        {
+            global_block_pool::instance().release(*it);
+        }
+    }
+
+    block_list_t        f_blocks;
+};
+
+thread_local local_block_pool g_local_pool;
+
+
+/** \brief Get a block from the pools.
+ *
+ * The function checks the pool of the current thread, then the global
+ * pool, and if both are empty it allocates a new block. The content of
+ * the block is undefined.
+ *
+ * \return A pointer to a block of BLOCK_MANAGER_BUFFER_SIZE bytes.
+ */
+char *allocate_block()
+{
+    if(!g_local_pool_destroyed && !g_local_pool.f_blocks.empty())
+    {
+        char *block(g_local_pool.f_blocks.back());
+        g_local_pool.f_blocks.pop_back();
+        return block;
+    }
+    char *block(global_block_pool::instance().allocate());
+    if(block == NULL)
+    {
+        block = new char[memory_file::block_manager::BLOCK_MANAGER_BUFFER_SIZE];
+    }
+    return block;
+}
+
+
+/** \brief Return a block to the pools.
+ *
+ * This function is the deleter of the shared pointers holding blocks.
+ *
+ * \param[in] block  The block to release.
+ */
+void release_block(char *block)
+{
+    if(!g_local_pool_destroyed && g_local_pool.f_blocks.size() < LOCAL_POOL_SIZE)
+    {
+        g_local_pool.f_blocks.push_back(block);
+        return;
+    }
+    global_block_pool::instance().release(block);
+}
+
+} // no name namespace
+
+
 /** \class memory_file::block_manager
  * \brief Manage all the blocks used by the memory file.
  *
@@ -224,8 +369,41 @@ CONTROLLED_VARS_STATIC_ASSERT(memory_file::block_manager::BLOCK_MANAGER_BUFFER_B
  */
 
 
+/** \class memory_file::block_manager
+ * \brief Manage the blocks of data of a memory file.
+ *
+ * The data of a memory file is saved in blocks of
+ * BLOCK_MANAGER_BUFFER_SIZE bytes. The blocks are reference counted so
+ * a block manager can share the blocks of another block manager. This
+ * is used to give access to the files found in an archive without
+ * copying their data (see share().)
+ *
+ * A shared block is copied only when one of its owners writes to it.
+ *
+ * The blocks are allocated from a pool and returned to it once released
+ * so the many temporary memory files do not each allocate and page in
+ * new memory. The blocks are not cleared on allocation. The block
+ * manager never reads data past its size and clears the gaps created by
+ * writing past its end.
+ */
+
+
+/** \brief Allocate a block of data.
+ *
+ * This function gets a block from the block pool and attaches it to a
+ * shared pointer which returns the block to the pool once released.
+ *
+ * \return A shared pointer to a new block of BLOCK_MANAGER_BUFFER_SIZE
+ *         bytes which content is undefined.
+ */
+memory_file::block_manager::shared_buffer_t memory_file::block_manager::new_block()
+{
+    return shared_buffer_t(allocate_block(), release_block);
+}
+
 memory_file::block_manager::block_manager()
-    //: f_size(0) -- auto-init
+    //: f_offset(0) -- auto-init
+    //  f_size(0) -- auto-init
     //  f_available_size(0) -- auto-init
     //  f_buffers() -- auto-init
 {
@@ -240,10 +418,63 @@ void memory_file::block_manager::clear()
 {
     // release all the buffers
     f_buffers.clear();
+    f_offset = 0;
     f_size = 0;
     f_available_size = 0;
 }
 
+/** \brief Swap the blocks of two block managers.
+ *
+ * This function exchanges the blocks of this block manager with the
+ * blocks of \p rhs. No data gets copied.
+ *
+ * \param[in,out] rhs  The other block manager.
+ */
+void memory_file::block_manager::swap(block_manager& rhs)
+{
+    f_buffers.swap(rhs.f_buffers);
+    std::swap(f_offset, rhs.f_offset);
+    std::swap(f_size, rhs.f_size);
+    std::swap(f_available_size, rhs.f_available_size);
+}
+
+/** \brief Share a range of another block manager.
+ *
+ * This function makes this block manager a view of \p size bytes of
+ * the \p source block manager starting at \p offset. The blocks are
+ * shared, no data gets copied. Writing to either block manager later
+ * copies the blocks being modified first so the other block manager
+ * is not affected.
+ *
+ * \param[in] source  The block manager to share the data of.
+ * \param[in] offset  The offset of the first byte in \p source.
+ * \param[in] size  The number of bytes to share.
+ */
+void memory_file::block_manager::share(const block_manager& source, int offset, int size)
+{
+    if(offset < 0 || size < 0 || offset + size > source.f_size)
+    {
+        throw memfile_exception_parameter("offset or size is out of bounds");
+    }
+
+    // in case source is this block manager
+    const int physical(offset + source.f_offset);
+    const int first(physical >> BLOCK_MANAGER_BUFFER_BITS);
+    const int last(size == 0 ? first - 1 : (physical + size - 1) >> BLOCK_MANAGER_BUFFER_BITS);
+    if(&source != this)
+    {
+        f_buffers.assign(source.f_buffers.begin() + first, source.f_buffers.begin() + last + 1);
+    }
+    else
+    {
+        f_buffers.erase(f_buffers.begin() + last + 1, f_buffers.end());
+        f_buffers.erase(f_buffers.begin(), f_buffers.begin() + first);
+    }
+    f_offset = size == 0 ? 0 : physical & (BLOCK_MANAGER_BUFFER_SIZE - 1);
+    f_size = size;
+    f_available_size = static_cast<int>(f_buffers.size()) * BLOCK_MANAGER_BUFFER_SIZE - f_offset;
+}
+
 int memory_file::block_manager::read(char *buffer, int offset, int bufsize) const
 {
     if(offset < 0 || offset > f_size)
@@ -254,36 +485,101 @@ int memory_file::block_manager::read(char *buffer, int offset, int bufsize) cons
     {
         bufsize = f_size - offset;
     }
-    if(bufsize > 0)
+    // copy block by block
+    int left(bufsize);
+    while(left > 0)
     {
-        // copy bytes between offset and next block boundary
-        int pos(offset & (BLOCK_MANAGER_BUFFER_SIZE - 1));
-        int page(offset >> BLOCK_MANAGER_BUFFER_BITS);
-        int sz(std::min(bufsize, BLOCK_MANAGER_BUFFER_SIZE - pos));
-        {
-            const auto bufpos = f_buffers[page].begin() + pos;
-            std::copy( bufpos , bufpos + sz , buffer );
-        }
+        int available;
+        const char *data(data_at(offset, available));
+        const int sz(std::min(left, available));
+        memcpy(buffer, data, sz);
         buffer += sz;
-        // copy full pages at once unless size left is less than a page
-        int size_left(bufsize - sz);
-        while(size_left >= BLOCK_MANAGER_BUFFER_SIZE)
-        {
-            ++page;
-            const auto bufpos = f_buffers[page].begin();
-            std::copy( bufpos, bufpos + BLOCK_MANAGER_BUFFER_SIZE, buffer );
-            buffer += BLOCK_MANAGER_BUFFER_SIZE;
-            size_left -= BLOCK_MANAGER_BUFFER_SIZE;
-        }
-        // copy a bit, what's left afterward
-        if(size_left > 0)
+        offset += sz;
+        left -= sz;
+    }
+    return std::max(bufsize, 0);
+}
+
+/** \brief Get a direct pointer to the data at the specified offset.
+ *
+ * This function returns a pointer to the byte at \p offset within the
+ * block holding it. The \p size parameter is set to the number of bytes
+ * that can be accessed from that pointer, which is limited by the end
+ * of the block and the end of the file.
+ *
+ * The pointer remains valid until the block manager is modified.
+ *
+ * \param[in] offset  The offset of the data to access.
+ * \param[out] size  The number of bytes available at the returned pointer.
+ *
+ * \return A pointer to the data or NULL when \p offset is the end of
+ *         the file.
+ */
+const char *memory_file::block_manager::data_at(int offset, int& size) const
+{
+    if(offset < 0 || offset > f_size)
+    {
+        throw memfile_exception_parameter("offset is out of bounds");
+    }
+    const int physical(offset + f_offset);
+    const int pos(physical & (BLOCK_MANAGER_BUFFER_SIZE - 1));
+    size = std::min(BLOCK_MANAGER_BUFFER_SIZE - pos, static_cast<int>(f_size - offset));
+    if(size <= 0)
+    {
+        size = 0;
+        return NULL;
+    }
+    return f_buffers[physical >> BLOCK_MANAGER_BUFFER_BITS].get() + pos;
+}
+
+/** \brief Get a pointer to modify the data at the specified offset.
+ *
+ * This function is similar to data_at() except that the block is first
+ * copied if it is shared with another block manager. The block must
+ * already be allocated.
+ *
+ * \param[in] offset  The offset of the data to modify.
+ * \param[out] size  The number of bytes available up to the end of the block.
+ *
+ * \return A pointer to the data.
+ */
+char *memory_file::block_manager::writable_at(int offset, int& size)
+{
+    const int physical(offset + f_offset);
+    const int pos(physical & (BLOCK_MANAGER_BUFFER_SIZE - 1));
+    shared_buffer_t& block(f_buffers[physical >> BLOCK_MANAGER_BUFFER_BITS]);
+    if(block.use_count() != 1)
+    {
+        shared_buffer_t copy(new_block());
+        memcpy(copy.get(), block.get(), BLOCK_MANAGER_BUFFER_SIZE);
+        block = copy;
+    }
+    size = BLOCK_MANAGER_BUFFER_SIZE - pos;
+    return block.get() + pos;
+}
+
+/** \brief Allocate the blocks needed to hold \p size bytes.
+ *
+ * This function allocates the blocks at once when the final size of
+ * the data is known in advance. The size of the data does not change.
+ *
+ * \param[in] size  The number of bytes the block manager will hold.
+ */
+void memory_file::block_manager::reserve(int size)
+{
+    if(size > 1024 * 1024 * 1024)
+    {
+        throw memfile_exception_parameter("memory file size too large (over 1Gb?!)");
+    }
+    if(size > f_available_size)
+    {
+        f_buffers.reserve(f_buffers.size() + (size - f_available_size + BLOCK_MANAGER_BUFFER_SIZE - 1) / BLOCK_MANAGER_BUFFER_SIZE);
+        while(size > f_available_size)
         {
-            // page is not incremented yet
-            const auto bufpos = f_buffers[page + 1].begin();
-            std::copy( bufpos, bufpos + size_left, buffer );
+            f_buffers.push_back(new_block());
+            f_available_size += BLOCK_MANAGER_BUFFER_SIZE;
         }
     }
-    return bufsize;
 }
 
 int memory_file::block_manager::write(const char *buffer, const int offset, const int bufsize)
@@ -308,52 +604,33 @@ int memory_file::block_manager::write(const char *buffer, const int offset, cons
     // allocate blocks to satisfy the total size
     while(total > f_available_size)
     {
-        f_buffers.push_back( buffer_t( BLOCK_MANAGER_BUFFER_SIZE, 0 ) );
+        f_buffers.push_back(new_block());
         f_available_size += BLOCK_MANAGER_BUFFER_SIZE;
     }
 
     // if offset is larger than size we want to clear the buffers in between
-    if(offset > f_size)
+    // (a shared block may include data of the other block manager there)
+    while(offset > f_size)
     {
-        int pos(f_size & (BLOCK_MANAGER_BUFFER_SIZE - 1));
-        int page(f_size >> BLOCK_MANAGER_BUFFER_BITS);
-        int sz(std::min(offset - f_size, BLOCK_MANAGER_BUFFER_SIZE - pos));
-        const auto& buff_pos( f_buffers[page].begin() + pos );
-        std::fill( buff_pos, buff_pos + sz, 0 );
+        int available;
+        char *data(writable_at(f_size, available));
+        const int sz(std::min(static_cast<int>(offset - f_size), available));
+        memset(data, 0, sz);
         f_size += sz;
-        while(offset > f_size)
-        {
-            ++page;
-            sz = std::min(offset - f_size, BLOCK_MANAGER_BUFFER_SIZE);
-            const auto& page_iter( f_buffers[page].begin() );
-            std::fill( page_iter, page_iter + sz, 0 );  // Does this need to happen since we now clear the full buffer above in the constructor?
-            f_size += sz;
-        }
     }
 
     // now copy buffer to our blocks
-    if(bufsize > 0)
-    {
-        // copy up to the end of the current block
-        const int pos(offset & (BLOCK_MANAGER_BUFFER_SIZE - 1));
-        int page(offset >> BLOCK_MANAGER_BUFFER_BITS);
-        const int sz(std::min(BLOCK_MANAGER_BUFFER_SIZE - pos, bufsize));
-        int buffer_size(bufsize);
-        std::copy( buffer, buffer + sz, f_buffers[page].begin() + pos );
+    int pos(offset);
+    int left(bufsize);
+    while(left > 0)
+    {
+        int available;
+        char *data(writable_at(pos, available));
+        const int sz(std::min(left, available));
+        memcpy(data, buffer, sz);
         buffer += sz;
-        buffer_size -= sz;
-        // copy entire blocks if possible
-        while(buffer_size >= BLOCK_MANAGER_BUFFER_SIZE)
-        {
-            std::copy( buffer, buffer + BLOCK_MANAGER_BUFFER_SIZE, f_buffers[++page].begin() );
-            buffer      += BLOCK_MANAGER_BUFFER_SIZE;
-            buffer_size -= BLOCK_MANAGER_BUFFER_SIZE;
-        }
-        // copy the remainder if any
-        if(buffer_size > 0)
-        {
-            std::copy( buffer, buffer + buffer_size, f_buffers[page+1].begin() );
-        }
+        pos += sz;
+        left -= sz;
     }
 
     f_size = std::max(static_cast<int>(f_size), total);
@@ -363,31 +640,25 @@ int memory_file::block_manager::write(const char *buffer, const int offset, cons
 
 int memory_file::block_manager::compare(const block_manager& rhs) const
 {
-    int32_t sz( std::min(f_size, rhs.f_size) );
-    int     page(0);
-    for(; sz >= BLOCK_MANAGER_BUFFER_SIZE; sz -= BLOCK_MANAGER_BUFFER_SIZE, ++page)
-    {
-        const auto& lhs_page( f_buffers[page]     );
-        const auto& rhs_page( rhs.f_buffers[page] );
-        if( lhs_page != rhs_page )
+    // compare the common part block by block
+    const int sz(std::min(f_size, rhs.f_size));
+    int offset(0);
+    while(offset < sz)
+    {
+        int lhs_available;
+        int rhs_available;
+        const char *lhs_data(data_at(offset, lhs_available));
+        const char *rhs_data(rhs.data_at(offset, rhs_available));
+        const int size(std::min(std::min(lhs_available, rhs_available), sz - offset));
+        const int r(memcmp(lhs_data, rhs_data, size));
+        if(r != 0)
         {
-            return (lhs_page < rhs_page)? -1: 1;
+            return r < 0 ? -1 : 1;
         }
+        offset += size;
     }
 
-    const auto& lhs_page( f_buffers[page]     );
-    const auto& rhs_page( rhs.f_buffers[page] );
-    if( std::equal( lhs_page.begin(), lhs_page.begin() + sz, rhs_page.begin() ) )
-    {
-        return 0;
-    }
-
-    if( std::lexicographical_compare( lhs_page.begin(), lhs_page.end() + sz, rhs_page.begin(), rhs_page.end() + sz ) )
-    {
-        return -1;
-    }
-
-    return 1;
+    return 0;
 }
 
 memory_file::file_format_t memory_file::block_manager::data_to_format(int offset, int /*bufsize*/ ) const
@@ -564,43 +835,71 @@ public:
         inflateEnd(&f_zstream);
     }
 
+    /** \brief Decompress the next bytes of the stream.
+     *
+     * This function decompresses up to \p size bytes in \p buffer. The
+     * compressed data is read directly from the blocks of \p block
+     * starting at \p in_offset which gets updated accordingly.
+     *
+     * \param[in] block  The compressed data.
+     * \param[in,out] in_offset  The offset of the next compressed byte.
+     * \param[out] buffer  The buffer receiving the decompressed data.
+     * \param[in] size  The size of \p buffer.
+     *
+     * \return The number of bytes saved in \p buffer, 0 once the end of
+     *         the stream was reached.
+     */
+    int read(const memory_file::block_manager& block, int& in_offset, char *buffer, int size)
+    {
+        f_zstream.next_out = reinterpret_cast<Bytef *>(buffer);
+        f_zstream.avail_out = static_cast<uInt>(size);
+        while(f_zstream.avail_out > 0 && !f_end)
+        {
+            if(f_zstream.avail_in == 0)
+            {
+                int available;
+                const char *data(block.data_at(in_offset, available));
+                if(data == NULL)
+                {
+                    // no more input
+                    f_end = true;
+                    break;
+                }
+                in_offset += available;
+                f_zstream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+                f_zstream.avail_in = static_cast<uInt>(available);
+            }
+            const int r(inflate(&f_zstream, Z_NO_FLUSH));
+            check_error(r);
+            if(r == Z_STREAM_END)
+            {
+                f_end = true;
+            }
+        }
+        return size - static_cast<int>(f_zstream.avail_out);
+    }
+
     void decompress(memory_file& result, const memory_file::block_manager& block)
     {
         result.create(memory_file::file_format_other);
-        Bytef out[1024 * 64];
-        char in[memory_file::block_manager::BLOCK_MANAGER_BUFFER_SIZE];
-        int sz(block.size());
+        char out[1024 * 64];
         int in_offset(0);
         int offset(0);
-        f_zstream.next_in = reinterpret_cast<Bytef *>(in);
-        f_zstream.avail_in = 0;
-        while(sz > 0) {
-            if(f_zstream.avail_in < static_cast<uInt>(memory_file::block_manager::BLOCK_MANAGER_BUFFER_SIZE)) {
-                // move what's left to the start of the buffer
-                memmove(in, f_zstream.next_in, f_zstream.avail_in);
-                int left_used(std::min(sz, memory_file::block_manager::BLOCK_MANAGER_BUFFER_SIZE - static_cast<int>(f_zstream.avail_in)));
-                block.read(in + f_zstream.avail_in, in_offset, left_used);
-                sz -= left_used;
-                in_offset += left_used;
-                f_zstream.next_in = reinterpret_cast<Bytef *>(in);
-                f_zstream.avail_in += static_cast<uInt>(left_used);
+        for(;;)
+        {
+            const int size_used(read(block, in_offset, out, static_cast<int>(sizeof(out))));
+            if(size_used == 0)
+            {
+                break;
             }
-            int r(Z_OK);
-            do {
-                f_zstream.next_out = out;
-                f_zstream.avail_out = static_cast<uInt>(sizeof(out));
-                // using Z_NO_FLUSH is the best value to get the best compression
-                // it is also the most annoying to use because avail_in may not
-                // go to zero and thus we need to handle that special case
-                r = inflate(&f_zstream, sz == 0 ? Z_NO_FLUSH : Z_NO_FLUSH);
-                check_error(r);
-                int size_used(static_cast<int>(sizeof(out) - f_zstream.avail_out));
-                result.write(reinterpret_cast<char *>(out), offset, size_used);
-                offset += size_used;
-            } while(f_zstream.avail_out == 0 && r != Z_STREAM_END && r != Z_BUF_ERROR);
+            result.write(out, offset, size_used);
+            offset += size_used;
         }
         result.guess_format_from_data();
     }
+
+private:
+    controlled_vars::fbool_t    f_end;
 };
 
 
@@ -720,47 +1019,71 @@ public:
         check_error(BZ2_bzDecompressEnd(&f_bzstream));
     }
 
+    /** \brief Decompress the next bytes of the stream.
+     *
+     * This function decompresses up to \p size bytes in \p buffer. The
+     * compressed data is read directly from the blocks of \p block
+     * starting at \p in_offset which gets updated accordingly.
+     *
+     * \param[in] block  The compressed data.
+     * \param[in,out] in_offset  The offset of the next compressed byte.
+     * \param[out] buffer  The buffer receiving the decompressed data.
+     * \param[in] size  The size of \p buffer.
+     *
+     * \return The number of bytes saved in \p buffer, 0 once the end of
+     *         the stream was reached.
+     */
+    int read(const memory_file::block_manager& block, int& in_offset, char *buffer, int size)
+    {
+        f_bzstream.next_out = buffer;
+        f_bzstream.avail_out = static_cast<unsigned int>(size);
+        while(f_bzstream.avail_out > 0 && !f_end)
+        {
+            if(f_bzstream.avail_in == 0)
+            {
+                int available;
+                const char *data(block.data_at(in_offset, available));
+                if(data == NULL)
+                {
+                    // no more input
+                    f_end = true;
+                    break;
+                }
+                in_offset += available;
+                f_bzstream.next_in = const_cast<char *>(data);
+                f_bzstream.avail_in = static_cast<unsigned int>(available);
+            }
+            const int r(BZ2_bzDecompress(&f_bzstream));
+            check_error(r);
+            if(r == BZ_STREAM_END)
+            {
+                f_end = true;
+            }
+        }
+        return size - static_cast<int>(f_bzstream.avail_out);
+    }
+
     void decompress(memory_file& result, const memory_file::block_manager& block)
     {
         result.create(memory_file::file_format_other);
         char out[1024 * 64]; // 64Kb like the block manager at this time
-        int out_offset(0);
-        char in[memory_file::block_manager::BLOCK_MANAGER_BUFFER_SIZE];
         int in_offset(0);
-        int sz(block.size());
-        f_bzstream.next_in = in;
-        f_bzstream.avail_in = 0;
-        while(sz > 0)
+        int offset(0);
+        for(;;)
         {
-            if(f_bzstream.avail_in < static_cast<unsigned int>(memory_file::block_manager::BLOCK_MANAGER_BUFFER_SIZE))
-            {
-                // move what's left to the start of the buffer
-                memmove(in, f_bzstream.next_in, f_bzstream.avail_in);
-                int left_used(std::min(sz, memory_file::block_manager::BLOCK_MANAGER_BUFFER_SIZE - static_cast<int>(f_bzstream.avail_in)));
-                block.read(in + f_bzstream.avail_in, in_offset, left_used);
-                sz -= left_used;
-                in_offset += left_used;
-                f_bzstream.next_in = in;
-                f_bzstream.avail_in += static_cast<unsigned int>(left_used);
-            }
-            int r(BZ_OK);
-            do
+            const int size_used(read(block, in_offset, out, static_cast<int>(sizeof(out))));
+            if(size_used == 0)
             {
-                f_bzstream.next_out = out;
-                f_bzstream.avail_out = static_cast<unsigned int>(sizeof(out));
-                // using BZ_RUN is the best value to get the best compression
-                // it is also the most annoying to use because avail_in may not
-                // go to zero and thus we need to handle that special case
-                r = BZ2_bzDecompress(&f_bzstream);
-                check_error(r);
-                int size_used(static_cast<int>(sizeof(out) - f_bzstream.avail_out));
-                result.write(reinterpret_cast<char *>(out), out_offset, size_used);
-                out_offset += size_used;
+                break;
             }
-            while(f_bzstream.avail_out == 0 && r != BZ_STREAM_END);
+            result.write(out, offset, size_used);
+            offset += size_used;
         }
         result.guess_format_from_data();
     }
+
+private:
+    controlled_vars::fbool_t    f_end;
 };
 
 
@@ -1081,9 +1404,56 @@ memory_file::memory_file()
     reset();
 }
 
-void memory_file::set_filename(const wpkg_filename::uri_filename& filename)
+/** \brief Move a memory file.
+ *
+ * This constructor takes over the data of \p rhs without copying it.
+ * The \p rhs memory file is reset.
+ *
+ * \param[in,out] rhs  The memory file to move.
+ */
+memory_file::memory_file(memory_file&& rhs)
+    //: ... initialized in reset() plus all vars are auto-initialized!
 {
-    f_filename = filename;
+    reset();
+    *this = std::move(rhs);
+}
+
+/** \brief Move a memory file.
+ *
+ * This operator releases the current data of this memory file and
+ * takes over the data of \p rhs without copying it. The \p rhs
+ * memory file is reset.
+ *
+ * \param[in,out] rhs  The memory file to move.
+ *
+ * \return A reference to this memory file.
+ */
+memory_file& memory_file::operator = (memory_file&& rhs)
+{
+    if(this != &rhs)
+    {
+        f_filename = rhs.f_filename;
+        f_format = rhs.f_format;
+        f_created = rhs.f_created;
+        f_loaded = rhs.f_loaded;
+        f_directory = rhs.f_directory;
+        f_recursive = rhs.f_recursive;
+        f_dir_size = rhs.f_dir_size;
+        f_dir = rhs.f_dir;
+        f_dir_stack.swap(rhs.f_dir_stack);
+        f_dir_pos = rhs.f_dir_pos;
+        f_member_index_size = rhs.f_member_index_size;
+        f_member_index.swap(rhs.f_member_index);
+        f_buffer.swap(rhs.f_buffer);
+        f_package_path = rhs.f_package_path;
+        rhs.reset();
+    }
+    return *this;
+}
+
+void memory_file::set_filename(const wpkg_filename::uri_filename& filename)
+{
+    f_filename = filename;
 }
 
 const wpkg_filename::uri_filename& memory_file::get_filename() const
@@ -1405,14 +1775,17 @@ std::string memory_file::to_base64(const char *buf, size_t size)
  */
 void memory_file::read_file(const wpkg_filename::uri_filename& filename, file_info *info)
 {
+    wpkg_metrics::profile_scope profile("read_file");
+
     reset();
 
     f_filename = filename;
 
-    wpkg_output::log("Reading file '%1'.")
-            .quoted_arg(f_filename.original_filename())
-        .debug(wpkg_output::debug_flags::debug_detail_files)
-        .module(wpkg_output::module_repository);
+    WPKG_OUTPUT_IF_DEBUG(wpkg_output::debug_flags::debug_detail_files)
+        wpkg_output::log("Reading file '%1'.")
+                .quoted_arg(f_filename.original_filename())
+            .debug(wpkg_output::debug_flags::debug_detail_files)
+            .module(wpkg_output::module_repository);
 
     // WARNING: here the filename may NOT have been canonicalized
     std::string scheme(filename.path_scheme());
@@ -1467,220 +1840,22 @@ void memory_file::read_file(const wpkg_filename::uri_filename& filename, file_in
     }
     else if(scheme == "http" /*|| scheme == "https"*/)
     {
-        // make a copy of filename so we can handle redirects and not
-        // lose the original filename
-        wpkg_filename::uri_filename uri(filename);
-
-        // the only type of files we can gather from HTTP are regular files
-        if(info != NULL)
+        wpkg_http::http_response response;
+        memory_file body;
+        try
         {
-            info->set_file_type(memory_file::file_info::regular_file);
-            info->set_mode(0644);
-        }
-        std::unique_ptr<tcp_client_server::tcp_client> http_client;
-        bool redirect;
-        std::string location;
-        int content_length(-1);
-        // TODO: add cache support
-        do
-        {
-            std::string name(uri.path_only());
-            redirect = false;
-            location.clear();
-            int port_number(80);
-            std::string port(uri.get_port());
-            if(!port.empty())
-            {
-                port_number = file_info::str_to_int(port.c_str(), static_cast<int>(port.length()), 10);
-            }
-            if(info != NULL)
-            {
-                info->set_filename(name);
-            }
-            std::string request("GET " + name + " HTTP/1.1\r\nHost: " + uri.get_domain() + "\r\n");
-            if(!filename.get_username().empty() && !filename.get_password().empty())
-            {
-                std::string credentials(filename.get_username() + ":" + filename.get_password());
-                request += ("Authorization: Basic " + to_base64(credentials.c_str(), credentials.length()) + "\r\n");
-            }
-            request += "\r\n"; // add an empty line
-            http_client.reset(new tcp_client_server::tcp_client(uri.get_domain(), port_number));
-            if(http_client->write(request.c_str(), request.length()) != static_cast<int>(request.length()))
-            {
-                throw memfile_exception_io("error while writing HTTP request for \"" + filename.original_filename() + "\"");
-            }
-
-            // the reply is a header followed by the data, here we read the
-            // header because it is throw away data at this point
-            bool first_line(true);
-            for(;;)
-            {
-                case_insensitive::case_insensitive_string field_name("");
-                std::string field_value;
-                bool got_name(false), trim(true);
-                for(;;)
-                {
-                    char c;
-                    if(http_client->read(&c, 1) != 1)
-                    {
-                        throw memfile_exception_io("error while reading HTTP response for \"" + filename.original_filename() + "\"");
-                    }
-                    if(c == '\r')
-                    {
-                        if(http_client->read(&c, 1) != 1)
-                        {
-                            throw memfile_exception_io("error while reading HTTP response for \"" + filename.original_filename() + "\"");
-                        }
-                        if(c != '\n')
-                        {
-                            throw memfile_exception_io("error while reading HTTP response for \"" + filename.original_filename() + "\": expected \\n");
-                        }
-                        break;
-                    }
-                    if(c == '\n')
-                    {
-                        // '\r' missing?!
-                        break;
-                    }
-                    if(got_name)
-                    {
-                        if(trim)
-                        {
-                            trim = isspace(c) != 0;
-                        }
-                        if(!trim)
-                        {
-                            field_value += c;
-                        }
-                    }
-                    else if(c == ':' && !first_line)
-                    {
-                        got_name = true;
-                    }
-                    else
-                    {
-                        field_name += c;
-                    }
-                }
-                if(field_name.empty())
-                {
-                    break;
-                }
-                if(first_line)
-                {
-                    first_line = false;
-                    // the first line must be HTTP/1.0 200 OK or HTTP/1.1 200 OK
-                    // although we want to support 301, 302, and 303 redirects
-                    std::string http_protocol(field_name.substr(0, 9));
-                    if(http_protocol != "HTTP/1.0 " && http_protocol != "HTTP/1.1 ")
-                    {
-                        throw memfile_exception_io("HTTP response: is not HTTP/1.0 or HTTP/1.1");
-                    }
-                    int http_response(file_info::str_to_int(field_name.c_str() + 9, 4, 10));
-                    switch(http_response)
-                    {
-                    case 301: // Moved permanently
-                    case 302: // Found
-                    case 303: // See Other
-                    case 307: // Temporary Redirect
-                    case 308: // Permanent Redirect
-                        // handle redirect
-                        redirect = true;
-                        break;
-
-                    case 200: // OK
-                        // valid response!
-                        break;
-
-                    case 401: // Unauthorized
-                        // TBD:
-                        // at times servers force you to reply to this one instead of
-                        // directly accepting the Authorization: Basic ... field!?
-                    default:
-                        // TODO: we MUST test the field_name string before printing for security reasons
-                        throw memfile_exception_io("HTTP response was " + field_name.substr(9, 3) + ", expected 200 or a redirect");
-
-                    }
-                }
-                else
-                {
-                    if(field_name == "Location")
-                    {
-                        location = field_value;
-                    }
-                    else if(field_name == "Content-Length")
-                    {
-                        content_length = file_info::str_to_int(field_value.c_str(), static_cast<int>(field_value.length()), 10);
-                    }
-                    else if(info != NULL)
-                    {
-                        if(field_name == "Last-Modified")
-                        {
-                            struct tm time_info;
-                            if(strptime(field_value.c_str(), "%a, %d %b %Y %H:%M:%S %z", &time_info) != NULL)
-                            {
-                                // unfortunately the tar format does not support time64_t
-                                info->set_mtime(mktime(&time_info));
-                            }
-                            // else -- silent error?
-                        }
-                    }
-                    // other fields of interest?
-                }
-            }
-            if(location.empty())
-            {
-                if(redirect)
-                {
-                    throw memfile_exception_io("received an HTTP redirect without a Location field");
-                }
-            }
-            else
-            {
-                if(!redirect)
-                {
-                    throw memfile_exception_io("received an HTTP Location field without a redirect response");
-                }
-                uri.set_filename(location);
-                std::string location_scheme(uri.path_scheme());
-                if(location_scheme != "http" && location_scheme != "https")
-                {
-                    throw memfile_exception_io("HTTP redirect has a location not using the HTTP or HTTPS scheme");
-                }
-                // note that we ignore the new user and password parameters since
-                // we continue to use filename.get_username() and filename.get_password()
-                // when generating the credentials
-            }
+            read_http(filename, info, response, body, 0, std::string());
         }
-        while(!location.empty());
-
-        // now read the file contents
-        // we do not trust the Content-Size (or even whether it is present)
-        // so we read until we get a read_size of zero
-        int pos(0);
-        for(; content_length == -1 || pos < content_length;)
+        catch(const wpkg_http::wpkg_http_exception& e)
         {
-            //const int sz(content_length == -1 ? block_manager::BLOCK_MANAGER_BUFFER_SIZE : std::min(content_length - pos, block_manager::BLOCK_MANAGER_BUFFER_SIZE));
-            char buf[block_manager::BLOCK_MANAGER_BUFFER_SIZE];
-            const int read_size(http_client->read(buf, block_manager::BLOCK_MANAGER_BUFFER_SIZE));
-            if(read_size == -1)
-            {
-                // reading of the entire file failed
-                reset();
-                throw memfile_exception_io("I/O error while reading HTTP file");
-            }
-            if(read_size == 0)
-            {
-                // done!
-                break;
-            }
-            f_buffer.write(buf, pos, read_size);
-            pos += read_size;
+            reset();
+            throw memfile_exception_io("error while reading HTTP file \"" + filename.original_filename() + "\": " + e.what());
         }
         if(info != NULL)
         {
-            info->set_size(pos);
+            info->set_size(body.size());
         }
+        f_buffer.swap(body.f_buffer);
     }
     else
     {
@@ -1717,6 +1892,350 @@ void memory_file::read_file(const wpkg_filename::uri_filename& filename, file_in
     }
 }
 
+/** \brief Send an HTTP GET request and read the response.
+ *
+ * This function sends a GET request for \p filename, follows redirects,
+ * and reads the response in \p body.
+ *
+ * When \p offset is larger than zero, a Range field asks the server for
+ * the data starting at that offset. The server may then answer with 206
+ * (the body starts at \p offset), 416 (the offset is at or after the
+ * end of the file), or 200 (the body is the whole file.) The caller
+ * checks the status of \p response to know which one it got.
+ *
+ * The \p if_range validator (an ETag or a Last-Modified date) is sent
+ * along the Range field in an If-Range field. If the file changed, the
+ * server ignores the Range and answers with 200 and the whole file.
+ *
+ * The wpkg_http exceptions are not caught. The response and the body
+ * hold whatever was received before the error, which is what allows
+ * resume_file() to keep the data of a dropped connection.
+ *
+ * \exception memfile_exception_io
+ * The server answered with an unexpected status or an invalid redirect.
+ *
+ * \param[in] filename  The HTTP URI of the file to read.
+ * \param[in] info  The information about this file, may be NULL.
+ * \param[out] response  The status and fields of the last response.
+ * \param[out] body  The body of the last response.
+ * \param[in] offset  The offset of the first byte requested.
+ * \param[in] if_range  The validator of the data already received, may
+ *                      be empty.
+ */
+void memory_file::read_http(const wpkg_filename::uri_filename& filename, file_info *info, wpkg_http::http_response& response, memory_file& body, int offset, const std::string& if_range)
+{
+    // make a copy of filename so we can handle redirects and not
+    // lose the original filename
+    wpkg_filename::uri_filename uri(filename);
+
+    // the only type of files we can gather from HTTP are regular files
+    if(info != NULL)
+    {
+        info->set_file_type(memory_file::file_info::regular_file);
+        info->set_mode(0644);
+    }
+    for(int redirects(0);; ++redirects)
+    {
+        if(redirects >= 10)
+        {
+            throw memfile_exception_io("too many HTTP redirects while reading \"" + filename.original_filename() + "\"");
+        }
+        std::string name(uri.path_only());
+        int port_number(80);
+        std::string port(uri.get_port());
+        if(!port.empty())
+        {
+            port_number = file_info::str_to_int(port.c_str(), static_cast<int>(port.length()), 10);
+        }
+        if(info != NULL)
+        {
+            info->set_filename(name);
+        }
+        wpkg_http::http_request request(name);
+        if(!filename.get_username().empty() && !filename.get_password().empty())
+        {
+            std::string credentials(filename.get_username() + ":" + filename.get_password());
+            request.set_field("Authorization", "Basic " + to_base64(credentials.c_str(), credentials.length()));
+        }
+        if(offset > 0)
+        {
+            char range[32];
+            snprintf(range, sizeof(range), "bytes=%d-", offset);
+            request.set_field("Range", range);
+            if(!if_range.empty())
+            {
+                request.set_field("If-Range", if_range);
+            }
+        }
+
+        // reuse the connection to that host if still open
+        wpkg_http::http_pool& pool(wpkg_http::http_pool::instance());
+        wpkg_http::http_client::pointer_t http_client(pool.acquire(uri.get_domain(), port_number));
+        http_client->request(request, response, body);
+        pool.release(http_client);
+
+        // the response must be 200 OK although we want to support
+        // 301, 302, 303, 307, and 308 redirects
+        bool redirect(false);
+        switch(response.get_status())
+        {
+        case 301: // Moved permanently
+        case 302: // Found
+        case 303: // See Other
+        case 307: // Temporary Redirect
+        case 308: // Permanent Redirect
+            // handle redirect
+            redirect = true;
+            break;
+
+        case 200: // OK
+            // valid response!
+            break;
+
+        case 206: // Partial Content
+        case 416: // Range Not Satisfiable
+            if(offset > 0)
+            {
+                // valid answers to our Range field
+                break;
+            }
+            /*FALLTHROUGH*/
+        case 401: // Unauthorized
+            // TBD:
+            // at times servers force you to reply to this one instead of
+            // directly accepting the Authorization: Basic ... field!?
+        default:
+            {
+                char status[16];
+                snprintf(status, sizeof(status), "%d", response.get_status());
+                throw memfile_exception_io(std::string("HTTP response was ") + status + ", expected 200 or a redirect");
+            }
+
+        }
+        const std::string location(response.get_field("Location"));
+        if(location.empty())
+        {
+            if(redirect)
+            {
+                throw memfile_exception_io("received an HTTP redirect without a Location field");
+            }
+            break;
+        }
+        if(!redirect)
+        {
+            throw memfile_exception_io("received an HTTP Location field without a redirect response");
+        }
+        uri.set_filename(location);
+        std::string location_scheme(uri.path_scheme());
+        if(location_scheme != "http" && location_scheme != "https")
+        {
+            throw memfile_exception_io("HTTP redirect has a location not using the HTTP or HTTPS scheme");
+        }
+        // note that we ignore the new user and password parameters since
+        // we continue to use filename.get_username() and filename.get_password()
+        // when generating the credentials
+    }
+
+    if(info != NULL)
+    {
+        const std::string last_modified(response.get_field("Last-Modified"));
+        if(!last_modified.empty())
+        {
+            struct tm time_info;
+            if(strptime(last_modified.c_str(), "%a, %d %b %Y %H:%M:%S %z", &time_info) != NULL)
+            {
+                // unfortunately the tar format does not support time64_t
+                info->set_mtime(mktime(&time_info));
+            }
+            // else -- silent error?
+        }
+    }
+}
+
+
+/** \brief Read a remote file, resuming a previous partial download.
+ *
+ * This function reads \p filename like read_file() does. For HTTP
+ * files, the data already received is kept when the connection drops:
+ * the function asks the server for the rest of the file with a Range
+ * field, up to HTTP_RESUME_ATTEMPTS times. If the download still fails,
+ * the data received so far is saved in the \p partial file and the next
+ * call to resume_file() starts from there.
+ *
+ * The \p partial file is deleted once the file was read successfully.
+ * Files which do not use the HTTP scheme are read with read_file().
+ *
+ * While resuming, the function sends the validator of the first response
+ * (its strong ETag or its Last-Modified date) in an If-Range field so
+ * the data does not get mixed with a newer version of the file. That
+ * validator is not saved with the \p partial file though, so a partial
+ * file may be out of date if the remote file changed in between. The
+ * caller is expected to verify the result (i.e. against the md5sum found
+ * in a repository index) and to try again from scratch if it does not
+ * match.
+ *
+ * \exception memfile_exception_io
+ * The file could not be read.
+ *
+ * \param[in] filename  The name of the file to read.
+ * \param[in] partial  The file used to save the data of a failed download.
+ * \param[in] expected_size  The size of the file if known, -1 otherwise.
+ */
+void memory_file::resume_file(const wpkg_filename::uri_filename& filename, const wpkg_filename::uri_filename& partial, int expected_size)
+{
+    if(filename.path_scheme() != "http")
+    {
+        read_file(filename);
+        return;
+    }
+
+    reset();
+
+    memory_file data;
+    data.create(file_format_other);
+    if(partial.exists())
+    {
+        try
+        {
+            data.read_file(partial);
+        }
+        catch(const memfile_exception&)
+        {
+            data.create(file_format_other);
+        }
+        if(expected_size >= 0 && data.size() > expected_size)
+        {
+            // that cannot be the beginning of this file
+            data.create(file_format_other);
+        }
+    }
+
+    WPKG_OUTPUT_IF_DEBUG(wpkg_output::debug_flags::debug_detail_files)
+        wpkg_output::log("Reading file '%1' from offset %2.")
+                .quoted_arg(filename.original_filename())
+                .arg(data.size())
+            .debug(wpkg_output::debug_flags::debug_detail_files)
+            .module(wpkg_output::module_repository);
+
+    std::string validator;
+    for(int attempt(1);; ++attempt)
+    {
+        wpkg_http::http_response response;
+        memory_file body;
+        std::string error;
+        try
+        {
+            read_http(filename, NULL, response, body, data.size(), validator);
+        }
+        catch(const wpkg_http::wpkg_http_exception& e)
+        {
+            error = e.what();
+        }
+
+        if(validator.empty() && (response.get_status() == 200 || response.get_status() == 206))
+        {
+            // a weak ETag cannot be used with If-Range
+            validator = response.get_field("ETag");
+            if(validator.empty() || validator.compare(0, 2, "W/") == 0)
+            {
+                validator = response.get_field("Last-Modified");
+            }
+        }
+
+        switch(response.get_status())
+        {
+        case 200:
+            // the server sent the file from the start
+            data = std::move(body);
+            break;
+
+        case 206:
+            {
+                // make sure the data starts where we asked it to
+                const std::string content_range(response.get_field("Content-Range"));
+                if(content_range.compare(0, 6, "bytes ") != 0
+                || atol(content_range.c_str() + 6) != data.size())
+                {
+                    data.create(file_format_other);
+                    if(error.empty())
+                    {
+                        error = "invalid Content-Range \"" + content_range + "\" in HTTP response";
+                    }
+                    break;
+                }
+                char buf[block_manager::BLOCK_MANAGER_BUFFER_SIZE];
+                const int size(body.size());
+                for(int pos(0); pos < size;)
+                {
+                    const int sz(body.read(buf, pos, std::min(size - pos, static_cast<int>(sizeof(buf)))));
+                    data.write(buf, data.size(), sz);
+                    pos += sz;
+                }
+            }
+            break;
+
+        case 416:
+            // we already have the whole file unless it changed
+            if(expected_size >= 0 && data.size() == expected_size)
+            {
+                error.clear();
+            }
+            else
+            {
+                data.create(file_format_other);
+                if(error.empty())
+                {
+                    error = "HTTP range not satisfiable";
+                }
+            }
+            break;
+
+        default:
+            // the request failed before we received anything
+            break;
+
+        }
+
+        if(error.empty())
+        {
+            break;
+        }
+        if(attempt >= HTTP_RESUME_ATTEMPTS)
+        {
+            if(data.size() > 0)
+            {
+                try
+                {
+                    data.write_file(partial, true);
+                }
+                catch(const memfile_exception&)
+                {
+                    // ignore, the next attempt starts from scratch
+                }
+            }
+            throw memfile_exception_io("error while reading HTTP file \"" + filename.original_filename() + "\": " + error);
+        }
+
+        wpkg_output::log("Resuming file '%1' from offset %2 after error: %3.")
+                .quoted_arg(filename.original_filename())
+                .arg(data.size())
+                .arg(error)
+            .debug(wpkg_output::debug_flags::debug_detail_files)
+            .module(wpkg_output::module_repository);
+    }
+
+    if(partial.exists())
+    {
+        partial.os_unlink();
+    }
+
+    f_filename = filename;
+    f_buffer.swap(data.f_buffer);
+    f_format = f_buffer.data_to_format(0, f_buffer.size());
+    f_loaded = true;
+}
+
+
 void memory_file::write_file(const wpkg_filename::uri_filename& filename, bool create_folders, bool force) const
 {
     if(!f_created && !f_loaded)
@@ -1763,24 +2282,30 @@ void memory_file::write_file(const wpkg_filename::uri_filename& filename, bool c
             throw memfile_exception_io("opening the output file \"" + filename.original_filename() + "\" failed");
         }
     }
+    // write the blocks directly from memory
     int offset(0);
-    int sz(f_buffer.size());
-    while(sz > 0)
+    while(offset < f_buffer.size())
     {
-        char buf[block_manager::BLOCK_MANAGER_BUFFER_SIZE];
-        int write_size(std::min(sz, block_manager::BLOCK_MANAGER_BUFFER_SIZE));
-        f_buffer.read(buf, offset, write_size);
-        file.write(buf, write_size);
+        int write_size;
+        const char *data(f_buffer.data_at(offset, write_size));
+        file.write(data, write_size);
         if(!file.good())
         {
             throw memfile_exception_io("writing the entire file to the output file \"" + filename.original_filename() + "\" failed");
         }
         offset += write_size;
-        sz -= write_size;
     }
 }
 
 
+/** \brief Copy this memory file to \p destination.
+ *
+ * The blocks of data are shared between both memory files so the copy
+ * is cheap. A block gets duplicated only once one of the two memory
+ * files writes to it.
+ *
+ * \param[out] destination  The memory file receiving the copy.
+ */
 void memory_file::copy(memory_file& destination) const
 {
     switch(f_format) {
@@ -1789,21 +2314,10 @@ void memory_file::copy(memory_file& destination) const
         throw memfile_exception_parameter("the source file in a copy() call cannot be undefined or a directory");
 
     default:
-        destination.create(f_format);
+        if(&destination != this)
         {
-            char buf[block_manager::BLOCK_MANAGER_BUFFER_SIZE];
-            int offset(0);
-            int sz(f_buffer.size());
-            while(sz >= block_manager::BLOCK_MANAGER_BUFFER_SIZE) {
-                f_buffer.read(buf, offset, block_manager::BLOCK_MANAGER_BUFFER_SIZE);
-                destination.write(buf, offset, block_manager::BLOCK_MANAGER_BUFFER_SIZE);
-                offset += block_manager::BLOCK_MANAGER_BUFFER_SIZE;
-                sz -= block_manager::BLOCK_MANAGER_BUFFER_SIZE;
-            }
-            if(sz > 0) {
-                f_buffer.read(buf, offset, sz);
-                destination.write(buf, offset, sz);
-            }
+            destination.create(f_format);
+            destination.f_buffer.share(f_buffer, 0, f_buffer.size());
         }
         break;
 
@@ -1857,7 +2371,7 @@ void memory_file::compress(memory_file& result, file_format_t format, int zlevel
             compress_to_gz(result, zlevel);
             compress_to_bz2(r1, zlevel);
             if(r1.size() < result.size()) {
-                r1.copy(result);
+                result = std::move(r1);
             }
             // TODO: add the other compressions
         }
@@ -1883,6 +2397,8 @@ void memory_file::decompress(memory_file& result) const
     if(!f_created && !f_loaded) {
         throw memfile_exception_undefined("this memory file is still undefined and it cannot be decompressed");
     }
+    wpkg_metrics::phase_timer timer(wpkg_metrics::phase_decompress);
+    wpkg_metrics::profile_scope profile("decompress");
     // already compressed?
     switch(f_format) {
     case file_format_gz:
@@ -1902,6 +2418,7 @@ void memory_file::decompress(memory_file& result) const
         throw memfile_exception_compatibility("this memory file is not compressed, see is_compressed()");
 
     }
+    wpkg_metrics::add_to_counter(wpkg_metrics::counter_bytes_decompressed, result.size());
 }
 
 void memory_file::reset()
@@ -1915,6 +2432,8 @@ void memory_file::reset()
     f_dir.reset();
     f_dir_stack.clear();
     f_dir_pos = 0;
+    f_member_index_size = -1;
+    f_member_index.clear();
     f_buffer.clear();
     f_package_path.clear();
 }
@@ -1978,6 +2497,29 @@ int memory_file::read(char *buffer, int offset, int bufsize) const
     return bufsize;
 }
 
+namespace
+{
+
+/** \brief Search the end of a line.
+ *
+ * This function searches for the first "\n" or "\r" in the specified
+ * buffer. The search uses memchr() which is vectorized by the C library.
+ *
+ * \param[in] data  The data to search.
+ * \param[in] size  The number of bytes in \p data.
+ *
+ * \return A pointer to the first end of line character or NULL.
+ */
+const char *find_eol(const char *data, int size)
+{
+    const char *nl(static_cast<const char *>(memchr(data, '\n', size)));
+    const char *cr(static_cast<const char *>(memchr(data, '\r', nl == NULL ? size : nl - data)));
+    return cr == NULL ? nl : cr;
+}
+
+} // no name namespace
+
+
 /** \brief Read one line from this memory file.
  *
  * This function reads one line of data from this memory file. Lines are
@@ -2000,8 +2542,45 @@ int memory_file::read(char *buffer, int offset, int bufsize) const
  */
 bool memory_file::read_line(int& offset, std::string& result) const
 {
-    result.clear();
-
+    const char *line;
+    int length;
+    if(!read_line(offset, line, length, result))
+    {
+        result.clear();
+        return false;
+    }
+    if(line != result.data())
+    {
+        result.assign(line, length);
+    }
+    return true;
+}
+
+
+/** \brief Read one line from this memory file without copying it.
+ *
+ * This function works like the read_line() returning a string except
+ * that the line is returned as a pointer and a length. When the line is
+ * fully defined in one of the blocks of the file, the pointer points
+ * directly in that block and no copy is made. When the line spans two
+ * or more blocks, it gets copied in \p buffer and the pointer points
+ * to the buffer data.
+ *
+ * The line is not null terminated. The pointer remains valid until the
+ * file or \p buffer get modified.
+ *
+ * \param[in,out] offset  The current position where we read from, usually starts with 0.
+ * \param[out] line  A pointer to the first character of the line.
+ * \param[out] length  The number of characters in the line.
+ * \param[in,out] buffer  A buffer used when the line spans multiple blocks.
+ *
+ * \return true if more data is available, false once the end of the file was reached.
+ */
+bool memory_file::read_line(int& offset, const char *& line, int& length, std::string& buffer) const
+{
+    line = NULL;
+    length = 0;
+
     if(!f_created && !f_loaded) {
         throw memfile_exception_undefined("you cannot read a line of data from an undefined file");
     }
@@ -2012,40 +2591,48 @@ bool memory_file::read_line(int& offset, std::string& result) const
         return false;
     }
 
-    // TODO: we may want to move the following to the block manager
-    //       so we avoid many small reads and instead go through the
-    //       buffers; although buffers are 64Kb each so that's quite
-    //       a bit of testing to know which buffer we're currently
-    //       in to load the next byte
-
     // read this line (empty line are returned)
-    char buf[1];
-    for(; offset < f_buffer.size(); ++offset) {
-        f_buffer.read(buf, offset, 1);
-        if(buf[0] == '\n' || buf[0] == '\r') {
+    bool copied(false);
+    for(;;) {
+        int available;
+        const char *data(f_buffer.data_at(offset, available));
+        const char *eol(find_eol(data, available));
+        const bool last(eol != NULL || offset + available == f_buffer.size());
+        const int size(eol == NULL ? available : static_cast<int>(eol - data));
+        if(last && !copied) {
+            // the whole line is in this block
+            line = data;
+            length = size;
+            offset += size;
+            break;
+        }
+        if(!copied) {
+            buffer.clear();
+            copied = true;
+        }
+        buffer.append(data, size);
+        offset += size;
+        if(last) {
+            line = buffer.data();
+            length = static_cast<int>(buffer.length());
             break;
         }
-        result += buf[0];
     }
 
     // skip the newline now
     if(offset < f_buffer.size()) {
-        f_buffer.read(buf, offset, 1);
-        if(buf[0] == '\r') {
-            ++offset;
-            if(offset < f_buffer.size()) {
-                f_buffer.read(buf, offset, 1);
-                if(buf[0] == '\n') {
-                    // skipping "\r\n" (MS-Windows)
-                    ++offset;
-                }
+        int available;
+        const char *data(f_buffer.data_at(offset, available));
+        ++offset;
+        if(*data == '\r' && offset < f_buffer.size()) {
+            data = f_buffer.data_at(offset, available);
+            if(*data == '\n') {
+                // skipping "\r\n" (MS-Windows)
+                ++offset;
             }
             // else skipping "\r" (Mac)
         }
-        else if(buf[0] == '\n') {
-            // skipping "\n" (Unix)
-            ++offset;
-        }
+        // else skipping "\n" (Unix)
     }
 
     return true;
@@ -2057,10 +2644,29 @@ int memory_file::write(const char *buffer, int offset, int bufsize)
     {
         throw memfile_exception_undefined("you cannot write data to an undefined file; use create() or read_file() first");
     }
+    // the data may overwrite an archive header
+    f_member_index_size = -1;
     f_buffer.write(buffer, offset, bufsize);
     return bufsize;
 }
 
+/** \brief Allocate the memory needed to hold \p size bytes.
+ *
+ * When the final size of a file is known before its data gets written,
+ * calling this function first allocates all the blocks at once. The size
+ * of the file does not change.
+ *
+ * \param[in] size  The number of bytes the file will hold.
+ */
+void memory_file::reserve(int size)
+{
+    if(file_format_undefined == f_format)
+    {
+        throw memfile_exception_undefined("you cannot reserve space in an undefined file; use create() or read_file() first");
+    }
+    f_buffer.reserve(size);
+}
+
 void memory_file::printf(const char *format, ...)
 {
     // we don't expect to use this function with format so large
@@ -2097,203 +2703,688 @@ void memory_file::append_file(const file_info& info, const memory_file& data)
         throw memfile_exception_compatibility("only archive files support the append_file() function");
 
     }
-}
+}
+
+/** \brief Return the size, in bytes, of the file.
+ *
+ * This function returns the byte size of the memory file. Note that a disk
+ * directory (as opened with a call to the dir_rewind() function) has a
+ * size equal to the number of files read so far in the directory (actually
+ * +1 while reading.)
+ *
+ * If the file was not created or loaded, then the size is zero. It is not
+ * an error to retrieve the size of such memory_file objects.
+ *
+ * \return The memory file size in byte (or number of files for a directory.)
+ */
+int memory_file::size() const
+{
+    switch(f_format) {
+    case file_format_directory:
+        return f_dir_size;
+
+    default:
+        return f_buffer.size();
+
+    }
+}
+
+void memory_file::dir_rewind(const wpkg_filename::uri_filename& path, bool recursive)
+{
+    f_dir.reset();
+
+    f_directory = !path.empty();
+    if(f_directory)
+    {
+        f_format = file_format_directory;
+        f_recursive = recursive;
+        f_dir.reset(new wpkg_filename::os_dir(path));
+        f_dir_size = 1;
+    }
+    else
+    {
+        // that does not really apply in this case
+        f_recursive = false;
+    }
+
+    // in case of an ar archive we want to skip the magic code
+    // at the very beginning of the file
+    f_dir_pos = file_format_ar == f_format ? 8 : 0;
+    if(f_dir_pos > f_buffer.size())
+    {
+        f_dir_pos = f_buffer.size();
+    }
+}
+
+int memory_file::dir_pos() const
+{
+    // Note: at this point we do not know whether it is legal to call this
+    // function (i.e. whether dir_rewind() was ever called)
+    switch(f_format)
+    {
+    case file_format_directory:
+    case file_format_ar:
+    case file_format_tar:
+    case file_format_zip:
+    case file_format_7z:
+    case file_format_wpkg:
+    case file_format_meta:
+        break;
+
+    default:
+        throw std::logic_error("dir_pos() cannot be called with a file that is not an archive or a directory");
+
+    }
+    return f_dir_pos;
+}
+
+bool memory_file::dir_next(file_info& info, memory_file *data) const
+{
+    wpkg_metrics::profile_scope profile("dir_next");
+
+    if(data != NULL)
+    {
+        data->reset();
+    }
+    info.reset();
+
+    if(!f_created && !f_loaded && !f_directory)
+    {
+        throw memfile_exception_undefined("you cannot read a directory from an undefined or incompatible file");
+    }
+
+    if(f_dir_pos >= size())
+    {
+        // end of directory reached
+        return false;
+    }
+
+    int block_size(1);
+    switch(f_format)
+    {
+    case file_format_directory:
+        // the block size and stuff won't work right for disk directories
+        // instead we handle the f_dir_pos and f_size in dir_next_dir(),
+        // the f_dir_pos represents a file number rather than an offset
+        if(!dir_next_dir(info))
+        {
+            return false;
+        }
+        switch(info.get_file_type())
+        {
+        case file_info::regular_file:
+        case file_info::continuous: // this should not happen
+            if(data != NULL) {
+                // user wants a copy of the data!
+                data->read_file(info.get_filename());
+            }
+            break;
+
+        default:
+            // ignore special files and directories
+            break;
+
+        }
+        return true;
+
+    case file_format_ar:
+        dir_next_ar(info);
+        block_size = 2;
+        break;
+
+    case file_format_tar:
+        if(!dir_next_tar(info))
+        {
+            return false;
+        }
+        block_size = 512;
+        break;
+
+    case file_format_wpkg:
+        // data read by dir_next_wpkg() if required
+        dir_next_wpkg(info, data);
+        return true;
+
+    case file_format_meta:
+        if(!dir_next_meta(info))
+        {
+            return false;
+        }
+        break;
+
+    default:
+        throw memfile_exception_compatibility("you cannot read a directory from a file that is not an archive");
+
+    }
+
+    int adjusted_size((info.get_size() + block_size - 1) & ~(block_size - 1));
+    if(f_dir_pos + adjusted_size > f_buffer.size())
+    {
+        info.set_size(0);
+        throw memfile_exception_io("archive file data out of bounds (invalid size)");
+    }
+
+    // the size counts only if the file is a regular file or continuous
+    switch(info.get_file_type()) {
+    case file_info::regular_file:
+    case file_info::continuous:
+        if(data != NULL)
+        {
+            // user wants the data; share our blocks instead of copying them
+            data->create(f_buffer.data_to_format(f_dir_pos, info.get_size()));
+            data->f_buffer.share(f_buffer, f_dir_pos, info.get_size());
+        }
+
+        f_dir_pos += adjusted_size;
+        break;
+
+    default:
+        // by special files or directory data have no data per se
+        break;
+
+    }
+
+    return true;
+}
+
+namespace
+{
+
+/** \brief Canonicalize the name of an archive member.
+ *
+ * Tarballs often include "./" at the start of their filenames and
+ * the wpkgar files start their filenames with a "/". This function
+ * removes those so a member can be searched with or without them.
+ *
+ * \param[in] name  The name to canonicalize.
+ *
+ * \return The name without its leading "./" and "/".
+ */
+std::string member_name(const std::string& name)
+{
+    std::string::size_type pos(0);
+    for(;;)
+    {
+        if(name.compare(pos, 2, "./") == 0)
+        {
+            pos += 2;
+        }
+        else if(name.compare(pos, 1, "/") == 0)
+        {
+            ++pos;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return name.substr(pos);
+}
+
+} // no name namespace
+
+
+/** \brief Find a file in an archive.
+ *
+ * This function searches the archive for the file named \p name and
+ * returns its information and, if \p data is not NULL, its data.
+ *
+ * The first time the function is called, the whole archive is scanned
+ * and the position of each file is saved in an index. Further calls
+ * use that index directly. The index is rebuilt if the archive gets
+ * modified.
+ *
+ * The function does not change the current position of dir_next().
+ *
+ * If the archive includes the same name more than once, the first
+ * instance is returned.
+ *
+ * \param[in] name  The name of the file to search.
+ * \param[out] info  The information about the file.
+ * \param[out] data  The data of the file if not NULL.
+ *
+ * \return true if the file was found.
+ */
+bool memory_file::dir_find(const std::string& name, file_info& info, memory_file *data) const
+{
+    switch(f_format)
+    {
+    case file_format_ar:
+    case file_format_tar:
+    case file_format_wpkg:
+        break;
+
+    default:
+        throw memfile_exception_compatibility("dir_find() can only be used with ar, tar, and wpkg archives");
+
+    }
+
+    if(f_member_index_size != f_buffer.size())
+    {
+        build_member_index();
+    }
+
+    member_index_t::const_iterator it(f_member_index.find(member_name(name)));
+    if(it == f_member_index.end())
+    {
+        info.reset();
+        if(data != NULL)
+        {
+            data->reset();
+        }
+        return false;
+    }
+
+    const int saved_pos(f_dir_pos);
+    f_dir_pos = it->second;
+    try
+    {
+        dir_next(info, data);
+    }
+    catch(...)
+    {
+        f_dir_pos = saved_pos;
+        throw;
+    }
+    f_dir_pos = saved_pos;
+
+    return true;
+}
+
+
+/** \brief Build the index of the files of an archive.
+ *
+ * This function reads all the headers of the archive and saves the
+ * position of each file in the member index.
+ */
+void memory_file::build_member_index() const
+{
+    f_member_index.clear();
+
+    const int saved_pos(f_dir_pos);
+    f_dir_pos = file_format_ar == f_format ? std::min(8, f_buffer.size()) : 0;
+    try
+    {
+        for(;;)
+        {
+            const int pos(f_dir_pos);
+            file_info info;
+            if(!dir_next(info, NULL))
+            {
+                break;
+            }
+            // keep the first instance
+            f_member_index.insert(member_index_t::value_type(member_name(info.get_filename()), pos));
+        }
+    }
+    catch(...)
+    {
+        f_member_index.clear();
+        f_dir_pos = saved_pos;
+        throw;
+    }
+    f_dir_pos = saved_pos;
+
+    f_member_index_size = f_buffer.size();
+}
+
+
+/** \class memory_file::decompressor
+ * \brief Read a compressed memory file as a stream.
+ *
+ * The decompress() function saves the whole decompressed data in another
+ * memory file. When the data only needs to be read once, as when going
+ * through the files of a compressed tarball, this class can be used
+ * instead. It decompresses the data a little at a time as it gets read
+ * so the decompressed data never needs to be held in memory all at once.
+ *
+ * The source memory file does not need to be compressed, in which case
+ * its data is returned as is.
+ *
+ * The decompressor shares the blocks of the source memory file so the
+ * source can be modified or destroyed while the decompressor is in use.
+ */
+
+
+/** \brief The state of a decompressor.
+ *
+ * This class holds the compressed data and the gz or bz2 stream used to
+ * decompress it.
+ */
+class memory_file::decompressor::stream
+{
+public:
+    stream(const memory_file& source)
+        //: f_source() -- auto-init
+        //  f_in_offset(0) -- auto-init
+        //  f_gz() -- auto-init
+        //  f_bz2() -- auto-init
+    {
+        switch(source.f_format)
+        {
+        case file_format_undefined:
+        case file_format_directory:
+            throw memfile_exception_parameter("the source file of a decompressor cannot be undefined or a directory");
+
+        case file_format_gz:
+            f_gz.reset(new gz_inflate);
+            break;
+
+        case file_format_bz2:
+            f_bz2.reset(new bz2_inflate);
+            break;
+
+        // TODO add support for lzma and xz
+        case file_format_lzma:
+        case file_format_xz:
+            throw memfile_exception_compatibility("this compression (lzma, xz) is not yet supported by wpkg");
+
+        default:
+            // not compressed, return the data as is
+            break;
+
+        }
+        f_source.share(source.f_buffer, 0, source.f_buffer.size());
+    }
+
+    int read(char *buffer, int size)
+    {
+        int in_offset(f_in_offset);
+        int sz;
+        if(f_gz)
+        {
+            sz = f_gz->read(f_source, in_offset, buffer, size);
+        }
+        else if(f_bz2)
+        {
+            sz = f_bz2->read(f_source, in_offset, buffer, size);
+        }
+        else
+        {
+            sz = f_source.read(buffer, in_offset, size);
+            in_offset += sz;
+        }
+        f_in_offset = in_offset;
+        return sz;
+    }
 
-/** \brief Return the size, in bytes, of the file.
- *
- * This function returns the byte size of the memory file. Note that a disk
- * directory (as opened with a call to the dir_rewind() function) has a
- * size equal to the number of files read so far in the directory (actually
- * +1 while reading.)
+private:
+    memory_file::block_manager          f_source;
+    controlled_vars::zint32_t           f_in_offset;
+    std::shared_ptr<gz_inflate>         f_gz;
+    std::shared_ptr<bz2_inflate>        f_bz2;
+};
+
+
+/** \brief Initialize a decompressor.
  *
- * If the file was not created or loaded, then the size is zero. It is not
- * an error to retrieve the size of such memory_file objects.
+ * The decompressor reads the data of \p source from the start. If
+ * \p source is compressed with gz or bz2, the data gets decompressed
+ * as it is read.
  *
- * \return The memory file size in byte (or number of files for a directory.)
+ * \param[in] source  The memory file to read.
  */
-int memory_file::size() const
+memory_file::decompressor::decompressor(const memory_file& source)
+    : f_stream(new stream(source))
+    //, f_offset(0) -- auto-init
 {
-    switch(f_format) {
-    case file_format_directory:
-        return f_dir_size;
-
-    default:
-        return f_buffer.size();
-
-    }
 }
 
-void memory_file::dir_rewind(const wpkg_filename::uri_filename& path, bool recursive)
-{
-    f_dir.reset();
 
-    f_directory = !path.empty();
-    if(f_directory)
-    {
-        f_format = file_format_directory;
-        f_recursive = recursive;
-        f_dir.reset(new wpkg_filename::os_dir(path));
-        f_dir_size = 1;
-    }
-    else
+/** \brief Read the next bytes of decompressed data.
+ *
+ * This function reads up to \p size bytes in \p buffer. It returns
+ * less than \p size only once the end of the data is reached.
+ *
+ * \param[out] buffer  The buffer where the data gets saved.
+ * \param[in] size  The number of bytes to read.
+ *
+ * \return The number of bytes read, 0 at the end of the data.
+ */
+int memory_file::decompressor::read(char *buffer, int size)
+{
+    if(size < 0)
     {
-        // that does not really apply in this case
-        f_recursive = false;
+        throw memfile_exception_parameter("the size of a decompressor read() cannot be negative");
     }
-
-    // in case of an ar archive we want to skip the magic code
-    // at the very beginning of the file
-    f_dir_pos = file_format_ar == f_format ? 8 : 0;
-    if(f_dir_pos > f_buffer.size())
+    int total(0);
+    while(total < size)
     {
-        f_dir_pos = f_buffer.size();
+        const int sz(f_stream->read(buffer + total, size - total));
+        if(sz == 0)
+        {
+            break;
+        }
+        total += sz;
     }
+    f_offset += total;
+    wpkg_metrics::add_to_counter(wpkg_metrics::counter_bytes_decompressed, total);
+    return total;
 }
 
-int memory_file::dir_pos() const
+
+/** \brief Skip the next bytes of decompressed data.
+ *
+ * This function decompresses and ignores the next \p size bytes.
+ *
+ * \param[in] size  The number of bytes to skip.
+ *
+ * \return The number of bytes skipped, less than \p size only if the
+ *         end of the data is reached.
+ */
+int memory_file::decompressor::skip(int size)
 {
-    // Note: at this point we do not know whether it is legal to call this
-    // function (i.e. whether dir_rewind() was ever called)
-    switch(f_format)
+    char buf[1024 * 64];
+    int total(0);
+    while(total < size)
     {
-    case file_format_directory:
-    case file_format_ar:
-    case file_format_tar:
-    case file_format_zip:
-    case file_format_7z:
-    case file_format_wpkg:
-    case file_format_meta:
-        break;
+        const int sz(read(buf, std::min(size - total, static_cast<int>(sizeof(buf)))));
+        if(sz == 0)
+        {
+            break;
+        }
+        total += sz;
+    }
+    return total;
+}
 
-    default:
-        throw std::logic_error("dir_pos() cannot be called with a file that is not an archive or a directory");
 
-    }
-    return f_dir_pos;
+/** \brief Get the current position in the decompressed data.
+ *
+ * \return The number of decompressed bytes read or skipped so far.
+ */
+int memory_file::decompressor::tell() const
+{
+    return f_offset;
 }
 
-bool memory_file::dir_next(file_info& info, memory_file *data) const
+
+/** \brief Read the next file of a tarball.
+ *
+ * This function works like dir_next() on a tarball, only it reads the
+ * headers and data from the decompressor. Once this function was called,
+ * the decompressed data is expected to be a tarball from the current
+ * position.
+ *
+ * When \p data is NULL, the data of the file is skipped.
+ *
+ * \param[out] info  The information about the file.
+ * \param[out] data  The data of the file if not NULL.
+ *
+ * \return false once the end of the tarball is reached.
+ */
+bool memory_file::decompressor::next_tar(file_info& info, memory_file *data)
 {
     if(data != NULL)
     {
         data->reset();
     }
-    info.reset();
-
-    if(!f_created && !f_loaded && !f_directory)
+    if(!next_tar_header(info))
     {
-        throw memfile_exception_undefined("you cannot read a directory from an undefined or incompatible file");
+        return false;
     }
+    next_tar_data(info, data);
+    return true;
+}
 
-    if(f_dir_pos >= size())
+
+/** \brief Search a file in a tarball.
+ *
+ * This function reads the files of the tarball until it finds the file
+ * named \p name. The data of the files found before that file is skipped.
+ * The name is compared the same way as in dir_find(), i.e. a leading "./"
+ * or "/" is ignored.
+ *
+ * \param[in] name  The name of the file to search.
+ * \param[out] info  The information about the file.
+ * \param[out] data  The data of the file if not NULL.
+ *
+ * \return true if the file was found.
+ */
+bool memory_file::decompressor::find_tar(const std::string& name, file_info& info, memory_file *data)
+{
+    if(data != NULL)
     {
-        // end of directory reached
-        return false;
+        data->reset();
     }
-
-    int block_size(1);
-    switch(f_format)
+    const std::string canonical(member_name(name));
+    for(;;)
     {
-    case file_format_directory:
-        // the block size and stuff won't work right for disk directories
-        // instead we handle the f_dir_pos and f_size in dir_next_dir(),
-        // the f_dir_pos represents a file number rather than an offset
-        if(!dir_next_dir(info))
+        if(!next_tar_header(info))
         {
             return false;
         }
-        switch(info.get_file_type())
+        if(member_name(info.get_filename()) == canonical)
         {
-        case file_info::regular_file:
-        case file_info::continuous: // this should not happen
-            if(data != NULL) {
-                // user wants a copy of the data!
-                data->read_file(info.get_filename());
-            }
-            break;
-
-        default:
-            // ignore special files and directories
-            break;
-
+            next_tar_data(info, data);
+            return true;
         }
-        return true;
+        next_tar_data(info, NULL);
+    }
+}
 
-    case file_format_ar:
-        dir_next_ar(info);
-        block_size = 2;
-        break;
 
-    case file_format_tar:
-        if(!dir_next_tar(info))
+/** \brief Read the header of the next file of a tarball.
+ *
+ * \param[out] info  The information about the file.
+ *
+ * \return false once the end of the tarball is reached.
+ */
+bool memory_file::decompressor::next_tar_header(file_info& info)
+{
+    info.reset();
+
+    // the headers of one file, including the GNU and PaxHeader extensions,
+    // are gathered in a small tarball parsed by dir_next_tar()
+    memory_file headers;
+    headers.create(file_format_tar);
+    int offset(0);
+    for(;;)
+    {
+        char p[512];
+        const int sz(read(p, sizeof(p)));
+        if(sz == 0)
         {
+            // end of the tarball without the empty blocks
             return false;
         }
-        block_size = 512;
-        break;
-
-    case file_format_wpkg:
-        // data read by dir_next_wpkg() if required
-        dir_next_wpkg(info, data);
-        return true;
-
-    case file_format_meta:
-        if(!dir_next_meta(info))
+        if(sz != static_cast<int>(sizeof(p)))
+        {
+            throw memfile_exception_io("tar header out of bounds (invalid size)");
+        }
+        bool empty(true);
+        for(const char *e(p); e < p + sizeof(p); ++e)
+        {
+            if(*e != 0)
+            {
+                empty = false;
+                break;
+            }
+        }
+        if(empty)
         {
+            // the end of a tarball is marked by empty blocks
             return false;
         }
-        break;
-
-    default:
-        throw memfile_exception_compatibility("you cannot read a directory from a file that is not an archive");
+        headers.write(p, offset, sizeof(p));
+        offset += static_cast<int>(sizeof(p));
+        if(p[156] != 'K' && p[156] != 'L' && p[156] != 'x')
+        {
+            break;
+        }
 
+        // the data of the extension follows its header
+        const int adjusted_size((file_info::str_to_int(p + 124, 12, 8) + 511) & ~511);
+        if(adjusted_size > 0)
+        {
+            std::vector<char> extension(adjusted_size);
+            if(read(&extension[0], adjusted_size) != adjusted_size)
+            {
+                throw memfile_exception_io("archive file data out of bounds when reading a tar extension (invalid size)");
+            }
+            headers.write(&extension[0], offset, adjusted_size);
+            offset += adjusted_size;
+        }
     }
 
-    int adjusted_size((info.get_size() + block_size - 1) & ~(block_size - 1));
-    if(f_dir_pos + adjusted_size > f_buffer.size())
-    {
-        info.set_size(0);
-        throw memfile_exception_io("archive file data out of bounds (invalid size)");
-    }
+    return headers.dir_next_tar(info);
+}
+
 
+/** \brief Read the data of a file of a tarball.
+ *
+ * This function reads the data of the file which header was just read
+ * by next_tar_header(). When \p data is NULL, the data is skipped.
+ *
+ * \param[in,out] info  The information about the file.
+ * \param[out] data  The data of the file if not NULL.
+ */
+void memory_file::decompressor::next_tar_data(file_info& info, memory_file *data)
+{
     // the size counts only if the file is a regular file or continuous
-    switch(info.get_file_type()) {
+    switch(info.get_file_type())
+    {
     case file_info::regular_file:
     case file_info::continuous:
-        if(data != NULL)
-        {
-            // user wants a copy of the data!
-            data->create(f_buffer.data_to_format(f_dir_pos, info.get_size()));
-            char buf[block_manager::BLOCK_MANAGER_BUFFER_SIZE];
-            int in_offset(f_dir_pos);
-            int out_offset(0);
-            int sz(info.get_size());
-            while(sz >= block_manager::BLOCK_MANAGER_BUFFER_SIZE)
-            {
-                f_buffer.read(buf, in_offset, block_manager::BLOCK_MANAGER_BUFFER_SIZE);
-                data->write(buf, out_offset, block_manager::BLOCK_MANAGER_BUFFER_SIZE);
-                in_offset += block_manager::BLOCK_MANAGER_BUFFER_SIZE;
-                out_offset += block_manager::BLOCK_MANAGER_BUFFER_SIZE;
-                sz -= block_manager::BLOCK_MANAGER_BUFFER_SIZE;
-            }
-            if(sz > 0) {
-                f_buffer.read(buf, in_offset, sz);
-                data->write(buf, out_offset, sz);
-            }
-        }
-
-        f_dir_pos += adjusted_size;
         break;
 
     default:
         // by special files or directory data have no data per se
-        break;
+        return;
 
     }
 
-    return true;
+    const int size(info.get_size());
+    const int adjusted_size((size + 511) & ~511);
+    int left(size);
+    if(data != NULL)
+    {
+        data->create(file_format_other);
+        char buf[1024 * 64];
+        while(left > 0)
+        {
+            const int sz(read(buf, std::min(left, static_cast<int>(sizeof(buf)))));
+            if(sz == 0)
+            {
+                break;
+            }
+            data->write(buf, size - left, sz);
+            left -= sz;
+        }
+        data->guess_format_from_data();
+    }
+    else
+    {
+        left -= skip(size);
+    }
+    if(left != 0 || skip(adjusted_size - size) != adjusted_size - size)
+    {
+        info.set_size(0);
+        throw memfile_exception_io("archive file data out of bounds (invalid size)");
+    }
 }
 
+
 int memory_file::dir_size(const wpkg_filename::uri_filename& path, int& disk_size, int block_size)
 {
     int byte_size(0);
@@ -2349,20 +3440,14 @@ void memory_file::raw_md5sum(md5::raw_md5sum& raw) const
     }
     md5::md5sum sum;
 
-    char buf[block_manager::BLOCK_MANAGER_BUFFER_SIZE];
+    // hash the blocks in place
     int offset(0);
-    int sz(f_buffer.size());
-    while(sz >= block_manager::BLOCK_MANAGER_BUFFER_SIZE)
-    {
-        f_buffer.read(buf, offset, block_manager::BLOCK_MANAGER_BUFFER_SIZE);
-        sum.push_back(reinterpret_cast<uint8_t *>(buf), block_manager::BLOCK_MANAGER_BUFFER_SIZE);
-        offset += block_manager::BLOCK_MANAGER_BUFFER_SIZE;
-        sz -= block_manager::BLOCK_MANAGER_BUFFER_SIZE;
-    }
-    if(sz > 0)
+    while(offset < f_buffer.size())
     {
-        f_buffer.read(buf, offset, sz);
-        sum.push_back(reinterpret_cast<uint8_t *>(buf), sz);
+        int size;
+        const char *data(f_buffer.data_at(offset, size));
+        sum.push_back(reinterpret_cast<const uint8_t *>(data), size);
+        offset += size;
     }
 
     sum.raw_sum(raw);
@@ -2377,23 +3462,63 @@ std::string memory_file::md5sum() const
 
     md5::md5sum sum;
 
-    char buf[block_manager::BLOCK_MANAGER_BUFFER_SIZE];
+    // hash the blocks in place
     int offset(0);
-    int sz(f_buffer.size());
-    while(sz >= block_manager::BLOCK_MANAGER_BUFFER_SIZE)
+    while(offset < f_buffer.size())
     {
-        f_buffer.read(buf, offset, block_manager::BLOCK_MANAGER_BUFFER_SIZE);
-        sum.push_back(reinterpret_cast<uint8_t *>(buf), block_manager::BLOCK_MANAGER_BUFFER_SIZE);
-        offset += block_manager::BLOCK_MANAGER_BUFFER_SIZE;
-        sz -= block_manager::BLOCK_MANAGER_BUFFER_SIZE;
+        int size;
+        const char *data(f_buffer.data_at(offset, size));
+        sum.push_back(reinterpret_cast<const uint8_t *>(data), size);
+        offset += size;
     }
-    if(sz > 0)
+
+    return sum.sum();
+}
+
+void memory_file::raw_sha256sum(sha256::raw_sha256sum& raw) const
+{
+    md5::raw_md5sum ignore;
+    raw_checksums(ignore, raw);
+}
+
+std::string memory_file::sha256sum() const
+{
+    sha256::raw_sha256sum raw;
+    raw_sha256sum(raw);
+    return sha256::sha256sum::sum(raw);
+}
+
+/** \brief Compute the md5sum and the sha256sum of the file.
+ *
+ * This function computes both checksums while reading the data of the
+ * file only once. This is used whenever a package or an index saves
+ * both checksums.
+ *
+ * \param[out] md5  The raw md5sum of the file.
+ * \param[out] sha256  The raw sha256sum of the file.
+ */
+void memory_file::raw_checksums(md5::raw_md5sum& md5, sha256::raw_sha256sum& sha256) const
+{
+    if(!f_created && !f_loaded)
     {
-        f_buffer.read(buf, offset, sz);
-        sum.push_back(reinterpret_cast<uint8_t *>(buf), sz);
+        throw memfile_exception_undefined("you cannot compute a checksum from an undefined file");
     }
+    md5::md5sum md5_sum;
+    sha256::sha256sum sha256_sum;
 
-    return sum.sum();
+    // hash the blocks in place
+    int offset(0);
+    while(offset < f_buffer.size())
+    {
+        int size;
+        const char *data(f_buffer.data_at(offset, size));
+        md5_sum.push_back(reinterpret_cast<const uint8_t *>(data), size);
+        sha256_sum.push_back(reinterpret_cast<const uint8_t *>(data), size);
+        offset += size;
+    }
+
+    md5_sum.raw_sum(md5);
+    sha256_sum.raw_sum(sha256);
 }
 
 void memory_file::compress_to_gz(memory_file& result, int zlevel) const
@@ -2982,6 +4107,15 @@ void memory_file::dir_next_wpkg(file_info& info, memory_file *data) const
     md5::raw_md5sum raw;
     std::copy( header->f_md5sum, header->f_md5sum + md5::raw_md5sum::MD5SUM_RAW_BUFSIZ, raw.f_sum );
     info.set_raw_md5sum(raw);
+    // older wpkgar files have zeroes in place of the sha256sum
+    if(std::find_if(header->f_sha256sum, header->f_sha256sum + sha256::raw_sha256sum::SHA256SUM_RAW_BUFSIZ,
+                    [](const controlled_vars::zuchar_t& c) { return c != 0; })
+            != header->f_sha256sum + sha256::raw_sha256sum::SHA256SUM_RAW_BUFSIZ)
+    {
+        sha256::raw_sha256sum raw_sha256;
+        std::copy( header->f_sha256sum, header->f_sha256sum + sha256::raw_sha256sum::SHA256SUM_RAW_BUFSIZ, raw_sha256.f_sum );
+        info.set_raw_sha256sum(raw_sha256);
+    }
     info.set_original_compression(
         static_cast<wpkgar::wpkgar_block_t::wpkgar_compression_t>( static_cast<uint8_t>(header->f_original_compression) ) );
 
@@ -3891,8 +5025,11 @@ void memory_file::append_wpkg(const file_info& info, const memory_file& data)
             header.f_type = wpkgar::wpkgar_block_t::WPKGAR_TYPE_REGULAR;
         }
 
-        // for regular files, compute their md5sum
-        if(data.f_created || data.f_loaded)
+        // for regular files, compute their md5sum; the sha256sum is only
+        // saved when the caller already computed it (i.e. the package has
+        // a sha256sums control file) otherwise it is left as zeroes
+        if((data.f_created || data.f_loaded)
+        && !info.is_field_defined(file_info::field_name_raw_sha256sum))
         {
             md5::raw_md5sum sum;
             data.raw_md5sum(sum);
@@ -3901,6 +5038,10 @@ void memory_file::append_wpkg(const file_info& info, const memory_file& data)
         else
         {
             std::copy( info.get_raw_md5sum().f_sum, info.get_raw_md5sum().f_sum + sizeof(header.f_md5sum), header.f_md5sum );
+            if(info.is_field_defined(file_info::field_name_raw_sha256sum))
+            {
+                std::copy( info.get_raw_sha256sum().f_sum, info.get_raw_sha256sum().f_sum + sizeof(header.f_sha256sum), header.f_sha256sum );
+            }
         }
         break;
 
@@ -4036,6 +5177,7 @@ void memory_file::file_info::reset()
     f_dev_major = 0;
     f_dev_minor = 0;
     // f_raw_md5sum -- there isn't a clear for this one (necessary?)
+    // f_raw_sha256sum -- same, see is_field_defined()
     f_original_compression = wpkgar::wpkgar_block_t::WPKGAR_COMPRESSION_NONE;
 }
 
@@ -4191,6 +5333,11 @@ const md5::raw_md5sum& memory_file::file_info::get_raw_md5sum() const
     return f_raw_md5sum;
 }
 
+const sha256::raw_sha256sum& memory_file::file_info::get_raw_sha256sum() const
+{
+    return f_raw_sha256sum;
+}
+
 wpkgar::wpkgar_block_t::wpkgar_compression_t memory_file::file_info::get_original_compression() const
 {
     return f_original_compression;
@@ -4399,6 +5546,12 @@ void memory_file::file_info::set_raw_md5sum(md5::raw_md5sum& raw)
     set_field(field_name_raw_md5sum);
 }
 
+void memory_file::file_info::set_raw_sha256sum(const sha256::raw_sha256sum& raw)
+{
+    f_raw_sha256sum = raw;
+    set_field(field_name_raw_sha256sum);
+}
+
 void memory_file::file_info::set_original_compression(wpkgar::wpkgar_block_t::wpkgar_compression_t original_compression)
 {
     f_original_compression = original_compression;
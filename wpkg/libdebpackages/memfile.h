@@ -28,11 +28,18 @@
  * used to read files from disk or via HTTP and write files to disk.
  */
 #include    "md5.h"
+#include    "sha256.h"
 #include    "wpkgar_block.h"
 #include    "libdebpackages/wpkg_filename.h"
 #include    "controlled_vars/controlled_vars_auto_enum_init.h"
 #include    "controlled_vars/controlled_vars_limited_auto_enum_init.h"
 
+#include    <map>
+
+
+namespace wpkg_http {
+class http_response;
+}
 
 namespace memfile {
 
@@ -103,6 +110,7 @@ public:
             field_name_dev_minor,
             field_name_raw_md5sum,
             field_name_original_compression,
+            field_name_raw_sha256sum,
             field_name_max
         };
 
@@ -149,6 +157,7 @@ public:
         int get_dev_major() const;
         int get_dev_minor() const;
         const md5::raw_md5sum& get_raw_md5sum() const;
+        const sha256::raw_sha256sum& get_raw_sha256sum() const;
         wpkgar::wpkgar_block_t::wpkgar_compression_t get_original_compression() const;
 
         void set_uri(const wpkg_filename::uri_filename& uri);
@@ -181,6 +190,7 @@ public:
         void set_dev_minor(int dev);
         void set_dev_minor(const char *d, int max_size, int base);
         void set_raw_md5sum(md5::raw_md5sum& raw);
+        void set_raw_sha256sum(const sha256::raw_sha256sum& raw);
         void set_original_compression(wpkgar::wpkgar_block_t::wpkgar_compression_t original_compression);
 
         static int strnlen(const char *s, int n);
@@ -206,6 +216,7 @@ public:
         int                     f_dev_major;
         int                     f_dev_minor;
         md5::raw_md5sum         f_raw_md5sum;
+        sha256::raw_sha256sum   f_raw_sha256sum;
         wpkgar::wpkgar_block_t::wpkgar_compression_t f_original_compression;
     };
 
@@ -246,28 +257,65 @@ public:
         ~block_manager();
 
         void clear();
+        void swap(block_manager& rhs);
+        void reserve(int size);
         int size() const { return f_size; }
+        void share(const block_manager& source, int offset, int size);
         int read(char *buffer, int offset, int size) const;
+        const char *data_at(int offset, int& size) const;
         int write(const char *buffer, int offset, int size);
         int compare(const block_manager& rhs) const;
 
         file_format_t data_to_format(int offset, int size) const;
 
     private:
-        typedef std::vector<char>           buffer_t;
-        typedef std::vector<buffer_t>       buffer_list_t;
+        typedef std::shared_ptr<char>       shared_buffer_t;
+        typedef std::vector<shared_buffer_t> buffer_list_t;
 
+        static shared_buffer_t new_block();
+        char *writable_at(int offset, int& size);
+
+        controlled_vars::zint32_t           f_offset;
         controlled_vars::zint32_t           f_size;
         controlled_vars::zint32_t           f_available_size;
         buffer_list_t                       f_buffers;
     };
 
+    class DEBIAN_PACKAGE_EXPORT decompressor
+    {
+    public:
+        decompressor(const memory_file& source);
+
+        int read(char *buffer, int size);
+        int skip(int size);
+        int tell() const;
+        bool next_tar(file_info& info, memory_file *data = NULL);
+        bool find_tar(const std::string& name, file_info& info, memory_file *data = NULL);
+
+    private:
+        class stream;
+
+        bool next_tar_header(file_info& info);
+        void next_tar_data(file_info& info, memory_file *data);
+
+        // disallow copying
+        decompressor(const decompressor& rhs);
+        decompressor& operator = (const decompressor& rhs);
+
+        std::shared_ptr<stream>             f_stream;
+        controlled_vars::zint32_t           f_offset;
+    };
+
     static const int file_info_throw = 0x00;
     static const int file_info_return_errors = 0x01;
     static const int file_info_permissions_error = 0x02;
     static const int file_info_owner_error = 0x04;
 
+    static const int HTTP_RESUME_ATTEMPTS = 5;
+
     memory_file();
+    memory_file(memory_file&& rhs);
+    memory_file& operator = (memory_file&& rhs);
 
     // filename handling
     void set_filename(const wpkg_filename::uri_filename& filename);
@@ -283,6 +331,7 @@ public:
 
     // read from and write to disk
     void read_file(const wpkg_filename::uri_filename& filename, file_info *info = NULL);
+    void resume_file(const wpkg_filename::uri_filename& filename, const wpkg_filename::uri_filename& partial, int expected_size = -1);
     void write_file(const wpkg_filename::uri_filename& filename, bool create_folders = false, bool force = false) const;
     void copy(memory_file& destination) const;
     int compare(const memory_file& rhs) const;
@@ -298,7 +347,9 @@ public:
     void end_archive();
     int read(char *buffer, int offset, int bufsize) const;
     bool read_line(int& offset, std::string& result) const;
+    bool read_line(int& offset, const char *& line, int& length, std::string& buffer) const;
     int write(const char *buffer, const int offset, const int bufsize);
+    void reserve(int size);
     void printf(const char *format, ...);
     void append_file(const file_info& info, const memory_file& data);
     int size() const;
@@ -308,6 +359,7 @@ public:
     void dir_rewind(const wpkg_filename::uri_filename& path = wpkg_filename::uri_filename(), bool recursive = true);
     int dir_pos() const;
     bool dir_next(file_info& info, memory_file *data = NULL) const;
+    bool dir_find(const std::string& name, file_info& info, memory_file *data = NULL) const;
     int dir_size(const wpkg_filename::uri_filename& path, int& disk_size, int block_size = 512);
     void set_package_path(const wpkg_filename::uri_filename& path);
     static void disk_file_to_info(const wpkg_filename::uri_filename& filename, file_info& info);
@@ -317,8 +369,17 @@ public:
     void raw_md5sum(md5::raw_md5sum& raw) const;
     std::string md5sum() const;
 
+    // compute sha256sum of the entire file
+    void raw_sha256sum(sha256::raw_sha256sum& raw) const;
+    std::string sha256sum() const;
+
+    // compute md5sum and sha256sum in one pass
+    void raw_checksums(md5::raw_md5sum& md5, sha256::raw_sha256sum& sha256) const;
+
 private:
     typedef controlled_vars::limited_auto_enum_init<file_format_t, file_format_undefined, file_format_other, file_format_undefined>  safe_file_format_t;
+    typedef std::map<std::string, int>          member_index_t;
+    typedef controlled_vars::auto_init<int32_t, -1> member_index_size_t;
 
     memory_file(const memory_file&);
     memory_file& operator = (memory_file&);
@@ -326,6 +387,7 @@ private:
     void compress_to_bz2(memory_file& result, int zlevel) const;
     void decompress_from_gz(memory_file& result) const;
     void decompress_from_bz2(memory_file& result) const;
+    static void read_http(const wpkg_filename::uri_filename& filename, file_info *info, wpkg_http::http_response& response, memory_file& body, int offset, const std::string& if_range);
     bool dir_next_dir(file_info& info) const;
     void dir_next_ar(file_info& info) const;
     bool dir_next_tar(file_info& info) const;
@@ -333,6 +395,7 @@ private:
     void dir_next_wpkg(file_info& info, memory_file *data) const;
     bool dir_next_meta(file_info& info) const;
     bool dir_next_sources(file_info& info) const;
+    void build_member_index() const;
     void append_ar(const file_info& info, const memory_file& data);
     void append_tar(const file_info& info, const memory_file& data);
     void append_tar_write(const file_info& info, const memory_file& data);
@@ -348,6 +411,8 @@ private:
     mutable std::shared_ptr<wpkg_filename::os_dir>   f_dir;
     mutable std::vector<std::shared_ptr<wpkg_filename::os_dir> >  f_dir_stack;
     mutable controlled_vars::zint32_t           f_dir_pos;
+    mutable member_index_size_t                 f_member_index_size;
+    mutable member_index_t                      f_member_index;
     block_manager                               f_buffer;
     wpkg_filename::uri_filename                 f_package_path;
 };
@@ -0,0 +1,322 @@
+// Copyright (c) 2007-2015  Made to Order Software Corporation
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+/** \file
+ * \brief A SHA-256 implementation to compute a strong checksum.
+ *
+ * This file includes all the necessary functions used to compute
+ * a SHA-256 checksum as defined in FIPS 180-4. Contrary to the md5sum,
+ * this checksum is considered secure and thus it is used to verify the
+ * integrity of the files of a package when it gets installed.
+ */
+#include    "libdebpackages/sha256.h"
+#include    <string.h>
+
+namespace sha256
+{
+
+
+namespace {
+
+/** \brief The SHA-256 round constants.
+ *
+ * These are the first 32 bits of the fractional parts of the cube roots
+ * of the first 64 prime numbers.
+ */
+const uint32_t g_k[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+/** \brief The size of one SHA-256 block in bytes.
+ */
+const size_t SHA256_BLOCK_SIZE = 64;
+
+
+/** \brief Do a ror on 32 bits values.
+ *
+ * \param[in] value  The value to be rolled.
+ * \param[in] shift  The number of bits to roll, between 1 and 31.
+ *
+ * \return The roll of value by shift to the right.
+ */
+inline uint32_t ror(uint32_t value, uint32_t shift)
+{
+    return (value >> shift) | (value << (32 - shift));
+}
+
+
+/** \brief Read a big endian 32 bit value.
+ *
+ * \param[in] p  The pointer to the 4 bytes to read.
+ *
+ * \return The 32 bit value.
+ */
+inline uint32_t load_be32(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24)
+         | (static_cast<uint32_t>(p[1]) << 16)
+         | (static_cast<uint32_t>(p[2]) << 8)
+         |  static_cast<uint32_t>(p[3]);
+}
+
+
+/** \brief Apply the SHA-256 compression function on consecutive blocks.
+ *
+ * \param[in,out] state  The H0 to H7 state of a sha256sum.
+ * \param[in] data  The bytes to transform.
+ * \param[in] count  The number of 64 bytes blocks in \p data.
+ */
+void transform_blocks(uint32_t state[8], const uint8_t *data, size_t count)
+{
+    uint32_t w[64];
+    for(; count > 0; --count, data += SHA256_BLOCK_SIZE)
+    {
+        for(int i(0); i < 16; ++i)
+        {
+            w[i] = load_be32(data + i * 4);
+        }
+        for(int i(16); i < 64; ++i)
+        {
+            const uint32_t s0(ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3));
+            const uint32_t s1(ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10));
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a(state[0]);
+        uint32_t b(state[1]);
+        uint32_t c(state[2]);
+        uint32_t d(state[3]);
+        uint32_t e(state[4]);
+        uint32_t f(state[5]);
+        uint32_t g(state[6]);
+        uint32_t h(state[7]);
+
+        for(int i(0); i < 64; ++i)
+        {
+            const uint32_t s1(ror(e, 6) ^ ror(e, 11) ^ ror(e, 25));
+            const uint32_t ch(g ^ (e & (f ^ g)));
+            const uint32_t t1(h + s1 + ch + g_k[i] + w[i]);
+            const uint32_t s0(ror(a, 2) ^ ror(a, 13) ^ ror(a, 22));
+            const uint32_t maj((a & b) | (c & (a | b)));
+            const uint32_t t2(s0 + maj);
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+}        // private namespace
+
+
+
+/** \class sha256sum
+ * \brief The sha256sum class allows for an in place computation of a SHA-256 checksum.
+ *
+ * This class works exactly like the md5::md5sum class. The data is added
+ * with push_back() and the checksum can be retrieved at any time with
+ * sum() or raw_sum().
+ */
+
+
+/** \class raw_sha256sum
+ * \brief Handle raw SHA-256 checksums.
+ *
+ * The raw checksum is 32 bytes. It is used to compare checksums without
+ * having to convert them to hexadecimal. The wpkgar blocks save the
+ * checksum of files in this format.
+ */
+
+
+bool raw_sha256sum::operator == (const raw_sha256sum& rhs) const
+{
+    return memcmp(f_sum, rhs.f_sum, sizeof(f_sum)) == 0;
+}
+
+bool raw_sha256sum::operator != (const raw_sha256sum& rhs) const
+{
+    return !operator == (rhs);
+}
+
+
+/** \brief Initialize a sha256sum object.
+ *
+ * The object is set to the empty file checksum.
+ */
+sha256sum::sha256sum()
+{
+    clear();
+}
+
+
+void sha256sum::clear()
+{
+    f_size = 0;
+
+    f_state[0] = 0x6a09e667;
+    f_state[1] = 0xbb67ae85;
+    f_state[2] = 0x3c6ef372;
+    f_state[3] = 0xa54ff53a;
+    f_state[4] = 0x510e527f;
+    f_state[5] = 0x9b05688c;
+    f_state[6] = 0x1f83d9ab;
+    f_state[7] = 0x5be0cd19;
+
+    f_pos = 0;
+}
+
+
+bool sha256sum::empty() const
+{
+    return f_size == 0;
+}
+
+
+uint64_t sha256sum::size() const
+{
+    return f_size;
+}
+
+
+/** \brief Add data to the sha256sum.
+ *
+ * This function adds \p data_size bytes to the checksum. Whole blocks
+ * are transformed directly from \p data; only the bytes of an incomplete
+ * block are copied in the internal buffer.
+ *
+ * \param[in] data  The bytes to add to the sha256sum.
+ * \param[in] data_size  The number of bytes in \p data.
+ */
+void sha256sum::push_back(const uint8_t *data, size_t data_size)
+{
+    f_size += data_size;
+
+    if(f_pos != 0)
+    {
+        size_t size(SHA256_BLOCK_SIZE - f_pos);
+        if(size > data_size)
+        {
+            size = data_size;
+        }
+        memcpy(f_buffer + f_pos, data, size);
+        f_pos += static_cast<uint32_t>(size);
+        data += size;
+        data_size -= size;
+        if(f_pos < SHA256_BLOCK_SIZE)
+        {
+            return;
+        }
+        transform_blocks(f_state, f_buffer, 1);
+        f_pos = 0;
+    }
+
+    const size_t count(data_size / SHA256_BLOCK_SIZE);
+    if(count > 0)
+    {
+        transform_blocks(f_state, data, count);
+        data += count * SHA256_BLOCK_SIZE;
+        data_size -= count * SHA256_BLOCK_SIZE;
+    }
+
+    if(data_size > 0)
+    {
+        memcpy(f_buffer, data, data_size);
+        f_pos = static_cast<uint32_t>(data_size);
+    }
+}
+
+
+void sha256sum::raw_sum(raw_sha256sum& raw) const
+{
+    // work on a copy so the sum remains incremental
+    uint32_t state[8];
+    memcpy(state, f_state, sizeof(state));
+
+    // 0x80 closes the stream, then zeroes, then the size in bits
+    uint8_t last[SHA256_BLOCK_SIZE * 2];
+    memcpy(last, f_buffer, f_pos);
+    last[f_pos] = 0x80;
+    const size_t blocks(f_pos >= SHA256_BLOCK_SIZE - 8 ? 2 : 1);
+    const size_t end(blocks * SHA256_BLOCK_SIZE);
+    memset(last + f_pos + 1, 0, end - f_pos - 1);
+    const uint64_t bit_size(f_size * 8);
+    for(int i(0); i < 8; ++i)
+    {
+        last[end - 1 - i] = static_cast<uint8_t>(bit_size >> (i * 8));
+    }
+    transform_blocks(state, last, blocks);
+
+    for(int i(0); i < 8; ++i)
+    {
+        raw.f_sum[i * 4 + 0] = static_cast<uint8_t>(state[i] >> 24);
+        raw.f_sum[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
+        raw.f_sum[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
+        raw.f_sum[i * 4 + 3] = static_cast<uint8_t>(state[i]);
+    }
+}
+
+
+std::string sha256sum::sum(const raw_sha256sum& raw)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    char buf[raw_sha256sum::SHA256SUM_RAW_BUFSIZ * 2 + 1];
+    for(int i(0); i < raw_sha256sum::SHA256SUM_RAW_BUFSIZ; ++i)
+    {
+        buf[i * 2 + 0] = hex[(raw.f_sum[i] >> 4) & 15];
+        buf[i * 2 + 1] = hex[raw.f_sum[i] & 15];
+    }
+    buf[sizeof(buf) - 1] = '\0';
+
+    return buf;
+}
+
+
+std::string sha256sum::sum() const
+{
+    raw_sha256sum raw;
+    raw_sum(raw);
+    return sum(raw);
+}
+
+
+
+}    // namespace sha256
+// vim: ts=4 sw=4 et
@@ -0,0 +1,87 @@
+// Copyright (c) 2007-2015  Made to Order Software Corporation
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+#ifndef SHA256_H
+#define SHA256_H
+
+/** \file
+ * \brief List of sha256 functions one can use to compute a SHA-256 checksum.
+ *
+ * This file has the sha256 class declaration. It offers the same interface
+ * as the md5sum class so both checksums can be computed in one pass over
+ * the data of a file.
+ *
+ * The SHA-256 checksum is saved along the md5sum in packages (sha256sums),
+ * in indexes (Package-sha256sum), and in the wpkgar blocks.
+ */
+#include    "debian_export.h"
+
+#include    <stdint.h>
+#include    <string>
+
+namespace sha256
+{
+
+struct DEBIAN_PACKAGE_EXPORT raw_sha256sum
+{
+    static const int SHA256SUM_RAW_BUFSIZ = 32;
+
+    bool operator == (const raw_sha256sum& rhs) const;
+    bool operator != (const raw_sha256sum& rhs) const;
+
+    uint8_t     f_sum[SHA256SUM_RAW_BUFSIZ];
+};
+
+
+// sha256 uses a context to offer an incremental interface
+//
+// Usage:
+//  sha256sum.clear() to reset any other sha256sum
+//  sha256sum.push_back(buffer, len) -- repeat as required
+//  // retrieve raw sum (32 bytes)
+//  raw_sha256sum raw;
+//  sha256sum.raw_sum(raw);
+//  // or for a string:
+//  sha256sum_str = sha256sum.sum();
+//
+class DEBIAN_PACKAGE_EXPORT sha256sum
+{
+public:
+
+                        sha256sum();
+
+    void                clear();
+    bool                empty() const;
+    uint64_t            size() const;
+    void                push_back(const uint8_t *data, size_t size);
+    void                raw_sum(raw_sha256sum& raw) const;
+    std::string         sum() const;
+    static std::string  sum(const raw_sha256sum& raw);
+
+private:
+    uint64_t            f_size;         // byte size
+
+    uint32_t            f_state[8];     // H0 to H7
+
+    uint32_t            f_pos;          // buffer index
+    uint8_t             f_buffer[64];
+};
+
+
+
+}   // namespace sha256
+#endif
+// vim: ts=4 sw=4 et
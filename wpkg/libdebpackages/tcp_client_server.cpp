@@ -350,6 +350,9 @@ int tcp_client::write(const char *buf, size_t size)
 {
 #ifdef _MSC_VER
     return ::send(f_socket, buf, static_cast<int>(size), 0);
+#elif defined(MSG_NOSIGNAL)
+    // do not get killed by a SIGPIPE if the server closed the connection
+    return ::send(f_socket, buf, size, MSG_NOSIGNAL);
 #else
     return ::write(f_socket, buf, size);
 #endif
@@ -37,7 +37,9 @@
  */
 #include    "libdebpackages/wpkg_architecture.h"
 
+#include    <algorithm>
 #include    <iostream>
+#include    <string.h>
 
 
 /** \brief The architecture namespace.
@@ -259,6 +261,167 @@ const architecture::processor_t arch_processor[] =
 };
 
 
+/** \brief Perfect hash table of the names of one of the lists.
+ *
+ * The table is built once, the first time it is needed. The constructor
+ * searches for a hash seed which gives each name its own slot so a
+ * search is one hash and one string comparison.
+ *
+ * C++11 constexpr functions are too limited to build the table at
+ * compile time, building it on first use is the next best thing.
+ */
+class name_table
+{
+public:
+    static const size_t         TABLE_SIZE = 128;   // must be a power of 2
+
+    template<class T>
+    name_table(const T *list, const char * const T::*name)
+        : f_seed(0)
+    {
+        for(; f_seed < 1000; ++f_seed)
+        {
+            std::fill(f_slots, f_slots + TABLE_SIZE, -1);
+            bool perfect(true);
+            for(int i(0); list[i].*name != NULL; ++i)
+            {
+                const size_t slot(hash(list[i].*name, strlen(list[i].*name)));
+                if(f_slots[slot] != -1)
+                {
+                    perfect = false;
+                    break;
+                }
+                f_slots[slot] = static_cast<signed char>(i);
+                f_names[slot] = list[i].*name;
+            }
+            if(perfect)
+            {
+                return;
+            }
+        }
+        throw std::logic_error("no perfect hash could be found for an architecture table");
+    }
+
+    int find(const std::string& name) const
+    {
+        const size_t slot(hash(name.c_str(), name.length()));
+        const int idx(f_slots[slot]);
+        return idx != -1 && name == f_names[slot] ? idx : -1;
+    }
+
+private:
+    size_t hash(const char *name, size_t length) const
+    {
+        // FNV-1a
+        uint32_t h(2166136261U ^ f_seed);
+        for(size_t i(0); i < length; ++i)
+        {
+            h = (h ^ static_cast<unsigned char>(name[i])) * 16777619U;
+        }
+        return (h ^ (h >> 16)) & (TABLE_SIZE - 1);
+    }
+
+    uint32_t                    f_seed;
+    signed char                 f_slots[TABLE_SIZE];
+    const char *                f_names[TABLE_SIZE];
+};
+
+const size_t name_table::TABLE_SIZE;
+
+
+const name_table& abbreviation_table()
+{
+    static const name_table table(arch_abbreviation, &architecture::abbreviation_t::f_abbreviation);
+    return table;
+}
+
+
+const name_table& os_table()
+{
+    static const name_table table(arch_os, &architecture::os_t::f_name);
+    return table;
+}
+
+
+const name_table& processor_table()
+{
+    static const name_table table(arch_processor, &architecture::processor_t::f_name);
+    return table;
+}
+
+
+/** \brief Layout of the architecture triplets.
+ *
+ * An architecture is packed in one integer: the index of the operating
+ * system in arch_os, the index of the processor in arch_processor, and
+ * a vendor code. "any" is the first entry of both lists and the "any"
+ * vendor code is also zero so a field set to zero is a pattern.
+ *
+ * Vendors are free form names; only the well known ones get their own
+ * code, the others need the vendor strings to be compared.
+ */
+const uint32_t TRIPLET_OS_MASK          = 0x0000FF;
+const uint32_t TRIPLET_PROCESSOR_MASK   = 0x00FF00;
+const uint32_t TRIPLET_VENDOR_MASK      = 0xFF0000;
+const int      TRIPLET_PROCESSOR_SHIFT  = 8;
+const int      TRIPLET_VENDOR_SHIFT     = 16;
+
+const uint32_t TRIPLET_ID_ANY           = 0x00;
+const uint32_t TRIPLET_ID_ALL           = 0xFD;
+const uint32_t TRIPLET_ID_SOURCE        = 0xFE;
+const uint32_t TRIPLET_ID_EMPTY         = 0xFF;
+
+const uint32_t TRIPLET_VENDOR_ANY       = 0x00;
+const uint32_t TRIPLET_VENDOR_UNKNOWN   = 0x01;
+const uint32_t TRIPLET_VENDOR_ALL       = 0x02;
+const uint32_t TRIPLET_VENDOR_OTHER     = 0x03;
+const uint32_t TRIPLET_VENDOR_EMPTY     = 0xFF;
+
+
+uint32_t make_triplet(uint32_t os, uint32_t vendor, uint32_t processor)
+{
+    return os | (processor << TRIPLET_PROCESSOR_SHIFT) | (vendor << TRIPLET_VENDOR_SHIFT);
+}
+
+
+uint32_t vendor_code(const std::string& vendor)
+{
+    if(vendor == "any")
+    {
+        return TRIPLET_VENDOR_ANY;
+    }
+    if(vendor == architecture::UNKNOWN_VENDOR)
+    {
+        return TRIPLET_VENDOR_UNKNOWN;
+    }
+    if(vendor == "all")
+    {
+        return TRIPLET_VENDOR_ALL;
+    }
+    return TRIPLET_VENDOR_OTHER;
+}
+
+
+bool is_pattern_triplet(uint32_t triplet)
+{
+    return (triplet & TRIPLET_OS_MASK) == TRIPLET_ID_ANY
+        || (triplet & TRIPLET_PROCESSOR_MASK) == (TRIPLET_ID_ANY << TRIPLET_PROCESSOR_SHIFT)
+        || (triplet & TRIPLET_VENDOR_MASK) == (TRIPLET_VENDOR_ANY << TRIPLET_VENDOR_SHIFT);
+}
+
+
+/** \brief Mask of the fields a pattern cares about.
+ *
+ * The operating system and processor fields set to "any" match anything
+ * so they are not part of the mask.
+ */
+uint32_t pattern_mask(uint32_t triplet)
+{
+    return ((triplet & TRIPLET_OS_MASK) == TRIPLET_ID_ANY ? 0 : TRIPLET_OS_MASK)
+         | ((triplet & TRIPLET_PROCESSOR_MASK) == (TRIPLET_ID_ANY << TRIPLET_PROCESSOR_SHIFT) ? 0 : TRIPLET_PROCESSOR_MASK);
+}
+
+
 
 } // no name namespace
 
@@ -412,12 +575,10 @@ bool architecture::valid_vendor(const std::string& vendor)
  */
 const architecture::abbreviation_t *architecture::find_abbreviation(const std::string& abbreviation)
 {
-    for(const abbreviation_t *a(arch_abbreviation); a->f_abbreviation != NULL; ++a)
+    const int idx(abbreviation_table().find(abbreviation));
+    if(idx != -1)
     {
-        if(abbreviation == a->f_abbreviation)
-        {
-            return a;
-        }
+        return arch_abbreviation + idx;
     }
 
     // unknown abbreviation
@@ -442,18 +603,15 @@ const architecture::abbreviation_t *architecture::find_abbreviation(const std::s
  */
 const architecture::os_t *architecture::find_os(const std::string& os)
 {
-    std::string operating_system(os);
     if(os == "win32" || os == "win64")
     {
         // backward compatibility
-        operating_system = "mswindows";
+        return find_os("mswindows");
     }
-    for(const os_t *o(arch_os); o->f_name != NULL; ++o)
+    const int idx(os_table().find(os));
+    if(idx != -1)
     {
-        if(operating_system == o->f_name)
-        {
-            return o;
-        }
+        return arch_os + idx;
     }
 
     // unknown operating system
@@ -477,14 +635,24 @@ const architecture::os_t *architecture::find_os(const std::string& os)
  */
 const architecture::processor_t *architecture::find_processor(const std::string& processor, bool extended)
 {
-    if(extended)
+    // the canonical names are checked first; none of them match the
+    // patterns of another processor appearing earlier in the list
+    const int idx(processor_table().find(processor));
+    if(idx != -1)
     {
-        // in this case the processor name may include invalid characters
-        // that would not be caught by the '*' in a pattern
-        if(!valid_vendor(processor))
-        {
-            return NULL;
-        }
+        return arch_processor + idx;
+    }
+    if(!extended)
+    {
+        // unknown processor
+        return NULL;
+    }
+
+    // in this case the processor name may include invalid characters
+    // that would not be caught by the '*' in a pattern
+    if(!valid_vendor(processor))
+    {
+        return NULL;
     }
 
     // we use a "filename" so that way we can test with glob() patterns
@@ -492,11 +660,7 @@ const architecture::processor_t *architecture::find_processor(const std::string&
     wpkg_filename::uri_filename processor_filename(processor);
     for(const processor_t *p(arch_processor); p->f_name != NULL; ++p)
     {
-        if(processor == p->f_name)
-        {
-            return p;
-        }
-        if(extended && p->f_other_names != NULL)
+        if(p->f_other_names != NULL)
         {
             const char *start(p->f_other_names);
             for(const char *s(start);; ++s)
@@ -600,6 +764,7 @@ architecture::architecture()
     //: f_os("") -- auto-init
     //, f_vendor("") -- auto-init
     //, f_processor("") -- auto-init
+    : f_triplet(make_triplet(TRIPLET_ID_EMPTY, TRIPLET_VENDOR_EMPTY, TRIPLET_ID_EMPTY))
     //, f_ignore_vendor(false) -- auto-init
 {
 }
@@ -621,7 +786,8 @@ architecture::architecture(const std::string& arch, bool ignore_vendor_field)
     //: f_os("") -- auto-init
     //, f_vendor("") -- auto-init
     //, f_processor("") -- auto-init
-    : f_ignore_vendor(ignore_vendor_field)
+    : f_triplet(make_triplet(TRIPLET_ID_EMPTY, TRIPLET_VENDOR_EMPTY, TRIPLET_ID_EMPTY))
+    , f_ignore_vendor(ignore_vendor_field)
 {
     if(!set(arch))
     {
@@ -640,6 +806,7 @@ architecture::architecture(const architecture& arch)
     : f_os(arch.f_os)
     , f_vendor(arch.f_vendor)
     , f_processor(arch.f_processor)
+    , f_triplet(arch.f_triplet)
     , f_ignore_vendor(arch.f_ignore_vendor)
 {
 }
@@ -654,7 +821,7 @@ architecture::architecture(const architecture& arch)
  */
 bool architecture::empty() const
 {
-    return f_os.empty() && f_vendor.empty() && f_processor.empty();
+    return f_triplet == make_triplet(TRIPLET_ID_EMPTY, TRIPLET_VENDOR_EMPTY, TRIPLET_ID_EMPTY);
 }
 
 
@@ -672,7 +839,7 @@ bool architecture::empty() const
  */
 bool architecture::is_pattern() const
 {
-    return f_os == "any" || f_vendor == "any" || f_processor == "any";
+    return is_pattern_triplet(f_triplet);
 }
 
 
@@ -686,7 +853,7 @@ bool architecture::is_pattern() const
  */
 bool architecture::is_source() const
 {
-    return f_processor == "source";
+    return (f_triplet & TRIPLET_PROCESSOR_MASK) == (TRIPLET_ID_SOURCE << TRIPLET_PROCESSOR_SHIFT);
 }
 
 
@@ -809,6 +976,7 @@ bool architecture::set(const std::string& arch)
         f_os = "";
         f_vendor = "";
         f_processor = "";
+        f_triplet = make_triplet(TRIPLET_ID_EMPTY, TRIPLET_VENDOR_EMPTY, TRIPLET_ID_EMPTY);
         return true;
     }
 
@@ -818,6 +986,7 @@ bool architecture::set(const std::string& arch)
         f_os = "all";
         f_vendor = "all";
         f_processor = "all";
+        f_triplet = make_triplet(TRIPLET_ID_ALL, TRIPLET_VENDOR_ALL, TRIPLET_ID_ALL);
         return true;
     }
 
@@ -827,6 +996,7 @@ bool architecture::set(const std::string& arch)
         f_os = "all";
         f_vendor = "all";
         f_processor = "source";
+        f_triplet = make_triplet(TRIPLET_ID_ALL, TRIPLET_VENDOR_ALL, TRIPLET_ID_SOURCE);
         return true;
     }
 
@@ -836,6 +1006,7 @@ bool architecture::set(const std::string& arch)
         f_os = "any";
         f_vendor = "any";
         f_processor = "any";
+        f_triplet = make_triplet(TRIPLET_ID_ANY, TRIPLET_VENDOR_ANY, TRIPLET_ID_ANY);
         return true;
     }
 
@@ -910,6 +1081,9 @@ bool architecture::set(const std::string& arch)
     f_os = co->f_name;
     f_vendor = vendor;
     f_processor = cp->f_name;
+    f_triplet = make_triplet(static_cast<uint32_t>(co - arch_os),
+                             vendor_code(vendor),
+                             static_cast<uint32_t>(cp - arch_processor));
 
     return true;
 }
@@ -1008,6 +1182,7 @@ architecture& architecture::operator = (const architecture& rhs)
         f_os = rhs.f_os;
         f_vendor = rhs.f_vendor;
         f_processor = rhs.f_processor;
+        f_triplet = rhs.f_triplet;
         f_ignore_vendor = rhs.f_ignore_vendor;
     }
 
@@ -1100,42 +1275,68 @@ bool architecture::operator == (const architecture& rhs) const
  */
 bool architecture::operator != (const architecture& rhs) const
 {
-    const bool pa(is_pattern());
-    const bool pb(rhs.is_pattern());
-    const bool iv(f_ignore_vendor || rhs.f_ignore_vendor);
+    return !match(rhs, false);
+}
+
+
+/** \brief Check whether two architectures match.
+ *
+ * This function is the implementation of the == and != operators. When
+ * one of the architectures is a pattern, the fields of the other
+ * architecture are only compared with the fields of the pattern which
+ * are not "any". Otherwise the architectures have to be equal.
+ *
+ * The operating systems and processors are compared all at once using
+ * the packed triplets. The vendor strings only need to be compared
+ * when both vendors are not one of the well known vendors.
+ *
+ * \param[in] rhs  The other architecture or pattern.
+ * \param[in] ignore_vendor_field  Whether the vendors are ignored; they
+ *             also are if either architecture was marked as ignoring
+ *             the vendor field.
+ *
+ * \return true if the architectures match.
+ */
+bool architecture::match(const architecture& rhs, bool ignore_vendor_field) const
+{
+    const bool pa(is_pattern_triplet(f_triplet));
+    const bool pb(is_pattern_triplet(rhs.f_triplet));
+    const bool iv(ignore_vendor_field || f_ignore_vendor || rhs.f_ignore_vendor);
+    const uint32_t va((f_triplet & TRIPLET_VENDOR_MASK) >> TRIPLET_VENDOR_SHIFT);
+    const uint32_t vb((rhs.f_triplet & TRIPLET_VENDOR_MASK) >> TRIPLET_VENDOR_SHIFT);
 
-//printf("%d/%d => %s-%s-%s vs %s-%s-%s\n", pa, pb, f_os.c_str(), f_vendor.c_str(), f_processor.c_str(), rhs.f_os.c_str(), rhs.f_vendor.c_str(), rhs.f_processor.c_str());
     if(pa ^ pb)
     {
         // compare pattern against architecture
         const architecture *a(pa ? &rhs : this);
         const architecture *p(pa ? this : &rhs);
-        if(p->f_os != "any" && p->f_os != a->f_os)
+        if(((a->f_triplet ^ p->f_triplet) & pattern_mask(p->f_triplet)) != 0)
         {
-            return true;
-        }
-        if(!iv && p->f_vendor != "any" && p->f_vendor != UNKNOWN_VENDOR && p->f_vendor != a->f_vendor)
-        {
-            return true;
+            return false;
         }
-        if(p->f_processor != "any" && p->f_processor != a->f_processor)
+        const uint32_t vp(pa ? va : vb);
+        if(!iv && vp != TRIPLET_VENDOR_ANY && vp != TRIPLET_VENDOR_UNKNOWN
+        && (va != vb || (va == TRIPLET_VENDOR_OTHER && f_vendor != rhs.f_vendor)))
         {
-            return true;
+            return false;
         }
     }
     else
     {
         // compare architecture against architecture
         //      or pattern against pattern
-        if(f_os != rhs.f_os
-        || (!iv && f_vendor != rhs.f_vendor && f_vendor != UNKNOWN_VENDOR && rhs.f_vendor != UNKNOWN_VENDOR)
-        || f_processor != rhs.f_processor)
+        if(((f_triplet ^ rhs.f_triplet) & (TRIPLET_OS_MASK | TRIPLET_PROCESSOR_MASK)) != 0)
+        {
+            return false;
+        }
+        if(!iv && va != TRIPLET_VENDOR_UNKNOWN && vb != TRIPLET_VENDOR_UNKNOWN
+        && (va != vb || (va == TRIPLET_VENDOR_OTHER && f_vendor != rhs.f_vendor)))
         {
-            return true;
+            return false;
         }
     }
 
-    return false;
+    return true;
 }
 
 
@@ -114,6 +114,7 @@ public:
 
     void set_ignore_vendor(bool ignore_vendor_field);
     bool ignore_vendor() const;
+    bool match(const architecture& rhs, bool ignore_vendor_field) const;
 
     architecture& operator = (const architecture& rhs);
 
@@ -134,6 +135,9 @@ private:
     std::string                 f_vendor;
     std::string                 f_processor;
 
+    // the same triplet packed in an integer for fast comparisons
+    uint32_t                    f_triplet;
+
     // while doing a compare, ignore vendor field?
     controlled_vars::fbool_t    f_ignore_vendor;
 };
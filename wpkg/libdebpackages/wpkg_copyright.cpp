@@ -375,6 +375,9 @@ void copyright_file::copyright_field_factory_t::register_field(copyright_file::c
         g_field_factory_map = new field_factory_map_t;
     }
     (*g_field_factory_map)[field_factory->name()] = field_factory;
+
+    // give the field an identifier now so field_file lookups are fast
+    wpkg_field::field_file::intern_field_name(field_factory->name());
 }
 
 
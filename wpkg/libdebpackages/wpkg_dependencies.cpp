@@ -37,6 +37,8 @@
 #include    "libdebpackages/wpkg_util.h"
 #include    "libdebpackages/debian_version.h"
 
+#include    <functional>
+
 
 /** \brief The wpkg_dependencies namespace declares and implements dependency related functions.
  *
@@ -609,6 +611,64 @@ std::string dependencies::to_string(const std::string& architecture, bool remove
 }
 
 
+namespace
+{
+
+/** \brief Cache of the last architectures parsed by match_architectures().
+ *
+ * The same few architectures are matched over and over (the target
+ * architecture against each package of an index, for example) so the
+ * parsed architectures are kept in a small direct mapped cache.
+ * Architectures and patterns get separate caches so the second lookup
+ * never evicts the result of the first.
+ */
+class architecture_cache
+{
+public:
+    static const size_t CACHE_SIZE = 16;   // must be a power of 2
+
+    const wpkg_architecture::architecture& get(const std::string& name)
+    {
+        entry_t& e(f_entries[std::hash<std::string>()(name) & (CACHE_SIZE - 1)]);
+        if(!e.f_valid || e.f_name != name)
+        {
+            // throws if the architecture is not valid
+            e.f_architecture.set_ignore_vendor(false);
+            if(!e.f_architecture.set(name))
+            {
+                e.f_valid = false;
+                throw wpkg_architecture::wpkg_architecture_exception_invalid("\"" + name + "\" is an invalid architecture.");
+            }
+            e.f_name = name;
+            e.f_valid = true;
+        }
+        return e.f_architecture;
+    }
+
+private:
+    struct entry_t
+    {
+        entry_t()
+            //: f_name() -- auto-init
+            //, f_architecture() -- auto-init
+            : f_valid(false)
+        {
+        }
+
+        std::string                         f_name;
+        wpkg_architecture::architecture     f_architecture;
+        bool                                f_valid;
+    };
+
+    entry_t                                 f_entries[CACHE_SIZE];
+};
+
+thread_local architecture_cache g_architectures;
+thread_local architecture_cache g_patterns;
+
+} // no name namespace
+
+
 bool dependencies::is_architecture_valid(const std::string& architecture)
 {
     wpkg_architecture::architecture arch;
@@ -631,9 +691,9 @@ bool dependencies::match_architectures(const std::string& architecture, const st
     }
 
     // more complicated test with more complicated patterns
-    wpkg_architecture::architecture arch(architecture, ignore_vendor_field);
-    wpkg_architecture::architecture pat(pattern, ignore_vendor_field);
-    return arch == pat;
+    const wpkg_architecture::architecture& arch(g_architectures.get(architecture));
+    const wpkg_architecture::architecture& pat(g_patterns.get(pattern));
+    return arch.match(pat, ignore_vendor_field);
 }
 
 
@@ -54,9 +54,15 @@
 #endif
 #include    "libexpr/expr.h"
 
+#include    "libutf8/libutf8.h"
+
 #include    <sstream>
 #include    <iostream>
 #include    <algorithm>
+#include    <atomic>
+#include    <deque>
+#include    <mutex>
+#include    <string.h>
 
 
 /** \brief The wpkg_field declares and implements field related functions.
@@ -210,10 +216,63 @@ public:
     {
     }
 
-    virtual void call_function(std::string& name, arglist& list, libexpr::variable& result)
+    using libexpr::expr_evaluator::call_function;
+
+    enum function_t
+    {
+        FUNCTION_ARCHITECTURE = libexpr::expr_evaluator::FUNCTION_USER,
+        FUNCTION_GETFIELD,
+        FUNCTION_OS,
+        FUNCTION_PROCESSOR,
+        FUNCTION_TRIPLET,
+        FUNCTION_VENDOR,
+        FUNCTION_VERSIONCMP,
+        FUNCTION_WPKGVERSION
+    };
+
+    virtual int find_function(const std::string& name) const
     {
         if(name == "architecture")
         {
+            return FUNCTION_ARCHITECTURE;
+        }
+        if(name == "getfield")
+        {
+            return FUNCTION_GETFIELD;
+        }
+        if(name == "os")
+        {
+            return FUNCTION_OS;
+        }
+        if(name == "processor")
+        {
+            return FUNCTION_PROCESSOR;
+        }
+        if(name == "triplet")
+        {
+            return FUNCTION_TRIPLET;
+        }
+        if(name == "vendor")
+        {
+            return FUNCTION_VENDOR;
+        }
+        if(name == "versioncmp")
+        {
+            return FUNCTION_VERSIONCMP;
+        }
+        if(name == "wpkgversion")
+        {
+            return FUNCTION_WPKGVERSION;
+        }
+        // check the default evaluator functions
+        return expr_evaluator::find_function(name);
+    }
+
+    virtual void call_function(int id, arglist& list, libexpr::variable& result)
+    {
+        switch(id)
+        {
+        case FUNCTION_ARCHITECTURE:
             if(list.size() != 0)
             {
                 throw libexpr::function_args("an invalid number of arguments was specified, architecture() does not expect any parameter");
@@ -221,13 +280,13 @@ public:
             // note: without the std::string() an architecture that starts
             //       with a digit would become a number
             result.set(std::string(debian_packages_architecture()));
-        }
-        else if(name == "getfield")
-        {
+            break;
+
+        case FUNCTION_GETFIELD:
             get_field(list, result);
-        }
-        else if(name == "os")
-        {
+            break;
+
+        case FUNCTION_OS:
             if(list.size() != 0)
             {
                 throw libexpr::function_args("an invalid number of arguments was specified, os() does not expect any parameter");
@@ -235,9 +294,9 @@ public:
             // note: without the std::string() an os that starts
             //       with a digit would become a number
             result.set(debian_packages_os());
-        }
-        else if(name == "processor")
-        {
+            break;
+
+        case FUNCTION_PROCESSOR:
             if(list.size() != 0)
             {
                 throw libexpr::function_args("an invalid number of arguments was specified, processor() does not expect any parameter");
@@ -245,9 +304,9 @@ public:
             // note: without the std::string() a processor that starts
             //       with a digit would become a number
             result.set(debian_packages_processor());
-        }
-        else if(name == "triplet")
-        {
+            break;
+
+        case FUNCTION_TRIPLET:
             if(list.size() != 0)
             {
                 throw libexpr::function_args("an invalid number of arguments was specified, triplet() does not expect any parameter");
@@ -255,9 +314,9 @@ public:
             // note: without the std::string() a triplet that starts
             //       with a digit would become a number
             result.set(debian_packages_triplet());
-        }
-        else if(name == "vendor")
-        {
+            break;
+
+        case FUNCTION_VENDOR:
             if(list.size() != 0)
             {
                 throw libexpr::function_args("an invalid number of arguments was specified, vendor() does not expect any parameter");
@@ -265,31 +324,35 @@ public:
             // note: without the std::string() a vendor that starts
             //       with a digit would become a number
             result.set(std::string(DEBIAN_PACKAGES_VENDOR));
-        }
-        else if(name == "versioncmp")
-        {
+            break;
+
+        case FUNCTION_VERSIONCMP:
             if(list.size() != 2)
             {
                 throw libexpr::function_args("an invalid number of arguments was specified, versioncmp() expects exactly 2 arguments");
             }
-            std::string v1, v2;
-            list[0].get(v1);
-            list[1].get(v2);
-            result.set(static_cast<long>(wpkg_util::versioncmp(v1, v2)));
-        }
-        else if(name == "wpkgversion")
-        {
+            {
+                std::string v1, v2;
+                list[0].get(v1);
+                list[1].get(v2);
+                result.set(static_cast<long>(wpkg_util::versioncmp(v1, v2)));
+            }
+            break;
+
+        case FUNCTION_WPKGVERSION:
             if(list.size() != 0)
             {
                 throw libexpr::function_args("an invalid number of arguments was specified, wpkgversion() does not expect any parameter");
             }
             // note: without the std::string() the version gets converted to a number
             result.set(std::string(DEBIAN_PACKAGES_VERSION_STRING));
-        }
-        else
-        {
+            break;
+
+        default:
             // we don't support that function, check the default evaluator functions
-            expr_evaluator::call_function(name, list, result);
+            expr_evaluator::call_function(id, list, result);
+            break;
+
         }
     }
 
@@ -462,9 +525,245 @@ private:
 };
 
 
+/** \brief Cache of the compiled expressions.
+ *
+ * The --validate-fields expressions are checked against every package
+ * and the same $(...) expressions often appear in many fields. This
+ * cache keeps the compiled version of the expressions so each one gets
+ * parsed only once.
+ *
+ * The compiled expressions only depend on the functions of the
+ * check_fields evaluator so they can be shared by all the field files.
+ */
+class expression_cache
+{
+public:
+    static const size_t MAX_EXPRESSIONS = 256;
+
+    libexpr::expr_evaluator::program_t get(libexpr::expr_evaluator& evaluator, const std::string& expression)
+    {
+        std::lock_guard<std::mutex> lock(f_mutex);
+        program_map_t::const_iterator it(f_programs.find(expression));
+        if(it != f_programs.end())
+        {
+            return it->second;
+        }
+
+        // a syntax error throws and nothing gets cached
+        libexpr::expr_evaluator::program_t program(evaluator.compile(expression));
+        if(f_programs.size() >= MAX_EXPRESSIONS)
+        {
+            f_programs.clear();
+        }
+        f_programs[expression] = program;
+        return program;
+    }
+
+private:
+    typedef std::map<std::string, libexpr::expr_evaluator::program_t> program_map_t;
+
+    std::mutex                          f_mutex;
+    program_map_t                       f_programs;
+};
+
+
+/** \brief Compile an expression using the cache.
+ *
+ * \param[in] evaluator  The evaluator used to compile the expression.
+ * \param[in] expression  The expression to compile.
+ *
+ * \return The compiled expression.
+ */
+libexpr::expr_evaluator::program_t compile_expression(check_fields& evaluator, const std::string& expression)
+{
+    static expression_cache g_expression_cache;
+    return g_expression_cache.get(evaluator, expression);
+}
+
+
+// field names are limited to ASCII characters (see read_field())
+// so only ASCII letters get folded
+char fold_field_char(char c)
+{
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+
+/** \brief Compare a field name against another name, ignoring case.
+ *
+ * \param[in] lhs  The name of a field.
+ * \param[in] rhs  The name to compare with, it does not need to be null
+ *                 terminated.
+ * \param[in] length  The number of characters in \p rhs.
+ *
+ * \return true if both names are equal.
+ */
+bool field_name_equal(const std::string& lhs, const char *rhs, size_t length)
+{
+    if(lhs.length() != length)
+    {
+        return false;
+    }
+    size_t idx(0);
+    for(; idx < length && fold_field_char(lhs[idx]) == fold_field_char(rhs[idx]); ++idx);
+    return idx == length;
+}
+
+
+/** \brief Table of the interned field names.
+ *
+ * Each base field name gets a small integer identifier the first time
+ * it is seen. The names of the fields defined by a factory are interned
+ * when the factory registers itself, unknown fields are interned when
+ * first set in a field_file. Names with a sub-package specification
+ * are not interned since there can be any number of them.
+ *
+ * The table does not grow: the slots never move and a name never gets
+ * removed, so find() reads the slots without taking the mutex. Only
+ * intern() locks the mutex to add a name. Once the table is half full,
+ * new names do not get an identifier and the field_file objects compare
+ * those names instead.
+ */
+class field_name_table
+{
+public:
+    static const size_t     TABLE_SIZE = 2048;
+    static const size_t     MAX_NAMES = TABLE_SIZE / 2;
+
+    field_name_table()
+        //: f_mutex() -- auto-init
+        //, f_names() -- auto-init
+    {
+        for(size_t idx(0); idx < TABLE_SIZE; ++idx)
+        {
+            f_slots[idx].store(NULL, std::memory_order_relaxed);
+        }
+    }
+
+    field_file::field_id_t find(const char *name, size_t length) const
+    {
+        const name_t *n(f_slots[find_slot(name, length)].load(std::memory_order_acquire));
+        return n == NULL ? field_file::FIELD_ID_UNDEFINED : n->f_id;
+    }
+
+    field_file::field_id_t intern(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(f_mutex);
+        const size_t slot(find_slot(name.c_str(), name.length()));
+        const name_t *n(f_slots[slot].load(std::memory_order_relaxed));
+        if(n != NULL)
+        {
+            return n->f_id;
+        }
+        if(f_names.size() >= MAX_NAMES)
+        {
+            return field_file::FIELD_ID_UNDEFINED;
+        }
+
+        // a deque does not move its items so the slots can point to them
+        name_t entry;
+        entry.f_id = static_cast<field_file::field_id_t>(f_names.size());
+        entry.f_name = name;
+        f_names.push_back(entry);
+        f_slots[slot].store(&f_names.back(), std::memory_order_release);
+
+        return entry.f_id;
+    }
+
+private:
+    struct name_t
+    {
+        field_file::field_id_t      f_id;
+        std::string                 f_name;
+    };
+
+    size_t find_slot(const char *name, size_t length) const
+    {
+        // FNV-1a on the lowercase characters
+        uint32_t hash(2166136261U);
+        for(size_t idx(0); idx < length; ++idx)
+        {
+            hash = (hash ^ static_cast<unsigned char>(fold_field_char(name[idx]))) * 16777619U;
+        }
+
+        const size_t mask(TABLE_SIZE - 1);
+        for(size_t slot(hash & mask);; slot = (slot + 1) & mask)
+        {
+            const name_t *n(f_slots[slot].load(std::memory_order_acquire));
+            if(n == NULL || field_name_equal(n->f_name, name, length))
+            {
+                return slot;
+            }
+        }
+    }
+
+    std::mutex                              f_mutex;
+    std::deque<name_t>                      f_names;
+    std::atomic<const name_t *>             f_slots[TABLE_SIZE];
+};
+
+
+/** \brief Retrieve the table of interned field names.
+ *
+ * The table is created on first use because the field factories
+ * register their names while the static objects get initialized.
+ *
+ * \return A reference to the table of field names.
+ */
+field_name_table& get_field_name_table()
+{
+    static field_name_table g_field_name_table;
+    return g_field_name_table;
+}
+
+
 } // no name namespace
 
 
+const field_file::field_id_t field_file::FIELD_ID_UNDEFINED;
+
+
+/** \brief Get the identifier of a field name.
+ *
+ * This function returns the identifier of the named field. If the name
+ * was never seen before, a new identifier gets allocated. Names are
+ * case insensitive so "Package" and "package" share the same identifier.
+ *
+ * The field factories call this function when they get registered.
+ * The \p name must not include a sub-package specification.
+ *
+ * \param[in] name  The name of the field.
+ *
+ * \return The identifier of the field name, or FIELD_ID_UNDEFINED if
+ *         the table of names is full.
+ */
+field_file::field_id_t field_file::intern_field_name(const std::string& name)
+{
+    return get_field_name_table().intern(name);
+}
+
+
+/** \brief Search for the identifier of a field name.
+ *
+ * This function searches for the identifier of a field name without
+ * allocating a new identifier if the name was not yet interned. The
+ * name does not need to be null terminated which allows for searching
+ * the name of a field without its sub-package specification.
+ *
+ * This function does not lock a mutex so it is cheap to call on each
+ * search of a field.
+ *
+ * \param[in] name  The name of the field.
+ * \param[in] length  The number of characters in \p name.
+ *
+ * \return The identifier of the field or FIELD_ID_UNDEFINED.
+ */
+field_file::field_id_t field_file::find_field_id(const char *name, size_t length)
+{
+    return get_field_name_table().find(name, length);
+}
+
+
 /** \brief Clean up function for the field_file state.
  *
  * This destructor ensures a proper virtual table for
@@ -586,6 +885,9 @@ bool field_file::field_file_state_t::accept_sub_packages() const
  */
 field_file::field_file(const std::shared_ptr<field_file_state_t> state)
     //: f_fields() -- auto-init
+    //, f_field_ids() -- auto-init
+    //, f_sorted_fields() -- auto-init
+    //, f_generation(1) -- auto-init
     //, f_variables() -- auto-init
     //, f_substitutions() -- auto-init
     : f_state(state)
@@ -641,6 +943,7 @@ void field_file::set_field_variable(const std::string& name, const std::string&
     // less likely to be specialized.)
     std::shared_ptr<field_t> field(create_variable(name, value));
     f_substitutions[name] = field;
+    changed();
 }
 
 
@@ -844,13 +1147,14 @@ bool field_file::read()
                     {
                         std::shared_ptr<field_t> field(create_variable(f_field_name, f_field_value, f_filename, f_line));
                         f_variables[f_field_name] = field;
+                        changed();
                         //set_variable(field); -- do not call set_variable()
                         // or we'll get a verify_value() call
                     }
                 }
                 else
                 {
-                    if(f_fields.find(f_field_name) != f_fields.end())
+                    if(find_field_entry(f_field_name, true) != NULL)
                     {
                         wpkg_output::log("field:%1:%2: a field cannot be defined more than once; %3 found twice")
                                 .arg(f_filename)
@@ -865,7 +1169,7 @@ bool field_file::read()
                     else
                     {
                         std::shared_ptr<field_t> field(create_field(f_field_name, f_field_value, f_filename, f_line));
-                        f_fields[f_field_name] = field;
+                        store_field(f_field_name, field);
                         //set_field(field); -- do not call set_field() or
                         // we'll get a verify_value() call
                     }
@@ -876,11 +1180,12 @@ bool field_file::read()
     // f_is_reading is false
 
     // verify all the fields as defined by the state
-    for(field_map_t::const_iterator it(f_fields.begin()); it != f_fields.end(); ++it)
+    const field_index_t& sorted(sorted_fields());
+    for(field_index_t::const_iterator it(sorted.begin()); it != sorted.end(); ++it)
     {
         try
         {
-            it->second->verify_value();
+            f_fields[*it].f_field->verify_value();
         }
         catch(const std::exception& e)
         {
@@ -1190,16 +1495,23 @@ bool field_file::read_field()
         return false;
     }
 
+    // the following lines are only looked at to find continuations so
+    // we read them in place, without copying them unless they span
+    // two blocks of the input file
     int next_offset(f_offset);
-    while(f_input->read_line(next_offset, input_line))
+    const char *line;
+    int length;
+    while(f_input->read_line(next_offset, line, length, input_line))
     {
-        const char *s(input_line.c_str());
+        const char *s(line);
+        const char *nul(static_cast<const char *>(memchr(line, '\0', length)));
+        const char *end(nul == NULL ? line + length : nul);
         int has_spaces(0);
-        for(; isspace(*s); ++s)
+        for(; s < end && isspace(*s); ++s)
         {
             ++has_spaces;
         }
-        if(*s == '#')
+        if(s < end && *s == '#')
         {
             // ignore comments silently; here we're done, this means
             // there is no continuation of the previous line
@@ -1218,13 +1530,13 @@ bool field_file::read_field()
         f_offset = next_offset;
 
         // empty line? (represented by a period by itself)
-        if(s[0] == '.')
+        if(s < end && s[0] == '.')
         {
-            if(s[1] != '\0')
+            if(s + 1 < end)
             {
                 if(isspace(s[1]))
                 {
-                    if(s[2] != '\0')
+                    if(s + 2 < end)
                     {
                         //
                         // Lines that start with 1 or more spaces/tabs, a
@@ -1271,11 +1583,11 @@ bool field_file::read_field()
         {
             // spaces are significant in a field when there is more than one
             // (transforms the Description to a <pre>...</pre> entry)
-            value += input_line.substr(1);
+            value.append(line + 1, length - 1);
         }
         else
         {
-            value += s;
+            value.append(s, end - s);
         }
     }
 
@@ -1367,13 +1679,15 @@ void field_file::write(memfile::memory_file& file, write_mode_t mode, const list
         }
     }
 
-    for(field_map_t::const_iterator it(f_fields.begin()); it != f_fields.end(); ++it)
+    const field_index_t& sorted(sorted_fields());
+    for(field_index_t::const_iterator it(sorted.begin()); it != sorted.end(); ++it)
     {
-        if(output_fields.find(it->first) == output_fields.end())
+        const field_entry_t& entry(f_fields[*it]);
+        if(output_fields.find(entry.f_name) == output_fields.end())
         {
-            std::shared_ptr<field_t> info(get_field_info(it->first));
+            const std::shared_ptr<field_t>& info(entry.f_field);
             std::string value(mode != WRITE_MODE_RAW_FIELDS ? info->get_transformed_value() : info->get_value());
-            std::string field(it->first + ": " + output_multiline_field(value) + "\n");
+            std::string field(entry.f_name + ": " + output_multiline_field(value) + "\n");
             file.write(field.c_str(), file.size(), static_cast<int>(field.length()));
         }
     }
@@ -1444,17 +1758,18 @@ void field_file::copy(field_file& destination, const std::string& sub_package, c
 
     std::map<case_insensitive::case_insensitive_string, bool> defined_fields;
 
-    for(field_map_t::const_iterator it(f_fields.begin()); it != f_fields.end(); ++it)
+    for(field_table_t::const_iterator entry(f_fields.begin()); entry != f_fields.end(); ++entry)
     {
+        const std::shared_ptr<field_t>& it(entry->f_field);
         bool use(true);
         if(!sub_package.empty())
         {
-            if(it->second->has_sub_package_name())
+            if(it->has_sub_package_name())
             {
                 // use only if sub-package name matches
                 // (or if the field exists but does not have a sub-package
                 // definition that match, which happens in a second loop)
-                use = sub_package == it->second->get_sub_package_name();
+                use = sub_package == it->get_sub_package_name();
             }
             else
             {
@@ -1463,7 +1778,7 @@ void field_file::copy(field_file& destination, const std::string& sub_package, c
         }
         if(use)
         {
-            std::string name(it->second->get_field_name());
+            std::string name(it->get_field_name());
             case_insensitive::case_insensitive_string n(name);
             if(std::find(excluded.begin(), excluded.end(), n) == excluded.end())
             {
@@ -1471,9 +1786,9 @@ void field_file::copy(field_file& destination, const std::string& sub_package, c
                 // create a new field because if &destination != this then
                 // the f_field_file pointer would be wrong (i.e. we cannot
                 // share the same field between different field_file objects)
-                std::string value(it->second->get_transformed_value());
-                std::string filename(it->second->get_filename());
-                std::shared_ptr<field_t> field(create_field(n, value, filename, it->second->get_line()));
+                std::string value(it->get_transformed_value());
+                std::string filename(it->get_filename());
+                std::shared_ptr<field_t> field(create_field(n, value, filename, it->get_line()));
                 destination.set_field(field);
                 defined_fields[n] = true;
             }
@@ -1484,20 +1799,21 @@ void field_file::copy(field_file& destination, const std::string& sub_package, c
     {
         // just in case, check for fields that did not match sub_package
         // and have a definition without the
-        for(field_map_t::const_iterator it(f_fields.begin()); it != f_fields.end(); ++it)
+        for(field_table_t::const_iterator entry(f_fields.begin()); entry != f_fields.end(); ++entry)
         {
-            if(!it->second->has_sub_package_name())
+            const std::shared_ptr<field_t>& it(entry->f_field);
+            if(!it->has_sub_package_name())
             {
-                std::string name(it->second->get_field_name());
+                std::string name(it->get_field_name());
                 case_insensitive::case_insensitive_string n(name);
                 if(std::find(excluded.begin(), excluded.end(), n) == excluded.end()
                 && defined_fields.find(n) == defined_fields.end())
                 {
                     // as before we overwrite even if destination already
                     // exists
-                    std::string value(it->second->get_transformed_value());
-                    std::string filename(it->second->get_filename());
-                    std::shared_ptr<field_t> field(create_field(n, value, filename, it->second->get_line()));
+                    std::string value(it->get_transformed_value());
+                    std::string filename(it->get_filename());
+                    std::shared_ptr<field_t> field(create_field(n, value, filename, it->get_line()));
                     destination.set_field(field);
                 }
             }
@@ -1834,7 +2150,7 @@ void field_file::transform_dynamic_variables(const field_t *field, std::string&
                 }
                 check_fields evaluator(const_cast<field_file&>(*this));
                 libexpr::variable r;
-                evaluator.eval(data, r);
+                evaluator.eval(compile_expression(evaluator, data), r);
                 std::string v;
                 r.to_string(v);
                 result += v;
@@ -2042,22 +2358,160 @@ std::shared_ptr<field_file::field_t> field_file::variable_factory(const case_ins
  */
 bool field_file::field_is_defined(const std::string& name, bool as_is) const
 {
-    if(f_fields.find(name) != f_fields.end())
-    {
-        // found this field with the name used as is
-        return true;
-    }
-    if(!as_is)
+    return find_field_entry(name, as_is) != NULL;
+}
+
+
+/** \brief Search for a field entry.
+ *
+ * This function searches for the named field. When \p as_is is false
+ * and the field is not defined with that exact name, the function
+ * searches again without the '/<sub-package name>' part, without
+ * creating a temporary string.
+ *
+ * \param[in] name  The name of the field to find.
+ * \param[in] as_is  Whether the sub-package name should not be removed.
+ *
+ * \return A pointer to the field entry or NULL if not defined.
+ */
+const field_file::field_entry_t *field_file::find_field_entry(const std::string& name, bool as_is) const
+{
+    int pos(find_field_position(name.c_str(), name.length()));
+    if(pos < 0 && !as_is)
     {
         std::string::size_type p(name.find_last_of('/'));
         if(p != std::string::npos)
         {
             // try again without the '/<sub-package name>'
-            return f_fields.find(name.substr(0, p)) != f_fields.end();
+            pos = find_field_position(name.c_str(), p);
         }
         // name does not include a sub-package specification
     }
-    return false;
+    return pos < 0 ? NULL : &f_fields[pos];
+}
+
+
+/** \brief Search for the position of a field.
+ *
+ * The fields with a base name are found with a binary search of their
+ * identifier in f_field_ids. The fields with a sub-package specification
+ * (and base names which could not be interned) do not have an identifier
+ * so their names get compared instead; there are usually very few of
+ * them.
+ *
+ * \param[in] name  The name of the field, it does not need to be null
+ *                  terminated.
+ * \param[in] length  The number of characters in \p name.
+ *
+ * \return The position of the field in f_fields or -1 if not defined.
+ */
+int field_file::find_field_position(const char *name, size_t length) const
+{
+    if(memchr(name, '/', length) == NULL)
+    {
+        const field_id_t id(find_field_id(name, length));
+        if(id != FIELD_ID_UNDEFINED)
+        {
+            const field_id_map_t::const_iterator it(std::lower_bound(f_field_ids.begin(), f_field_ids.end(), std::make_pair(id, -1)));
+            if(it == f_field_ids.end() || it->first != id)
+            {
+                return -1;
+            }
+            return it->second;
+        }
+    }
+
+    for(size_t idx(0); idx < f_fields.size(); ++idx)
+    {
+        if(f_fields[idx].f_id == FIELD_ID_UNDEFINED
+        && field_name_equal(f_fields[idx].f_name, name, length))
+        {
+            return static_cast<int>(idx);
+        }
+    }
+    return -1;
+}
+
+
+/** \brief Save a field in the table of fields.
+ *
+ * If the field is already defined, it gets replaced, although the
+ * name remains the one used when the field was first defined.
+ *
+ * \param[in] name  The name of the field.
+ * \param[in] field  The field to save.
+ */
+void field_file::store_field(const std::string& name, const std::shared_ptr<field_t> field)
+{
+    const int pos(find_field_position(name.c_str(), name.length()));
+    if(pos < 0)
+    {
+        field_entry_t entry;
+        // only base names get interned
+        entry.f_id = name.find('/') == std::string::npos ? intern_field_name(name) : FIELD_ID_UNDEFINED;
+        entry.f_name = name;
+        entry.f_field = field;
+        if(entry.f_id != FIELD_ID_UNDEFINED)
+        {
+            const std::pair<field_id_t, int> id(entry.f_id, static_cast<int>(f_fields.size()));
+            f_field_ids.insert(std::lower_bound(f_field_ids.begin(), f_field_ids.end(), id), id);
+        }
+        f_fields.push_back(entry);
+        f_sorted_fields.clear();
+    }
+    else
+    {
+        f_fields[pos].f_field = field;
+    }
+    changed();
+}
+
+
+/** \brief Mark the fields and variables as changed.
+ *
+ * The transformed value of a field is cached (see
+ * field_t::get_transformed_value()) along the generation of this
+ * field_file. Any change to a field or a variable may change the result
+ * of a transformation so this function bumps the generation which
+ * invalidates all the cached values.
+ */
+void field_file::changed()
+{
+    ++f_generation;
+    if(f_generation == 0)
+    {
+        // zero means "not cached"
+        f_generation = 1;
+    }
+}
+
+
+/** \brief Get the fields sorted by name.
+ *
+ * The fields are saved in the order they were defined. Functions such
+ * as write() and get_field_name() present them sorted by name (case
+ * insensitive) so the output does not depend on that order. The sorted
+ * list is cached until a field gets added or deleted.
+ *
+ * \return The positions of the fields in f_fields sorted by name.
+ */
+const field_file::field_index_t& field_file::sorted_fields() const
+{
+    if(f_sorted_fields.size() != f_fields.size())
+    {
+        f_sorted_fields.resize(f_fields.size());
+        for(size_t idx(0); idx < f_fields.size(); ++idx)
+        {
+            f_sorted_fields[idx] = static_cast<int>(idx);
+        }
+        const field_table_t& fields(f_fields);
+        std::sort(f_sorted_fields.begin(), f_sorted_fields.end(),
+            [&fields](int a, int b)
+            {
+                return libutf8::mbscasecmp(fields[a].f_name, fields[b].f_name) < 0;
+            });
+    }
+    return f_sorted_fields;
 }
 
 
@@ -2071,7 +2525,7 @@ void field_file::set_field(const std::shared_ptr<field_t> field)
 {
     // TBD: should we not overwrite the source filename & line
     //      if the new field information does not include them?
-    f_fields[field->get_name()] = field;
+    store_field(field->get_name(), field);
 
     // verify the value now that it was saved in the field;
     // sooner and the get_transformed_value() fails.
@@ -2157,33 +2611,15 @@ void field_file::set_field(const std::string& name, long value)
 std::string field_file::get_field(const std::string& name) const
 {
     // find the field if available
-    field_map_t::const_iterator it(f_fields.find(name));
-    if(it == f_fields.end())
-    {
-        size_t p(name.find_last_of('/'));
-        if(p != std::string::npos)
-        {
-            it = f_fields.find(name.substr(0, p));
-        }
-        if(it == f_fields.end())
-        {
-            // with or without the sub-package name we cannot find it
-            throw wpkg_field_exception_undefined("field \"" + name + "\" is undefined");
-        }
-    }
-
-    // avoid calling the transform function if the value does not
-    // include at least one '$' (it creates at least one extra copy)
-    std::string result(it->second->get_value());
-    if(result.find('$') != std::string::npos)
+    const field_entry_t *entry(find_field_entry(name, false));
+    if(entry == NULL)
     {
-        // TBD: should we cache the result? can the result ever change
-        //      over time?
-        transform_dynamic_variables(it->second.get(), result);
-        return result;
+        // with or without the sub-package name we cannot find it
+        throw wpkg_field_exception_undefined("field \"" + name + "\" is undefined");
     }
 
-    return result;
+    // the field caches its transformed value
+    return entry->f_field->get_transformed_value();
 }
 
 
@@ -2402,22 +2838,14 @@ int field_file::number_of_fields() const
 std::shared_ptr<field_file::field_t> field_file::get_field_info(const std::string& name) const
 {
     // find the field if available
-    field_map_t::const_iterator it(f_fields.find(name));
-    if(it == f_fields.end())
+    const field_entry_t *entry(find_field_entry(name, false));
+    if(entry == NULL)
     {
-        size_t p(name.find_last_of('/'));
-        if(p != std::string::npos)
-        {
-            it = f_fields.find(name.substr(0, p));
-        }
-        if(it == f_fields.end())
-        {
-            // with or without the sub-package name we cannot find it
-            throw wpkg_field_exception_undefined("get_field_info(): field \"" + name + "\" is undefined");
-        }
+        // with or without the sub-package name we cannot find it
+        throw wpkg_field_exception_undefined("get_field_info(): field \"" + name + "\" is undefined");
     }
 
-    return it->second;
+    return entry->f_field;
 }
 
 
@@ -2446,17 +2874,13 @@ const std::string& field_file::get_field_name(int idx) const
         throw std::underflow_error("index out of bounds (too small) to get a field name");
     }
 
-    // f_fields is a map so we cannot just jump at the right place!
-    field_map_t::const_iterator it(f_fields.begin());
-    for(; idx > 0; --idx, ++it)
+    const field_index_t& sorted(sorted_fields());
+    if(static_cast<size_t>(idx) >= sorted.size())
     {
-        if(it == f_fields.end())
-        {
-            throw std::overflow_error("index out of bounds trying to get a field name");
-        }
+        throw std::overflow_error("index out of bounds trying to get a field name");
     }
 
-    return it->first;
+    return f_fields[sorted[idx]].f_name;
 }
 
 
@@ -2471,14 +2895,27 @@ const std::string& field_file::get_field_name(int idx) const
  */
 bool field_file::delete_field(const std::string& name)
 {
-    field_map_t::iterator it(f_fields.find(name));
-    const bool result(it != f_fields.end());
-    if(result)
+    const int pos(find_field_position(name.c_str(), name.length()));
+    if(pos < 0)
     {
-        f_fields.erase(it);
+        return false;
     }
 
-    return result;
+    // the fields after the deleted field move down by one
+    f_fields.erase(f_fields.begin() + pos);
+    f_field_ids.clear();
+    for(size_t idx(0); idx < f_fields.size(); ++idx)
+    {
+        if(f_fields[idx].f_id != FIELD_ID_UNDEFINED)
+        {
+            f_field_ids.push_back(std::make_pair(f_fields[idx].f_id, static_cast<int>(idx)));
+        }
+    }
+    std::sort(f_field_ids.begin(), f_field_ids.end());
+    f_sorted_fields.clear();
+    changed();
+
+    return true;
 }
 
 
@@ -2585,6 +3022,7 @@ bool field_file::delete_variable(const std::string& name)
     if(result)
     {
         f_variables.erase(it);
+        changed();
     }
 
     return result;
@@ -2605,6 +3043,7 @@ bool field_file::delete_variable(const std::string& name)
 void field_file::set_variable(const std::shared_ptr<field_t> field)
 {
     f_variables[field->get_name()] = field;
+    changed();
 }
 
 
@@ -2753,7 +3192,7 @@ bool field_file::validate_fields(const std::string& expression)
 
     check_fields evaluator(*this);
     libexpr::variable result;
-    evaluator.eval(expression, result);
+    evaluator.eval(compile_expression(evaluator, expression), result);
 
     // it has to be an integer
     long valid;
@@ -2791,6 +3230,7 @@ bool field_file::validate_fields(const std::string& expression)
 void field_file::auto_transform_variables()
 {
     f_auto_transform_variables = true;
+    changed();
 }
 
 
@@ -2808,6 +3248,8 @@ field_file::field_t::field_t()
     //, f_value() -- auto-init
     //, f_filename() -- auto-init
     //, f_line() -- auto-init
+    //, f_transformed_value() -- auto-init
+    //, f_transformed_generation(0) -- auto-init
 {
 }
 
@@ -2826,6 +3268,8 @@ field_file::field_t::field_t(const field_t& rhs)
     , f_value(rhs.f_value)
     , f_filename(rhs.f_filename)
     , f_line(rhs.f_line)
+    //, f_transformed_value() -- auto-init
+    //, f_transformed_generation(0) -- auto-init
 {
 }
 
@@ -2854,6 +3298,8 @@ field_file::field_t::field_t(const field_file& file, const std::string& name, co
     , f_value(value)
     //, f_filename() -- auto-init
     //, f_line() -- auto-init
+    //, f_transformed_value() -- auto-init
+    //, f_transformed_generation(0) -- auto-init
 {
     if(name.empty())
     {
@@ -2974,6 +3420,11 @@ void field_file::field_t::set_value(const std::string& value)
 {
     std::string original(f_value);
     f_value = value;
+    f_transformed_generation = 0;
+    if(f_field_file)
+    {
+        f_field_file->changed();
+    }
 
     try
     {
@@ -2983,6 +3434,11 @@ void field_file::field_t::set_value(const std::string& value)
     {
         // fulfill the contract, restore a valid value
         f_value = original;
+        f_transformed_generation = 0;
+        if(f_field_file)
+        {
+            f_field_file->changed();
+        }
         throw;
     }
 }
@@ -3028,22 +3484,33 @@ std::string field_file::field_t::get_value() const
 }
 
 
-/** \brief Retrieve the current value of this field.
+/** \brief Retrieve the transformed value of this field.
  *
- * This function returns the raw value of the field. This value may
- * include untransformed variables and expressions. You should instead
- * get fields via the field_file interface.
+ * This function returns the value of the field with its variables and
+ * expressions transformed. The result is cached in the field and
+ * reused until a field or a variable of the field_file changes.
  *
- * \return A copy of the current field value.
+ * \return A copy of the transformed field value.
  */
 std::string field_file::field_t::get_transformed_value() const
 {
-    std::string result(f_value);
-    if(result.find('$') != std::string::npos)
+    // avoid calling the transform function if the value does not
+    // include at least one '$' (it creates at least one extra copy)
+    if(f_value.find('$') == std::string::npos)
     {
+        return f_value;
+    }
+
+    // the result remains valid until a field or variable changes
+    const uint32_t generation(f_field_file->f_generation);
+    if(f_transformed_generation != generation)
+    {
+        std::string result(f_value);
         f_field_file->transform_dynamic_variables(this, result);
+        f_transformed_value = result;
+        f_transformed_generation = generation;
     }
-    return result;
+    return f_transformed_value;
 }
 
 
@@ -3165,6 +3632,11 @@ field_file::field_t& field_file::field_t::operator = (const field_t& rhs)
         f_value      = rhs.f_value;
         f_filename   = rhs.f_filename;
         f_line       = rhs.f_line;
+        f_transformed_generation = 0;
+        if(f_field_file)
+        {
+            f_field_file->changed();
+        }
     }
 
     return *this;
@@ -70,6 +70,9 @@ class DEBIAN_PACKAGE_EXPORT field_file
 {
 public:
     typedef std::vector<std::string>    list_t;
+    typedef int                         field_id_t;
+
+    static const field_id_t             FIELD_ID_UNDEFINED = -1;
 
     class DEBIAN_PACKAGE_EXPORT field_t
     {
@@ -107,6 +110,8 @@ public:
         std::string                 f_value;
         std::string                 f_filename;
         controlled_vars::zint32_t   f_line;
+        mutable std::string         f_transformed_value;
+        mutable controlled_vars::zuint32_t  f_transformed_generation;
     };
 
     typedef std::vector<field_t>        field_list_t;
@@ -149,6 +154,9 @@ public:
         WRITE_MODE_RAW_FIELDS
     };
 
+    static field_id_t intern_field_name(const std::string& name);
+    static field_id_t find_field_id(const char *name, size_t length);
+
     field_file(const std::shared_ptr<field_file_state_t> state);
     std::shared_ptr<field_file_state_t> get_state() const;
     void copy_input(const field_file& source);
@@ -221,10 +229,29 @@ private:
     static bool validate_standards_version(const std::string& version);
     bool read_field();
 
+    struct field_entry_t
+    {
+        field_id_t                      f_id;
+        std::string                     f_name;
+        std::shared_ptr<field_t>        f_field;
+    };
+
     typedef std::map<case_insensitive::case_insensitive_string, std::shared_ptr<field_t>, std::less<case_insensitive::case_insensitive_string> >  field_map_t;
     typedef std::vector<case_insensitive::case_insensitive_string>  field_stack_t;
-
-    field_map_t                         f_fields;
+    typedef std::vector<field_entry_t>  field_table_t;
+    typedef std::vector<int>            field_index_t;
+    typedef std::vector<std::pair<field_id_t, int> >    field_id_map_t;
+
+    const field_entry_t *find_field_entry(const std::string& name, bool as_is) const;
+    int find_field_position(const char *name, size_t length) const;
+    void store_field(const std::string& name, const std::shared_ptr<field_t> field);
+    const field_index_t& sorted_fields() const;
+    void changed();
+
+    field_table_t                       f_fields;
+    field_id_map_t                      f_field_ids;
+    mutable field_index_t               f_sorted_fields;
+    controlled_vars::auto_init<uint32_t, 1> f_generation;
     field_map_t                         f_variables;
     field_map_t                         f_substitutions;
 
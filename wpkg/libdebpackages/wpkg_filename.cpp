@@ -54,6 +54,7 @@
 #include    "libdebpackages/compatibility.h"
 #include    <algorithm>
 #include    <sstream>
+#include    <string.h>
 #include    <errno.h>
 #include    <time.h>
 #include    <sys/types.h>
@@ -546,6 +547,51 @@ bool is_localhost(const std::string& host)
 }
 
 
+/** \brief Compute the extensions of a basename.
+ *
+ * This function extracts the last extension and the "previous" extension
+ * of \p lastname. The previous extension is the one found before a
+ * compression extension (i.e. "tar" in "file.tar.gz") or the same as the
+ * last extension otherwise.
+ *
+ * A period found as the very first character of \p lastname is not
+ * considered as the start of an extension.
+ *
+ * \param[in] lastname  The basename to check.
+ * \param[out] ext  The last extension, without the period.
+ * \param[out] previous_ext  The previous extension, without the period.
+ */
+void get_extensions(const std::string& lastname, std::string& ext, std::string& previous_ext)
+{
+    std::string::size_type period(lastname.find_last_of('.'));
+    if(period != 0 && period != std::string::npos)
+    {
+        std::string::size_type previous_period(std::string::npos);
+        ext = lastname.substr(period + 1);
+#ifdef WINDOWS
+        case_insensitive::case_insensitive_string cext(ext);
+#else
+        const std::string& cext(ext);
+#endif
+        if(cext == "gz"
+        || cext == "bz2"
+        || cext == "lzma"
+        || cext == "xv")
+        {
+            previous_period = lastname.find_last_of('.', period - 1);
+        }
+        if(previous_period != 0 && previous_period != std::string::npos)
+        {
+            previous_ext = lastname.substr(previous_period + 1, period - previous_period - 1);
+        }
+        else
+        {
+            previous_ext = ext;
+        }
+    }
+}
+
+
 } // no name namespace
 
 
@@ -1476,32 +1522,7 @@ void uri_filename::set_filename(std::string filename)
     }
     segments.push_back(lastname);
 
-    std::string::size_type period(lastname.find_last_of('.'));
-    if(period != 0 && period != std::string::npos)
-    {
-        std::string::size_type previous_period(std::string::npos);
-        ext = lastname.substr(period + 1);
-#ifdef WINDOWS
-        case_insensitive::case_insensitive_string cext(ext);
-#else
-        const std::string& cext(ext);
-#endif
-        if(cext == "gz"
-        || cext == "bz2"
-        || cext == "lzma"
-        || cext == "xv")
-        {
-            previous_period = lastname.find_last_of('.', period - 1);
-        }
-        if(previous_period != 0 && previous_period != std::string::npos)
-        {
-            previous_ext = lastname.substr(previous_period + 1, period - previous_period - 1);
-        }
-        else
-        {
-            previous_ext = ext;
-        }
-    }
+    get_extensions(lastname, ext, previous_ext);
 
     // only now do we generate an error because of invalid names or characters
     // because only the direct schemes consider them invalid
@@ -1643,7 +1664,7 @@ void uri_filename::clear_cache()
  *
  * \return The original filename as passed to set_filename().
  */
-std::string uri_filename::original_filename() const
+const std::string& uri_filename::original_filename() const
 {
     return f_original;
 }
@@ -1873,7 +1894,7 @@ int uri_filename::segment_size() const
  *
  * \return Segment \p idx of this path.
  */
-std::string uri_filename::segment(int idx) const
+const std::string& uri_filename::segment(int idx) const
 {
     return f_segments[idx];
 }
@@ -1984,7 +2005,7 @@ std::string uri_filename::dirname(bool with_drive) const
  *
  * \return The extension of the basename or an empty string.
  */
-std::string uri_filename::extension() const
+const std::string& uri_filename::extension() const
 {
     return f_extension;
 }
@@ -2012,7 +2033,7 @@ std::string uri_filename::extension() const
  *
  * \sa extension()
  */
-std::string uri_filename::previous_extension() const
+const std::string& uri_filename::previous_extension() const
 {
     return f_previous_extension;
 }
@@ -2723,12 +2744,126 @@ uri_filename uri_filename::append_child(const std::string& child) const
         }
         ++c;
     }
+    if(result.append_child_segments(p, child.c_str() + c))
+    {
+        // all the fields were refreshed without a re-parse
+        return result;
+    }
     result.f_path = result.f_path.substr(0, p) + "/" + child.substr(c);
 
     // re-parse the result to refresh all the fields
     return result.full_path();
 }
 
+/** \brief Append a child to a plain local path without a re-parse.
+ *
+ * This function is the fast path of append_child(). Re-parsing the
+ * whole filename each time a child gets appended is expensive and
+ * append_child() is called in all the loops that handle the files
+ * of a package (install, remove, build, index...)
+ *
+ * When this uri_filename is a plain local path (i.e. a direct "file"
+ * path which was not decoded and has a drive that does not get
+ * substituted, if any) then the parent fields are already canonicalized
+ * and only the \p child part needs to be parsed. The function updates
+ * the segments, dirname, path, basename and extensions in place. The
+ * result is exactly the same as what set_filename() generates with
+ * the full_path() of the concatenated path.
+ *
+ * If the function cannot be sure of that (i.e. the child includes a
+ * segment which is not valid under MS-Windows and set_filename() would
+ * throw) then it returns false and does not modify this uri_filename.
+ *
+ * \param[in] path_length  The length of f_path without its trailing slashes.
+ * \param[in] child  The child to append, without its leading slashes.
+ *
+ * \return true if the child was appended, false if a re-parse is required.
+ */
+bool uri_filename::append_child_segments(std::string::size_type path_length, const char *child)
+{
+    if(f_type != uri_type_direct
+    || f_scheme != uri_scheme_file
+    || f_decode
+    || f_segments.empty())
+    {
+        return false;
+    }
+    if(f_drive != uri_no_msdos_drive
+    && get_subst(f_drive).f_drive != uri_no_msdos_drive)
+    {
+        // the drive would be replaced by a path in full_path()
+        return false;
+    }
+
+    std::string path;
+    path.reserve(path_length + 1 + strlen(child));
+    path.assign(f_path, 0, path_length);
+    std::string::size_type dirname_length(path.length());
+    path += '/';
+
+    path_parts_t segments;
+    char previous('/');
+    const char *segment_start(child);
+    const char *s(child);
+    for(; *s != '\0'; ++s)
+    {
+        char c(*s);
+        if(c == '\\')
+        {
+            c = '/';
+        }
+        if(c == '/')
+        {
+            if(previous != '/')
+            {
+                const std::string segment_str(segment_start, s - segment_start);
+                if(wpkg_util::is_special_windows_filename(segment_str)
+                || !wpkg_util::is_valid_windows_filename(segment_str))
+                {
+                    // let set_filename() generate the error
+                    return false;
+                }
+                segments.push_back(segment_str);
+                dirname_length = path.length();
+                path += c;
+                previous = c;
+            }
+            segment_start = s + 1;
+            continue;
+        }
+        path += c;
+        previous = c;
+    }
+    std::string lastname(segment_start, s - segment_start);
+    if(wpkg_util::is_special_windows_filename(lastname)
+    || !wpkg_util::is_valid_windows_filename(lastname))
+    {
+        return false;
+    }
+    std::string ext;
+    std::string previous_ext;
+    get_extensions(lastname, ext, previous_ext);
+
+    // the last segment of the parent is its basename, which is empty
+    // when the parent path ends with a slash
+    if(f_basename.empty())
+    {
+        f_segments.pop_back();
+    }
+    f_segments.insert(f_segments.end(), segments.begin(), segments.end());
+    f_segments.push_back(lastname);
+    f_dirname.assign(path, 0, dirname_length);
+    f_path.swap(path);
+    f_basename.swap(lastname);
+    f_extension.swap(ext);
+    f_previous_extension.swap(previous_ext);
+    f_is_deb = false;
+    f_original = full_path();
+    clear_cache();
+
+    return true;
+}
+
 /** \brief Prepend a path to this uri_filename and return the result.
  *
  * This function ensures that this uri_filename is a safe path to
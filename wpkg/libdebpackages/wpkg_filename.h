@@ -202,18 +202,18 @@ public:
     void                        clear();
     void                        clear_cache();
 
-    std::string                 original_filename() const;
+    const std::string&          original_filename() const;
     std::string                 path_type() const;
     std::string                 path_scheme() const;
     std::string                 drive_subst(drive_t drive, bool for_absolute_path) const;
     std::string                 path_only(bool with_drive = true) const;
     std::string                 full_path(bool replace_slashes = false) const;
     int                         segment_size() const;
-    std::string                 segment(int idx) const;
+    const std::string&          segment(int idx) const;
     std::string                 dirname(bool with_drive = true) const;
     std::string                 basename(bool last_extension_only = false) const;
-    std::string                 extension() const;
-    std::string                 previous_extension() const;
+    const std::string&          extension() const;
+    const std::string&          previous_extension() const;
     char                        msdos_drive() const;
     std::string                 get_username() const;
     std::string                 get_password() const;
@@ -267,6 +267,7 @@ public:
 
 private:
     bool                        glob(const char *filename, const char *pattern) const;
+    bool                        append_child_segments(std::string::size_type path_length, const char *child);
 
     std::string                 f_original;
     std::string                 f_type; // type of URI
@@ -0,0 +1,866 @@
+/*    wpkg_http.cpp -- HTTP/1.1 client used to download files
+ *    Copyright (C) 2012-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+
+/** \file
+ * \brief Implementation of the HTTP/1.1 client.
+ *
+ * The client reads the socket through a 64Kb buffer so the response
+ * headers are parsed from memory instead of one system call per byte.
+ * The connection is kept alive as long as the server accepts it and
+ * the idle connections are saved in a pool so the next request to the
+ * same host does not have to connect again.
+ */
+#include    "libdebpackages/wpkg_http.h"
+
+#include    <algorithm>
+#include    <stdio.h>
+#include    <stdlib.h>
+#include    <string.h>
+
+namespace wpkg_http
+{
+
+
+namespace
+{
+
+/** \brief Remove the spaces at the start and end of a string.
+ *
+ * \param[in] s  The string to trim.
+ *
+ * \return The trimmed string.
+ */
+std::string trim(const std::string& s)
+{
+    std::string::size_type start(s.find_first_not_of(" \t"));
+    if(start == std::string::npos)
+    {
+        return std::string();
+    }
+    std::string::size_type end(s.find_last_not_of(" \t"));
+    return s.substr(start, end - start + 1);
+}
+
+} // no name namespace
+
+
+
+/** \class http_request
+ * \brief An HTTP request.
+ *
+ * This class holds the method, path and header fields of a request.
+ * The Host field is added when the request is sent.
+ */
+
+
+/** \brief Initialize a request.
+ *
+ * \param[in] path  The path of the resource, starting with a slash.
+ * \param[in] method  The request method, "GET" by default.
+ */
+http_request::http_request(const std::string& path, const std::string& method)
+    : f_method(method)
+    , f_path(path)
+    //, f_fields() -- auto-init
+{
+    if(f_path.empty())
+    {
+        f_path = "/";
+    }
+}
+
+
+/** \brief Get the method of this request.
+ *
+ * \return The method such as "GET" or "HEAD".
+ */
+const std::string& http_request::get_method() const
+{
+    return f_method;
+}
+
+
+/** \brief Get the path of this request.
+ *
+ * \return The path of the resource.
+ */
+const std::string& http_request::get_path() const
+{
+    return f_path;
+}
+
+
+/** \brief Set a header field.
+ *
+ * An empty \p value removes the field.
+ *
+ * \param[in] name  The name of the field (case insensitive).
+ * \param[in] value  The value of the field.
+ */
+void http_request::set_field(const std::string& name, const std::string& value)
+{
+    if(name.empty() || name.find_first_of(":\r\n") != std::string::npos
+    || value.find_first_of("\r\n") != std::string::npos)
+    {
+        throw wpkg_http_exception_invalid("invalid HTTP field \"" + name + "\"");
+    }
+    if(value.empty())
+    {
+        f_fields.erase(name);
+    }
+    else
+    {
+        f_fields[name] = value;
+    }
+}
+
+
+/** \brief Get a header field.
+ *
+ * \param[in] name  The name of the field (case insensitive).
+ *
+ * \return The value of the field or an empty string.
+ */
+std::string http_request::get_field(const std::string& name) const
+{
+    field_map_t::const_iterator it(f_fields.find(name));
+    if(it == f_fields.end())
+    {
+        return std::string();
+    }
+    return it->second;
+}
+
+
+/** \brief Generate the request as sent to the server.
+ *
+ * \param[in] host  The name of the host, used for the Host field.
+ *
+ * \return The request line and header followed by an empty line.
+ */
+std::string http_request::to_string(const std::string& host) const
+{
+    std::string result(f_method + " " + f_path + " HTTP/1.1\r\nHost: " + host + "\r\n");
+    if(f_fields.find("Connection") == f_fields.end())
+    {
+        result += "Connection: keep-alive\r\n";
+    }
+    for(field_map_t::const_iterator it(f_fields.begin()); it != f_fields.end(); ++it)
+    {
+        result += it->first + ": " + it->second + "\r\n";
+    }
+    result += "\r\n";
+    return result;
+}
+
+
+
+/** \class http_response
+ * \brief An HTTP response.
+ *
+ * This class holds the status and header fields of a response. The
+ * body is saved in a memory file by the http_client::receive() function.
+ */
+
+
+/** \brief Initialize an empty response.
+ */
+http_response::http_response()
+    //: f_status(0) -- auto-init
+    //  f_protocol() -- auto-init
+    //  f_fields() -- auto-init
+{
+}
+
+
+/** \brief Get the status code of the response.
+ *
+ * \return The status code such as 200 or 404.
+ */
+int http_response::get_status() const
+{
+    return f_status;
+}
+
+
+/** \brief Get the protocol of the response.
+ *
+ * \return "HTTP/1.0" or "HTTP/1.1".
+ */
+const std::string& http_response::get_protocol() const
+{
+    return f_protocol;
+}
+
+
+/** \brief Check whether a header field was received.
+ *
+ * \param[in] name  The name of the field (case insensitive).
+ *
+ * \return true if the field is defined.
+ */
+bool http_response::has_field(const std::string& name) const
+{
+    return f_fields.find(name) != f_fields.end();
+}
+
+
+/** \brief Get a header field.
+ *
+ * \param[in] name  The name of the field (case insensitive).
+ *
+ * \return The value of the field or an empty string.
+ */
+std::string http_response::get_field(const std::string& name) const
+{
+    field_map_t::const_iterator it(f_fields.find(name));
+    if(it == f_fields.end())
+    {
+        return std::string();
+    }
+    return it->second;
+}
+
+
+/** \brief Get the Content-Length of the response.
+ *
+ * \return The value of the Content-Length field or -1 when not defined.
+ */
+int http_response::get_content_length() const
+{
+    field_map_t::const_iterator it(f_fields.find("Content-Length"));
+    if(it == f_fields.end() || it->second.empty())
+    {
+        return -1;
+    }
+    char *end;
+    const long length(strtol(it->second.c_str(), &end, 10));
+    if(*end != '\0' || length < 0 || length > 1024 * 1024 * 1024)
+    {
+        throw wpkg_http_exception_invalid("invalid Content-Length \"" + it->second + "\"");
+    }
+    return static_cast<int>(length);
+}
+
+
+/** \brief Check whether the server keeps the connection open.
+ *
+ * HTTP/1.1 connections are kept alive unless the server sends a
+ * "Connection: close" field. HTTP/1.0 connections are closed unless
+ * the server sends a "Connection: keep-alive" field.
+ *
+ * \return true if the connection can be used for further requests.
+ */
+bool http_response::is_keep_alive() const
+{
+    const case_insensitive::case_insensitive_string connection(get_field("Connection"));
+    if(f_protocol == "HTTP/1.0")
+    {
+        return connection == "keep-alive";
+    }
+    return connection != "close";
+}
+
+
+
+/** \class http_client
+ * \brief A buffered HTTP/1.1 client.
+ *
+ * The client connects to one host. The connection is opened on the
+ * first request and kept alive between requests.
+ *
+ * Several requests can be sent with send() before their responses get
+ * read with receive(). The responses are returned in the order the
+ * requests were sent (HTTP pipelining.) The request() function sends
+ * one request and reads its response; if the connection was closed by
+ * the server while idle, it reconnects and sends the request again.
+ */
+
+
+/** \brief Initialize a client for the specified host.
+ *
+ * The connection is not opened until the first request is sent.
+ *
+ * \param[in] host  The name or IP address of the server.
+ * \param[in] port  The port of the server.
+ */
+http_client::http_client(const std::string& host, int port)
+    : f_host(host)
+    , f_port(port)
+    //, f_connection() -- auto-init
+    //, f_sent_on_connection(0) -- auto-init
+    //, f_pending() -- auto-init
+    , f_input(INPUT_BUFFER_SIZE)
+    //, f_input_pos(0) -- auto-init
+    //, f_input_size(0) -- auto-init
+{
+}
+
+
+/** \brief Get the host of this client.
+ *
+ * \return The name of the host.
+ */
+const std::string& http_client::get_host() const
+{
+    return f_host;
+}
+
+
+/** \brief Get the port of this client.
+ *
+ * \return The port of the server.
+ */
+int http_client::get_port() const
+{
+    return f_port;
+}
+
+
+/** \brief Check whether the client has an open connection.
+ *
+ * \return true if the connection is open.
+ */
+bool http_client::is_connected() const
+{
+    return f_connection.get() != NULL;
+}
+
+
+/** \brief Get the number of responses not yet received.
+ *
+ * \return The number of requests sent and not yet received.
+ */
+int http_client::get_pending() const
+{
+    return static_cast<int>(f_pending.size());
+}
+
+
+/** \brief Send a request to the server.
+ *
+ * The response must later be read with receive(). More requests can be
+ * sent before reading the responses.
+ *
+ * \param[in] request  The request to send.
+ */
+void http_client::send(const http_request& request)
+{
+    if(!f_connection)
+    {
+        connect();
+    }
+    write_all(request.to_string(f_host));
+    f_pending.push_back(request.get_method());
+    ++f_sent_on_connection;
+}
+
+
+/** \brief Receive the response of the oldest request sent.
+ *
+ * The \p body memory file is created and receives the body of the
+ * response. When the Content-Length is known, the blocks of \p body
+ * are allocated before the data gets read.
+ *
+ * If the server does not keep the connection alive, the connection
+ * gets closed once the response was read.
+ *
+ * \param[out] response  The status and fields of the response.
+ * \param[out] body  The body of the response.
+ */
+void http_client::receive(http_response& response, memfile::memory_file& body)
+{
+    if(f_pending.empty())
+    {
+        throw wpkg_http_exception_invalid("receive() called without a pending request");
+    }
+    const std::string method(f_pending.front());
+    f_pending.pop_front();
+
+    body.create(memfile::memory_file::file_format_other);
+    try
+    {
+        // skip "100 Continue" and other informational responses
+        do
+        {
+            read_header(response);
+        }
+        while(response.f_status >= 100 && response.f_status < 200);
+
+        if(method == "HEAD" || response.f_status == 204 || response.f_status == 304)
+        {
+            // no body
+        }
+        else if(response.get_field("Transfer-Encoding").find("chunked") != std::string::npos)
+        {
+            read_chunked(body);
+        }
+        else if(response.get_content_length() >= 0)
+        {
+            read_length(body, response.get_content_length());
+        }
+        else
+        {
+            read_until_closed(body);
+        }
+    }
+    catch(...)
+    {
+        disconnect();
+        throw;
+    }
+
+    if(!response.is_keep_alive())
+    {
+        disconnect();
+    }
+}
+
+
+/** \brief Send a request and receive its response.
+ *
+ * If the connection was reused and the server closed it in the meantime,
+ * the request is sent once more on a new connection. A connection which
+ * drops after the server started answering is not retried since the
+ * response and body hold the data received so far.
+ *
+ * \param[in] request  The request to send.
+ * \param[out] response  The status and fields of the response.
+ * \param[out] body  The body of the response.
+ */
+void http_client::request(const http_request& request, http_response& response, memfile::memory_file& body)
+{
+    if(!f_pending.empty())
+    {
+        throw wpkg_http_exception_invalid("request() called with pending requests, use receive() first");
+    }
+    const bool reused(f_connection && f_sent_on_connection > 0);
+    response.f_status = 0;
+    try
+    {
+        send(request);
+        receive(response, body);
+    }
+    catch(const wpkg_http_exception_io&)
+    {
+        if(!reused || response.f_status != 0)
+        {
+            // the server answered, the connection was not stale
+            throw;
+        }
+        // the server closed the idle connection, try again once
+        disconnect();
+        send(request);
+        receive(response, body);
+    }
+}
+
+
+/** \brief Close the connection.
+ *
+ * The responses not yet received are lost.
+ */
+void http_client::disconnect()
+{
+    f_connection.reset();
+    f_sent_on_connection = 0;
+    f_pending.clear();
+    f_input_pos = 0;
+    f_input_size = 0;
+}
+
+
+/** \brief Open a new connection to the server.
+ */
+void http_client::connect()
+{
+    disconnect();
+    try
+    {
+        f_connection.reset(new tcp_client_server::tcp_client(f_host, f_port));
+    }
+    catch(const std::runtime_error& e)
+    {
+        throw wpkg_http_exception_io("cannot connect to \"" + f_host + "\": " + e.what());
+    }
+}
+
+
+/** \brief Write all the data to the socket.
+ *
+ * \param[in] data  The data to write.
+ */
+void http_client::write_all(const std::string& data)
+{
+    const char *buf(data.c_str());
+    size_t left(data.length());
+    while(left > 0)
+    {
+        const int sz(f_connection->write(buf, left));
+        if(sz <= 0)
+        {
+            throw wpkg_http_exception_io("error while writing HTTP request to \"" + f_host + "\"");
+        }
+        buf += sz;
+        left -= sz;
+    }
+}
+
+
+/** \brief Read more data from the socket in the input buffer.
+ *
+ * \return false if the server closed the connection.
+ */
+bool http_client::fill_input()
+{
+    if(f_input_pos > 0)
+    {
+        // move what's left to the start of the buffer
+        memmove(&f_input[0], &f_input[f_input_pos], f_input_size - f_input_pos);
+        f_input_size -= f_input_pos;
+        f_input_pos = 0;
+    }
+    if(f_input_size >= static_cast<int>(f_input.size()))
+    {
+        throw wpkg_http_exception_invalid("HTTP header line too long");
+    }
+    const int sz(f_connection->read(&f_input[f_input_size], f_input.size() - f_input_size));
+    if(sz < 0)
+    {
+        throw wpkg_http_exception_io("I/O error while reading HTTP response from \"" + f_host + "\"");
+    }
+    f_input_size += sz;
+    return sz > 0;
+}
+
+
+/** \brief Read one line from the input buffer.
+ *
+ * The line ends with "\r\n" or "\n". The end of line is not included
+ * in \p line.
+ *
+ * \param[out] line  The line read.
+ *
+ * \return false if the server closed the connection before the end of
+ *         the line.
+ */
+bool http_client::read_line(std::string& line)
+{
+    for(;;)
+    {
+        const char *start(&f_input[0] + f_input_pos);
+        const char *nl(static_cast<const char *>(memchr(start, '\n', f_input_size - f_input_pos)));
+        if(nl != NULL)
+        {
+            const char *end(nl);
+            if(end > start && end[-1] == '\r')
+            {
+                --end;
+            }
+            line.assign(start, end - start);
+            f_input_pos += static_cast<int>(nl - start + 1);
+            return true;
+        }
+        if(!fill_input())
+        {
+            return false;
+        }
+    }
+}
+
+
+/** \brief Read body data.
+ *
+ * The data still available in the input buffer is returned first. Once
+ * empty, the data is read directly from the socket.
+ *
+ * \param[out] buffer  The buffer receiving the data.
+ * \param[in] size  The size of \p buffer.
+ *
+ * \return The number of bytes read, 0 if the server closed the connection.
+ */
+int http_client::read_input(char *buffer, int size)
+{
+    if(f_input_pos < f_input_size)
+    {
+        const int sz(std::min(size, static_cast<int>(f_input_size - f_input_pos)));
+        memcpy(buffer, &f_input[f_input_pos], sz);
+        f_input_pos += sz;
+        return sz;
+    }
+    const int sz(f_connection->read(buffer, size));
+    if(sz < 0)
+    {
+        throw wpkg_http_exception_io("I/O error while reading HTTP response from \"" + f_host + "\"");
+    }
+    return sz;
+}
+
+
+/** \brief Read the status line and header fields of a response.
+ *
+ * \param[out] response  The response receiving the status and fields.
+ */
+void http_client::read_header(http_response& response)
+{
+    response.f_status = 0;
+    response.f_protocol.clear();
+    response.f_fields.clear();
+
+    std::string line;
+    if(!read_line(line))
+    {
+        throw wpkg_http_exception_io("connection closed by \"" + f_host + "\" before an HTTP response was received");
+    }
+    // the first line must be HTTP/1.0 200 OK or HTTP/1.1 200 OK
+    if(line.length() < 12
+    || (line.compare(0, 9, "HTTP/1.0 ") != 0 && line.compare(0, 9, "HTTP/1.1 ") != 0))
+    {
+        throw wpkg_http_exception_invalid("HTTP response: is not HTTP/1.0 or HTTP/1.1");
+    }
+    response.f_protocol = line.substr(0, 8);
+    response.f_status = memfile::memory_file::file_info::str_to_int(line.c_str() + 9, 3, 10);
+    if(response.f_status < 100 || response.f_status > 999)
+    {
+        throw wpkg_http_exception_invalid("HTTP response: invalid status code");
+    }
+
+    for(;;)
+    {
+        if(!read_line(line))
+        {
+            throw wpkg_http_exception_io("connection closed by \"" + f_host + "\" while reading the HTTP response header");
+        }
+        if(line.empty())
+        {
+            break;
+        }
+        const std::string::size_type colon(line.find(':'));
+        if(colon == std::string::npos)
+        {
+            throw wpkg_http_exception_invalid("HTTP response: field without a colon");
+        }
+        // a field may appear multiple times, merge the values
+        const case_insensitive::case_insensitive_string name(trim(line.substr(0, colon)));
+        const std::string value(trim(line.substr(colon + 1)));
+        http_response::field_map_t::iterator it(response.f_fields.find(name));
+        if(it == response.f_fields.end())
+        {
+            response.f_fields.insert(http_response::field_map_t::value_type(name, value));
+        }
+        else
+        {
+            it->second += ", " + value;
+        }
+    }
+}
+
+
+/** \brief Read a body of a known size.
+ *
+ * \param[out] body  The memory file receiving the body.
+ * \param[in] size  The size of the body as defined by Content-Length.
+ */
+void http_client::read_length(memfile::memory_file& body, int size)
+{
+    // allocate all the blocks at once
+    body.reserve(body.size() + size);
+
+    char buf[memfile::memory_file::block_manager::BLOCK_MANAGER_BUFFER_SIZE];
+    int left(size);
+    while(left > 0)
+    {
+        const int sz(read_input(buf, std::min(left, static_cast<int>(sizeof(buf)))));
+        if(sz == 0)
+        {
+            throw wpkg_http_exception_io("connection closed by \"" + f_host + "\" before the end of the HTTP response");
+        }
+        body.write(buf, body.size(), sz);
+        left -= sz;
+    }
+}
+
+
+/** \brief Read a body using the chunked transfer encoding.
+ *
+ * Each chunk starts with its size in hexadecimal followed by the data.
+ * A chunk of size zero ends the body and is followed by optional
+ * trailer fields which are ignored.
+ *
+ * \param[out] body  The memory file receiving the body.
+ */
+void http_client::read_chunked(memfile::memory_file& body)
+{
+    std::string line;
+    for(;;)
+    {
+        if(!read_line(line))
+        {
+            throw wpkg_http_exception_io("connection closed by \"" + f_host + "\" while reading an HTTP chunk size");
+        }
+        char *end;
+        const long size(strtol(line.c_str(), &end, 16));
+        if(end == line.c_str() || (*end != '\0' && *end != ';' && *end != ' ')
+        || size < 0 || size > 1024 * 1024 * 1024)
+        {
+            throw wpkg_http_exception_invalid("HTTP response: invalid chunk size");
+        }
+        if(size == 0)
+        {
+            break;
+        }
+        read_length(body, static_cast<int>(size));
+        if(!read_line(line) || !line.empty())
+        {
+            throw wpkg_http_exception_invalid("HTTP response: chunk not followed by an empty line");
+        }
+    }
+
+    // skip the trailer
+    do
+    {
+        if(!read_line(line))
+        {
+            throw wpkg_http_exception_io("connection closed by \"" + f_host + "\" while reading the HTTP trailer");
+        }
+    }
+    while(!line.empty());
+}
+
+
+/** \brief Read a body which ends when the server closes the connection.
+ *
+ * \param[out] body  The memory file receiving the body.
+ */
+void http_client::read_until_closed(memfile::memory_file& body)
+{
+    char buf[memfile::memory_file::block_manager::BLOCK_MANAGER_BUFFER_SIZE];
+    for(;;)
+    {
+        const int sz(read_input(buf, static_cast<int>(sizeof(buf))));
+        if(sz == 0)
+        {
+            break;
+        }
+        body.write(buf, body.size(), sz);
+    }
+    disconnect();
+}
+
+
+
+/** \class http_pool
+ * \brief Pool of idle HTTP connections.
+ *
+ * Once a response was received, the client can be released to the pool.
+ * The next acquire() for the same host and port returns that client so
+ * its connection gets reused. The pool keeps at most
+ * MAX_IDLE_CONNECTIONS idle clients per host.
+ *
+ * The pool can be used from several threads.
+ */
+
+
+/** \brief Initialize the pool.
+ */
+http_pool::http_pool()
+    //: f_mutex() -- auto-init
+    //  f_idle() -- auto-init
+{
+}
+
+
+/** \brief Get the pool of the process.
+ *
+ * \return A reference to the pool.
+ */
+http_pool& http_pool::instance()
+{
+    static http_pool g_pool;
+    return g_pool;
+}
+
+
+/** \brief Get a client for the specified host.
+ *
+ * If an idle client connected to that host exists, it is returned.
+ * Otherwise a new client is created.
+ *
+ * \param[in] host  The name or IP address of the server.
+ * \param[in] port  The port of the server.
+ *
+ * \return A client ready to send requests.
+ */
+http_client::pointer_t http_pool::acquire(const std::string& host, int port)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), ":%d", port);
+    const std::string key(host + buf);
+    {
+        std::lock_guard<std::mutex> lock(f_mutex);
+        idle_map_t::iterator it(f_idle.find(key));
+        if(it != f_idle.end() && !it->second.empty())
+        {
+            http_client::pointer_t client(it->second.back());
+            it->second.pop_back();
+            return client;
+        }
+    }
+    return http_client::pointer_t(new http_client(host, port));
+}
+
+
+/** \brief Return a client to the pool.
+ *
+ * The client is kept only if its connection is still open and all its
+ * responses were received.
+ *
+ * \param[in] client  The client to return.
+ */
+void http_pool::release(http_client::pointer_t client)
+{
+    if(!client || !client->is_connected() || client->get_pending() != 0)
+    {
+        return;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), ":%d", client->get_port());
+    const std::string key(client->get_host() + buf);
+    std::lock_guard<std::mutex> lock(f_mutex);
+    client_list_t& clients(f_idle[key]);
+    if(static_cast<int>(clients.size()) < MAX_IDLE_CONNECTIONS)
+    {
+        clients.push_back(client);
+    }
+}
+
+
+/** \brief Close all the idle connections.
+ */
+void http_pool::clear()
+{
+    std::lock_guard<std::mutex> lock(f_mutex);
+    f_idle.clear();
+}
+
+
+} // namespace wpkg_http
+// vim: ts=4 sw=4 et
@@ -0,0 +1,182 @@
+/*    wpkg_http.h -- HTTP/1.1 client used to download files
+ *    Copyright (C) 2012-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+#ifndef WPKG_HTTP_H
+#define WPKG_HTTP_H
+
+/** \file
+ * \brief HTTP/1.1 client declarations.
+ *
+ * The memory_file::read_file() function downloads files from remote
+ * repositories. This file declares the HTTP client it uses: a buffered
+ * client which keeps its connection alive between requests, supports
+ * sending several requests before reading the responses, and decodes
+ * chunked responses. A pool keeps the idle connections so further
+ * requests to the same host reuse them.
+ */
+// the tcp_client_server.h must be first for MS-Windows
+#include "libdebpackages/tcp_client_server.h"
+#include "libdebpackages/memfile.h"
+#include "libdebpackages/case_insensitive_string.h"
+
+#include <deque>
+#include <mutex>
+
+namespace wpkg_http
+{
+
+// generic HTTP exception
+class wpkg_http_exception : public std::runtime_error
+{
+public:
+    wpkg_http_exception(const std::string& msg) : runtime_error(msg) {}
+};
+
+// problem with I/O
+class wpkg_http_exception_io : public wpkg_http_exception
+{
+public:
+    wpkg_http_exception_io(const std::string& msg) : wpkg_http_exception(msg) {}
+};
+
+// the response is not valid HTTP
+class wpkg_http_exception_invalid : public wpkg_http_exception
+{
+public:
+    wpkg_http_exception_invalid(const std::string& msg) : wpkg_http_exception(msg) {}
+};
+
+
+class DEBIAN_PACKAGE_EXPORT http_request
+{
+public:
+    http_request(const std::string& path, const std::string& method = "GET");
+
+    const std::string& get_method() const;
+    const std::string& get_path() const;
+    void set_field(const std::string& name, const std::string& value);
+    std::string get_field(const std::string& name) const;
+
+    std::string to_string(const std::string& host) const;
+
+private:
+    typedef std::map<case_insensitive::case_insensitive_string, std::string> field_map_t;
+
+    std::string                     f_method;
+    std::string                     f_path;
+    field_map_t                     f_fields;
+};
+
+
+class DEBIAN_PACKAGE_EXPORT http_response
+{
+public:
+    http_response();
+
+    int get_status() const;
+    const std::string& get_protocol() const;
+    bool has_field(const std::string& name) const;
+    std::string get_field(const std::string& name) const;
+    int get_content_length() const;
+    bool is_keep_alive() const;
+
+private:
+    friend class http_client;
+
+    typedef std::map<case_insensitive::case_insensitive_string, std::string> field_map_t;
+
+    controlled_vars::zint32_t       f_status;
+    std::string                     f_protocol;
+    field_map_t                     f_fields;
+};
+
+
+class DEBIAN_PACKAGE_EXPORT http_client
+{
+public:
+    typedef std::shared_ptr<http_client> pointer_t;
+
+    static const int INPUT_BUFFER_SIZE = 64 * 1024;
+
+    http_client(const std::string& host, int port);
+
+    const std::string& get_host() const;
+    int get_port() const;
+    bool is_connected() const;
+    int get_pending() const;
+
+    void send(const http_request& request);
+    void receive(http_response& response, memfile::memory_file& body);
+    void request(const http_request& request, http_response& response, memfile::memory_file& body);
+    void disconnect();
+
+private:
+    // disallow copying
+    http_client(const http_client& rhs);
+    http_client& operator = (const http_client& rhs);
+
+    void connect();
+    void write_all(const std::string& data);
+    bool fill_input();
+    bool read_line(std::string& line);
+    int read_input(char *buffer, int size);
+    void read_header(http_response& response);
+    void read_length(memfile::memory_file& body, int size);
+    void read_chunked(memfile::memory_file& body);
+    void read_until_closed(memfile::memory_file& body);
+
+    std::string                                         f_host;
+    controlled_vars::zint32_t                           f_port;
+    std::shared_ptr<tcp_client_server::tcp_client>      f_connection;
+    controlled_vars::zint32_t                           f_sent_on_connection;
+    std::deque<std::string>                             f_pending;
+    std::vector<char>                                   f_input;
+    controlled_vars::zint32_t                           f_input_pos;
+    controlled_vars::zint32_t                           f_input_size;
+};
+
+
+class DEBIAN_PACKAGE_EXPORT http_pool
+{
+public:
+    static const int MAX_IDLE_CONNECTIONS = 4;
+
+    static http_pool& instance();
+
+    http_client::pointer_t acquire(const std::string& host, int port);
+    void release(http_client::pointer_t client);
+    void clear();
+
+private:
+    typedef std::vector<http_client::pointer_t> client_list_t;
+    typedef std::map<std::string, client_list_t> idle_map_t;
+
+    http_pool();
+    http_pool(const http_pool& rhs);
+    http_pool& operator = (const http_pool& rhs);
+
+    std::mutex                      f_mutex;
+    idle_map_t                      f_idle;
+};
+
+} // namespace wpkg_http
+#endif
+//#ifndef WPKG_HTTP_H
+// vim: ts=4 sw=4 et
@@ -0,0 +1,662 @@
+/*    wpkg_metrics.cpp -- timings and counters of the packager processes
+ *    Copyright (C) 2012-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+
+/** \file
+ * \brief Implementation of the metrics.
+ *
+ * Each phase_timer object measures the wall clock and CPU time spent
+ * between its creation and its destruction. The result is added to the
+ * totals of that phase and sent as a JSON line event:
+ *
+ * \code
+ * {"event":"phase","phase":"unpack","package":"foo","wall_us":1200,"cpu_us":950}
+ * \endcode
+ *
+ * Phases can be nested (i.e. the unpack phase includes running the
+ * preinst script) so the times of the different phases are inclusive
+ * and must not be added together.
+ *
+ * The CPU time is the time used by the whole process, threads included.
+ *
+ * The emit_summary() function sends one last event with the totals of
+ * all the phases and all the counters.
+ *
+ * The profiler works on a per thread stack of profile_scope objects.
+ * When a scope ends, its self time (its time minus the time of the scopes
+ * it includes) is added to its stack, written in the folded format:
+ *
+ * \code
+ * load_package;read_file;decompress 1200
+ * \endcode
+ *
+ * Scopes started in a worker thread start a new stack of their own.
+ */
+#include    "libdebpackages/wpkg_metrics.h"
+
+#include    <algorithm>
+#include    <atomic>
+#include    <chrono>
+#include    <map>
+#include    <mutex>
+#include    <sstream>
+#include    <vector>
+#include    <string.h>
+#if defined(MO_WINDOWS)
+#   include <windows.h>
+#else
+#   include <sys/resource.h>
+#endif
+
+
+namespace wpkg_metrics
+{
+
+namespace
+{
+
+struct phase_totals_t
+{
+    std::atomic<uint64_t>   f_count;
+    std::atomic<uint64_t>   f_wall_time;
+    std::atomic<uint64_t>   f_cpu_time;
+};
+
+phase_totals_t              g_phases[phase_max];
+std::atomic<uint64_t>       g_counters[counter_max];
+
+
+struct profile_totals_t
+{
+    profile_totals_t()
+        : f_calls(0)
+        , f_time(0)
+        , f_self_time(0)
+    {
+    }
+
+    uint64_t                f_calls;
+    uint64_t                f_time;
+    uint64_t                f_self_time;
+};
+
+struct profile_stack_t
+{
+    std::string                 f_path;
+    std::vector<const char *>   f_names;
+    std::vector<uint64_t>       f_child_time;
+};
+
+std::atomic<bool>                           g_profiling(false);
+std::mutex                                  g_profile_mutex;
+std::map<std::string, uint64_t>             g_profile_stacks;
+std::map<std::string, profile_totals_t>     g_profile_scopes;
+thread_local profile_stack_t                g_profile_stack;
+
+
+/** \brief Get the current wall clock in microseconds.
+ *
+ * \return A monotonic time in microseconds.
+ */
+uint64_t wall_time()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+/** \brief Get the CPU time used by this process in microseconds.
+ *
+ * \return The user and system time used so far in microseconds.
+ */
+uint64_t cpu_time()
+{
+#if defined(MO_WINDOWS)
+    FILETIME creation, exit, kernel, user;
+    if(!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+    {
+        return 0;
+    }
+    // FILETIME are in 100ns units
+    const uint64_t k((static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime);
+    const uint64_t u((static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime);
+    return (k + u) / 10;
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL
+         + static_cast<uint64_t>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+#endif
+}
+
+
+/** \brief Write a string as a JSON string.
+ *
+ * \param[in] out  The stream where the string is written.
+ * \param[in] str  The string to write between double quotes.
+ */
+void write_json_string(std::ostringstream& out, const std::string& str)
+{
+    out << '"';
+    for(const char *s(str.c_str()); *s != '\0'; ++s)
+    {
+        const unsigned char c(static_cast<unsigned char>(*s));
+        if(c == '"' || c == '\\')
+        {
+            out << '\\' << *s;
+        }
+        else if(c < 0x20)
+        {
+            static const char hex[] = "0123456789abcdef";
+            out << "\\u00" << hex[c >> 4] << hex[c & 15];
+        }
+        else
+        {
+            out << *s;
+        }
+    }
+    out << '"';
+}
+
+
+/** \brief Send one JSON event to the output.
+ *
+ * \param[in] json  The JSON object representing the event.
+ * \param[in] package_name  The package concerned by the event, may be empty.
+ */
+void emit_event(const std::string& json, const std::string& package_name)
+{
+    wpkg_output::log("%1")
+            .arg(json)
+        .debug(wpkg_output::debug_flags::debug_metrics)
+        .module(wpkg_output::module_metrics)
+        .package(package_name)
+        .action("metrics");
+}
+
+} // no name namespace
+
+
+/** \brief Transform a phase to a string.
+ *
+ * The string is used as the name of the phase in the JSON events.
+ *
+ * \param[in] phase  The phase to convert.
+ *
+ * \return A constant string representing the phase.
+ */
+const char *phase_to_string(phase_t phase)
+{
+    switch(phase)
+    {
+    case phase_validation:      return "validation";
+    case phase_dependencies:    return "dependencies";
+    case phase_download:        return "download";
+    case phase_decompress:      return "decompress";
+    case phase_unpack:          return "unpack";
+    case phase_scripts:         return "scripts";
+    case phase_configure:       return "configure";
+
+    default:
+        throw std::overflow_error("the phase_to_string() function was called with an invalid phase");
+
+    }
+    /*NOTREACHED*/
+}
+
+
+/** \brief Transform a counter to a string.
+ *
+ * The string is used as the name of the counter in the JSON events.
+ *
+ * \param[in] counter  The counter to convert.
+ *
+ * \return A constant string representing the counter.
+ */
+const char *counter_to_string(counter_t counter)
+{
+    switch(counter)
+    {
+    case counter_bytes_downloaded:      return "bytes_downloaded";
+    case counter_bytes_decompressed:    return "bytes_decompressed";
+    case counter_bytes_written:         return "bytes_written";
+    case counter_files_written:         return "files_written";
+    case counter_cache_hits:            return "cache_hits";
+    case counter_cache_misses:          return "cache_misses";
+
+    default:
+        throw std::overflow_error("the counter_to_string() function was called with an invalid counter");
+
+    }
+    /*NOTREACHED*/
+}
+
+
+/** \brief Check whether the metrics are being gathered.
+ *
+ * The metrics are only gathered when a listener of the output object
+ * accepts the debug_metrics messages. This is the case when the wpkg
+ * tool is used with --log-output or with the debug_metrics flag
+ * in --debug.
+ *
+ * \return true if the metrics are gathered.
+ */
+bool is_enabled()
+{
+    return wpkg_output::is_debug_enabled(wpkg_output::debug_flags::debug_metrics);
+}
+
+
+/** \brief Add a value to one of the counters.
+ *
+ * Nothing happens when the metrics are not enabled and the profiler
+ * is not running.
+ *
+ * \param[in] counter  The counter to increase.
+ * \param[in] value  The value to add to the counter.
+ */
+void add_to_counter(counter_t counter, uint64_t value)
+{
+    if(counter < 0 || counter >= counter_max)
+    {
+        throw std::overflow_error("the add_to_counter() function was called with an invalid counter");
+    }
+    if(is_enabled() || g_profiling)
+    {
+        g_counters[counter] += value;
+    }
+}
+
+
+/** \brief Retrieve the current value of a counter.
+ *
+ * \param[in] counter  The counter to retrieve.
+ *
+ * \return The counter value.
+ */
+uint64_t get_counter(counter_t counter)
+{
+    if(counter < 0 || counter >= counter_max)
+    {
+        throw std::overflow_error("the get_counter() function was called with an invalid counter");
+    }
+    return g_counters[counter];
+}
+
+
+/** \brief Retrieve the number of times a phase was timed.
+ *
+ * \param[in] phase  The phase to check.
+ *
+ * \return The number of phase_timer objects of that phase that completed.
+ */
+uint64_t get_phase_count(phase_t phase)
+{
+    if(phase < 0 || phase >= phase_max)
+    {
+        throw std::overflow_error("the get_phase_count() function was called with an invalid phase");
+    }
+    return g_phases[phase].f_count;
+}
+
+
+/** \brief Retrieve the total wall clock time of a phase.
+ *
+ * \param[in] phase  The phase to check.
+ *
+ * \return The time in microseconds.
+ */
+uint64_t get_phase_wall_time(phase_t phase)
+{
+    if(phase < 0 || phase >= phase_max)
+    {
+        throw std::overflow_error("the get_phase_wall_time() function was called with an invalid phase");
+    }
+    return g_phases[phase].f_wall_time;
+}
+
+
+/** \brief Retrieve the total CPU time of a phase.
+ *
+ * \param[in] phase  The phase to check.
+ *
+ * \return The time in microseconds.
+ */
+uint64_t get_phase_cpu_time(phase_t phase)
+{
+    if(phase < 0 || phase >= phase_max)
+    {
+        throw std::overflow_error("the get_phase_cpu_time() function was called with an invalid phase");
+    }
+    return g_phases[phase].f_cpu_time;
+}
+
+
+/** \brief Reset all the phases and counters to zero.
+ *
+ * An application embedding the library can call this function before
+ * each installation to get separate metrics for each one.
+ */
+void reset()
+{
+    for(int i(0); i < phase_max; ++i)
+    {
+        g_phases[i].f_count = 0;
+        g_phases[i].f_wall_time = 0;
+        g_phases[i].f_cpu_time = 0;
+    }
+    for(int i(0); i < counter_max; ++i)
+    {
+        g_counters[i] = 0;
+    }
+}
+
+
+/** \brief Generate the summary event.
+ *
+ * The summary is a JSON object with the totals of each phase and the
+ * value of each counter:
+ *
+ * \code
+ * {"event":"summary","phases":{"validation":{"count":1,"wall_us":80,"cpu_us":75},...},"counters":{"bytes_downloaded":0,...}}
+ * \endcode
+ *
+ * \return The JSON object as a string.
+ */
+std::string get_summary()
+{
+    std::ostringstream json;
+    json << "{\"event\":\"summary\",\"phases\":{";
+    for(int i(0); i < phase_max; ++i)
+    {
+        if(i != 0)
+        {
+            json << ',';
+        }
+        json << '"' << phase_to_string(static_cast<phase_t>(i)) << "\":{"
+             << "\"count\":" << g_phases[i].f_count.load()
+             << ",\"wall_us\":" << g_phases[i].f_wall_time.load()
+             << ",\"cpu_us\":" << g_phases[i].f_cpu_time.load()
+             << '}';
+    }
+    json << "},\"counters\":{";
+    for(int i(0); i < counter_max; ++i)
+    {
+        if(i != 0)
+        {
+            json << ',';
+        }
+        json << '"' << counter_to_string(static_cast<counter_t>(i)) << "\":" << g_counters[i].load();
+    }
+    json << "}}";
+    return json.str();
+}
+
+
+/** \brief Send the summary event to the output.
+ *
+ * Nothing happens when the metrics are not enabled.
+ */
+void emit_summary()
+{
+    if(is_enabled())
+    {
+        emit_event(get_summary(), "");
+    }
+}
+
+
+/** \brief Start or stop the profiler.
+ *
+ * While the profiler runs, each profile_scope object records the time
+ * spent in its scope and the counters are updated even if no listener
+ * accepts the debug_metrics messages.
+ *
+ * Scopes that already started when the profiler gets started are
+ * ignored.
+ *
+ * \param[in] profiling  Whether the profiler runs.
+ */
+void set_profiling(bool profiling)
+{
+    g_profiling = profiling;
+}
+
+
+/** \brief Check whether the profiler runs.
+ *
+ * \return true if set_profiling() was called with true.
+ */
+bool is_profiling()
+{
+    return g_profiling;
+}
+
+
+/** \brief Generate the profiler report.
+ *
+ * The report starts with the folded stacks, one per line, followed by
+ * the self time of that stack in microseconds. These lines can directly
+ * be given to a flame graph generator. The other lines start with a
+ * '#' character: the \p top scopes with the largest inclusive time and
+ * the value of each counter.
+ *
+ * The inclusive time of a scope that appears several times in the same
+ * stack (recursion) only includes the outermost call.
+ *
+ * \param[in] top  The maximum number of scopes listed after the stacks.
+ *
+ * \return The report, one line per entry.
+ */
+std::string get_profile_report(size_t top)
+{
+    std::ostringstream report;
+
+    std::lock_guard<std::mutex> lock(g_profile_mutex);
+
+    for(std::map<std::string, uint64_t>::const_iterator it(g_profile_stacks.begin());
+                                                        it != g_profile_stacks.end(); ++it)
+    {
+        report << it->first << ' ' << it->second << '\n';
+    }
+
+    typedef std::pair<std::string, profile_totals_t> scope_t;
+    std::vector<scope_t> scopes(g_profile_scopes.begin(), g_profile_scopes.end());
+    std::sort(scopes.begin(), scopes.end(), [](const scope_t& a, const scope_t& b)
+        {
+            return a.second.f_time > b.second.f_time;
+        });
+    if(scopes.size() > top)
+    {
+        scopes.resize(top);
+    }
+    report << "# top " << scopes.size() << " scopes: name calls total_us self_us\n";
+    for(std::vector<scope_t>::const_iterator it(scopes.begin()); it != scopes.end(); ++it)
+    {
+        report << "# " << it->first
+               << ' ' << it->second.f_calls
+               << ' ' << it->second.f_time
+               << ' ' << it->second.f_self_time << '\n';
+    }
+
+    report << "# counters\n";
+    for(int i(0); i < counter_max; ++i)
+    {
+        report << "# " << counter_to_string(static_cast<counter_t>(i)) << ' ' << g_counters[i].load() << '\n';
+    }
+
+    return report.str();
+}
+
+
+/** \brief Start timing a phase.
+ *
+ * The timer stops when the object gets destroyed. Whether the metrics
+ * are enabled is checked once here so a timer costs nothing when they
+ * are not.
+ *
+ * \param[in] phase  The phase being timed.
+ * \param[in] package_name  The name of the package being worked on, if any.
+ */
+phase_timer::phase_timer(phase_t phase, const std::string& package_name)
+    : f_phase(phase)
+    , f_enabled(is_enabled())
+    //, f_package_name() -- initialized below
+    , f_wall_start(0)
+    , f_cpu_start(0)
+{
+    if(f_phase < 0 || f_phase >= phase_max)
+    {
+        throw std::overflow_error("the phase_timer was created with an invalid phase");
+    }
+    if(f_enabled)
+    {
+        f_package_name = package_name;
+        f_wall_start = wall_time();
+        f_cpu_start = cpu_time();
+    }
+}
+
+
+/** \brief Stop timing the phase.
+ *
+ * The time spent is added to the totals of the phase and a "phase"
+ * event is emitted. This happens even when an exception is being
+ * propagated.
+ */
+phase_timer::~phase_timer()
+{
+    if(!f_enabled)
+    {
+        return;
+    }
+
+    const uint64_t wall(wall_time() - f_wall_start);
+    const uint64_t cpu_now(cpu_time());
+    const uint64_t cpu(cpu_now > f_cpu_start ? cpu_now - f_cpu_start : 0);
+
+    phase_totals_t& totals(g_phases[f_phase]);
+    ++totals.f_count;
+    totals.f_wall_time += wall;
+    totals.f_cpu_time += cpu;
+
+    try
+    {
+        std::ostringstream json;
+        json << "{\"event\":\"phase\",\"phase\":\"" << phase_to_string(f_phase) << "\"";
+        if(!f_package_name.empty())
+        {
+            json << ",\"package\":";
+            write_json_string(json, f_package_name);
+        }
+        json << ",\"wall_us\":" << wall << ",\"cpu_us\":" << cpu << '}';
+        emit_event(json.str(), f_package_name);
+    }
+    catch(const std::exception&)
+    {
+        // never throw from a destructor
+    }
+}
+
+
+/** \brief Start a profiled scope.
+ *
+ * The scope gets added to the stack of the current thread. Whether the
+ * profiler runs is checked once here so a scope costs nothing when it
+ * does not.
+ *
+ * \param[in] name  The name of the scope; it must be a static string.
+ */
+profile_scope::profile_scope(const char *name)
+    : f_name(name)
+    , f_enabled(g_profiling)
+    , f_start(0)
+{
+    if(f_enabled)
+    {
+        profile_stack_t& stack(g_profile_stack);
+        if(!stack.f_names.empty())
+        {
+            stack.f_path += ';';
+        }
+        stack.f_path += f_name;
+        stack.f_names.push_back(f_name);
+        stack.f_child_time.push_back(0);
+        f_start = wall_time();
+    }
+}
+
+
+/** \brief End a profiled scope.
+ *
+ * The self time of the scope is added to its stack and its total time
+ * is added to the time of its parent scope so the parent self time
+ * can be computed.
+ */
+profile_scope::~profile_scope()
+{
+    if(!f_enabled)
+    {
+        return;
+    }
+
+    const uint64_t elapsed(wall_time() - f_start);
+
+    profile_stack_t& stack(g_profile_stack);
+    const uint64_t children(stack.f_child_time.back());
+    const uint64_t self(elapsed > children ? elapsed - children : 0);
+    const bool recursive(std::find(stack.f_names.begin(), stack.f_names.end() - 1, f_name) != stack.f_names.end() - 1);
+
+    try
+    {
+        std::lock_guard<std::mutex> lock(g_profile_mutex);
+        g_profile_stacks[stack.f_path] += self;
+        profile_totals_t& totals(g_profile_scopes[f_name]);
+        ++totals.f_calls;
+        if(!recursive)
+        {
+            totals.f_time += elapsed;
+        }
+        totals.f_self_time += self;
+    }
+    catch(const std::exception&)
+    {
+        // never throw from a destructor
+    }
+
+    stack.f_names.pop_back();
+    stack.f_child_time.pop_back();
+    if(stack.f_names.empty())
+    {
+        stack.f_path.clear();
+    }
+    else
+    {
+        stack.f_path.resize(stack.f_path.size() - strlen(f_name) - 1);
+        stack.f_child_time.back() += elapsed;
+    }
+}
+
+
+}   // namespace wpkg_metrics
+// vim: ts=4 sw=4 et
@@ -0,0 +1,131 @@
+/*    wpkg_metrics.h -- timings and counters of the packager processes
+ *    Copyright (C) 2012-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+
+/** \file
+ * \brief Metrics declarations.
+ *
+ * The library measures how long the main phases of an installation take
+ * (validation, dependency resolution, downloads, decompression, unpacking,
+ * scripts, configuration) and counts bytes, files, and cache hits. The
+ * results are sent through the output object as JSON lines with the
+ * module_metrics module and the debug_metrics debug flag so log files
+ * and applications embedding the library can process them.
+ *
+ * Nothing gets measured unless a listener accepts the debug_metrics
+ * messages (see wpkg_output::is_debug_enabled()).
+ *
+ * The profiler is a separate, finer grained tool: profile_scope objects
+ * placed around the main entry points of the library build a call tree
+ * which get_profile_report() returns as folded stacks (the input format
+ * of flame graph generators) once set_profiling() was called.
+ */
+#ifndef WPKG_METRICS_H
+#define WPKG_METRICS_H
+
+#include    "libdebpackages/wpkg_output.h"
+
+
+namespace wpkg_metrics
+{
+
+enum phase_t
+{
+    phase_validation,
+    phase_dependencies,
+    phase_download,
+    phase_decompress,
+    phase_unpack,
+    phase_scripts,
+    phase_configure,
+
+    phase_max       // must be last
+};
+
+enum counter_t
+{
+    counter_bytes_downloaded,
+    counter_bytes_decompressed,
+    counter_bytes_written,
+    counter_files_written,
+    counter_cache_hits,
+    counter_cache_misses,
+
+    counter_max     // must be last
+};
+
+DEBIAN_PACKAGE_EXPORT const char *phase_to_string(phase_t phase);
+DEBIAN_PACKAGE_EXPORT const char *counter_to_string(counter_t counter);
+
+DEBIAN_PACKAGE_EXPORT bool is_enabled();
+DEBIAN_PACKAGE_EXPORT void add_to_counter(counter_t counter, uint64_t value = 1);
+DEBIAN_PACKAGE_EXPORT uint64_t get_counter(counter_t counter);
+DEBIAN_PACKAGE_EXPORT uint64_t get_phase_count(phase_t phase);
+DEBIAN_PACKAGE_EXPORT uint64_t get_phase_wall_time(phase_t phase);
+DEBIAN_PACKAGE_EXPORT uint64_t get_phase_cpu_time(phase_t phase);
+DEBIAN_PACKAGE_EXPORT void reset();
+DEBIAN_PACKAGE_EXPORT std::string get_summary();
+DEBIAN_PACKAGE_EXPORT void emit_summary();
+
+DEBIAN_PACKAGE_EXPORT void set_profiling(bool profiling);
+DEBIAN_PACKAGE_EXPORT bool is_profiling();
+DEBIAN_PACKAGE_EXPORT std::string get_profile_report(size_t top);
+
+
+class DEBIAN_PACKAGE_EXPORT phase_timer
+{
+public:
+                                    phase_timer(phase_t phase, const std::string& package_name = "");
+                                    ~phase_timer();
+
+private:
+    // disallow copying
+                                    phase_timer(const phase_timer& rhs);
+    phase_timer&                    operator = (const phase_timer& rhs);
+
+    const phase_t                   f_phase;
+    const bool                      f_enabled;
+    std::string                     f_package_name;
+    uint64_t                        f_wall_start;
+    uint64_t                        f_cpu_start;
+};
+
+
+class DEBIAN_PACKAGE_EXPORT profile_scope
+{
+public:
+                                    profile_scope(const char *name);
+                                    ~profile_scope();
+
+private:
+    // disallow copying
+                                    profile_scope(const profile_scope& rhs);
+    profile_scope&                  operator = (const profile_scope& rhs);
+
+    const char * const              f_name;
+    const bool                      f_enabled;
+    uint64_t                        f_start;
+};
+
+
+}   // namespace wpkg_metrics
+#endif
+//#ifndef WPKG_METRICS_H
+// vim: ts=4 sw=4 et
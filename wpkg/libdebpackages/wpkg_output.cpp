@@ -32,7 +32,10 @@
 #include    "libdebpackages/wpkg_output.h"
 #include    "libdebpackages/compatibility.h"
 #include    <time.h>
+#include    <atomic>
+#include    <condition_variable>
 #include    <sstream>
+#include    <thread>
 
 #if !defined(MO_WINDOWS)
 #   include    <unistd.h>
@@ -138,6 +141,21 @@ namespace wpkg_output
  */
 
 
+/** \class silence_thread
+ * \brief Discard the log messages of the current thread.
+ *
+ * Background threads (i.e. the download cache prefetch threads) call
+ * library functions which log messages. Those messages would be
+ * counted as errors and mixed with the output of the main thread even
+ * though the main thread reports the same errors again when it needs
+ * the result. Creating a silence_thread object on the stack of such a
+ * thread discards all the messages it logs, including the progress
+ * records, until the object gets destroyed.
+ *
+ * Objects can be nested; the destructor restores the previous state.
+ */
+
+
 /** \class message_t
  * \brief An output message.
  *
@@ -195,6 +213,7 @@ const char *module_to_string(const module_t module)
     case module_field:                 return "field";
     case module_tool:                  return "tool";
     case module_track:                 return "track";
+    case module_metrics:               return "metrics";
 
     default:
         throw std::overflow_error("the module_to_string() function was called with an invalid module");
@@ -277,15 +296,25 @@ int compare_levels(level_t l1, level_t l2)
  */
 std::string generate_timestamp()
 {
-    char buf[1024];
+    // every log message gets a time stamp so we keep the last one
+    // generated by this thread and reuse it within the same second
+    thread_local time_t last_time(0);
+    thread_local std::string last_timestamp;
+
     time_t t;
     time(&t);
-    struct tm *m(localtime(&t));
-    // WARNING: remember that format needs to work on MS-Windows
-    strftime_utf8(buf, sizeof(buf) - 1, "%Y/%m/%d %H:%M:%S", m);
-    buf[sizeof(buf) / sizeof(buf[0]) - 1] = '\0';
+    if(t != last_time || last_timestamp.empty())
+    {
+        char buf[1024];
+        struct tm *m(localtime(&t));
+        // WARNING: remember that format needs to work on MS-Windows
+        strftime_utf8(buf, sizeof(buf) - 1, "%Y/%m/%d %H:%M:%S", m);
+        buf[sizeof(buf) / sizeof(buf[0]) - 1] = '\0';
+        last_timestamp = buf;
+        last_time = t;
+    }
     //
-    return buf;
+    return last_timestamp;
 }
 
 
@@ -415,6 +444,7 @@ void message_t::set_level(level_t level)
  * \li module_field
  * \li module_tool -- this is the default when creating a new message
  * \li module_track
+ * \li module_metrics
  *
  * \param[in] module  The new module of the message.
  */
@@ -424,7 +454,7 @@ void message_t::set_module(module_t module)
     {
         throw std::underflow_error("module is out of range in message_t::set_module()");
     }
-    if(module > module_track)
+    if(module > module_metrics)
     {
         throw std::overflow_error("module is out of range in message_t::set_module()");
     }
@@ -796,6 +826,49 @@ void progress_record_t::set_progress_what( const std::string& val )
 }
 
 
+
+namespace
+{
+    // Whether the log messages of this thread get discarded.
+    //
+    thread_local bool       g_thread_silenced(false);
+}
+
+
+/** \brief Start discarding the log messages of this thread.
+ *
+ * The messages logged by this thread are discarded until this object
+ * gets destroyed.
+ */
+silence_thread::silence_thread()
+    : f_previous(g_thread_silenced)
+{
+    g_thread_silenced = true;
+}
+
+
+/** \brief Restore the previous state.
+ *
+ * If another silence_thread object was created before this one, the
+ * messages continue to be discarded until that other object gets
+ * destroyed.
+ */
+silence_thread::~silence_thread()
+{
+    g_thread_silenced = f_previous;
+}
+
+
+/** \brief Check whether the log messages of this thread get discarded.
+ *
+ * \return true if a silence_thread object exists in this thread.
+ */
+bool silence_thread::is_silenced()
+{
+    return g_thread_silenced;
+}
+
+
 /** \brief Initialize the log with a message format.
  *
  * Set the format of the message to the specified \p format parameter.
@@ -982,13 +1055,34 @@ log::log(std::string& output_message, const std::wstring& format)
  * Note that if the log::set_output() was not yet called then nothing
  * happens since no output would be available for this function to
  * send the log message.
+ *
+ * Debug messages which none of the output listeners would accept
+ * (see is_debug_enabled()) are dropped before the arguments get
+ * replaced so they cost next to nothing.
  */
 log::~log()
 {
+    if(!f_output_message && silence_thread::is_silenced())
+    {
+        // this thread does not send anything to the output object
+        return;
+    }
+
     if(f_output_message)
     {
         *f_output_message = replace_arguments();
     }
+    else if(f_message.get_level() == level_debug
+         && f_message.get_debug_flags() != debug_flags::debug_none
+         && !is_debug_enabled(f_message.get_debug_flags()))
+    {
+        // nobody listens to this debug message, avoid formatting it
+        if( f_progress_rec )
+        {
+            output::get_output().lock()->progress( *f_progress_rec );
+        }
+        return;
+    }
 
     // mark the action as "debug" if undefined and the level is debug
     if(f_message.get_action().empty()
@@ -1711,6 +1805,371 @@ namespace
     // to access the static instance of the output object.
     //
     std::recursive_mutex    g_mutex;
+
+    // The debug flags that at least one listener accepts; kept
+    // outside of the output object so is_debug_enabled() can be
+    // checked without any lock.
+    //
+    std::atomic<debug_flags::debug_t> g_enabled_debug_flags(debug_flags::debug_none);
+
+    // Whether the atexit() function flushing the asynchronous writer
+    // was already registered.
+    //
+    bool                    g_flush_at_exit_registered(false);
+
+    // Set in the asynchronous writer thread; a raw log listener which
+    // emits a message from that thread gets it delivered immediately.
+    //
+    thread_local bool       g_in_writer_thread(false);
+
+    void flush_at_exit()
+    {
+        // the listeners often reference global objects which are about
+        // to be destroyed so make sure all messages get written now
+        output::get_output().lock()->set_asynchronous(false);
+    }
+}
+
+
+/** \brief Asynchronous delivery of the messages to the raw log listeners.
+ *
+ * When the output is asynchronous, output::log() only saves a copy of
+ * the message in a ring buffer for the raw log listeners. A background
+ * thread drains that buffer in batches and calls those listeners. This
+ * way the thread installing or removing packages does not wait on the
+ * log file. The user and progress listeners (i.e. the console) are
+ * still called by the thread emitting the message so their output does
+ * not get mixed up with the output of the command itself.
+ *
+ * The ring buffer is a fixed array of slots, each with a sequence
+ * number which tells whether it is free or holds a message. Producers
+ * reserve a slot with a compare-and-swap so they never take a lock.
+ * There is only one consumer: the writer thread.
+ *
+ * The buffer has a fixed capacity so memory stays bounded. What happens
+ * when it is full depends on the overflow policy.
+ */
+class output::async_writer
+{
+public:
+    static const size_t     BATCH_SIZE = 64;
+
+                            async_writer(const output *out, size_t capacity, overflow_policy_t policy);
+                            ~async_writer();
+
+    void                    push(const message_t& message);
+    void                    flush();
+    uint64_t                get_dropped_count() const;
+    static bool             is_writer_thread();
+
+private:
+    struct slot_t
+    {
+        std::atomic<size_t>     f_sequence;
+        message_t               f_message;
+    };
+
+    // disallow copying
+                            async_writer(const async_writer& rhs);
+    async_writer&           operator = (const async_writer& rhs);
+
+    bool                    try_push(const message_t& message);
+    bool                    is_empty() const;
+    void                    wake_up();
+    void                    run();
+
+    const output *                  f_output;
+    const overflow_policy_t         f_policy;
+    size_t                          f_mask;
+    std::unique_ptr<slot_t[]>       f_slots;
+    std::atomic<size_t>             f_enqueue_pos;
+    size_t                          f_dequeue_pos;
+    std::atomic<size_t>             f_delivered;
+    std::atomic<uint64_t>           f_dropped;
+    std::atomic<bool>               f_writer_waiting;
+    std::atomic<bool>               f_stop;
+    std::mutex                      f_wait_mutex;
+    std::condition_variable         f_wake;
+    std::condition_variable         f_flushed;
+    std::thread                     f_thread;
+};
+
+
+/** \brief Initialize the writer and start its thread.
+ *
+ * The \p capacity is rounded up to a power of two.
+ *
+ * \param[in] out  The output object whose raw log listeners receive the messages.
+ * \param[in] capacity  The maximum number of messages waiting to be written.
+ * \param[in] policy  What to do with new messages when the buffer is full.
+ */
+output::async_writer::async_writer(const output *out, size_t capacity, overflow_policy_t policy)
+    : f_output(out)
+    , f_policy(policy)
+    , f_mask(1)
+    //, f_slots() -- auto-init
+    , f_enqueue_pos(0)
+    , f_dequeue_pos(0)
+    , f_delivered(0)
+    , f_dropped(0)
+    , f_writer_waiting(false)
+    , f_stop(false)
+    //, f_wait_mutex() -- auto-init
+    //, f_wake() -- auto-init
+    //, f_flushed() -- auto-init
+    //, f_thread() -- auto-init
+{
+    while(f_mask < capacity)
+    {
+        f_mask <<= 1;
+    }
+    f_slots.reset(new slot_t[f_mask]);
+    for(size_t i(0); i < f_mask; ++i)
+    {
+        f_slots[i].f_sequence = i;
+    }
+    --f_mask;
+
+    f_thread = std::thread(&async_writer::run, this);
+}
+
+
+/** \brief Write the remaining messages and stop the thread.
+ *
+ * The destructor does not return until all the messages that were
+ * pushed were delivered to the raw log listeners.
+ */
+output::async_writer::~async_writer()
+{
+    f_stop = true;
+    wake_up();
+    if(f_thread.joinable())
+    {
+        f_thread.join();
+    }
+}
+
+
+/** \brief Add a message to the buffer.
+ *
+ * If the buffer is full, the message is dropped or the function waits
+ * for the writer thread to make room, depending on the overflow policy.
+ * Errors are never dropped.
+ *
+ * \param[in] message  The message to push.
+ */
+void output::async_writer::push(const message_t& message)
+{
+    while(!try_push(message))
+    {
+        bool drop(false);
+        switch(f_policy)
+        {
+        case overflow_policy_block:
+            break;
+
+        case overflow_policy_drop_debug:
+            drop = message.get_level() == level_debug;
+            break;
+
+        case overflow_policy_drop:
+            drop = compare_levels(message.get_level(), level_error) < 0;
+            break;
+
+        }
+        if(drop)
+        {
+            ++f_dropped;
+            return;
+        }
+
+        // full, give the writer a chance to catch up
+        wake_up();
+        std::this_thread::yield();
+    }
+
+    if(f_writer_waiting)
+    {
+        wake_up();
+    }
+}
+
+
+/** \brief Try to save a message in the next free slot.
+ *
+ * \param[in] message  The message to push.
+ *
+ * \return false if the buffer is full.
+ */
+bool output::async_writer::try_push(const message_t& message)
+{
+    size_t pos(f_enqueue_pos.load(std::memory_order_relaxed));
+    slot_t *slot;
+    for(;;)
+    {
+        slot = &f_slots[pos & f_mask];
+        const size_t seq(slot->f_sequence.load(std::memory_order_acquire));
+        if(seq == pos)
+        {
+            if(f_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+            // pos was reloaded by compare_exchange_weak()
+        }
+        else if(seq < pos)
+        {
+            // the writer did not yet empty this slot
+            return false;
+        }
+        else
+        {
+            pos = f_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->f_message = message;
+    slot->f_sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+
+/** \brief Check whether the writer has nothing to write.
+ *
+ * Only the writer thread may call this function.
+ *
+ * \return true if the next slot to be read was not yet filled.
+ */
+bool output::async_writer::is_empty() const
+{
+    return f_slots[f_dequeue_pos & f_mask].f_sequence.load(std::memory_order_acquire) != f_dequeue_pos + 1;
+}
+
+
+/** \brief Wake up the writer thread.
+ */
+void output::async_writer::wake_up()
+{
+    std::lock_guard<std::mutex> lock(f_wait_mutex);
+    f_wake.notify_one();
+}
+
+
+/** \brief Wait until all the messages pushed so far were written.
+ *
+ * Messages pushed by other threads while waiting may or may not be
+ * written by the time this function returns.
+ *
+ * Calling this function from a raw log listener (i.e. from the writer
+ * thread itself) returns immediately.
+ */
+void output::async_writer::flush()
+{
+    if(is_writer_thread())
+    {
+        return;
+    }
+
+    const size_t ticket(f_enqueue_pos.load());
+    std::unique_lock<std::mutex> lock(f_wait_mutex);
+    f_wake.notify_one();
+    while(f_delivered.load() < ticket)
+    {
+        f_flushed.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+
+/** \brief Retrieve the number of messages that were dropped.
+ *
+ * \return The number of messages dropped because the buffer was full.
+ */
+uint64_t output::async_writer::get_dropped_count() const
+{
+    return f_dropped;
+}
+
+
+/** \brief Check whether the caller is the writer thread.
+ *
+ * \return true when called from a raw log listener run by the writer.
+ */
+bool output::async_writer::is_writer_thread()
+{
+    return g_in_writer_thread;
+}
+
+
+/** \brief The writer thread.
+ *
+ * The thread takes up to BATCH_SIZE messages out of the buffer at once
+ * and then sends them to the raw log listeners. When the buffer is empty it
+ * sleeps until a producer wakes it up.
+ */
+void output::async_writer::run()
+{
+    g_in_writer_thread = true;
+
+    std::vector<slot_t *> batch;
+    batch.reserve(BATCH_SIZE);
+    for(;;)
+    {
+        // the slots stay reserved until delivered so we can read them
+        // in place instead of copying the messages once more
+        batch.clear();
+        for(size_t pos(f_dequeue_pos); batch.size() < BATCH_SIZE; ++pos)
+        {
+            slot_t *slot(&f_slots[pos & f_mask]);
+            if(slot->f_sequence.load(std::memory_order_acquire) != pos + 1)
+            {
+                break;
+            }
+            batch.push_back(slot);
+        }
+
+        if(batch.empty())
+        {
+            std::unique_lock<std::mutex> lock(f_wait_mutex);
+            if(f_stop && is_empty())
+            {
+                break;
+            }
+            f_writer_waiting = true;
+            if(is_empty() && !f_stop)
+            {
+                // the timeout protects against a missed notification
+                f_wake.wait_for(lock, std::chrono::milliseconds(10));
+            }
+            f_writer_waiting = false;
+            continue;
+        }
+
+        {
+            std::lock_guard<std::recursive_mutex> lg(f_output->f_listener_mutex);
+            for(auto slot : batch)
+            {
+                // there is nobody to report an exception to in this thread
+                try
+                {
+                    f_output->log_raw_output(slot->f_message);
+                }
+                catch(const std::exception&)
+                {
+                }
+            }
+        }
+
+        // release the slots to the producers
+        for(auto slot : batch)
+        {
+            slot->f_sequence.store(f_dequeue_pos + f_mask + 1, std::memory_order_release);
+            ++f_dequeue_pos;
+        }
+
+        std::lock_guard<std::mutex> lock(f_wait_mutex);
+        f_delivered += batch.size();
+        f_flushed.notify_all();
+    }
 }
 
 
@@ -1735,12 +2194,19 @@ std::weak_ptr<output> output::get_output()
 
 
 output::output()
+    //: f_program_name("") -- auto-init
+    //, f_debug_flags(debug_none) -- auto-init
+    : f_log_debug_flags(debug_flags::debug_all)
+    //, f_error_count(0) -- auto-init
+    //, f_exception_on_error(false) -- auto-init
 {
 }
 
 
 output::~output()
 {
+    // stop the writer before the listeners get destroyed
+    f_async_writer.reset();
 }
 
 
@@ -1792,16 +2258,78 @@ bool output::get_exception_on_error() const
  */
 void output::log(const message_t& message) const
 {
-    std::lock_guard<std::recursive_mutex> lg(f_mutex);
-
-    if(compare_levels(message.get_level(), level_error) >= 0)
+    const bool is_error(compare_levels(message.get_level(), level_error) >= 0);
+    if(is_error)
     {
+        std::lock_guard<std::recursive_mutex> lg(f_mutex);
         ++f_error_count;
     }
 
-    // always send to the log (i.e. no test against the debug flags)
-    f_log_output( message );
+    std::shared_ptr<async_writer> writer(async_writer::is_writer_thread() ? std::shared_ptr<async_writer>() : get_async_writer());
+    if(writer)
+    {
+        // do not wait on the log file, except for errors which
+        // we want saved before anything else happens
+        writer->push(message);
+        if(is_error)
+        {
+            writer->flush();
+        }
+    }
+    else
+    {
+        std::lock_guard<std::recursive_mutex> lg(f_listener_mutex);
+        log_raw_output( message );
+    }
+
+    // the console output always happens in the emitting thread so
+    // it appears in order with whatever else that thread prints
+    {
+        std::lock_guard<std::recursive_mutex> lg(f_user_listener_mutex);
+        log_user_output( message );
+    }
+
+    if( get_exception_on_error() && error_count() )
+    {
+        throw wpkg_output_exception( message.get_full_message().c_str() );
+    }
+}
+
+
+/** \brief Send a message to the raw log listeners.
+ *
+ * This function calls the raw log listeners unless the message is a
+ * debug message which the log debug flags exclude. It is called
+ * directly by log() or by the asynchronous writer thread.
+ *
+ * The caller must hold f_listener_mutex.
+ *
+ * \param[in] message  The message to send to the raw log listeners.
+ */
+void output::log_raw_output(const message_t& message) const
+{
+    // send to the log unless the log debug flags were restricted
+    if(message.get_level() != level_debug
+    || f_log_debug_flags == debug_flags::debug_all
+    || (message.get_debug_flags() & f_log_debug_flags) != 0)
+    {
+        f_log_output( message );
+    }
+}
+
 
+/** \brief Send a message to the user listeners.
+ *
+ * This function calls the user listeners unless the message is a
+ * debug message which the user did not ask to see. It is always
+ * called by the thread that emitted the message.
+ *
+ * The caller must hold f_user_listener_mutex.
+ *
+ * \param[in] message  The message to send to the user listeners.
+ */
+void output::log_user_output(const message_t& message) const
+{
     // if the message is a debug message, then make sure that
     // at least one of the debug flags was turned on by the user
     if(message.get_level() != level_debug
@@ -1809,11 +2337,6 @@ void output::log(const message_t& message) const
     {
         f_user_output( message );
     }
-
-    if( f_exception_on_error && f_error_count )
-    {
-        throw wpkg_output_exception( message.get_full_message().c_str() );
-    }
 }
 
 
@@ -1823,11 +2346,124 @@ void output::log(const message_t& message) const
  */
 void output::progress(const progress_record_t& record) const
 {
-    std::lock_guard<std::recursive_mutex> lg(f_mutex);
+    std::lock_guard<std::recursive_mutex> lg(f_user_listener_mutex);
     f_progress_output( record );
 }
 
 
+/** \brief Send the messages to the raw log listeners from a background thread.
+ *
+ * By default the listeners are called by the thread that emits the
+ * message. When \p async is true, messages are saved in a buffer of
+ * \p capacity messages instead and a background thread calls the
+ * raw log listeners. The emitting thread does not wait on the I/O
+ * those listeners do (i.e. writing a log file.) The user and progress
+ * listeners are still called by the emitting thread.
+ *
+ * The messages are always delivered in order. Messages of level error
+ * or fatal are written before log() returns. The flush() function
+ * can be used to wait for all the other messages. Calling this
+ * function with \p async set to false also writes all the pending
+ * messages before returning. The same happens when the process exits
+ * and when clear_listeners() is called.
+ *
+ * When the buffer is full, the \p policy defines whether the caller
+ * waits or the message gets dropped. Error messages are never dropped.
+ *
+ * \warning
+ * The raw log listeners get called from another thread. They must not
+ * expect to run in the thread that emitted the message.
+ *
+ * \param[in] async  Whether the raw log listeners are called asynchronously.
+ * \param[in] capacity  The number of messages the buffer can hold.
+ * \param[in] policy  What to do with new messages when the buffer is full.
+ */
+void output::set_asynchronous(bool async, size_t capacity, overflow_policy_t policy)
+{
+    std::shared_ptr<async_writer> old_writer;
+    {
+        std::lock_guard<std::recursive_mutex> lg(f_mutex);
+        old_writer = f_async_writer;
+        f_async_writer.reset();
+        if(async)
+        {
+            if(capacity == 0)
+            {
+                throw wpkg_output_exception_parameter("the asynchronous output capacity cannot be zero");
+            }
+            f_async_writer.reset(new async_writer(this, capacity, policy));
+            if(!g_flush_at_exit_registered)
+            {
+                g_flush_at_exit_registered = true;
+                atexit(flush_at_exit);
+            }
+        }
+    }
+
+    // the old writer drains its buffer before it gets destroyed
+    if(old_writer)
+    {
+        old_writer->flush();
+    }
+}
+
+
+/** \brief Check whether the output is asynchronous.
+ *
+ * \return true if set_asynchronous() was last called with true.
+ */
+bool output::get_asynchronous() const
+{
+    return get_async_writer() != NULL;
+}
+
+
+/** \brief Wait until all the messages were sent to the listeners.
+ *
+ * When the output is asynchronous, this function waits until the
+ * messages emitted so far were given to the raw log listeners. Otherwise
+ * it returns immediately.
+ */
+void output::flush() const
+{
+    std::shared_ptr<async_writer> writer(get_async_writer());
+    if(writer)
+    {
+        writer->flush();
+    }
+}
+
+
+/** \brief Retrieve the number of messages that were dropped.
+ *
+ * When the output is asynchronous and the overflow policy allows it,
+ * messages get dropped when the buffer is full. This function returns
+ * how many were dropped by the current writer.
+ *
+ * \return The number of dropped messages.
+ */
+uint64_t output::get_dropped_count() const
+{
+    std::shared_ptr<async_writer> writer(get_async_writer());
+    if(writer)
+    {
+        return writer->get_dropped_count();
+    }
+    return 0;
+}
+
+
+/** \brief Retrieve the asynchronous writer if there is one.
+ *
+ * \return A pointer to the writer or NULL.
+ */
+std::shared_ptr<output::async_writer> output::get_async_writer() const
+{
+    std::lock_guard<std::recursive_mutex> lg(f_mutex);
+    return f_async_writer;
+}
+
+
 /** \brief Define the set of debug flags that the user wants to see.
  *
  * This function saves a set of debug flags that the user wants to
@@ -1841,7 +2477,9 @@ void output::progress(const progress_record_t& record) const
 void output::set_debug_flags(debug_flags::debug_t debug_flags)
 {
     std::lock_guard<std::recursive_mutex> lg(f_mutex);
+    std::lock_guard<std::recursive_mutex> ulg(f_user_listener_mutex);
     f_debug_flags = debug_flags;
+    update_enabled_debug_flags();
 }
 
 
@@ -1861,6 +2499,60 @@ debug_flags::debug_t output::get_debug_flags() const
 }
 
 
+/** \brief Define the set of debug flags sent to the raw log listeners.
+ *
+ * By default the raw log listeners receive all the messages, including
+ * all the debug messages. When an application knows that its log
+ * listener does not need some (or any) of the debug messages, for
+ * example because no log file was opened, it can restrict them here.
+ *
+ * This matters because debug messages that none of the listeners
+ * accept are not even formatted (see is_debug_enabled()).
+ *
+ * \param[in] debug_flags  The set of debug flags the raw log listeners accept.
+ */
+void output::set_log_debug_flags(debug_flags::debug_t debug_flags)
+{
+    std::lock_guard<std::recursive_mutex> lg(f_mutex);
+    std::lock_guard<std::recursive_mutex> llg(f_listener_mutex);
+    f_log_debug_flags = debug_flags;
+    update_enabled_debug_flags();
+}
+
+
+/** \brief Retrieve the set of debug flags sent to the raw log listeners.
+ *
+ * This function returns the flags defined with set_log_debug_flags().
+ * The default is debug_flags::debug_all.
+ *
+ * \return The set of debug flags the raw log listeners accept.
+ */
+debug_flags::debug_t output::get_log_debug_flags() const
+{
+    std::lock_guard<std::recursive_mutex> lg(f_mutex);
+    return f_log_debug_flags;
+}
+
+
+/** \brief Recompute the debug flags that at least one listener accepts.
+ *
+ * The user listeners accept the messages matching the debug flags and
+ * the raw log listeners, if any, accept those matching the log debug
+ * flags. The union is what is_debug_enabled() checks against.
+ *
+ * The caller must hold f_mutex.
+ */
+void output::update_enabled_debug_flags()
+{
+    debug_flags::debug_t enabled(f_debug_flags);
+    if(!f_log_output.empty())
+    {
+        enabled |= f_log_debug_flags;
+    }
+    g_enabled_debug_flags = enabled;
+}
+
+
 /** \brief Retrieve the current number of errors.
  *
  * This function returns the number of errors that have already been emitted
@@ -1915,7 +2607,9 @@ void output::reset_error_count()
 void output::register_raw_log_listener( listener_func_t func )
 {
     std::lock_guard<std::recursive_mutex> lg(f_mutex);
+    std::lock_guard<std::recursive_mutex> llg(f_listener_mutex);
     f_log_output.register_listener( func );
+    update_enabled_debug_flags();
 }
 
 
@@ -1934,6 +2628,7 @@ void output::register_raw_log_listener( listener_func_t func )
 void output::register_user_log_listener( listener_func_t func )
 {
     std::lock_guard<std::recursive_mutex> lg(f_mutex);
+    std::lock_guard<std::recursive_mutex> ulg(f_user_listener_mutex);
     f_user_output.register_listener( func );
 }
 
@@ -1947,15 +2642,23 @@ void output::register_user_log_listener( listener_func_t func )
 void output::register_progress_listener( progress_listener_func_t func )
 {
     std::lock_guard<std::recursive_mutex> lg(f_mutex);
+    std::lock_guard<std::recursive_mutex> ulg(f_user_listener_mutex);
     f_progress_output.register_listener( func );
 }
 
 
 void output::clear_listeners()
 {
+    // pending messages go to the listeners being removed
+    flush();
+
+    std::lock_guard<std::recursive_mutex> lg(f_mutex);
+    std::lock_guard<std::recursive_mutex> llg(f_listener_mutex);
+    std::lock_guard<std::recursive_mutex> ulg(f_user_listener_mutex);
     f_log_output      .clear();
     f_user_output     .clear();
     f_progress_output .clear();
+    update_enabled_debug_flags();
 }
 
 
@@ -1996,6 +2699,26 @@ uint32_t get_output_error_count()
 }
 
 
+/** \brief Check whether a debug message would be output.
+ *
+ * This function checks whether at least one of the \p dbg_flags is
+ * accepted by a listener of the output object: either the user listeners
+ * through the debug flags or the raw log listeners through the log debug
+ * flags.
+ *
+ * The function does not lock anything so it can be called in tight
+ * loops. The WPKG_OUTPUT_IF_DEBUG() macro makes use of it.
+ *
+ * \param[in] dbg_flags  The debug flags of the message to be checked.
+ *
+ * \return true if a debug message with those flags would be used.
+ */
+bool is_debug_enabled(debug_flags::debug_t dbg_flags)
+{
+    return (g_enabled_debug_flags & dbg_flags) != 0;
+}
+
+
 
 } // namespace wpkg_output
 // vim: ts=4 sw=4 et
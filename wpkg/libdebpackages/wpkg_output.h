@@ -110,7 +110,8 @@ enum module_t
     module_copyright,
     module_field,
     module_tool,
-    module_track
+    module_track,
+    module_metrics
 };
 
 typedef controlled_vars::auto_enum_init<module_t, module_tool> safe_module_t;
@@ -142,7 +143,8 @@ public:
     static const debug_t    debug_trigger          = 010000; // trigger activation and processing
     static const debug_t    debug_detail_trigger   = 020000; // detailed output for each trigger
     static const debug_t    debug_full_trigger     = 040000; // all output about each trigger
-    static const debug_t    debug_all              = 077777;
+    static const debug_t    debug_metrics          = 0100000; // timings and counters as JSON lines
+    static const debug_t    debug_all              = 0177777;
 
     typedef controlled_vars::auto_init<debug_t, debug_none> safe_debug_t;
 
@@ -279,6 +281,22 @@ private:
 };
 
 
+class DEBIAN_PACKAGE_EXPORT silence_thread
+{
+public:
+                            silence_thread();
+                            ~silence_thread();
+
+                            silence_thread(const silence_thread& ) = delete;
+    silence_thread&         operator =(const silence_thread& ) = delete;
+
+    static bool             is_silenced();
+
+private:
+    bool                    f_previous;
+};
+
+
 template <class T>
 class DEBIAN_PACKAGE_EXPORT listener_list_t
 {
@@ -305,6 +323,11 @@ class DEBIAN_PACKAGE_EXPORT listener_list_t
             f_func_list.clear();
         }
 
+        bool empty() const
+        {
+            return f_func_list.empty();
+        }
+
     private:
         typedef std::vector<func_t> func_list_t;
 
@@ -315,6 +338,15 @@ class DEBIAN_PACKAGE_EXPORT listener_list_t
 class DEBIAN_PACKAGE_EXPORT output
 {
 public:
+    enum overflow_policy_t
+    {
+        overflow_policy_block,          // wait for the writer to make room
+        overflow_policy_drop_debug,     // drop debug messages, wait for others
+        overflow_policy_drop            // drop anything below level_error
+    };
+
+    static const size_t     DEFAULT_ASYNC_CAPACITY = 4096;
+
     virtual                 ~output();
 
     // Forbid copy construction and assignment
@@ -326,6 +358,8 @@ public:
     const std::string&      get_program_name() const;
     void                    set_debug_flags(debug_flags::debug_t debug_flags);
     debug_flags::debug_t    get_debug_flags() const;
+    void                    set_log_debug_flags(debug_flags::debug_t debug_flags);
+    debug_flags::debug_t    get_log_debug_flags() const;
     uint32_t                error_count() const;
     void                    reset_error_count();
     void                    set_exception_on_error( const bool val = true );
@@ -334,6 +368,11 @@ public:
     void                    log(const message_t& message) const;
     void                    progress( const progress_record_t& record ) const;
 
+    void                    set_asynchronous(bool async, size_t capacity = DEFAULT_ASYNC_CAPACITY, overflow_policy_t policy = overflow_policy_block);
+    bool                    get_asynchronous() const;
+    void                    flush() const;
+    uint64_t                get_dropped_count() const;
+
     typedef listener_list_t<message_t>::func_t listener_func_t;
     void                    register_raw_log_listener  ( listener_func_t func );
     void                    register_user_log_listener ( listener_func_t func );
@@ -347,13 +386,19 @@ public:
 
 
 private:
+    class async_writer;
+
                                                 output();   // Forbid construction except by get_output()
 
     std::string                          f_program_name;
     debug_flags::safe_debug_t            f_debug_flags;
+    debug_flags::debug_t                 f_log_debug_flags;
     mutable controlled_vars::zuint32_t   f_error_count;
     controlled_vars::zbool_t             f_exception_on_error;
     mutable std::recursive_mutex         f_mutex;
+    mutable std::recursive_mutex         f_listener_mutex;
+    mutable std::recursive_mutex         f_user_listener_mutex;
+    std::shared_ptr<async_writer>        f_async_writer;
 
     listener_list_t<message_t>           f_log_output;
     listener_list_t<message_t>           f_user_output;
@@ -363,12 +408,34 @@ private:
 
     void log_raw_output  ( const message_t& message ) const;
     void log_user_output ( const message_t& message ) const;
+    void update_enabled_debug_flags();
+    std::shared_ptr<async_writer> get_async_writer() const;
 };
 
 DEBIAN_PACKAGE_EXPORT std::shared_ptr<output> get_output();
 DEBIAN_PACKAGE_EXPORT debug_flags::debug_t    get_output_debug_flags();
 DEBIAN_PACKAGE_EXPORT uint32_t                get_output_error_count();
+DEBIAN_PACKAGE_EXPORT bool                    is_debug_enabled(debug_flags::debug_t dbg_flags);
 
 }       // namespace wpkg_output
+
+
+/** \brief Skip a debug log when nobody would see it.
+ *
+ * Put this macro in front of a wpkg_output::log() statement that is
+ * only a debug message. When none of the \p flags are enabled, the
+ * statement is skipped entirely so its arguments do not even get
+ * computed. Use it in loops that run once per file or per package.
+ *
+ * \code
+ * WPKG_OUTPUT_IF_DEBUG(wpkg_output::debug_flags::debug_detail_files)
+ *     wpkg_output::log("Reading file %1.")
+ *             .quoted_arg(filename)
+ *         .debug(wpkg_output::debug_flags::debug_detail_files);
+ * \endcode
+ */
+#define WPKG_OUTPUT_IF_DEBUG(flags) \
+    if(!wpkg_output::is_debug_enabled(flags)) {} else
+
 // vim: ts=4 sw=4 et
 #endif //#ifndef WPKGAR_OUTPUT_H
@@ -291,6 +291,48 @@ bool is_package_name(const std::string& name)
 }
 
 
+namespace
+{
+
+/** \brief Transform a checksums file into a map.
+ *
+ * This function is the implementation of parse_md5sums() and
+ * parse_sha256sums(). Only the length of the checksums differs.
+ *
+ * \param[in,out] sums  The map where the sums are saved.
+ * \param[in,out] sumsfile  The file to read for sums.
+ * \param[in] length  The number of hexadecimal digits in one checksum.
+ * \param[in] name  The name of the checksums file, used in errors.
+ */
+void parse_checksums(md5sums_map_t& sums, memfile::memory_file& sumsfile, std::string::size_type length, const std::string& name)
+{
+    int offset(0);
+    std::string line;
+    while(sumsfile.read_line(offset, line))
+    {
+        if(line.length() < length + 3)
+        {
+            throw wpkg_util_exception_invalid("input line is too short for an " + name + " file");
+        }
+        std::string sum(line.substr(0, length));
+        if(line[length] != ' '
+        || (line[length + 1] != ' ' && line[length + 1] != '*'))
+        {
+            throw wpkg_util_exception_invalid("invalid checksum and filename separator \"  \" or \" *\" expected in " + name + " file");
+        }
+        std::string filename(line.substr(length + 2));
+        if(isspace(*filename.begin())
+        || isspace(*filename.rbegin()))
+        {
+            throw wpkg_util_exception_invalid("filename cannot start/end with a space");
+        }
+        sums[filename] = sum;
+    }
+}
+
+} // no name namespace
+
+
 /** \brief Transform an md5sums file into a map.
  *
  * This function reads the list of filenames and md5sums from
@@ -312,28 +354,23 @@ bool is_package_name(const std::string& name)
  */
 void parse_md5sums(md5sums_map_t& sums, memfile::memory_file& md5file)
 {
-    int offset(0);
-    std::string line;
-    while(md5file.read_line(offset, line))
-    {
-        if(line.length() < 35)
-        {
-            throw wpkg_util_exception_invalid("input line is too short for an md5sums file");
-        }
-        std::string md5sum(line.substr(0, 32));
-        if(line[32] != ' '
-        || (line[33] != ' ' && line[33] != '*'))
-        {
-            throw wpkg_util_exception_invalid("invalid md5sum and filename separator \"  \" or \" *\" expected");
-        }
-        std::string filename(line.substr(34));
-        if(isspace(*filename.begin())
-        || isspace(*filename.rbegin()))
-        {
-            throw wpkg_util_exception_invalid("filename cannot start/end with a space");
-        }
-        sums[filename] = md5sum;
-    }
+    parse_checksums(sums, md5file, 32, "md5sums");
+}
+
+
+/** \brief Transform a sha256sums file into a map.
+ *
+ * This function reads the list of filenames and sha256sums from
+ * a sha256sums file and transforms that in a map. The format is the
+ * same as the md5sums file (see parse_md5sums()) except that each
+ * checksum is 64 hexadecimal digits.
+ *
+ * \param[in,out] sums  The map where the sums are saved. It is NOT cleared by this function.
+ * \param[in,out] sha256file  The file to read for sums.
+ */
+void parse_sha256sums(md5sums_map_t& sums, memfile::memory_file& sha256file)
+{
+    parse_checksums(sums, sha256file, 64, "sha256sums");
 }
 
 
@@ -473,27 +510,22 @@ std::string make_safe_console_string(const std::string& str)
  */
 int versioncmp(const std::string& a, const std::string& b)
 {
-    char error_string[256];
+    // the versions are parsed on the stack, no memory gets allocated
+    const char *error_msg(NULL);
 
-    debian_version_handle_t l(string_to_debian_version(a.c_str(), error_string, sizeof(error_string)));
-    if(l == 0)
+    debian_version::value l;
+    if(!l.set(a, &error_msg))
     {
-        throw wpkg_util_exception_invalid("left hand side version " + a + " is invalid (" + error_string + ")");
+        throw wpkg_util_exception_invalid("left hand side version " + a + " is invalid (" + error_msg + ")");
     }
 
-    debian_version_handle_t r(string_to_debian_version(b.c_str(), error_string, sizeof(error_string)));
-    if(r == 0)
+    debian_version::value r;
+    if(!r.set(b, &error_msg))
     {
-        delete_debian_version(l);
-        throw wpkg_util_exception_invalid("right hand side version " + b + " is invalid (" + error_string + ")");
+        throw wpkg_util_exception_invalid("right hand side version " + b + " is invalid (" + error_msg + ")");
     }
 
-    int result = debian_versions_compare(l, r);
-
-    delete_debian_version(l);
-    delete_debian_version(r);
-
-    return result;
+    return l.compare(r);
 }
 
 
@@ -54,6 +54,7 @@ DEBIAN_PACKAGE_EXPORT bool is_special_windows_filename(const std::string& path_p
 DEBIAN_PACKAGE_EXPORT bool is_valid_windows_filename(const std::string& filename);
 DEBIAN_PACKAGE_EXPORT bool is_package_name(const std::string& name);
 DEBIAN_PACKAGE_EXPORT void parse_md5sums(md5sums_map_t& sums, memfile::memory_file& md5file);
+DEBIAN_PACKAGE_EXPORT void parse_sha256sums(md5sums_map_t& sums, memfile::memory_file& sha256file);
 DEBIAN_PACKAGE_EXPORT std::string rfc2822_date(time_t t = 0);
 DEBIAN_PACKAGE_EXPORT bool is_valid_uri(const std::string& uri, std::string protocols = "");
 DEBIAN_PACKAGE_EXPORT std::string make_safe_console_string(const std::string& str);
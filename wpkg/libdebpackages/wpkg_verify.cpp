@@ -0,0 +1,527 @@
+/*    wpkg_verify.cpp -- verify the md5sums of many files
+ *    Copyright (C) 2012-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+
+/** \file
+ * \brief Verify the md5sums of a list of files.
+ *
+ * This file implements the md5sums verifier. The verifier reads each file
+ * in large chunks and pushes the data directly to the md5 context instead
+ * of first loading the whole file in a memory_file. The files are
+ * distributed between a set of worker threads so a large number of files
+ * can be verified concurrently.
+ */
+#include    "libdebpackages/wpkg_verify.h"
+#include    "libdebpackages/wpkg_stream.h"
+#include    "libdebpackages/memfile.h"
+
+#include    <algorithm>
+#include    <atomic>
+#include    <memory>
+#include    <thread>
+
+namespace wpkg_verify
+{
+
+
+/** \class md5sums_verifier
+ * \brief Verify the md5sums of a list of files.
+ *
+ * This class is used to check the md5sums of a large number of files.
+ * The user adds the files with their expected md5sum and then calls
+ * the run() function. Once run() returns, each entry has a status,
+ * the md5sum that was computed, and an error message if the file could
+ * not be read.
+ *
+ * The entries are kept in the order they were added so the results can
+ * be reported in a stable order whatever the number of jobs used to
+ * compute the md5sums.
+ *
+ * The verifier does not emit any log. The worker threads only compute
+ * md5sums and the caller is expected to report the results once run()
+ * returned.
+ */
+
+
+/** \class md5sums_verifier::file_entry
+ * \brief One file to be verified.
+ *
+ * This class holds the name of a file, its expected md5sum and, once
+ * the verifier ran, the result of the verification.
+ */
+
+
+/** \brief Initialize a file entry.
+ *
+ * The entry is created with the filename to check and the md5sum that
+ * the file is expected to have. The status is set to unknown until
+ * the verifier runs.
+ *
+ * \param[in] filename  The name of the file to verify.
+ * \param[in] expected_md5sum  The md5sum as a 32 hexadecimal digits string.
+ */
+md5sums_verifier::file_entry::file_entry(const wpkg_filename::uri_filename& filename, const std::string& expected_md5sum)
+    : f_filename(filename)
+    , f_expected_md5sum(expected_md5sum)
+    //, f_md5sum("") -- auto-init
+    //, f_error("") -- auto-init
+    , f_status(verify_status_unknown)
+{
+}
+
+
+/** \brief Retrieve the name of the file of this entry.
+ *
+ * \return The filename as passed to add_file().
+ */
+const wpkg_filename::uri_filename& md5sums_verifier::file_entry::get_filename() const
+{
+    return f_filename;
+}
+
+
+/** \brief Retrieve the expected md5sum.
+ *
+ * \return The md5sum as passed to add_file().
+ */
+const std::string& md5sums_verifier::file_entry::get_expected_md5sum() const
+{
+    return f_expected_md5sum;
+}
+
+
+/** \brief Retrieve the md5sum that was computed.
+ *
+ * This function returns the md5sum of the file as computed by the
+ * verifier. It remains empty if the file could not be read.
+ *
+ * \return The computed md5sum.
+ */
+const std::string& md5sums_verifier::file_entry::get_md5sum() const
+{
+    return f_md5sum;
+}
+
+
+/** \brief Retrieve the error that occurred while reading the file.
+ *
+ * When the status is verify_status_error, this function returns the
+ * message of the exception that was raised while reading the file.
+ *
+ * \return The error message or an empty string.
+ */
+const std::string& md5sums_verifier::file_entry::get_error() const
+{
+    return f_error;
+}
+
+
+/** \brief Retrieve the status of this entry.
+ *
+ * \return The verification status of this entry.
+ */
+md5sums_verifier::verify_status_t md5sums_verifier::file_entry::get_status() const
+{
+    return f_status;
+}
+
+
+/** \brief Initialize the verifier.
+ *
+ * By default the verifier uses one job, which means the files get
+ * verified by the thread calling run().
+ */
+md5sums_verifier::md5sums_verifier()
+    : f_jobs(1)
+    //, f_entries() -- auto-init
+{
+}
+
+
+/** \brief Define the number of files verified concurrently.
+ *
+ * This function sets the number of threads used by run(). If \p jobs is
+ * zero or negative, the number of processors available on this computer
+ * is used instead.
+ *
+ * \param[in] jobs  The number of jobs to run concurrently.
+ */
+void md5sums_verifier::set_jobs(int jobs)
+{
+    if(jobs <= 0)
+    {
+        jobs = static_cast<int>(std::thread::hardware_concurrency());
+        if(jobs <= 0)
+        {
+            jobs = 1;
+        }
+    }
+    f_jobs = jobs;
+}
+
+
+/** \brief Retrieve the number of jobs.
+ *
+ * \return The number of files verified concurrently.
+ */
+int md5sums_verifier::get_jobs() const
+{
+    return f_jobs;
+}
+
+
+/** \brief Add a file to be verified.
+ *
+ * This function adds a file to the list of files to verify. The files
+ * are reported in the order in which they are added here.
+ *
+ * \param[in] filename  The name of the file to check.
+ * \param[in] expected_md5sum  The md5sum the file is expected to have.
+ */
+void md5sums_verifier::add_file(const wpkg_filename::uri_filename& filename, const std::string& expected_md5sum)
+{
+    f_entries.push_back(file_entry(filename, expected_md5sum));
+}
+
+
+/** \brief Remove all the entries.
+ *
+ * This function clears the list of files so the verifier can be reused.
+ */
+void md5sums_verifier::clear()
+{
+    f_entries.clear();
+}
+
+
+/** \brief Verify all the files.
+ *
+ * This function computes the md5sum of all the files added with
+ * add_file() and compares them with the expected md5sums.
+ *
+ * The files are distributed between up to get_jobs() threads. Each
+ * thread takes the next file that was not yet verified so a few very
+ * large files do not prevent the other threads from making progress.
+ *
+ * When the processor can hash several buffers in parallel (see
+ * md5::md5sum::multi_lanes()), each thread takes a group of files
+ * instead and reads them side by side so their md5sums get computed
+ * together.
+ *
+ * Errors are not thrown. Instead the entry status is set to
+ * verify_status_error and the error message is saved in the entry.
+ */
+void md5sums_verifier::run()
+{
+    const size_t max(f_entries.size());
+    size_t jobs(static_cast<size_t>(static_cast<int>(f_jobs)));
+    if(jobs > max)
+    {
+        jobs = max;
+    }
+    if(jobs < 1)
+    {
+        jobs = 1;
+    }
+
+    // number of files verified together by one thread; keep enough
+    // groups for all the threads to have work
+    const size_t group(std::max(static_cast<size_t>(1), std::min(static_cast<size_t>(std::min(md5::md5sum::multi_lanes(), static_cast<int>(MAX_GROUP_SIZE))), (max + jobs - 1) / jobs)));
+
+    if(jobs == 1)
+    {
+        for(size_t i(0); i < max; i += group)
+        {
+            verify_range(i, std::min(i + group, max));
+        }
+        return;
+    }
+
+    // the first os_filename() call initializes globals such as the drive
+    // substitutions and MS-Windows network connections; make sure that
+    // happens here and not in parallel in the worker threads
+    for(size_t i(0); i < max; ++i)
+    {
+        try
+        {
+            f_entries[i].f_filename.os_filename();
+        }
+        catch(const std::exception&)
+        {
+            // verify_entry() reports the error
+        }
+    }
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for(size_t j(0); j < jobs; ++j)
+    {
+        workers.push_back(std::thread([this, &next, max, group]()
+            {
+                for(size_t i(next.fetch_add(group)); i < max; i = next.fetch_add(group))
+                {
+                    verify_range(i, std::min(i + group, max));
+                }
+            }));
+    }
+    for(size_t j(0); j < workers.size(); ++j)
+    {
+        workers[j].join();
+    }
+}
+
+
+/** \brief Retrieve the number of entries.
+ *
+ * \return The number of files added with add_file().
+ */
+size_t md5sums_verifier::size() const
+{
+    return f_entries.size();
+}
+
+
+/** \brief Retrieve an entry.
+ *
+ * The entries are returned in the order they were added with add_file().
+ *
+ * \param[in] idx  The index of the entry, between 0 and size() - 1.
+ *
+ * \return A reference to the entry.
+ */
+const md5sums_verifier::file_entry& md5sums_verifier::get_entry(size_t idx) const
+{
+    return f_entries[idx];
+}
+
+
+/** \brief Compute the md5sum of one entry.
+ *
+ * This function is called by the worker threads. It does not throw.
+ *
+ * \param[in,out] entry  The entry to verify.
+ */
+void md5sums_verifier::verify_entry(file_entry& entry) const
+{
+    try
+    {
+        entry.f_md5sum = file_md5sum(entry.f_filename);
+        entry.f_status = entry.f_md5sum == entry.f_expected_md5sum
+                            ? verify_status_valid
+                            : verify_status_invalid;
+    }
+    catch(const std::exception& e)
+    {
+        entry.f_error = e.what();
+        entry.f_status = verify_status_error;
+    }
+}
+
+
+/** \brief Verify a range of entries.
+ *
+ * This function verifies the entries from \p start to \p end
+ * (exclusive). A range of one entry is verified with verify_entry(),
+ * larger ranges with verify_group().
+ *
+ * \param[in] start  The index of the first entry to verify.
+ * \param[in] end  The index after the last entry to verify.
+ */
+void md5sums_verifier::verify_range(size_t start, size_t end)
+{
+    if(end - start == 1)
+    {
+        verify_entry(f_entries[start]);
+        return;
+    }
+
+    file_entry *entries[MAX_GROUP_SIZE];
+    int count(0);
+    for(size_t i(start); i < end; ++i)
+    {
+        entries[count] = &f_entries[i];
+        ++count;
+    }
+    verify_group(entries, count);
+}
+
+
+/** \brief Compute the md5sums of a group of entries together.
+ *
+ * This function opens all the files of the group and reads them side
+ * by side, VERIFIER_BUFFER_SIZE bytes at a time. The chunks are then
+ * given to md5::md5sum::push_back_multi() so the md5sums of the files
+ * get computed in parallel by the vector unit.
+ *
+ * Remote files cannot be streamed so they are verified on their own
+ * with verify_entry() and do not take part in the group.
+ *
+ * A file which cannot be opened or read is marked as an error and
+ * removed from the group. The other files are not affected. This
+ * function does not throw.
+ *
+ * \param[in,out] entries  The entries to verify.
+ * \param[in] count  The number of entries, at most MAX_GROUP_SIZE.
+ */
+void md5sums_verifier::verify_group(file_entry * const entries[], int count) const
+{
+    std::shared_ptr<wpkg_stream::fstream> files[MAX_GROUP_SIZE];
+    std::vector<uint8_t> buffers[MAX_GROUP_SIZE];
+    md5::md5sum sums[MAX_GROUP_SIZE];
+    bool active[MAX_GROUP_SIZE];
+    for(int i(0); i < count; ++i)
+    {
+        active[i] = false;
+        if(!entries[i]->f_filename.is_direct())
+        {
+            verify_entry(*entries[i]);
+            continue;
+        }
+        try
+        {
+            files[i].reset(new wpkg_stream::fstream);
+            files[i]->open(entries[i]->f_filename);
+            if(!files[i]->good())
+            {
+                throw memfile::memfile_exception_io("cannot open \"" + entries[i]->f_filename.original_filename() + "\" for reading");
+            }
+            buffers[i].resize(VERIFIER_BUFFER_SIZE);
+            active[i] = true;
+        }
+        catch(const std::exception& e)
+        {
+            entries[i]->f_error = e.what();
+            entries[i]->f_status = verify_status_error;
+        }
+    }
+
+    for(;;)
+    {
+        md5::md5sum *chunk_sums[MAX_GROUP_SIZE];
+        const uint8_t *chunk_data[MAX_GROUP_SIZE];
+        size_t chunk_sizes[MAX_GROUP_SIZE];
+        int chunks(0);
+        for(int i(0); i < count; ++i)
+        {
+            if(!active[i])
+            {
+                continue;
+            }
+            const wpkg_stream::fstream::size_type r(files[i]->read(&buffers[i][0], VERIFIER_BUFFER_SIZE));
+            if(r < 0)
+            {
+                entries[i]->f_error = "reading input file \"" + entries[i]->f_filename.original_filename() + "\" failed";
+                entries[i]->f_status = verify_status_error;
+                active[i] = false;
+            }
+            else if(r == 0)
+            {
+                entries[i]->f_md5sum = sums[i].sum();
+                entries[i]->f_status = entries[i]->f_md5sum == entries[i]->f_expected_md5sum
+                                        ? verify_status_valid
+                                        : verify_status_invalid;
+                active[i] = false;
+            }
+            else
+            {
+                chunk_sums[chunks] = sums + i;
+                chunk_data[chunks] = &buffers[i][0];
+                chunk_sizes[chunks] = static_cast<size_t>(r);
+                ++chunks;
+            }
+        }
+        if(chunks == 0)
+        {
+            break;
+        }
+        md5::md5sum::push_back_multi(chunk_sums, chunk_data, chunk_sizes, chunks);
+    }
+}
+
+
+/** \brief Compute the raw md5sum of a file.
+ *
+ * This function reads the file in chunks of VERIFIER_BUFFER_SIZE bytes
+ * and pushes each chunk to the md5 context. The file is never loaded
+ * in full in memory.
+ *
+ * Remote files (i.e. an http:// URI) cannot be streamed so they get
+ * loaded with memory_file::read_file() instead.
+ *
+ * \exception memfile::memfile_exception_io
+ * The file cannot be opened or an error occurs while reading it.
+ *
+ * \param[in] filename  The name of the file to read.
+ * \param[out] raw  The resulting raw md5sum.
+ */
+void md5sums_verifier::file_raw_md5sum(const wpkg_filename::uri_filename& filename, md5::raw_md5sum& raw)
+{
+    if(!filename.is_direct())
+    {
+        memfile::memory_file data;
+        data.read_file(filename);
+        data.raw_md5sum(raw);
+        return;
+    }
+
+    md5::md5sum sum;
+    wpkg_stream::fstream file;
+    file.open(filename);
+    if(!file.good())
+    {
+        throw memfile::memfile_exception_io("cannot open \"" + filename.original_filename() + "\" for reading");
+    }
+    std::vector<uint8_t> buffer(VERIFIER_BUFFER_SIZE);
+    for(;;)
+    {
+        const wpkg_stream::fstream::size_type r(file.read(&buffer[0], VERIFIER_BUFFER_SIZE));
+        if(r < 0)
+        {
+            throw memfile::memfile_exception_io("reading input file \"" + filename.original_filename() + "\" failed");
+        }
+        if(r == 0)
+        {
+            break;
+        }
+        sum.push_back(&buffer[0], static_cast<size_t>(r));
+    }
+    sum.raw_sum(raw);
+}
+
+
+/** \brief Compute the md5sum of a file on disk.
+ *
+ * This function calls file_raw_md5sum() and transforms the result
+ * in a string of 32 hexadecimal digits.
+ *
+ * \param[in] filename  The name of the file to read.
+ *
+ * \return The md5sum as a string.
+ */
+std::string md5sums_verifier::file_md5sum(const wpkg_filename::uri_filename& filename)
+{
+    md5::raw_md5sum raw;
+    file_raw_md5sum(filename, raw);
+    return md5::md5sum::sum(raw);
+}
+
+
+} // namespace wpkg_verify
+// vim: ts=4 sw=4 et
@@ -0,0 +1,105 @@
+/*    wpkg_verify.h -- verify the md5sums of many files
+ *    Copyright (C) 2012-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+#ifndef WPKG_VERIFY_H
+#define WPKG_VERIFY_H
+
+/** \file
+ * \brief Verification of md5sums declarations.
+ *
+ * The wpkg tool verifies the md5sums of installed files (--audit) and of
+ * any list of files (--md5sums-check). This file declares a verifier
+ * which computes those md5sums by streaming the files from disk and
+ * which can work on many files in parallel.
+ */
+#include "libdebpackages/wpkg_filename.h"
+#include "libdebpackages/md5.h"
+#include "controlled_vars/controlled_vars_auto_init.h"
+
+#include <vector>
+
+namespace wpkg_verify
+{
+
+class DEBIAN_PACKAGE_EXPORT md5sums_verifier
+{
+public:
+    static const int VERIFIER_BUFFER_SIZE = 1024 * 1024;
+    static const int MAX_GROUP_SIZE = 8;
+
+    enum verify_status_t
+    {
+        verify_status_unknown,  // run() not called yet
+        verify_status_valid,    // computed md5sum matches
+        verify_status_invalid,  // computed md5sum differs
+        verify_status_error     // the file could not be read
+    };
+
+    class DEBIAN_PACKAGE_EXPORT file_entry
+    {
+    public:
+        file_entry(const wpkg_filename::uri_filename& filename, const std::string& expected_md5sum);
+
+        const wpkg_filename::uri_filename& get_filename() const;
+        const std::string& get_expected_md5sum() const;
+        const std::string& get_md5sum() const;
+        const std::string& get_error() const;
+        verify_status_t get_status() const;
+
+    private:
+        friend class md5sums_verifier;
+
+        wpkg_filename::uri_filename     f_filename;
+        std::string                     f_expected_md5sum;
+        std::string                     f_md5sum;
+        std::string                     f_error;
+        verify_status_t                 f_status;
+    };
+
+    md5sums_verifier();
+
+    void set_jobs(int jobs);
+    int get_jobs() const;
+
+    void add_file(const wpkg_filename::uri_filename& filename, const std::string& expected_md5sum);
+    void clear();
+    void run();
+
+    size_t size() const;
+    const file_entry& get_entry(size_t idx) const;
+
+    static void file_raw_md5sum(const wpkg_filename::uri_filename& filename, md5::raw_md5sum& raw);
+    static std::string file_md5sum(const wpkg_filename::uri_filename& filename);
+
+private:
+    void verify_range(size_t start, size_t end);
+    void verify_entry(file_entry& entry) const;
+    void verify_group(file_entry * const entries[], int count) const;
+
+    typedef std::vector<file_entry> file_entry_list_t;
+
+    controlled_vars::zint32_t       f_jobs;
+    file_entry_list_t               f_entries;
+};
+
+} // wpkg_verify namespace
+#endif
+//#ifndef WPKG_VERIFY_H
+// vim: ts=4 sw=4 et
@@ -29,7 +29,9 @@
  */
 #include    "libdebpackages/wpkgar.h"
 #include    "libdebpackages/wpkgar_repository.h"
+#include    "libdebpackages/wpkgar_download_cache.h"
 #include    "libdebpackages/debian_packages.h"
+#include    "libdebpackages/wpkg_metrics.h"
 #include    "libdebpackages/wpkg_util.h"
 #include    <algorithm>
 #include    <fstream>
@@ -41,6 +43,7 @@
 #if defined(MO_WINDOWS)
 #else
 #   include    <unistd.h>
+#   include    <sys/file.h>
 #endif
 
 
@@ -299,10 +302,14 @@ wpkgar_manager::wpkgar_manager()
     //, f_lock_filename("") -- auto-init
     //, f_lock_fd(-1) -- auto-init
     //, f_lock_count(0) -- auto-init
+    //, f_shared_lock_count(0) -- auto-init
+    //, f_database_lock_fd(-1) -- auto-init
+    //, f_database_lock_count(0) -- auto-init
     //, f_interrupt_handler(0) -- auto-init
     //, f_selves(0) -- auto-init
     //, f_include_selves(NULL) -- auto-init
     //, f_tracker(NULL) -- auto-init
+    //, f_download_cache(NULL) -- auto-init
 {
 }
 
@@ -321,6 +328,11 @@ wpkgar_manager::~wpkgar_manager()
     std::shared_ptr<wpkgar_tracker_interface> tracker;
     tracker.swap(f_tracker);
     tracker.reset();
+
+    if(f_database_lock_fd != -1)
+    {
+        close(f_database_lock_fd);
+    }
 }
 
 
@@ -423,6 +435,31 @@ void wpkgar_manager::create_database(const wpkg_filename::uri_filename& ctrl_fil
     wpkgar_file.write_file(core_dir.append_child("index.wpkgar"), true);
 }
 
+/** \brief Get the core directory of the database.
+ *
+ * This function checks that the "core" package of the database exists
+ * and is a directory. The lock functions cannot work without it.
+ *
+ * \return The path to the core directory.
+ */
+wpkg_filename::uri_filename wpkgar_manager::get_core_directory() const
+{
+    wpkg_filename::uri_filename lock_dir(get_database_path().append_child("core"));
+    if(!lock_dir.exists())
+    {
+        if(errno != ENOENT)
+        {
+            throw wpkgar_exception_locked("the database \"core\" package is not accessible.");
+        }
+        throw wpkgar_exception_locked("the database \"core\" package does not exist under \"" + get_database_path().original_filename() + "\"; did you run --create-admindir or use --admindir?");
+    }
+    if(!lock_dir.is_dir())
+    {
+        throw wpkgar_exception_locked("the database \"core\" package is not a directory as expected.");
+    }
+    return lock_dir;
+}
+
 void wpkgar_manager::lock(const std::string& status)
 {
     // are we already locked?
@@ -430,19 +467,7 @@ void wpkgar_manager::lock(const std::string& status)
     {
         // open the wpkg lock file, if it fails, then we cannot lock and
         // thus we throw an error ending the process right there
-        wpkg_filename::uri_filename lock_dir(get_database_path().append_child("core"));
-        if(!lock_dir.exists())
-        {
-            if(errno != ENOENT)
-            {
-                throw wpkgar_exception_locked("the database \"core\" package is not accessible.");
-            }
-            throw wpkgar_exception_locked("the database \"core\" package does not exist under \"" + get_database_path().original_filename() + "\"; did you run --create-admindir or use --admindir?");
-        }
-        if(!lock_dir.is_dir())
-        {
-            throw wpkgar_exception_locked("the database \"core\" package is not a directory as expected.");
-        }
+        wpkg_filename::uri_filename lock_dir(get_core_directory());
         f_lock_filename = lock_dir.append_child("wpkg.lck");
         // here we still use os_open() to access the lock file because it
         // works in all cases (including mingw); but we probably should look
@@ -495,6 +520,164 @@ void wpkgar_manager::unlock()
     }
 }
 
+/** \brief Lock the database for reading.
+ *
+ * Commands which only read the database (--list, --search, etc.) do not
+ * need to prevent other processes from working on the database. A shared
+ * lock does not create the lock file and does not change the status of
+ * the core package, so any number of readers can run at the same time,
+ * including while another process holds the exclusive lock.
+ *
+ * Readers do not wait for writers either. A process modifying the
+ * database only holds the database file lock (see lock_database_file())
+ * while it creates or replaces the files of a package, and a reader holds
+ * it only while it loads one package. So a reader sees the last committed
+ * state of each package without waiting for an installation to end.
+ *
+ * \sa unlock_shared()
+ */
+void wpkgar_manager::lock_shared()
+{
+    if(f_shared_lock_count == 0)
+    {
+        get_core_directory();
+        if(f_lock_fd == -1 && is_locked())
+        {
+            wpkg_output::log("another process is modifying the database, the result may not include its changes.")
+                .debug(wpkg_output::debug_flags::debug_basics)
+                .module(wpkg_output::module_tool);
+        }
+    }
+    ++f_shared_lock_count;
+}
+
+/** \brief Release a shared lock.
+ *
+ * \sa lock_shared()
+ */
+void wpkgar_manager::unlock_shared()
+{
+    if(f_shared_lock_count <= 0)
+    {
+        // if you use the RAII class (wpkgar_lock) this should never happen
+        throw wpkgar_exception_locked("when the shared lock is not active you cannot call unlock_shared()");
+    }
+    --f_shared_lock_count;
+}
+
+/** \brief Lock the database file.
+ *
+ * This function locks the "core/wpkg-database.lck" file with a shared
+ * (readers) or an exclusive (writer) operating system lock. Under Unix
+ * this is done with flock() and under MS-Windows with LockFileEx().
+ *
+ * The lock is only held for short periods of time: the process which
+ * holds the exclusive database lock (see lock()) takes the exclusive
+ * file lock while it commits the files of one package in the database,
+ * and readers take the shared file lock while they load one package.
+ * This way a reader never sees a package directory partially created
+ * or updated and yet it does not wait for a whole installation to end.
+ *
+ * Calls can be nested; the lock is released once unlock_database_file()
+ * was called as many times. Nested calls keep the lock of the outermost
+ * call. A shared lock requested by the process which holds the exclusive
+ * database lock is not taken since that process is the only writer.
+ *
+ * If the lock is not immediately available, the function waits until
+ * the other processes release their lock.
+ *
+ * The file is created if it does not exist yet and it never gets
+ * deleted; contrary to the wpkg.lck file, it does not stay behind
+ * when a process crashes since the system releases the lock.
+ *
+ * \param[in] exclusive  Whether the lock is exclusive.
+ *
+ * \sa wpkgar_database_lock
+ */
+void wpkgar_manager::lock_database_file(bool exclusive)
+{
+    if(f_database_lock_count == 0 && (exclusive || f_lock_count == 0))
+    {
+        if(f_database_lock_fd == -1)
+        {
+            const wpkg_filename::uri_filename lock_filename(get_core_directory().append_child("wpkg-database.lck"));
+            f_database_lock_fd = os_open(lock_filename.os_filename().get_os_string().c_str(), O_CREAT | O_RDWR, 0644);
+            if(f_database_lock_fd == -1 && !exclusive)
+            {
+                // a user who cannot write to the database can still read it
+                f_database_lock_fd = os_open(lock_filename.os_filename().get_os_string().c_str(), O_RDONLY, 0644);
+            }
+            if(f_database_lock_fd == -1)
+            {
+                if(!exclusive)
+                {
+                    // the file does not exist yet and we cannot create
+                    // it, read the database without the lock
+                    ++f_database_lock_count;
+                    return;
+                }
+                throw wpkgar_exception_locked("the database lock file \"" + lock_filename.original_filename() + "\" could not be opened.");
+            }
+#if !defined(MO_WINDOWS)
+            // the maintainer scripts do not inherit the lock
+            fcntl(f_database_lock_fd, F_SETFD, FD_CLOEXEC);
+#endif
+        }
+
+        for(;;)
+        {
+#if defined(MO_WINDOWS)
+            HANDLE h(reinterpret_cast<HANDLE>(_get_osfhandle(f_database_lock_fd)));
+            OVERLAPPED overlapped;
+            memset(&overlapped, 0, sizeof(overlapped));
+            if(LockFileEx(h, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, 1, 0, &overlapped))
+            {
+                break;
+            }
+            const bool busy(GetLastError() == ERROR_LOCK_VIOLATION || GetLastError() == ERROR_IO_PENDING);
+#else
+            if(flock(f_database_lock_fd, exclusive ? LOCK_EX : LOCK_SH) == 0)
+            {
+                break;
+            }
+            const bool busy(errno == EINTR);
+#endif
+            if(!busy)
+            {
+                throw wpkgar_exception_locked("the database lock file could not be locked.");
+            }
+        }
+    }
+    ++f_database_lock_count;
+}
+
+/** \brief Release the database file lock.
+ *
+ * This function releases the operating system lock obtained by
+ * lock_database_file() once the last nested call is released. The
+ * file itself remains open for the next lock.
+ */
+void wpkgar_manager::unlock_database_file()
+{
+    if(f_database_lock_count <= 0)
+    {
+        // if you use the RAII class (wpkgar_database_lock) this should never happen
+        throw wpkgar_exception_locked("when the database file is not locked you cannot call unlock_database_file()");
+    }
+    --f_database_lock_count;
+    if(f_database_lock_count == 0 && f_database_lock_fd != -1)
+    {
+#if defined(MO_WINDOWS)
+        HANDLE h(reinterpret_cast<HANDLE>(_get_osfhandle(f_database_lock_fd)));
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        UnlockFileEx(h, 0, 1, 0, &overlapped);
+#else
+        flock(f_database_lock_fd, LOCK_UN);
+#endif
+    }
+}
+
 // whether it was locked by us in this process
 bool wpkgar_manager::was_locked() const
 {
@@ -768,6 +951,7 @@ void wpkgar_manager::set_database_path(const wpkg_filename::uri_filename& databa
         throw wpkgar_exception_parameter("cannot change the database path once packages were read");
     }
     f_database_path = database_path;
+    f_download_cache.reset();
 }
 
 /** \brief Load a package in memory.
@@ -806,6 +990,8 @@ void wpkgar_manager::set_database_path(const wpkg_filename::uri_filename& databa
  */
 void wpkgar_manager::load_package(const wpkg_filename::uri_filename& filename, bool force_reload)
 {
+    wpkg_metrics::profile_scope profile("load_package");
+
     // a .deb package MUST include at least one _ generally two
     // (one if the architecture is not specified); the uri_filename
     // checks for that case; if the filename cannot represent a valid
@@ -841,7 +1027,11 @@ void wpkgar_manager::load_package(const wpkg_filename::uri_filename& filename, b
 
     std::shared_ptr<wpkgar_package> package(new wpkgar_package(filename, f_control_file_state));
     package->set_package_path(get_database_path().append_child(filename.path_only()));
-    package->read_package();
+    {
+        // make sure the package is not being committed while we read it
+        wpkgar_database_lock database_lock(*this, false);
+        package->read_package();
+    }
     f_packages[filename.basename()] = package;
 }
 
@@ -909,14 +1099,14 @@ void wpkgar_manager::load_temporary_package(const wpkg_filename::uri_filename& f
     }
 
     // in this case filename is a direct reference to a package (the .deb file)
+    // remote packages go through the download cache
     memfile::memory_file p;
-    p.read_file(filename);
+    get_download_cache()->read_file(filename, p);
     if(p.is_compressed())
     {
         // the file should not be compressed though
         // (the contents are compresses, but not the .deb itself)
-        memfile::memory_file d;
-        p.copy(d);
+        memfile::memory_file d(std::move(p));
         d.decompress(p);
     }
     if(p.get_format() != memfile::memory_file::file_format_ar)
@@ -1482,6 +1672,14 @@ bool wpkgar_manager::has_control_file(const wpkg_filename::uri_filename& package
 void wpkgar_manager::get_control_file(memfile::memory_file& p, const wpkg_filename::uri_filename& package_name, std::string& control_filename, bool compress)
 {
     // this reads any control file, including control.tar.gz
+    if(package_name.is_deb())
+    {
+        // an installed package: make sure it is not being committed
+        // while we read its files
+        wpkgar_database_lock database_lock(*this, false);
+        get_package(package_name)->read_control_file(p, control_filename, compress);
+        return;
+    }
     get_package(package_name)->read_control_file(p, control_filename, compress);
 }
 
@@ -1513,9 +1711,7 @@ void wpkgar_manager::set_field(const wpkg_filename::uri_filename& package_name,
     cf.set_field(name, value);
     if(save)
     {
-        memfile::memory_file ctrl;
-        cf.write(ctrl, wpkg_field::field_file::WRITE_MODE_FIELD_ONLY);
-        ctrl.write_file(p->get_package_path().append_child("wpkg-status"), true);
+        save_status_file(p);
     }
 }
 
@@ -1526,9 +1722,36 @@ void wpkgar_manager::set_field(const wpkg_filename::uri_filename& package_name,
     cf.set_field(name, value);
     if(save)
     {
-        memfile::memory_file ctrl;
-        cf.write(ctrl, wpkg_field::field_file::WRITE_MODE_FIELD_ONLY);
-        ctrl.write_file(p->get_package_path().append_child("wpkg-status"), true);
+        save_status_file(p);
+    }
+}
+
+/** \brief Save the status file of a package.
+ *
+ * The status file is first written to a temporary file which then
+ * atomically replaces the existing status file. This way the status
+ * file never is partially written, even if the process gets killed.
+ *
+ * \param[in] p  The package which status file gets saved.
+ */
+void wpkgar_manager::save_status_file(const std::shared_ptr<wpkgar_package>& p)
+{
+    memfile::memory_file ctrl;
+    p->get_status_file_info().write(ctrl, wpkg_field::field_file::WRITE_MODE_FIELD_ONLY);
+    const wpkg_filename::uri_filename status_filename(p->get_package_path().append_child("wpkg-status"));
+    const wpkg_filename::uri_filename tmp_filename(p->get_package_path().append_child("wpkg-status.tmp"));
+    ctrl.write_file(tmp_filename, true);
+    wpkgar_database_lock database_lock(*this, true);
+#if defined(MO_WINDOWS)
+    // rename() does not replace an existing file under MS-Windows
+    if(!MoveFileExW(tmp_filename.os_filename().get_os_string().c_str(),
+                    status_filename.os_filename().get_os_string().c_str(),
+                    MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+#else
+    if(!tmp_filename.os_rename(status_filename))
+#endif
+    {
+        throw wpkgar_exception_io("the status file \"" + status_filename.original_filename() + "\" could not be replaced");
     }
 }
 
@@ -1642,6 +1865,33 @@ std::shared_ptr<wpkgar_tracker_interface> wpkgar_manager::get_tracker() const
 }
 
 
+/** \brief Get the download cache.
+ *
+ * The files read from remote repositories are saved in the download
+ * cache which lives in the core directory of the database. The cache
+ * is created the first time this function gets called. Without a
+ * database the cache does not save anything.
+ *
+ * \return A pointer to the download cache.
+ */
+std::shared_ptr<wpkgar_download_cache> wpkgar_manager::get_download_cache()
+{
+    if(!f_download_cache)
+    {
+        if(f_database_path.empty())
+        {
+            f_download_cache.reset(new wpkgar_download_cache(wpkg_filename::uri_filename()));
+            f_download_cache->set_max_size(0);
+        }
+        else
+        {
+            f_download_cache.reset(new wpkgar_download_cache(get_database_path().append_child("core/download-cache")));
+        }
+    }
+    return f_download_cache;
+}
+
+
 void wpkgar_manager::track(const std::string& command, const std::string& package_name)
 {
     if(f_tracker)
@@ -1925,6 +2175,8 @@ wpkgar_manager::hooks_t wpkgar_manager::list_hooks() const
  */
 bool wpkgar_manager::run_script(const wpkg_filename::uri_filename& package_name, script_t script, script_parameters_t params)
 {
+    wpkg_metrics::profile_scope profile("run_script");
+
     // make sure it's loaded
     load_package(package_name);
 
@@ -2014,6 +2266,8 @@ bool wpkgar_manager::run_script(const wpkg_filename::uri_filename& package_name,
 
 bool wpkgar_manager::run_one_script(const wpkg_filename::uri_filename& package_name, const std::string& interpreter, const wpkg_filename::uri_filename& script_name, const std::string& parameters)
 {
+    wpkg_metrics::phase_timer timer(wpkg_metrics::phase_scripts, package_name.original_filename());
+
     std::string cmd("cd " + wpkg_util::make_safe_console_string(get_root_path().full_path()) + " && " + interpreter + " ");
     std::string script(wpkg_util::make_safe_console_string(script_name.full_path()));
 #ifdef MO_WINDOWS
@@ -2125,10 +2379,29 @@ void wpkgar_manager::check_interrupt() const
 
 
 
-wpkgar_lock::wpkgar_lock(wpkgar_manager::pointer_t manager, const std::string& status)
+/** \brief Lock the database until this object gets destroyed.
+ *
+ * By default the lock is exclusive and the status of the core package
+ * is set to \p status. With lock_mode_shared the database is only
+ * locked for reading (see wpkgar_manager::lock_shared()) and \p status
+ * is ignored since nothing gets written.
+ *
+ * \param[in] manager  The manager of the database to lock.
+ * \param[in] status  The status of the database while locked.
+ * \param[in] mode  Whether the lock is exclusive or shared.
+ */
+wpkgar_lock::wpkgar_lock(wpkgar_manager::pointer_t manager, const std::string& status, lock_mode_t mode)
     : f_manager(manager)
+    , f_mode(mode)
 {
-    f_manager->lock(status);
+    if(f_mode == lock_mode_shared)
+    {
+        f_manager->lock_shared();
+    }
+    else
+    {
+        f_manager->lock(status);
+    }
 }
 
 
@@ -2141,11 +2414,40 @@ void wpkgar_lock::unlock()
 {
     if(f_manager != NULL)
     {
-        f_manager->unlock();
+        if(f_mode == lock_mode_shared)
+        {
+            f_manager->unlock_shared();
+        }
+        else
+        {
+            f_manager->unlock();
+        }
         f_manager = NULL;
     }
 }
 
+/** \brief Lock the database file for a short period of time.
+ *
+ * This RAII class calls wpkgar_manager::lock_database_file() in its
+ * constructor and wpkgar_manager::unlock_database_file() in its
+ * destructor. Use it around the code committing the files of a
+ * package in the database (exclusive) or reading them (shared.)
+ *
+ * \param[in] manager  The manager of the database to lock.
+ * \param[in] exclusive  Whether the lock is exclusive.
+ */
+wpkgar_database_lock::wpkgar_database_lock(wpkgar_manager& manager, bool exclusive)
+    : f_manager(manager)
+{
+    f_manager.lock_database_file(exclusive);
+}
+
+
+wpkgar_database_lock::~wpkgar_database_lock()
+{
+    f_manager.unlock_database_file();
+}
+
 wpkgar_interrupt::~wpkgar_interrupt()
 {
 }
@@ -45,6 +45,8 @@
 namespace wpkgar
 {
 
+class wpkgar_download_cache;
+
 class DEBIAN_PACKAGE_EXPORT wpkgar_interrupt
 {
 public:
@@ -167,6 +169,8 @@ public:
     std::shared_ptr<wpkgar_tracker_interface> get_tracker() const;
     void                                    track(const std::string& command, const std::string& package_name = "");
 
+    std::shared_ptr<wpkgar_download_cache>  get_download_cache();
+
     void                                    add_global_hook(const wpkg_filename::uri_filename& script_name);
     bool                                    remove_global_hook(const wpkg_filename::uri_filename& script_name);
     hooks_t                                 list_hooks() const;
@@ -176,9 +180,13 @@ public:
 
     void                                    lock(const std::string& status);
     void                                    unlock();
+    void                                    lock_shared();
+    void                                    unlock_shared();
     bool                                    was_locked() const;
     bool                                    is_locked() const;
     bool                                    remove_lock();
+    void                                    lock_database_file(bool exclusive);
+    void                                    unlock_database_file();
 
     // control file
     void                                    set_control_file_state(std::shared_ptr<wpkg_control::control_file::control_file_state_t> state);
@@ -215,6 +223,8 @@ private:
 
     const std::shared_ptr<wpkgar_package>   get_package(const wpkg_filename::uri_filename& package_name) const;
     void                                    load_temporary_package(const wpkg_filename::uri_filename& filename);
+    wpkg_filename::uri_filename             get_core_directory() const;
+    void                                    save_status_file(const std::shared_ptr<wpkgar_package>& p);
     bool                                    run_one_script(const wpkg_filename::uri_filename& package_name, const std::string& interpreter, const wpkg_filename::uri_filename& script_name, const std::string& parameters);
 
     typedef std::shared_ptr<wpkgar_package>           package_t;
@@ -234,10 +244,14 @@ private:
     wpkg_filename::uri_filename                         f_lock_filename;
     lock_fd_t                                           f_lock_fd;
     controlled_vars::zint32_t                           f_lock_count;
+    controlled_vars::zint32_t                           f_shared_lock_count;
+    lock_fd_t                                           f_database_lock_fd;
+    controlled_vars::zint32_t                           f_database_lock_count;
     controlled_vars::ptr_auto_init<wpkgar_interrupt>    f_interrupt_handler;
     self_packages_t                                     f_selves;
     controlled_vars::fbool_t                            f_include_selves;
     std::shared_ptr<wpkgar_tracker_interface>           f_tracker;
+    std::shared_ptr<wpkgar_download_cache>              f_download_cache;
     package_list_t                                      f_installed_packages;
 };
 
@@ -245,12 +259,34 @@ private:
 class DEBIAN_PACKAGE_EXPORT wpkgar_lock
 {
 public:
-    wpkgar_lock(wpkgar_manager::pointer_t manager, const std::string& status);
+    enum lock_mode_t
+    {
+        lock_mode_exclusive,    // the database gets modified
+        lock_mode_shared        // the database is only read
+    };
+
+    wpkgar_lock(wpkgar_manager::pointer_t manager, const std::string& status, lock_mode_t mode = lock_mode_exclusive);
     ~wpkgar_lock();
     void unlock();
 
 private:
     wpkgar_manager::pointer_t f_manager;
+    lock_mode_t               f_mode;
+};
+
+
+class DEBIAN_PACKAGE_EXPORT wpkgar_database_lock
+{
+public:
+    wpkgar_database_lock(wpkgar_manager& manager, bool exclusive);
+    ~wpkgar_database_lock();
+
+private:
+    // disallow copying
+    wpkgar_database_lock(const wpkgar_database_lock& rhs);
+    wpkgar_database_lock& operator = (const wpkgar_database_lock& rhs);
+
+    wpkgar_manager&           f_manager;
 };
 
 
@@ -89,6 +89,7 @@ wpkgar_block_t::wpkgar_block_t()
     //f_md5sum[16]
     //f_name_size(0)
     //f_link_size(0)
+    //f_sha256sum[32]
     //f_reserved[...]
     //f_checksum(0)
 {
@@ -120,12 +120,13 @@ struct DEBIAN_PACKAGE_EXPORT wpkgar_block_t
     controlled_vars::zuchar_t     f_md5sum[16];   // the original file md5sum (raw)
     controlled_vars::zuint16_t    f_name_size;    // extended filename if not zero (up to 64Kb - 1) (since version 1.1)
     controlled_vars::zuint16_t    f_link_size;    // extended symbolic link if not zero (up to 64Kb - 1) (since version 1.1)
+    controlled_vars::zuchar_t     f_sha256sum[32];// the original file sha256sum (raw, all zeroes when undefined)
 
     // space left blank so the structure is exactly 1Kb (1024 bytes)
     // we'll use that space as we see fit
     // if the number of reserved bytes becomes null or negative then
     // the compiler will complain
-    controlled_vars::zuchar_t     f_reserved[1024 - (4 + 4 + 1 + 1 + 1 + 1 + 4 + 4 + 4 + 4 + 4 + 4 + 4 + 300 + 300 + 32 + 32 + 16 + 2 + 2 + 4)];
+    controlled_vars::zuchar_t     f_reserved[1024 - (4 + 4 + 1 + 1 + 1 + 1 + 4 + 4 + 4 + 4 + 4 + 4 + 4 + 300 + 300 + 32 + 32 + 16 + 2 + 2 + 32 + 4)];
     controlled_vars::zuint32_t    f_checksum;     // sum of all the header as uint8_t with f_checksum = 0 at the time
 };
 
@@ -2078,6 +2078,8 @@ void wpkgar_build::build_source()
     append_file(data, info_dir, source_tar_gz);
     memfile::memory_file md5sums;
     md5sums.create(memfile::memory_file::file_format_other);
+    memfile::memory_file sha256sums;
+    sha256sums.create(memfile::memory_file::file_format_other);
     source_tar.dir_rewind();
     f_changelog_filename = wpkg_filename::uri_filename(source_dir).append_child(f_changelog_filename.full_path());
     f_copyright_filename = wpkg_filename::uri_filename(source_dir).append_child(f_copyright_filename.full_path());
@@ -2133,15 +2135,21 @@ void wpkgar_build::build_source()
         info.set_mtime(now);
         append_file(data, info, file_data);
 
-        // regular files get an md5sums
+        // regular files get an md5sums and a sha256sums
         if(info.get_file_type() == memfile::memory_file::file_info::regular_file
         || info.get_file_type() == memfile::memory_file::file_info::continuous)
         {
             md5::raw_md5sum raw;
-            file_data.raw_md5sum(raw);
+            sha256::raw_sha256sum raw_sha256;
+            file_data.raw_checksums(raw, raw_sha256);
+            const char mode(file_data.is_text() ? ' ' : '*');
             md5sums.printf("%s %c%s\n",
                     md5::md5sum::sum(raw).c_str(),
-                    file_data.is_text() ? ' ' : '*',
+                    mode,
+                    info.get_filename().c_str());
+            sha256sums.printf("%s %c%s\n",
+                    sha256::sha256sum::sum(raw_sha256).c_str(),
+                    mode,
                     info.get_filename().c_str());
         }
     }
@@ -2176,6 +2184,17 @@ void wpkgar_build::build_source()
         append_file(control_tar, info, md5sums);
     }
 
+    // add sha256sums
+    {
+        memfile::memory_file::file_info info;
+        info.set_mode(0444);
+        info.set_user("Administrator");
+        info.set_group("Administrators");
+        info.set_filename("sha256sums");
+        info.set_size(sha256sums.size());
+        append_file(control_tar, info, sha256sums);
+    }
+
     control_tar.end_archive();
 
     // now add the control file
@@ -2696,74 +2715,90 @@ void wpkgar_build::build_repository()
             std::string data_filename("data.tar");
             f_manager->get_control_file(data, s->f_filename, data_filename, false);
 
-            data.dir_rewind();
-            for(;;)
+            // the file is expected under usr/src/<package>_<version>/wpkg
+            // (see build_source()) so first look for it directly
+            std::string plain_package(package_name.full_path());
+            if(plain_package.length() > 4 && plain_package.compare(plain_package.length() - 4, 4, "-src") == 0)
+            {
+                plain_package.erase(plain_package.length() - 4);
+            }
+            const std::string version(f_manager->get_field(s->f_filename, wpkg_control::control_file::field_version_factory_t::canonicalized_name()));
+            memfile::memory_file::file_info file_info;
+            memfile::memory_file file_data;
+            bool found(data.dir_find("usr/src/" + plain_package + "_" + wpkg_util::canonicalize_version_for_filename(version) + "/wpkg/control.info", file_info, &file_data));
+            if(!found)
             {
-                memfile::memory_file::file_info file_info;
-                memfile::memory_file file_data;
-                if(!data.dir_next(file_info, &file_data))
+                // the source directory was renamed, search any usr/src/*/wpkg/control.info
+                data.dir_rewind();
+                while(data.dir_next(file_info, &file_data))
                 {
-                    wpkg_output::log("source package %1 does not include a wpkg/control.info file; a valid wpkg source package must include that file")
-                            .quoted_arg(info.get_uri())
-                        .level(wpkg_output::level_error)
-                        .module(wpkg_output::module_build_info)
-                        .package(package_name)
-                        .action("build-validation");
-                    break;
+                    // TBD: should we check ignoring case?
+                    wpkg_filename::uri_filename controlinfo_filename(file_info.get_uri());
+                    int seg_idx(controlinfo_filename.segment_size());
+                    if(seg_idx == 5 && controlinfo_filename.segment(4) == "control.info" && controlinfo_filename.segment(3) == "wpkg")
+                    {
+                        found = true;
+                        break;
+                    }
                 }
-                // TBD: should we check ignoring case?
-                wpkg_filename::uri_filename controlinfo_filename(file_info.get_uri());
-                int seg_idx(controlinfo_filename.segment_size());
-                if(seg_idx == 5 && controlinfo_filename.segment(4) == "control.info" && controlinfo_filename.segment(3) == "wpkg")
+            }
+            if(!found)
+            {
+                wpkg_output::log("source package %1 does not include a wpkg/control.info file; a valid wpkg source package must include that file")
+                        .quoted_arg(info.get_uri())
+                    .level(wpkg_output::level_error)
+                    .module(wpkg_output::module_build_info)
+                    .package(package_name)
+                    .action("build-validation");
+            }
+            else
+            {
+                wpkg_control::source_control_file fields; //(std::shared_ptr<wpkg_control::control_file::control_file_state_t>(new wpkg_control::control_file::build_control_file_state_t));
+                //f_manager->set_control_variables(fields); -- TBD I think we only read files without variables in this case
+                fields.set_input_file(&file_data);
+                if(fields.read())
                 {
-                    wpkg_control::source_control_file fields; //(std::shared_ptr<wpkg_control::control_file::control_file_state_t>(new wpkg_control::control_file::build_control_file_state_t));
-                    //f_manager->set_control_variables(fields); -- TBD I think we only read files without variables in this case
-                    fields.set_input_file(&file_data);
-                    if(fields.read())
+                    if(!fields.field_is_defined(wpkg_control::control_file::field_subpackages_factory_t::canonicalized_name()))
+                    {
+                        wpkg_output::log("source package %1 does not include a Sub-Packages field; use \"Sub-Packages: runtime*\" by default if needed")
+                                .quoted_arg(info.get_uri())
+                            .level(wpkg_output::level_error)
+                            .module(wpkg_output::module_build_info)
+                            .package(package_name)
+                            .action("build-validation");
+                    }
+                    wpkg_field::field_file::list_t sub_packages(fields.get_field_list(wpkg_control::control_file::field_subpackages_factory_t::canonicalized_name()));
+                    for(wpkg_control::control_file::field_file::list_t::const_iterator it(sub_packages.begin());
+                                                                                       it != sub_packages.end();
+                                                                                       ++it)
                     {
-                        if(!fields.field_is_defined(wpkg_control::control_file::field_subpackages_factory_t::canonicalized_name()))
+                        // get the sub-package name
+                        std::string sub_name(*it);
+                        if(!sub_name.empty() && *sub_name.rbegin() == '*')
                         {
-                            wpkg_output::log("source package %1 does not include a Sub-Packages field; use \"Sub-Packages: runtime*\" by default if needed")
-                                    .quoted_arg(info.get_uri())
-                                .level(wpkg_output::level_error)
-                                .module(wpkg_output::module_build_info)
-                                .package(package_name)
-                                .action("build-validation");
+                            sub_name = sub_name.substr(0, sub_name.length() - 1);
                         }
-                        wpkg_field::field_file::list_t sub_packages(fields.get_field_list(wpkg_control::control_file::field_subpackages_factory_t::canonicalized_name()));
-                        for(wpkg_control::control_file::field_file::list_t::const_iterator it(sub_packages.begin());
-                                                                                           it != sub_packages.end();
-                                                                                           ++it)
+                        if(!sub_name.empty())
                         {
-                            // get the sub-package name
-                            std::string sub_name(*it);
-                            if(!sub_name.empty() && *sub_name.rbegin() == '*')
+                            std::string field_name(wpkg_control::control_file::field_package_factory_t::canonicalized_name() + ("/" + sub_name));
+                            if(!fields.field_is_defined(field_name, true))
                             {
-                                sub_name = sub_name.substr(0, sub_name.length() - 1);
+                                wpkg_output::log("Mandatory field %1 is not defined")
+                                        .quoted_arg(field_name)
+                                    .level(wpkg_output::level_error)
+                                    .module(wpkg_output::module_build_info)
+                                    .package(package_name)
+                                    .action("build-validation");
                             }
-                            if(!sub_name.empty())
+                            else
                             {
-                                std::string field_name(wpkg_control::control_file::field_package_factory_t::canonicalized_name() + ("/" + sub_name));
-                                if(!fields.field_is_defined(field_name, true))
-                                {
-                                    wpkg_output::log("Mandatory field %1 is not defined")
-                                            .quoted_arg(field_name)
-                                        .level(wpkg_output::level_error)
-                                        .module(wpkg_output::module_build_info)
-                                        .package(package_name)
-                                        .action("build-validation");
-                                }
-                                else
-                                {
-                                    std::string name(fields.get_field(field_name));
-                                    all_packages[name] = s;
-                                }
+                                std::string name(fields.get_field(field_name));
+                                all_packages[name] = s;
                             }
-                            // else -- if empty we should have caught it when
-                            //         validating the field contents
                         }
+                        // else -- if empty we should have caught it when
+                        //         validating the field contents
                     }
-                    break;
                 }
             }
 
@@ -3348,6 +3383,8 @@ void wpkgar_build::build_deb(const wpkg_filename::uri_filename& dir_name)
     data_tar.create(memfile::memory_file::file_format_tar);
     memfile::memory_file md5sums;
     md5sums.create(memfile::memory_file::file_format_other);
+    memfile::memory_file sha256sums;
+    sha256sums.create(memfile::memory_file::file_format_other);
     memfile::memory_file in;
     size_t total_size(0);
 //::fprintf(stderr, "*** start dir_name = [%s]\n", dir_name.original_filename().c_str());
@@ -3519,6 +3556,7 @@ void wpkgar_build::build_deb(const wpkg_filename::uri_filename& dir_name)
                             case memfile::memory_file::file_info::field_name_package_name:
                             case memfile::memory_file::file_info::field_name_size:
                             case memfile::memory_file::file_info::field_name_raw_md5sum:
+                            case memfile::memory_file::file_info::field_name_raw_sha256sum:
                             case memfile::memory_file::file_info::field_name_original_compression:
                             case memfile::memory_file::file_info::field_name_max:
                                 throw wpkgar_exception_invalid("invalid field name defined for a file meta data parameter");
@@ -3640,7 +3678,7 @@ void wpkgar_build::build_deb(const wpkg_filename::uri_filename& dir_name)
             append_file(data_tar, info, input_data);
             found[filename.full_path()] = info;
 
-            // regular files get an md5sums
+            // regular files get an md5sums and a sha256sums
             if(type == memfile::memory_file::file_info::regular_file
             || type == memfile::memory_file::file_info::continuous)
             {
@@ -3648,10 +3686,16 @@ void wpkgar_build::build_deb(const wpkg_filename::uri_filename& dir_name)
                 // TODO: let users define the block size
                 total_size += (info.get_size() + 511) & -512;
                 md5::raw_md5sum raw;
-                input_data.raw_md5sum(raw);
+                sha256::raw_sha256sum raw_sha256;
+                input_data.raw_checksums(raw, raw_sha256);
+                const char mode(input_data.is_text() ? ' ' : '*');
                 md5sums.printf("%s %c%s\n",
                         md5::md5sum::sum(raw).c_str(),
-                        input_data.is_text() ? ' ' : '*',
+                        mode,
+                        info.get_filename().c_str());
+                sha256sums.printf("%s %c%s\n",
+                        sha256::sha256sum::sum(raw_sha256).c_str(),
+                        mode,
                         info.get_filename().c_str());
             }
         }
@@ -3873,6 +3917,18 @@ void wpkgar_build::build_deb(const wpkg_filename::uri_filename& dir_name)
         found["md5sums"] = info;
     }
 
+    // add sha256sums
+    {
+        memfile::memory_file::file_info info;
+        info.set_mode(0444);
+        info.set_user("Administrator");
+        info.set_group("Administrators");
+        info.set_filename("sha256sums");
+        info.set_size(sha256sums.size());
+        append_file(control_tar, info, sha256sums);
+        found["sha256sums"] = info;
+    }
+
     // if defined, add conffiles
     if(conffiles.get_format() == memfile::memory_file::file_format_other)
     {
@@ -3930,6 +3986,7 @@ void wpkgar_build::build_deb(const wpkg_filename::uri_filename& dir_name)
             continue;
         }
         if(filename == "md5sums"
+        || filename == "sha256sums"
         || filename == "debian-binary"
         || filename == "wpkg-version"
         || filename == "control"  // this includes control.tar[.gz]
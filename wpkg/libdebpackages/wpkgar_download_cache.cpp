@@ -0,0 +1,1133 @@
+/*    wpkgar_download_cache.cpp -- local cache of remote packages and indexes
+ *    Copyright (C) 2012-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+
+/** \file
+ * \brief Implementation of the download cache.
+ *
+ * The cache saves the files read from remote repositories in a directory
+ * of the administration database. Each file is saved under the md5sum
+ * of its URI and an index file keeps the size, the md5sum of the data,
+ * and the last time the file was used. The data is checked against the
+ * Package-md5sum and Package-sha256sum fields of the repository index
+ * before a cached package gets reused.
+ */
+#include    "libdebpackages/wpkgar_download_cache.h"
+#include    "libdebpackages/wpkgar_exception.h"
+#include    "libdebpackages/wpkg_http.h"
+#include    "libdebpackages/wpkg_metrics.h"
+#include    "libdebpackages/wpkg_output.h"
+#include    "libdebpackages/compatibility.h"
+
+#include    <algorithm>
+#include    <atomic>
+#include    <set>
+#include    <sstream>
+#include    <fcntl.h>
+#include    <errno.h>
+#include    <stdlib.h>
+#if defined(MO_WINDOWS)
+#else
+#   include    <unistd.h>
+#   include    <sys/file.h>
+#endif
+
+namespace wpkgar
+{
+
+
+namespace
+{
+    // The caches with prefetch threads; these threads must be stopped
+    // before exit() destroys the globals they use (the HTTP connection
+    // pool, the output object, etc.)
+    //
+    std::mutex                                  g_prefetching_mutex;
+    std::set<wpkgar_download_cache *>           g_prefetching_caches;
+    bool                                        g_stop_at_exit_registered(false);
+
+    // makes the temporary filenames unique between threads
+    std::atomic<int>                            g_tmp_counter(0);
+
+    void stop_prefetch_at_exit()
+    {
+        std::set<wpkgar_download_cache *> caches;
+        {
+            std::lock_guard<std::mutex> lock(g_prefetching_mutex);
+            caches.swap(g_prefetching_caches);
+        }
+        for(std::set<wpkgar_download_cache *>::const_iterator it(caches.begin()); it != caches.end(); ++it)
+        {
+            (*it)->stop_prefetch();
+        }
+    }
+
+
+    /** \brief Lock the index of a download cache.
+     *
+     * Several processes may share the same download cache. While an
+     * object of this class exists, the "index.lck" file of the cache
+     * holds an exclusive operating system lock (flock() under Unix and
+     * LockFileEx() under MS-Windows) so the index can be read, modified,
+     * and saved back without losing the changes of the other processes.
+     *
+     * The cache is an optimization, if the lock file cannot be created
+     * (i.e. the database is read-only to this user) the cache is used
+     * without the lock.
+     */
+    class cache_lock
+    {
+    public:
+        cache_lock(const wpkg_filename::uri_filename& cache_path)
+            : f_fd(-1)
+        {
+            try
+            {
+                cache_path.os_mkdir_p();
+            }
+            catch(const std::runtime_error&)
+            {
+                return;
+            }
+            const wpkg_filename::uri_filename lock_filename(cache_path.append_child("index.lck"));
+            f_fd = os_open(lock_filename.os_filename().get_os_string().c_str(), O_CREAT | O_RDWR, 0644);
+            if(f_fd == -1)
+            {
+                return;
+            }
+#if defined(MO_WINDOWS)
+            HANDLE h(reinterpret_cast<HANDLE>(_get_osfhandle(f_fd)));
+            OVERLAPPED overlapped;
+            memset(&overlapped, 0, sizeof(overlapped));
+            LockFileEx(h, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+#else
+            while(flock(f_fd, LOCK_EX) != 0 && errno == EINTR)
+            {
+            }
+#endif
+        }
+
+        ~cache_lock()
+        {
+            // closing the file releases the lock
+            if(f_fd != -1)
+            {
+                close(f_fd);
+            }
+        }
+
+    private:
+        // disallow copying
+                        cache_lock(const cache_lock& rhs);
+        cache_lock&     operator = (const cache_lock& rhs);
+
+        int             f_fd;
+    };
+
+
+    bool is_older(const memfile::memory_file::file_info& lhs, const memfile::memory_file::file_info& rhs)
+    {
+        return lhs.get_mtime() < rhs.get_mtime();
+    }
+} // no name namespace
+
+
+/** \class wpkgar_download_cache
+ * \brief Cache of the files downloaded from remote repositories.
+ *
+ * Installing from a remote repository means downloading the index of
+ * the repository and then each package being installed. Without a
+ * cache, running the same command twice (or a --simulate followed by
+ * the actual installation) downloads everything twice.
+ *
+ * The cache keeps a copy of each downloaded file in the administration
+ * directory. A cached package is reused only when its md5sum, sha256sum,
+ * and size match the values found in the repository index (the
+ * Package-md5sum, Package-sha256sum, and Package-Size fields.) Those
+ * values are registered with the set_expected() function before the
+ * package gets loaded. A file without such expectations (i.e. the index
+ * itself) is downloaded again unless the cache is offline.
+ *
+ * When the cache is offline, nothing gets downloaded: the cached copy
+ * is used if present and an error is raised otherwise.
+ *
+ * The total size of the cache is limited. Once the limit is reached,
+ * the partial downloads and then the least recently used files are
+ * removed. A maximum size of zero means files do not get saved in the
+ * cache.
+ *
+ * Several processes can use the same cache. The index is re-read and
+ * saved with an operating system lock held each time it gets modified
+ * so the files added by one process are not lost by another.
+ *
+ * The functions are thread safe so packages can be downloaded in
+ * parallel. The download itself happens outside of the lock. The
+ * prefetch() function uses that to download a list of packages in
+ * background threads while the installer works on other things.
+ */
+
+
+/** \brief Initialize the download cache.
+ *
+ * The cache index is not read until the cache is first used.
+ *
+ * \param[in] cache_path  The directory where the files get saved.
+ */
+wpkgar_download_cache::wpkgar_download_cache(const wpkg_filename::uri_filename& cache_path)
+    //: f_mutex() -- auto-init
+    : f_cache_path(cache_path)
+    , f_max_size(DEFAULT_MAX_SIZE)
+    //, f_offline(false) -- auto-init
+    //, f_loaded(false) -- auto-init
+    //, f_sequence(0) -- auto-init
+    //, f_entries() -- auto-init
+    //, f_expected() -- auto-init
+    //, f_prefetch() -- auto-init
+    //, f_prefetch_done() -- auto-init
+    //, f_prefetch_threads() -- auto-init
+    //, f_stop_prefetch(false) -- auto-init
+{
+}
+
+
+/** \brief Clean up the download cache.
+ *
+ * The destructor waits for the prefetch threads to be done with their
+ * current download.
+ */
+wpkgar_download_cache::~wpkgar_download_cache()
+{
+    {
+        std::lock_guard<std::mutex> lock(g_prefetching_mutex);
+        g_prefetching_caches.erase(this);
+    }
+    stop_prefetch();
+}
+
+
+/** \brief Get the directory of the cache.
+ *
+ * \return The path to the directory holding the cached files.
+ */
+const wpkg_filename::uri_filename& wpkgar_download_cache::get_cache_path() const
+{
+    return f_cache_path;
+}
+
+
+/** \brief Set the maximum number of bytes kept in the cache.
+ *
+ * When the total size of the cached files goes over this limit, the
+ * least recently used files are removed. Setting the size to zero
+ * prevents new files from being saved in the cache.
+ *
+ * \param[in] max_size  The maximum size in bytes.
+ */
+void wpkgar_download_cache::set_max_size(int64_t max_size)
+{
+    if(max_size < 0)
+    {
+        throw wpkgar_exception_parameter("the maximum size of the download cache cannot be negative");
+    }
+    std::lock_guard<std::mutex> lock(f_mutex);
+    f_max_size = max_size;
+}
+
+
+/** \brief Get the maximum number of bytes kept in the cache.
+ *
+ * \return The maximum size in bytes.
+ */
+int64_t wpkgar_download_cache::get_max_size() const
+{
+    return f_max_size;
+}
+
+
+/** \brief Set whether remote files can be downloaded.
+ *
+ * In offline mode the read_file() function only returns files from
+ * the cache. A file which is not available in the cache generates an
+ * error.
+ *
+ * \param[in] offline  Whether the cache is offline.
+ */
+void wpkgar_download_cache::set_offline(bool offline)
+{
+    f_offline = offline;
+}
+
+
+/** \brief Check whether the cache is offline.
+ *
+ * \return true if files do not get downloaded.
+ */
+bool wpkgar_download_cache::get_offline() const
+{
+    return f_offline;
+}
+
+
+/** \brief Register the expected checksums and size of a remote file.
+ *
+ * The repository index includes the md5sum, sha256sum, and size of
+ * each package. The installer registers those values before loading a
+ * package so the cache can tell whether its copy is still current and
+ * whether the downloaded file is valid.
+ *
+ * \param[in] uri  The URI of the remote file.
+ * \param[in] md5sum  The expected md5sum, may be empty if unknown.
+ * \param[in] size  The expected size, zero if unknown.
+ * \param[in] sha256sum  The expected sha256sum, may be empty if unknown.
+ */
+void wpkgar_download_cache::set_expected(const wpkg_filename::uri_filename& uri, const std::string& md5sum, int64_t size, const std::string& sha256sum)
+{
+    std::lock_guard<std::mutex> lock(f_mutex);
+    expected_t& expected(f_expected[uri.full_path()]);
+    expected.f_md5sum = md5sum;
+    expected.f_sha256sum = sha256sum;
+    expected.f_size = size;
+}
+
+
+/** \brief Read a file through the cache.
+ *
+ * Direct (local) files are read as is. Remote files are searched in
+ * the cache first. A cached copy is used if:
+ *
+ * \li the cache is offline, or
+ * \li \p refresh is false and the checksums and size registered with
+ *     set_expected() match the cached copy.
+ *
+ * Otherwise the file is downloaded, checked against the expected
+ * checksums and size, and saved in the cache. When the expected md5sum is known,
+ * a download interrupted by a dropped connection is resumed (see
+ * memory_file::resume_file()) and the data received so far is kept in
+ * the cache directory for the next attempt. If the file resumed from
+ * that data does not match the md5sum, it gets downloaded again from
+ * scratch.
+ *
+ * \exception wpkgar_exception_io
+ * The cache is offline and the file is not available in the cache.
+ *
+ * \exception wpkgar_exception_invalid
+ * The downloaded file does not match the expected checksums or size.
+ *
+ * \param[in] uri  The URI of the file to read.
+ * \param[out] data  The memory file receiving the data.
+ * \param[in] refresh  Whether to download the file even if cached.
+ */
+void wpkgar_download_cache::read_file(const wpkg_filename::uri_filename& uri, memfile::memory_file& data, bool refresh)
+{
+    if(uri.is_direct())
+    {
+        data.read_file(uri);
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(f_mutex);
+        prefetch_map_t::iterator it(f_prefetch.find(uri.full_path()));
+        if(it != f_prefetch.end())
+        {
+            // wait for the prefetch thread to be done with that file
+            std::shared_ptr<prefetch_t> p(it->second);
+            f_prefetch_done.wait(lock, [p]() { return static_cast<bool>(p->f_done); });
+            f_prefetch.erase(uri.full_path());
+            if(p->f_data)
+            {
+                data = std::move(*p->f_data);
+                return;
+            }
+            // the prefetch failed, try again so the error gets reported
+        }
+    }
+
+    fetch(uri, data, refresh, true);
+}
+
+
+/** \brief Download files in the background.
+ *
+ * This function starts threads which download the specified files
+ * through the cache. The files are grouped by host and at most
+ * \p connections_per_host files get downloaded from the same host at
+ * the same time. The files are downloaded in the order specified so
+ * the first files the caller needs are available first.
+ *
+ * A later call to read_file() with one of these URIs waits for that one
+ * file to be downloaded and returns its data. The expected md5sum and
+ * size of the files should be registered with set_expected() before
+ * calling this function so the threads can verify the data.
+ *
+ * The messages logged by the prefetch threads are discarded (see
+ * wpkg_output::silence_thread.) If a download fails, the read_file()
+ * function downloads the file again and reports the error.
+ *
+ * The threads are stopped by stop_prefetch(), the destructor, or, if
+ * the process calls exit() while they are still running, by an
+ * atexit() function which runs before the globals they use get
+ * destroyed.
+ *
+ * \param[in] uris  The list of URIs to download.
+ * \param[in] connections_per_host  The maximum number of connections
+ *                                  opened to the same host.
+ */
+void wpkgar_download_cache::prefetch(const uri_list_t& uris, int connections_per_host)
+{
+    if(connections_per_host < 1)
+    {
+        connections_per_host = 1;
+    }
+
+    // the first os_filename() call initializes globals; make sure that
+    // happens here and not in parallel in the worker threads
+    if(!f_cache_path.empty())
+    {
+        get_entry_filename("prefetch").os_filename();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(g_prefetching_mutex);
+        if(!g_stop_at_exit_registered)
+        {
+            // the connection pool must be created before we register
+            // the atexit() function so it gets destroyed after the
+            // threads were stopped
+            wpkg_http::http_pool::instance();
+            atexit(stop_prefetch_at_exit);
+            g_stop_at_exit_registered = true;
+        }
+        g_prefetching_caches.insert(this);
+    }
+
+    typedef std::map<std::string, std::shared_ptr<uri_queue_t> > host_queues_t;
+    host_queues_t queues;
+    std::lock_guard<std::mutex> lock(f_mutex);
+    f_stop_prefetch = false;
+    for(uri_list_t::const_iterator it(uris.begin()); it != uris.end(); ++it)
+    {
+        const std::string uri_str(it->full_path());
+        if(it->is_direct() || f_prefetch.find(uri_str) != f_prefetch.end())
+        {
+            continue;
+        }
+        f_prefetch[uri_str].reset(new prefetch_t);
+        std::shared_ptr<uri_queue_t>& queue(queues[it->get_domain() + ":" + it->get_port()]);
+        if(!queue)
+        {
+            queue.reset(new uri_queue_t);
+        }
+        queue->push_back(*it);
+    }
+
+    for(host_queues_t::const_iterator it(queues.begin()); it != queues.end(); ++it)
+    {
+        const size_t threads(std::min(static_cast<size_t>(connections_per_host), it->second->size()));
+        for(size_t i(0); i < threads; ++i)
+        {
+            f_prefetch_threads.push_back(std::thread(&wpkgar_download_cache::prefetch_worker, this, it->second));
+        }
+    }
+}
+
+
+/** \brief Stop the prefetch threads.
+ *
+ * The threads finish their current download and then stop. The files
+ * which were not downloaded yet get downloaded by read_file() as usual.
+ */
+void wpkgar_download_cache::stop_prefetch()
+{
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(f_mutex);
+        f_stop_prefetch = true;
+        threads.swap(f_prefetch_threads);
+    }
+    for(size_t i(0); i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+
+    // forget about the files which did not get downloaded
+    std::lock_guard<std::mutex> lock(f_mutex);
+    for(prefetch_map_t::iterator it(f_prefetch.begin()); it != f_prefetch.end();)
+    {
+        if(it->second->f_done)
+        {
+            ++it;
+        }
+        else
+        {
+            it->second->f_done = true;
+            f_prefetch.erase(it++);
+        }
+    }
+    f_prefetch_done.notify_all();
+}
+
+
+/** \brief Download the files of one host.
+ *
+ * Each prefetch thread runs this function. It takes the next URI from
+ * the queue of its host until the queue is empty or the prefetch gets
+ * stopped.
+ *
+ * \param[in] queue  The queue of URIs of one host.
+ */
+void wpkgar_download_cache::prefetch_worker(std::shared_ptr<uri_queue_t> queue)
+{
+    // errors get reported by read_file() in the main thread
+    wpkg_output::silence_thread silence;
+
+    for(;;)
+    {
+        wpkg_filename::uri_filename uri;
+        {
+            std::lock_guard<std::mutex> lock(f_mutex);
+            if(f_stop_prefetch || queue->empty())
+            {
+                return;
+            }
+            uri = queue->front();
+            queue->pop_front();
+        }
+
+        std::shared_ptr<memfile::memory_file> data(new memfile::memory_file);
+        try
+        {
+            fetch(uri, *data, false, false);
+        }
+        catch(const std::exception&)
+        {
+            data.reset();
+        }
+
+        std::lock_guard<std::mutex> lock(f_mutex);
+        prefetch_map_t::iterator it(f_prefetch.find(uri.full_path()));
+        if(it != f_prefetch.end())
+        {
+            it->second->f_done = true;
+            it->second->f_data = data;
+        }
+        f_prefetch_done.notify_all();
+    }
+}
+
+
+/** \brief Read a file from the cache or download it.
+ *
+ * This function implements read_file() without the prefetch support.
+ *
+ * \param[in] uri  The URI of the file to read.
+ * \param[out] data  The memory file receiving the data.
+ * \param[in] refresh  Whether to download the file even if cached.
+ * \param[in] verbose  Whether messages can be logged.
+ */
+void wpkgar_download_cache::fetch(const wpkg_filename::uri_filename& uri, memfile::memory_file& data, bool refresh, bool verbose)
+{
+    const std::string uri_str(uri.full_path());
+    const std::string key(get_key(uri_str));
+    expected_t expected;
+    bool has_expected(false);
+    bool cached(false);
+    {
+        std::lock_guard<std::mutex> lock(f_mutex);
+        load_index();
+        expected_map_t::const_iterator e(f_expected.find(uri_str));
+        if(e != f_expected.end())
+        {
+            expected = e->second;
+            has_expected = true;
+        }
+        cached = f_entries.find(key) != f_entries.end();
+    }
+
+    if(cached && (f_offline || (!refresh && has_expected)))
+    {
+        if(read_entry(key, uri_str, has_expected ? &expected : NULL, data, verbose))
+        {
+            wpkg_metrics::add_to_counter(wpkg_metrics::counter_cache_hits);
+            if(verbose)
+            {
+                wpkg_output::log("using cached copy of %1.")
+                        .quoted_arg(uri_str)
+                    .debug(wpkg_output::debug_flags::debug_detail_files)
+                    .module(wpkg_output::module_repository);
+            }
+            return;
+        }
+    }
+
+    if(f_offline)
+    {
+        throw wpkgar_exception_io("file \"" + uri_str + "\" is not available in the download cache and the cache is offline");
+    }
+
+    wpkg_metrics::add_to_counter(wpkg_metrics::counter_cache_misses);
+    wpkg_metrics::phase_timer timer(wpkg_metrics::phase_download);
+
+    // keep the data of a dropped connection so the next attempt does
+    // not start from scratch; only files with a known checksum are
+    // resumed since a partial file may be from an older version of the file
+    const wpkg_filename::uri_filename partial(f_cache_path.append_child(key + ".part"));
+    const bool resume(f_max_size > 0 && has_expected && (!expected.f_md5sum.empty() || !expected.f_sha256sum.empty()));
+    for(bool resumed(resume && partial.exists());; resumed = false)
+    {
+        if(resume)
+        {
+            try
+            {
+                data.resume_file(uri, partial, expected.f_size != 0 ? static_cast<int>(expected.f_size) : -1);
+            }
+            catch(...)
+            {
+                // the partial file counts in the size of the cache
+                std::lock_guard<std::mutex> lock(f_mutex);
+                cache_lock index_lock(f_cache_path);
+                read_index();
+                evict(verbose);
+                save_index();
+                throw;
+            }
+        }
+        else
+        {
+            data.read_file(uri);
+        }
+        wpkg_metrics::add_to_counter(wpkg_metrics::counter_bytes_downloaded, data.size());
+
+        if(has_expected)
+        {
+            if(!matches_expected(expected, data))
+            {
+                if(resumed)
+                {
+                    // the remote file changed since the partial file was
+                    // saved, download the whole file again
+                    if(verbose)
+                    {
+                        wpkg_output::log("partial download of %1 is out of date, downloading the whole file.")
+                                .quoted_arg(uri_str)
+                            .debug(wpkg_output::debug_flags::debug_detail_files)
+                            .module(wpkg_output::module_repository);
+                    }
+                    partial.os_unlink();
+                    continue;
+                }
+                throw wpkgar_exception_invalid("file \"" + uri_str + "\" does not match the md5sum, sha256sum, or size defined in the repository index");
+            }
+        }
+        break;
+    }
+
+    if(f_max_size > 0 && data.size() <= f_max_size)
+    {
+        store_entry(key, uri_str, data, verbose);
+    }
+}
+
+
+/** \brief Check whether a file is in the cache.
+ *
+ * \param[in] uri  The URI of the file.
+ *
+ * \return true if a copy of the file is available in the cache.
+ */
+bool wpkgar_download_cache::is_cached(const wpkg_filename::uri_filename& uri)
+{
+    std::lock_guard<std::mutex> lock(f_mutex);
+    load_index();
+    return f_entries.find(get_key(uri.full_path())) != f_entries.end();
+}
+
+
+/** \brief Get the total size of the cached files.
+ *
+ * The partial downloads kept for the next attempt are included.
+ *
+ * \return The number of bytes used by the cached files.
+ */
+int64_t wpkgar_download_cache::get_total_size()
+{
+    std::lock_guard<std::mutex> lock(f_mutex);
+    load_index();
+    part_files_t parts;
+    get_part_files(parts);
+    int64_t total(0);
+    for(part_files_t::const_iterator it(parts.begin()); it != parts.end(); ++it)
+    {
+        total += it->get_size();
+    }
+    for(cache_entries_t::const_iterator it(f_entries.begin());
+                                        it != f_entries.end();
+                                        ++it)
+    {
+        total += it->second.f_size;
+    }
+    return total;
+}
+
+
+/** \brief Remove all the files from the cache.
+ *
+ * This includes the partial downloads.
+ */
+void wpkgar_download_cache::clear()
+{
+    std::lock_guard<std::mutex> lock(f_mutex);
+    cache_lock index_lock(f_cache_path);
+    read_index();
+    for(cache_entries_t::const_iterator it(f_entries.begin());
+                                        it != f_entries.end();
+                                        ++it)
+    {
+        get_entry_filename(it->first).os_unlink();
+    }
+    f_entries.clear();
+    part_files_t parts;
+    get_part_files(parts);
+    for(part_files_t::const_iterator it(parts.begin()); it != parts.end(); ++it)
+    {
+        it->get_uri().os_unlink();
+    }
+    save_index();
+}
+
+
+/** \brief Check data against the expected checksums and size.
+ *
+ * The checksums which are not known (empty) and a size of zero are
+ * not checked.
+ *
+ * \param[in] expected  The expected checksums and size.
+ * \param[in] data  The data to check.
+ *
+ * \return true if the data matches all the known expectations.
+ */
+bool wpkgar_download_cache::matches_expected(const expected_t& expected, const memfile::memory_file& data)
+{
+    if(expected.f_size != 0 && data.size() != expected.f_size)
+    {
+        return false;
+    }
+    if(!expected.f_md5sum.empty() && data.md5sum() != expected.f_md5sum)
+    {
+        return false;
+    }
+    if(!expected.f_sha256sum.empty() && data.sha256sum() != expected.f_sha256sum)
+    {
+        return false;
+    }
+    return true;
+}
+
+
+/** \brief Compute the key of a URI.
+ *
+ * URIs include characters which are not valid in filenames so the
+ * files are saved under the md5sum of their URI instead.
+ *
+ * \param[in] uri  The URI to convert.
+ *
+ * \return The key of the URI.
+ */
+std::string wpkgar_download_cache::get_key(const std::string& uri)
+{
+    md5::md5sum sum;
+    sum.push_back(reinterpret_cast<const uint8_t *>(uri.c_str()), uri.length());
+    return sum.sum();
+}
+
+
+/** \brief Get the filename of a cached file.
+ *
+ * \param[in] key  The key of the file.
+ *
+ * \return The full path to the cached file.
+ */
+wpkg_filename::uri_filename wpkgar_download_cache::get_entry_filename(const std::string& key) const
+{
+    return f_cache_path.append_child(key + ".data");
+}
+
+
+/** \brief Get the list of partial downloads.
+ *
+ * The files that memory_file::resume_file() keeps after a dropped
+ * connection are saved in the cache directory with the ".part"
+ * extension. They are not part of the index, yet they count in the
+ * total size of the cache.
+ *
+ * \param[out] parts  The list of partial downloads.
+ */
+void wpkgar_download_cache::get_part_files(part_files_t& parts) const
+{
+    parts.clear();
+    if(!f_cache_path.is_dir())
+    {
+        return;
+    }
+    memfile::memory_file dir;
+    dir.dir_rewind(f_cache_path, false);
+    memfile::memory_file::file_info info;
+    while(dir.dir_next(info))
+    {
+        const std::string name(info.get_basename());
+        if(info.get_file_type() == memfile::memory_file::file_info::regular_file
+        && name.length() > 5 && name.compare(name.length() - 5, 5, ".part") == 0)
+        {
+            parts.push_back(info);
+        }
+    }
+}
+
+
+/** \brief Read a file from the cache.
+ *
+ * The cached data is checked against the md5sum saved in the index so
+ * a file damaged on disk does not get used. When a sha256sum is expected
+ * the data is also checked against it since the md5sum alone does not
+ * prove that the file was not tampered with. A damaged file or a file
+ * which does not match the expected sha256sum is removed from the cache.
+ *
+ * \param[in] key  The key of the file.
+ * \param[in] uri  The URI of the file, used in messages.
+ * \param[in] expected  The expected md5sum and size, or NULL.
+ * \param[out] data  The memory file receiving the data.
+ * \param[in] verbose  Whether messages can be logged.
+ *
+ * \return true if the data was read from the cache.
+ */
+bool wpkgar_download_cache::read_entry(const std::string& key, const std::string& uri, const expected_t *expected, memfile::memory_file& data, bool verbose)
+{
+    std::string md5sum;
+    {
+        std::lock_guard<std::mutex> lock(f_mutex);
+        cache_entries_t::const_iterator it(f_entries.find(key));
+        if(it == f_entries.end())
+        {
+            return false;
+        }
+        if(expected != NULL
+        && ((expected->f_size != 0 && expected->f_size != it->second.f_size)
+         || (!expected->f_md5sum.empty() && expected->f_md5sum != it->second.f_md5sum)))
+        {
+            // the repository has a newer version of this file
+            return false;
+        }
+        md5sum = it->second.f_md5sum;
+    }
+
+    bool valid(true);
+    try
+    {
+        data.read_file(get_entry_filename(key));
+        valid = data.md5sum() == md5sum
+             && (expected == NULL || matches_expected(*expected, data));
+    }
+    catch(const memfile::memfile_exception&)
+    {
+        valid = false;
+    }
+
+    std::lock_guard<std::mutex> lock(f_mutex);
+    cache_lock index_lock(f_cache_path);
+    read_index();
+    if(!valid)
+    {
+        if(verbose)
+        {
+            wpkg_output::log("removing damaged cached copy of %1.")
+                    .quoted_arg(uri)
+                .debug(wpkg_output::debug_flags::debug_detail_files)
+                .module(wpkg_output::module_repository);
+        }
+        get_entry_filename(key).os_unlink();
+        f_entries.erase(key);
+        save_index();
+        return false;
+    }
+    cache_entries_t::iterator it(f_entries.find(key));
+    if(it != f_entries.end())
+    {
+        f_sequence = f_sequence + 1;
+        it->second.f_last_used = f_sequence;
+        save_index();
+    }
+    return true;
+}
+
+
+/** \brief Save a downloaded file in the cache.
+ *
+ * The cache is an optimization only, if the file cannot be saved (i.e.
+ * the database is read-only to this user) the error is ignored.
+ *
+ * \param[in] key  The key of the file.
+ * \param[in] uri  The URI of the file.
+ * \param[in] data  The downloaded data.
+ * \param[in] verbose  Whether messages can be logged.
+ */
+void wpkgar_download_cache::store_entry(const std::string& key, const std::string& uri, const memfile::memory_file& data, bool verbose)
+{
+    const std::string md5sum(data.md5sum());
+    const wpkg_filename::uri_filename filename(get_entry_filename(key));
+
+    // write to a temporary file first so another process never sees a
+    // partial file; the name includes our pid and a counter so processes
+    // and threads storing the same file do not share it
+    std::stringstream tmp_name;
+    tmp_name << key << "-" << getpid() << "-" << ++g_tmp_counter << ".tmp";
+    const wpkg_filename::uri_filename tmp(f_cache_path.append_child(tmp_name.str()));
+    try
+    {
+        data.write_file(tmp, true);
+        filename.os_unlink();
+        tmp.os_rename(filename);
+    }
+    catch(const std::runtime_error& e)
+    {
+        try
+        {
+            tmp.os_unlink();
+        }
+        catch(const std::runtime_error&)
+        {
+        }
+        if(verbose)
+        {
+            wpkg_output::log("could not save %1 in the download cache: %2.")
+                    .quoted_arg(uri)
+                    .arg(e.what())
+                .debug(wpkg_output::debug_flags::debug_detail_files)
+                .module(wpkg_output::module_repository);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(f_mutex);
+    cache_lock index_lock(f_cache_path);
+    read_index();
+    cache_entry_t& entry(f_entries[key]);
+    entry.f_size = data.size();
+    entry.f_md5sum = md5sum;
+    f_sequence = f_sequence + 1;
+    entry.f_last_used = f_sequence;
+    entry.f_uri = uri;
+    evict(verbose);
+    save_index();
+}
+
+
+/** \brief Remove the least recently used files.
+ *
+ * This function removes files from the cache until the total size is
+ * under the maximum size. The partial downloads count in the total and
+ * they get removed first, oldest first. It must be called with the mutex
+ * and the index lock held.
+ *
+ * \param[in] verbose  Whether messages can be logged.
+ */
+void wpkgar_download_cache::evict(bool verbose)
+{
+    part_files_t parts;
+    get_part_files(parts);
+    std::sort(parts.begin(), parts.end(), is_older);
+    int64_t total(0);
+    for(part_files_t::const_iterator it(parts.begin()); it != parts.end(); ++it)
+    {
+        total += it->get_size();
+    }
+    for(cache_entries_t::const_iterator it(f_entries.begin());
+                                        it != f_entries.end();
+                                        ++it)
+    {
+        total += it->second.f_size;
+    }
+    for(part_files_t::const_iterator it(parts.begin()); it != parts.end() && total > f_max_size; ++it)
+    {
+        if(verbose)
+        {
+            wpkg_output::log("evicting partial download %1 from the download cache.")
+                    .quoted_arg(it->get_uri())
+                .debug(wpkg_output::debug_flags::debug_detail_files)
+                .module(wpkg_output::module_repository);
+        }
+        total -= it->get_size();
+        it->get_uri().os_unlink();
+    }
+    while(total > f_max_size && !f_entries.empty())
+    {
+        cache_entries_t::iterator oldest(f_entries.begin());
+        for(cache_entries_t::iterator it(f_entries.begin());
+                                      it != f_entries.end();
+                                      ++it)
+        {
+            if(it->second.f_last_used < oldest->second.f_last_used)
+            {
+                oldest = it;
+            }
+        }
+        if(verbose)
+        {
+            wpkg_output::log("evicting %1 from the download cache.")
+                    .quoted_arg(oldest->second.f_uri)
+                .debug(wpkg_output::debug_flags::debug_detail_files)
+                .module(wpkg_output::module_repository);
+        }
+        total -= oldest->second.f_size;
+        get_entry_filename(oldest->first).os_unlink();
+        f_entries.erase(oldest);
+    }
+}
+
+
+/** \brief Read the cache index.
+ *
+ * Each line of the index defines one cached file:
+ *
+ * \code
+ * <key> <size> <md5sum> <last used> <uri>
+ * \endcode
+ *
+ * The index is read once; the functions modifying the index call
+ * read_index() instead. It must be called with the mutex locked.
+ */
+void wpkgar_download_cache::load_index()
+{
+    if(f_loaded)
+    {
+        return;
+    }
+    f_loaded = true;
+
+    read_index();
+}
+
+
+/** \brief Re-read the cache index.
+ *
+ * Other processes may have modified the index since this process last
+ * read it. The functions modifying the index call this function with
+ * the index lock held, then apply their change and save the index.
+ * That way the entries of the other processes are merged instead of
+ * being overwritten.
+ *
+ * If the index cannot be read or a line is invalid, the cache becomes
+ * empty. It must be called with the mutex locked.
+ */
+void wpkgar_download_cache::read_index()
+{
+    f_loaded = true;
+    f_entries.clear();
+
+    const wpkg_filename::uri_filename filename(f_cache_path.append_child("index"));
+    if(!filename.exists())
+    {
+        return;
+    }
+
+    memfile::memory_file data;
+    try
+    {
+        data.read_file(filename);
+    }
+    catch(const memfile::memfile_exception&)
+    {
+        return;
+    }
+
+    int offset(0);
+    std::string line;
+    while(data.read_line(offset, line))
+    {
+        if(line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::vector<std::string> fields;
+        std::string::size_type start(0);
+        while(fields.size() < 4)
+        {
+            const std::string::size_type pos(line.find(' ', start));
+            if(pos == std::string::npos)
+            {
+                break;
+            }
+            fields.push_back(line.substr(start, pos - start));
+            start = pos + 1;
+        }
+        if(fields.size() != 4 || fields[0].empty() || start >= line.length())
+        {
+            f_entries.clear();
+            return;
+        }
+        cache_entry_t& entry(f_entries[fields[0]]);
+        entry.f_size = static_cast<int64_t>(strtoll(fields[1].c_str(), NULL, 10));
+        entry.f_md5sum = fields[2];
+        entry.f_last_used = static_cast<uint64_t>(strtoull(fields[3].c_str(), NULL, 10));
+        entry.f_uri = line.substr(start);
+        if(entry.f_last_used > f_sequence)
+        {
+            f_sequence = entry.f_last_used;
+        }
+    }
+}
+
+
+/** \brief Save the cache index.
+ *
+ * Errors are ignored, the files saved in the cache without a matching
+ * index entry are simply not reused. It must be called with the mutex
+ * locked.
+ */
+void wpkgar_download_cache::save_index() const
+{
+    memfile::memory_file data;
+    data.create(memfile::memory_file::file_format_other);
+    data.printf("# wpkg download cache -- do not edit\n");
+    for(cache_entries_t::const_iterator it(f_entries.begin());
+                                        it != f_entries.end();
+                                        ++it)
+    {
+        data.printf("%s %lld %s %llu %s\n",
+                it->first.c_str(),
+                static_cast<long long>(static_cast<int64_t>(it->second.f_size)),
+                it->second.f_md5sum.c_str(),
+                static_cast<unsigned long long>(static_cast<uint64_t>(it->second.f_last_used)),
+                it->second.f_uri.c_str());
+    }
+
+    try
+    {
+        data.write_file(f_cache_path.append_child("index"), true);
+    }
+    catch(const memfile::memfile_exception&)
+    {
+        // ignore, the cache is an optimization
+    }
+}
+
+
+
+}   // namespace wpkgar
+// vim: ts=4 sw=4 et
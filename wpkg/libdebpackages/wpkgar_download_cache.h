@@ -0,0 +1,134 @@
+/*    wpkgar_download_cache.h -- local cache of remote packages and indexes
+ *    Copyright (C) 2012-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+
+/** \file
+ * \brief Download cache declaration.
+ *
+ * Files read from remote repositories (packages and index files) are
+ * saved in the administration directory so the next run does not have
+ * to download them again. The cache is bounded in size and the least
+ * recently used files get evicted first.
+ */
+#pragma once
+#ifndef WPKGAR_DOWNLOAD_CACHE_H
+#define WPKGAR_DOWNLOAD_CACHE_H
+#include    "libdebpackages/memfile.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+
+namespace wpkgar
+{
+
+
+
+class DEBIAN_PACKAGE_EXPORT wpkgar_download_cache
+{
+public:
+    typedef std::shared_ptr<wpkgar_download_cache> pointer_t;
+    typedef std::vector<wpkg_filename::uri_filename> uri_list_t;
+
+    static const int64_t            DEFAULT_MAX_SIZE = 256LL * 1024LL * 1024LL;
+    static const int                DEFAULT_CONNECTIONS_PER_HOST = 4;
+
+                                    wpkgar_download_cache(const wpkg_filename::uri_filename& cache_path);
+                                    ~wpkgar_download_cache();
+
+    const wpkg_filename::uri_filename& get_cache_path() const;
+    void                            set_max_size(int64_t max_size);
+    int64_t                         get_max_size() const;
+    void                            set_offline(bool offline);
+    bool                            get_offline() const;
+
+    void                            set_expected(const wpkg_filename::uri_filename& uri, const std::string& md5sum, int64_t size, const std::string& sha256sum = std::string());
+    void                            read_file(const wpkg_filename::uri_filename& uri, memfile::memory_file& data, bool refresh = false);
+    void                            prefetch(const uri_list_t& uris, int connections_per_host = DEFAULT_CONNECTIONS_PER_HOST);
+    void                            stop_prefetch();
+    bool                            is_cached(const wpkg_filename::uri_filename& uri);
+    int64_t                         get_total_size();
+    void                            clear();
+
+private:
+    struct cache_entry_t
+    {
+        controlled_vars::zint64_t       f_size;
+        std::string                     f_md5sum;
+        controlled_vars::zuint64_t      f_last_used;
+        std::string                     f_uri;
+    };
+    struct expected_t
+    {
+        std::string                     f_md5sum;
+        std::string                     f_sha256sum;
+        controlled_vars::zint64_t       f_size;
+    };
+    struct prefetch_t
+    {
+        controlled_vars::fbool_t                f_done;
+        std::shared_ptr<memfile::memory_file>   f_data;
+    };
+    typedef std::map<std::string, cache_entry_t>    cache_entries_t;
+    typedef std::map<std::string, expected_t>       expected_map_t;
+    typedef std::map<std::string, std::shared_ptr<prefetch_t> > prefetch_map_t;
+    typedef std::deque<wpkg_filename::uri_filename> uri_queue_t;
+    typedef std::vector<memfile::memory_file::file_info> part_files_t;
+
+    // disallow copying
+                                    wpkgar_download_cache(const wpkgar_download_cache& rhs);
+    wpkgar_download_cache&          operator = (const wpkgar_download_cache& rhs);
+
+    void                            fetch(const wpkg_filename::uri_filename& uri, memfile::memory_file& data, bool refresh, bool verbose);
+    void                            prefetch_worker(std::shared_ptr<uri_queue_t> queue);
+    static std::string              get_key(const std::string& uri);
+    static bool                     matches_expected(const expected_t& expected, const memfile::memory_file& data);
+    wpkg_filename::uri_filename     get_entry_filename(const std::string& key) const;
+    void                            get_part_files(part_files_t& parts) const;
+    bool                            read_entry(const std::string& key, const std::string& uri, const expected_t *expected, memfile::memory_file& data, bool verbose);
+    void                            store_entry(const std::string& key, const std::string& uri, const memfile::memory_file& data, bool verbose);
+    void                            evict(bool verbose);
+    void                            load_index();
+    void                            read_index();
+    void                            save_index() const;
+
+    std::mutex                      f_mutex;
+    wpkg_filename::uri_filename     f_cache_path;
+    controlled_vars::zint64_t       f_max_size;
+    controlled_vars::fbool_t        f_offline;
+    controlled_vars::fbool_t        f_loaded;
+    controlled_vars::zuint64_t      f_sequence;
+    cache_entries_t                 f_entries;
+    expected_map_t                  f_expected;
+    prefetch_map_t                  f_prefetch;
+    std::condition_variable         f_prefetch_done;
+    std::vector<std::thread>        f_prefetch_threads;
+    controlled_vars::fbool_t        f_stop_prefetch;
+};
+
+
+
+}   // namespace wpkgar
+#endif
+//#ifndef WPKGAR_DOWNLOAD_CACHE_H
+// vim: ts=4 sw=4 et
@@ -29,9 +29,11 @@
  * functions.
  */
 #include    "libdebpackages/wpkgar_install.h"
+#include    "libdebpackages/wpkgar_download_cache.h"
 #include    "libdebpackages/wpkgar_repository.h"
 #include    "libdebpackages/debian_version.h"
 #include    "libdebpackages/wpkg_backup.h"
+#include    "libdebpackages/wpkg_metrics.h"
 #include    "libdebpackages/wpkg_util.h"
 #include    "libdebpackages/debian_packages.h"
 #include    "libdebpackages/installer/details/disk.h"
@@ -87,6 +89,7 @@ wpkgar_install::wpkgar_install( wpkgar_manager::pointer_t manager )
     //, f_task()                 -- auto-init
     //, f_tree_max_depth(0)      -- auto-init
     //, f_install_source(false)  -- auto-init
+    //, f_prefetch(false)        -- auto-init
     //, f_field_validations()    -- auto-init
 {
     f_flags.reset( new flags );
@@ -124,6 +127,26 @@ void wpkgar_install::set_unpacking()
 }
 
 
+/** \brief Whether remote packages get downloaded in parallel.
+ *
+ * By default the validate() function downloads the remote packages
+ * one after another as it needs them. When prefetching is turned on,
+ * the validate() function starts downloading all the remote packages
+ * in background threads once the list of packages to install is final
+ * and the dependencies, distribution, packager version, and fields
+ * were validated successfully.
+ *
+ * Only turn this on when the packages are going to be installed or
+ * unpacked for real, not for a dry run or a --check-install.
+ *
+ * \param[in] prefetch  Whether to prefetch the remote packages.
+ */
+void wpkgar_install::set_prefetch(bool prefetch)
+{
+    f_prefetch = prefetch;
+}
+
+
 
 /** \brief Add one expression to run against all the packages to be installed.
  *
@@ -1269,6 +1292,56 @@ void wpkgar_install::validate_packager_version()
 
 
 
+/** \brief Start downloading the remote packages.
+ *
+ * Once the dependencies and fields were validated, the list of explicit
+ * and implicit packages is final. The packages coming from remote
+ * repositories get loaded one after another by the size and overwrite
+ * validation and then by unpack(); this function starts downloading all
+ * of them in parallel through the download cache so that each step only
+ * waits for the package it works on.
+ *
+ * This function is only called when set_prefetch() was used.
+ *
+ * The packages are requested in the order of the package list, which
+ * is the order in which the validations load them.
+ */
+void wpkgar_install::prefetch_packages()
+{
+    wpkgar_download_cache::uri_list_t uris;
+
+    auto& packages( f_package_list->get_package_list() );
+    for( auto& pkg : packages )
+    {
+        switch(pkg.get_type())
+        {
+        case package_item_t::package_type_explicit:
+        case package_item_t::package_type_implicit:
+            if(pkg.prepare_download())
+            {
+                uris.push_back(pkg.get_filename());
+            }
+            break;
+
+        default:
+            // other packages do not get loaded
+            break;
+
+        }
+    }
+
+    if(!uris.empty())
+    {
+        wpkg_output::log("prefetching %1 packages from remote repositories")
+                .arg(uris.size())
+            .debug(wpkg_output::debug_flags::debug_basics)
+            .module(wpkg_output::module_validate_installation);
+        f_manager->get_download_cache()->prefetch(uris);
+    }
+}
+
+
+
 /** \brief Ensure that enough space is available and no file gets overwritten.
  *
  * The installed size requires us to determine the list of drives
@@ -1795,6 +1868,7 @@ int wpkgar_install::count() const
 bool wpkgar_install::validate()
 {
     progress_scope s( &f_progress_stack, "validate", 13 );
+    wpkg_metrics::phase_timer timer(wpkg_metrics::phase_validation);
 
     // the caller is responsible for locking the database
     if(!f_manager->was_locked())
@@ -1953,6 +2027,14 @@ bool wpkgar_install::validate()
     // of indexes
     if(wpkg_output::get_output_error_count() == 0)
     {
+        // the list of packages to install is now final and valid; the
+        // following test loads each package in full so this is the time
+        // to start downloading the remote ones in parallel
+        if(f_prefetch)
+        {
+            prefetch_packages();
+        }
+
         // check that the new installation size is going to fit the hard drive
         // (this needs a lot of work to properly take the database in account!)
         // and since we read all the data files, check whether any file gets
@@ -1990,6 +2072,13 @@ bool wpkgar_install::validate()
         f_progress_stack.increment_progress();
     }
 
+    if(f_prefetch && wpkg_output::get_output_error_count() != 0)
+    {
+        // the packages are not going to be installed, do not waste time
+        // and bandwidth downloading the rest of them
+        f_manager->get_download_cache()->stop_prefetch();
+    }
+
 //printf("list packages after deps:\n");
 //for(wpkgar_package_list_t::size_type idx(0); idx < packages.size(); ++idx)
 //{
@@ -2555,6 +2644,9 @@ void wpkgar_install::unpack_file(package_item_t *item, const wpkg_filename::uri_
  */
 bool wpkgar_install::do_unpack(package_item_t *item, package_item_t *upgrade)
 {
+    wpkg_metrics::phase_timer timer(wpkg_metrics::phase_unpack, item->get_name());
+    wpkg_metrics::profile_scope profile("do_unpack");
+
     f_original_status = wpkgar_manager::not_installed;
 
     if(upgrade != NULL)
@@ -2690,12 +2782,15 @@ bool wpkgar_install::do_unpack(package_item_t *item, package_item_t *upgrade)
                             file.write_file(destination, true, true);
                             unpack_file(item, destination, info);
                             ++count_files;
+                            wpkg_metrics::add_to_counter(wpkg_metrics::counter_files_written);
+                            wpkg_metrics::add_to_counter(wpkg_metrics::counter_bytes_written, file.size());
 
-                            wpkg_output::log("%1 unpacked...")
-                                    .quoted_arg(destination)
-                                .debug(wpkg_output::debug_flags::debug_files)
-                                .module(wpkg_output::module_unpack_package)
-                                .package(package_name);
+                            WPKG_OUTPUT_IF_DEBUG(wpkg_output::debug_flags::debug_files)
+                                wpkg_output::log("%1 unpacked...")
+                                        .quoted_arg(destination)
+                                    .debug(wpkg_output::debug_flags::debug_files)
+                                    .module(wpkg_output::module_unpack_package)
+                                    .package(package_name);
                         }
                     }
                     break;
@@ -2736,12 +2831,13 @@ bool wpkgar_install::do_unpack(package_item_t *item, package_item_t *upgrade)
                         // unpack_file(item, destination, info);
                         //
                         ++count_files;
-                        wpkg_output::log("%1 --> %2 symlinked...")
-                                .quoted_arg(source)
-                                .quoted_arg(dest)
-                            .debug(wpkg_output::debug_flags::debug_files)
-                            .module(wpkg_output::module_unpack_package)
-                            .package(package_name);
+                        WPKG_OUTPUT_IF_DEBUG(wpkg_output::debug_flags::debug_files)
+                            wpkg_output::log("%1 --> %2 symlinked...")
+                                    .quoted_arg(source)
+                                    .quoted_arg(dest)
+                                .debug(wpkg_output::debug_flags::debug_files)
+                                .module(wpkg_output::module_unpack_package)
+                                .package(package_name);
                     }
                     break;
 
@@ -3093,6 +3189,8 @@ int wpkgar_install::unpack()
 
 bool wpkgar_install::configure_package(package_item_t *item)
 {
+    wpkg_metrics::phase_timer timer(wpkg_metrics::phase_configure, item->get_name());
+
     // count errors that occur here
     int err(0);
 
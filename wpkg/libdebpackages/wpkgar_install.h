@@ -83,6 +83,7 @@ public:
     void set_configuring();
     void set_reconfiguring();
     void set_unpacking();
+    void set_prefetch(bool prefetch);
 
     void add_field_validation(const std::string& expression);
 
@@ -124,6 +125,7 @@ private:
     bool check_implicit_for_upgrade(wpkgar_package_list_t& tree, const wpkgar_package_list_t::size_type idx);
 
     void validate_packager_version();
+    void prefetch_packages();
     void validate_installed_size_and_overwrite();
     void validate_fields();
     void validate_scripts();
@@ -161,6 +163,7 @@ private:
     //wpkgar_list_of_strings_t                  f_field_names;
     //controlled_vars::fbool_t                  f_read_essentials;
     controlled_vars::fbool_t                  f_install_source;
+    controlled_vars::fbool_t                  f_prefetch;
 
     typedef std::vector<std::string> string_list_t;
     string_list_t                             f_field_validations;
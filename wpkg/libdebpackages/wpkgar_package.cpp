@@ -21,6 +21,7 @@
 
 #include "libdebpackages/wpkgar_package.h"
 #include "libdebpackages/wpkgar_exception.h"
+#include "libdebpackages/wpkg_util.h"
 
 #if defined(MO_LINUX) || defined(MO_DARWIN) || defined(MO_SUNOS) || defined(MO_FREEBSD)
 #   include <unistd.h>
@@ -256,8 +257,7 @@ void wpkgar_package::read_archive(memfile::memory_file& p)
             // this is the control file, read its contents
             if(data.is_compressed())
             {
-                memfile::memory_file d;
-                data.copy(d);
+                memfile::memory_file d(std::move(data));
                 d.decompress(data);
             }
             // we save the file uncompressed (this is to support the -x option)
@@ -272,8 +272,7 @@ void wpkgar_package::read_archive(memfile::memory_file& p)
             // this is the data file, read its contents
             if(data.is_compressed())
             {
-                memfile::memory_file d;
-                data.copy(d);
+                memfile::memory_file d(std::move(data));
                 d.decompress(data);
             }
             // we save the file uncompressed in our db
@@ -379,6 +378,25 @@ void wpkgar_package::read_control(memfile::memory_file& p)
             //       verify so as we read the data file?
             has_md5sums = true;
         }
+        else if(filename == "sha256sums")
+        {
+            // the files get verified against these sums in read_data()
+            sha256sums_t sums;
+            wpkg_util::parse_sha256sums(sums, data);
+            for(sha256sums_t::const_iterator it(sums.begin()); it != sums.end(); ++it)
+            {
+                std::string name(it->first);
+                if(name.length() >= 2 && name[0] == '.' && name[1] == '/')
+                {
+                    name.erase(0, 1);
+                }
+                else if(name.empty() || name[0] != '/')
+                {
+                    name = "/" + name;
+                }
+                f_sha256sums[name] = it->second;
+            }
+        }
         // other files are optional
     }
 
@@ -447,6 +465,26 @@ void wpkgar_package::read_data(memfile::memory_file& p)
         {
             throw wpkgar_exception_invalid("the .deb data file includes two files with the same name (including path)");
         }
+        // verify the file against the sha256sums control file; only
+        // packages that include such a file pay for the sha256sum, we
+        // compute both sums in one pass and pass them to append_file()
+        // so the data does not get hashed again
+        sha256sums_t::const_iterator expected(f_sha256sums.find(filename));
+        if(expected != f_sha256sums.end()
+        && (info.get_file_type() == memfile::memory_file::file_info::regular_file
+         || info.get_file_type() == memfile::memory_file::file_info::continuous))
+        {
+            md5::raw_md5sum raw_md5;
+            sha256::raw_sha256sum raw_sha256;
+            data.raw_checksums(raw_md5, raw_sha256);
+            if(sha256::sha256sum::sum(raw_sha256) != expected->second)
+            {
+                throw wpkgar_exception_invalid("the sha256sum of \"" + filename + "\" does not match the one found in the sha256sums file, this package is corrupted");
+            }
+            info.set_raw_md5sum(raw_md5);
+            info.set_raw_sha256sum(raw_sha256);
+        }
+
         // save offset for very fast retrieval
         file->set_data_dir_pos(dir_pos);
         f_files[filename] = file;
@@ -499,8 +537,7 @@ void wpkgar_package::read_control_file(memfile::memory_file& p, std::string& fil
             throw wpkgar_exception_compatibility("unknown compression to recompress the control.tar file");
 
         }
-        memfile::memory_file d;
-        p.copy(d);
+        memfile::memory_file d(std::move(p));
         d.compress(p, format);
     }
 }
@@ -110,6 +110,7 @@ private:
 
     typedef std::map<std::string, std::shared_ptr<wpkgar_file> >    file_t;
     typedef std::map<std::string, int>                              conffiles_t;
+    typedef std::map<std::string, std::string>                      sha256sums_t;
 
     wpkg_filename::uri_filename       f_package_path;
     wpkg_filename::uri_filename       f_fullname;
@@ -117,6 +118,7 @@ private:
     controlled_vars::zbool_t          f_conffiles_defined;
     conffiles_t                       f_conffiles;
     file_t                            f_files;
+    sha256sums_t                      f_sha256sums;        // from the sha256sums control file, if present
     memfile::memory_file              f_wpkgar_file;
     wpkg_control::binary_control_file f_control_file;      // control fields
     wpkg_control::status_control_file f_status_file;       // control fields in the status file
@@ -26,13 +26,16 @@
  * removal commands such as --purge, --autoremove, and --deconfigure.
  */
 #include    "libdebpackages/wpkgar_remove.h"
+#include    "libdebpackages/wpkgar_reverse_dependencies.h"
 #include    "libdebpackages/debian_version.h"
 #include    "libdebpackages/wpkg_backup.h"
+#include    "libdebpackages/wpkg_metrics.h"
 #include    "libdebpackages/wpkg_util.h"
 #include    "libdebpackages/debian_packages.h"
 #include    <sstream>
 #include    <fstream>
 #include    <algorithm>
+#include    <set>
 #include    <stdarg.h>
 #include    <errno.h>
 #if defined(MO_LINUX)
@@ -46,6 +49,39 @@ namespace wpkgar
 {
 
 
+namespace
+{
+
+/** \brief Check whether a package is considered live.
+ *
+ * Half-installed and half-configured packages are not really installed
+ * but their dependencies should not be removed until they get repaired
+ * in some way. Packages that are not installed do not need any
+ * dependencies so we can ignore them.
+ *
+ * \param[in] status  The status of the package.
+ *
+ * \return true if the dependencies of the package must be kept.
+ */
+bool is_live_status(wpkgar_manager::package_status_t status)
+{
+    switch(status)
+    {
+    case wpkgar_manager::installed:
+    case wpkgar_manager::unpacked:
+    case wpkgar_manager::half_installed:
+    case wpkgar_manager::half_configured:
+        return true;
+
+    default:
+        return false;
+
+    }
+}
+
+} // no name namespace
+
+
 /** \class wpkgar_remove
  * \brief Class implemented to handle removal of packages.
  *
@@ -1021,6 +1057,9 @@ void wpkgar_remove::output_tree(int file_count, const wpkgar_package_list_t& tre
  */
 void wpkgar_remove::validate_dependencies()
 {
+    wpkg_metrics::phase_timer timer(wpkg_metrics::phase_dependencies);
+    wpkg_metrics::profile_scope profile("validate_dependencies");
+
     // in case --recursive is used we repeat the test on the newly marked
     // implicit packages, this is done by adding them to the package_indexes
     // vector initialized below with targets to be removed
@@ -1044,6 +1083,23 @@ void wpkgar_remove::validate_dependencies()
         }
     }
 
+    if(package_indexes.empty())
+    {
+        return;
+    }
+
+    // the graph gives us the dependents of a package without having to
+    // load and parse the dependencies of all the installed packages
+    wpkgar_reverse_dependencies graph(f_manager);
+    graph.load();
+
+    typedef std::map<std::string, std::vector<wpkgar_package_list_t::size_type> > package_name_indexes_t;
+    package_name_indexes_t name_indexes;
+    for(idx = 0; idx < f_packages.size(); ++idx)
+    {
+        name_indexes[f_packages[idx].get_name()].push_back(idx);
+    }
+
     while(!package_indexes.empty())
     {
         idx = package_indexes.back();
@@ -1052,122 +1108,82 @@ void wpkgar_remove::validate_dependencies()
 
         // look for any one package that would depend on the package
         // that is proposed for removal
-        for(wpkgar_package_list_t::size_type j(0); j < f_packages.size(); ++j)
+        const wpkgar_reverse_dependencies::name_list_t& dependents(graph.get_dependents(name, wpkgar_reverse_dependencies::dependency_kind_runtime));
+        for(wpkgar_reverse_dependencies::name_list_t::const_iterator dt(dependents.begin());
+                                                                     dt != dependents.end();
+                                                                     ++dt)
         {
-            f_manager->check_interrupt();
-
-            if(idx == j)
+            package_name_indexes_t::const_iterator nt(name_indexes.find(*dt));
+            if(nt == name_indexes.end())
             {
-                // skip ourself
                 continue;
             }
-            switch(f_packages[j].get_type())
+            for(std::vector<wpkgar_package_list_t::size_type>::const_iterator jt(nt->second.begin());
+                                                                             jt != nt->second.end();
+                                                                             ++jt)
             {
-            case package_item_t::package_type_explicit:
-            case package_item_t::package_type_not_installed:
-            case package_item_t::package_type_invalid:
-            case package_item_t::package_type_same:
-            case package_item_t::package_type_configured: // this is not an installed package
-            case package_item_t::package_type_need_repair: // this is a form of "unpacked" in most cases (i.e. no configuration files)
-                // ignore these packages as they are not linked to this item
-                break;
-
-            case package_item_t::package_type_removing:
-            case package_item_t::package_type_implicit:
-            case package_item_t::package_type_installed:
-            case package_item_t::package_type_unpacked:
-                // full path to package
-                std::string filename(f_packages[j].get_name());
+                f_manager->check_interrupt();
 
-                // make sure it's loaded
-                f_manager->load_package(filename);
-
-                // get list of all dependencies
-                std::string dependencies;
-                if(f_manager->field_is_defined(filename, wpkg_control::control_file::field_predepends_factory_t::canonicalized_name()))
+                const wpkgar_package_list_t::size_type j(*jt);
+                if(idx == j)
                 {
-                    // not necessary for the first one, it's always empty
-                    //if(!dependencies.empty()) {
-                    //    dependencies += ",";
-                    //}
-                    dependencies = f_manager->get_field(filename, wpkg_control::control_file::field_predepends_factory_t::canonicalized_name());
+                    // skip ourself
+                    continue;
                 }
-                if(f_manager->field_is_defined(filename, wpkg_control::control_file::field_depends_factory_t::canonicalized_name()))
+                switch(f_packages[j].get_type())
                 {
-                    if(!dependencies.empty())
+                case package_item_t::package_type_implicit: // implicitly marked for removal
+                case package_item_t::package_type_removing: // explicit that was already changed into removing
+                    // case 1: that other package is already marked for
+                    //         removal, this is not a problem
+                    break;
+
+                case package_item_t::package_type_installed:
+                case package_item_t::package_type_unpacked:
+                    // case 2 to 5: problem!
+                    if(get_parameter(wpkgar_remove::wpkgar_remove_force_depends, false))
                     {
-                        dependencies += ",";
+                        // case 4: ignore the problem
+                        ;
                     }
-                    dependencies += f_manager->get_field(filename, wpkg_control::control_file::field_depends_factory_t::canonicalized_name());
-                }
-                if(!dependencies.empty())
-                {
-                    wpkg_dependencies::dependencies depends(dependencies);
-                    for(int i(0); i < depends.size(); ++i)
+                    else if(get_parameter(wpkgar_remove::wpkgar_remove_recursive, false))
                     {
-                        f_manager->check_interrupt();
-
-                        const wpkg_dependencies::dependencies::dependency_t& d(depends.get_dependency(i));
-                        if(name == d.f_name)
+                        // case 3: --recursive remove fails if one
+                        //         of the following is true
+                        //             (a) essential;
+                        //             (b) required;
+                        //             (c) hold packages.
+                        if(can_package_be_removed(f_packages[j].get_name(), true))
                         {
-                            // case 1: that other package is already marked for removal
-                            bool marked_for_removal_too(false);
-                            switch(f_packages[j].get_type())
-                            {
-                            //case package_item_t::package_type_explicit: -- should not happen here anymore
-                            case package_item_t::package_type_implicit: // implicitly marked for removal
-                            case package_item_t::package_type_removing: // explicit that was already changed into removing
-                                // this is not a problem
-                                marked_for_removal_too = true;
-                                break;
-
-                            default:
-                                // any of the other packages may cause a problem
-                                break;
-
-                            }
-                            if(!marked_for_removal_too)
-                            {
-                                // case 2 to 5: problem!
-                                if(get_parameter(wpkgar_remove::wpkgar_remove_force_depends, false))
-                                {
-                                    // case 4: ignore the problem
-                                    ;
-                                }
-                                else if(get_parameter(wpkgar_remove::wpkgar_remove_recursive, false))
-                                {
-                                    // case 3: --recursive remove fails if one
-                                    //         of the following is true
-                                    //             (a) essential;
-                                    //             (b) required;
-                                    //             (c) hold packages.
-                                    if(can_package_be_removed(filename, true))
-                                    {
-                                        // case 2: automatically remove this dependent
-                                        wpkg_output::log("%1 is a dependent of %2 which will automatically be removed because you used --recursive.")
-                                                .quoted_arg(name)
-                                                .quoted_arg(f_packages[j].get_name())
-                                            .module(wpkg_output::module_validate_removal)
-                                            .package(name)
-                                            .action("remove-validation");
-                                        f_packages[j].set_type(package_item_t::package_type_implicit);
-                                        package_indexes.push_back(j);
-                                    }
-                                }
-                                else
-                                {
-                                    // case 5: generate an error
-                                    wpkg_output::log("package %1 depends on %2 preventing its removal (try --recursive).")
-                                            .quoted_arg(f_packages[j].get_name())
-                                            .quoted_arg(name)
-                                        .level(wpkg_output::level_error)
-                                        .module(wpkg_output::module_validate_removal)
-                                        .package(name)
-                                        .action("remove-validation");
-                                }
-                            }
+                            // case 2: automatically remove this dependent
+                            wpkg_output::log("%1 is a dependent of %2 which will automatically be removed because you used --recursive.")
+                                    .quoted_arg(name)
+                                    .quoted_arg(f_packages[j].get_name())
+                                .module(wpkg_output::module_validate_removal)
+                                .package(name)
+                                .action("remove-validation");
+                            f_packages[j].set_type(package_item_t::package_type_implicit);
+                            package_indexes.push_back(j);
                         }
                     }
+                    else
+                    {
+                        // case 5: generate an error
+                        wpkg_output::log("package %1 depends on %2 preventing its removal (try --recursive).")
+                                .quoted_arg(f_packages[j].get_name())
+                                .quoted_arg(name)
+                            .level(wpkg_output::level_error)
+                            .module(wpkg_output::module_validate_removal)
+                            .package(name)
+                            .action("remove-validation");
+                    }
+                    break;
+
+                default:
+                    // explicit, not installed, invalid, same, configured,
+                    // and need-repair packages are not linked to this item
+                    break;
+
                 }
             }
         }
@@ -1305,6 +1321,8 @@ void wpkgar_remove::validate_scripts()
  */
 bool wpkgar_remove::validate()
 {
+    wpkg_metrics::phase_timer timer(wpkg_metrics::phase_validation);
+
     // the caller is responsible for locking the database
     if(!f_manager->was_locked())
     {
@@ -1763,168 +1781,194 @@ int wpkgar_remove::remove()
  * so if A depends on B and both are marked "auto" and none of the other
  * packages depends on A or B, then both are removed.
  *
+ * The function uses a mark and sweep algorithm over the graph of the
+ * installed packages: all the packages that are installed and not
+ * candidates for removal are roots; everything reachable from a root
+ * through any dependency field is marked as needed; the candidates
+ * that were not marked are removed, dependents first.
+ *
  * \param[in] dryrun  Whether the removal is effectively done or not.
  */
 void wpkgar_remove::autoremove(bool dryrun)
 {
-    typedef std::vector<std::string> depend_field_names_t;
-    depend_field_names_t depend_names;
-    depend_names.push_back(wpkg_control::control_file::field_depends_factory_t::canonicalized_name());
-    depend_names.push_back(wpkg_control::control_file::field_predepends_factory_t::canonicalized_name());
-    depend_names.push_back(wpkg_control::control_file::field_builddepends_factory_t::canonicalized_name());
-    depend_names.push_back(wpkg_control::control_file::field_builddependsarch_factory_t::canonicalized_name());
-    depend_names.push_back(wpkg_control::control_file::field_builddependsindep_factory_t::canonicalized_name());
-    depend_names.push_back(wpkg_control::control_file::field_builtusing_factory_t::canonicalized_name());
-
     // since we're locked we assume that the list and the status of packages
     // won't change under our feet
+    wpkgar_reverse_dependencies graph(f_manager);
+    graph.load();
+    const wpkgar_reverse_dependencies::name_list_t& list(graph.get_packages());
+
     typedef std::map<std::string, wpkgar_manager::package_status_t> package_statuses_t;
     package_statuses_t status;
-    wpkgar_manager::package_list_t list;
-    f_manager->list_installed_packages(list);
-    for(wpkgar_manager::package_list_t::const_iterator it(list.begin());
-                                                       it != list.end();
-                                                       ++it)
+    for(wpkgar_reverse_dependencies::name_list_t::const_iterator it(list.begin());
+                                                                 it != list.end();
+                                                                 ++it)
     {
         f_manager->check_interrupt();
         status[*it] = f_manager->package_status(*it);
     }
 
-    // we use a simple repeat flag to implement the recursivity; it's a bit
-    // slow but it does the job well
-    bool repeat(true);
-    while(repeat && wpkg_output::get_output_error_count() == 0)
+    // determine the packages we want to remove
+    std::set<std::string> candidates;
+    for(wpkgar_reverse_dependencies::name_list_t::const_iterator it(list.begin());
+                                                                 it != list.end();
+                                                                 ++it)
     {
-        repeat = false;
+        f_manager->check_interrupt();
 
-        for(wpkgar_manager::package_list_t::const_iterator it(list.begin());
-                                                           it != list.end();
-                                                           ++it)
+        // don't ever attempt to remove self!
+        if(f_manager->exists_as_self(*it))
         {
-            f_manager->check_interrupt();
+            continue;
+        }
 
-            // don't ever attempt to remove self!
-            if(f_manager->exists_as_self(*it))
+        // check whether we want to remove this package
+        bool remove_package(false);
+        switch(status[*it])
+        {
+        case wpkgar_manager::config_files:
+            if(f_purging_packages)
             {
-                continue;
+                remove_package = true;
             }
+            break;
 
-            // check whether we want to remove this package
-            bool remove_package(false);
-            switch(status[*it])
-            {
-            case wpkgar_manager::config_files:
-                if(f_purging_packages)
-                {
-                    remove_package = true;
-                }
-                break;
+        case wpkgar_manager::installed:
+        case wpkgar_manager::unpacked:
+            remove_package = true;
 
-            case wpkgar_manager::installed:
-            case wpkgar_manager::unpacked:
-                remove_package = true;
+            // ignore the remove order if the package is essential
+            if(f_manager->field_is_defined(*it, wpkg_control::control_file::field_essential_factory_t::canonicalized_name())
+            && f_manager->get_field_boolean(*it, wpkg_control::control_file::field_essential_factory_t::canonicalized_name()))
+            {
+                remove_package = false;
+            }
 
-                // ignore the remove order if the package is essential
-                if(f_manager->field_is_defined(*it, wpkg_control::control_file::field_essential_factory_t::canonicalized_name())
-                && f_manager->get_field_boolean(*it, wpkg_control::control_file::field_essential_factory_t::canonicalized_name()))
+            // prevent the removal if the package is required
+            if(remove_package
+            && f_manager->field_is_defined(*it, wpkg_control::control_file::field_priority_factory_t::canonicalized_name()))
+            {
+                case_insensitive::case_insensitive_string priority(f_manager->get_field(*it, wpkg_control::control_file::field_priority_factory_t::canonicalized_name()));
+                if(priority == "required")
                 {
                     remove_package = false;
                 }
+            }
+            break;
 
-                // prevent the removal if the package is required
-                if(remove_package
-                && f_manager->field_is_defined(*it, wpkg_control::control_file::field_priority_factory_t::canonicalized_name()))
-                {
-                    case_insensitive::case_insensitive_string priority(f_manager->get_field(*it, wpkg_control::control_file::field_priority_factory_t::canonicalized_name()));
-                    if(priority == "required")
-                    {
-                        remove_package = false;
-                    }
-                }
-                break;
-
-            default:
-                // at this point ignore all the other statuses
-                break;
+        default:
+            // at this point ignore all the other statuses
+            break;
 
+        }
+        // if the status suggest we can remove the package, check the
+        // selection to know whether it is "auto"
+        if(remove_package)
+        {
+            remove_package = false;
+            if(f_manager->field_is_defined(*it, wpkg_control::control_file::field_xselection_factory_t::canonicalized_name()))
+            {
+                const wpkg_control::control_file::field_xselection_t::selection_t selection(wpkg_control::control_file::field_xselection_t::validate_selection(f_manager->get_field(*it, wpkg_control::control_file::field_xselection_factory_t::canonicalized_name())));
+                remove_package = selection == wpkg_control::control_file::field_xselection_t::selection_auto;
             }
-            // if the status suggest we can remove the package, check the
-            // selection to know whether it is "auto"
-            if(remove_package)
+            else if(f_manager->field_is_defined(*it, "X-Explicit"))
             {
-                remove_package = false;
-                if(f_manager->field_is_defined(*it, wpkg_control::control_file::field_xselection_factory_t::canonicalized_name()))
-                {
-                    const wpkg_control::control_file::field_xselection_t::selection_t selection(wpkg_control::control_file::field_xselection_t::validate_selection(f_manager->get_field(*it, wpkg_control::control_file::field_xselection_factory_t::canonicalized_name())));
-                    remove_package = selection == wpkg_control::control_file::field_xselection_t::selection_auto;
-                }
-                else if(f_manager->field_is_defined(*it, "X-Explicit"))
-                {
-                    // if X-Selection is not defined, fallback on the
-                    // internal X-Explicit value which is set to No when
-                    // a package was only ever installed implicitly
-                    remove_package = !f_manager->get_field_boolean(*it, "X-Explicit");
-                }
-                // else -- in other cases, ignore that package
+                // if X-Selection is not defined, fallback on the
+                // internal X-Explicit value which is set to No when
+                // a package was only ever installed implicitly
+                remove_package = !f_manager->get_field_boolean(*it, "X-Explicit");
             }
+            // else -- in other cases, ignore that package
+        }
+        if(remove_package)
+        {
+            candidates.insert(*it);
+        }
+    }
 
-            // still true? then we want to check whether it is still depended
-            // on and if not actually remove this package; note that a package
-            // with a status of config-files is never depended on!
-            if(remove_package
-            && status[*it] != wpkgar_manager::config_files)
+    // mark: everything reachable from a live package which is not
+    // a candidate is needed
+    std::set<std::string> needed;
+    wpkgar_reverse_dependencies::name_list_t stack;
+    for(wpkgar_reverse_dependencies::name_list_t::const_iterator it(list.begin());
+                                                                 it != list.end();
+                                                                 ++it)
+    {
+        if(is_live_status(status[*it])
+        && candidates.find(*it) == candidates.end())
+        {
+            needed.insert(*it);
+            stack.push_back(*it);
+        }
+    }
+    while(!stack.empty())
+    {
+        f_manager->check_interrupt();
+
+        const std::string name(stack.back());
+        stack.pop_back();
+        const wpkgar_reverse_dependencies::name_list_t& dependencies(graph.get_dependencies(name, wpkgar_reverse_dependencies::dependency_kind_all));
+        for(wpkgar_reverse_dependencies::name_list_t::const_iterator dt(dependencies.begin());
+                                                                     dt != dependencies.end();
+                                                                     ++dt)
+        {
+            // packages that are not live do not require their dependencies
+            package_statuses_t::const_iterator st(status.find(*dt));
+            if(needed.insert(*dt).second
+            && st != status.end()
+            && is_live_status(st->second))
             {
-                for(wpkgar_manager::package_list_t::const_iterator jt(list.begin());
-                                                                   remove_package && jt != list.end();
-                                                                   ++jt)
-                {
-                    // skip ourselves
-                    if(*it == *jt)
-                    {
-                        continue;
-                    }
-                    switch(status[*jt])
-                    {
-                    case wpkgar_manager::installed:
-                    case wpkgar_manager::unpacked:
-                    case wpkgar_manager::half_installed:
-                    case wpkgar_manager::half_configured:
-                        // half-installed and half-configured are not really
-                        // installed but their dependencies should not be
-                        // removed until they get repaired in some way
-                        break;
+                stack.push_back(*dt);
+            }
+        }
+    }
 
-                    default:
-                        // packages that are not installed do not need any
-                        // dependencies so we can ignore them
-                        continue;
+    // sweep: remove the candidates that were not marked; note that a
+    // package with a status of config-files is never depended on!
+    wpkgar_reverse_dependencies::name_list_t garbage;
+    for(wpkgar_reverse_dependencies::name_list_t::const_iterator it(list.begin());
+                                                                 it != list.end();
+                                                                 ++it)
+    {
+        if(candidates.find(*it) != candidates.end()
+        && (status[*it] == wpkgar_manager::config_files || needed.find(*it) == needed.end()))
+        {
+            garbage.push_back(*it);
+        }
+    }
 
-                    }
+    // the garbage may depend on other garbage in which case the
+    // dependents have to be removed first; we repeat until nothing
+    // more can be removed
+    bool repeat(true);
+    while(repeat && wpkg_output::get_output_error_count() == 0)
+    {
+        repeat = false;
 
-                    // check all the dependency fields
-                    for(depend_field_names_t::const_iterator nt(depend_names.begin());
-                                                             remove_package && nt != depend_names.end();
-                                                             ++nt)
-                    {
-                        // field is not even defined?
-                        if(!f_manager->field_is_defined(*jt, *nt))
-                        {
-                            continue;
-                        }
+        for(wpkgar_reverse_dependencies::name_list_t::const_iterator it(garbage.begin());
+                                                                     it != garbage.end();
+                                                                     ++it)
+        {
+            f_manager->check_interrupt();
 
-                        // check the actual dependencies
-                        wpkg_dependencies::dependencies depends(f_manager->get_field(*jt, *nt));
-                        for(int k(0); k < depends.size(); ++k)
-                        {
-                            const wpkg_dependencies::dependencies::dependency_t& d(depends.get_dependency(k));
-                            if(d.f_name == *it)
-                            {
-                                // someone still depends on us, we cannot be
-                                // removed
-                                remove_package = false;
-                                break;
-                            }
-                        }
+            if(status[*it] == wpkgar_manager::not_installed)
+            {
+                // already removed in a previous round
+                continue;
+            }
+
+            // still depended on by another package that was not yet removed?
+            bool remove_package(true);
+            if(status[*it] != wpkgar_manager::config_files)
+            {
+                const wpkgar_reverse_dependencies::name_list_t& dependents(graph.get_dependents(*it, wpkgar_reverse_dependencies::dependency_kind_all));
+                for(wpkgar_reverse_dependencies::name_list_t::const_iterator dt(dependents.begin());
+                                                                             dt != dependents.end();
+                                                                             ++dt)
+                {
+                    if(*dt != *it && is_live_status(status[*dt]))
+                    {
+                        remove_package = false;
+                        break;
                     }
                 }
             }
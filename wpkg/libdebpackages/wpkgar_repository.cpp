@@ -28,6 +28,7 @@
  */
 #include    "libdebpackages/wpkgar_repository.h"
 #include    "libdebpackages/debian_version.h"
+#include    "libdebpackages/wpkg_metrics.h"
 #include    "libdebpackages/wpkg_util.h"
 #include    <algorithm>
 #include    <sstream>
@@ -467,6 +468,8 @@ int wpkgar_repository::get_parameter(parameter_t flag, int default_value) const
  */
 void wpkgar_repository::create_index(memfile::memory_file& index_file)
 {
+    wpkg_metrics::profile_scope profile("create_index");
+
     // save all the data in a map so we can have it in alphabetical order
     // before creating the output tarball
     typedef std::map<std::string, index_entry> map_t;
@@ -498,21 +501,23 @@ void wpkgar_repository::create_index(memfile::memory_file& index_file)
                 if(info.get_file_type() != memfile::memory_file::file_info::directory
                 || !get_parameter(wpkgar_repository_recursive, false))
                 {
-                    wpkg_output::log("skip file %1 since it is not a regular file.")
-                            .quoted_arg(filename)
-                        .debug(wpkg_output::debug_flags::debug_detail_config)
-                        .module(wpkg_output::module_repository)
-                        .package(filename);
+                    WPKG_OUTPUT_IF_DEBUG(wpkg_output::debug_flags::debug_detail_config)
+                        wpkg_output::log("skip file %1 since it is not a regular file.")
+                                .quoted_arg(filename)
+                            .debug(wpkg_output::debug_flags::debug_detail_config)
+                            .module(wpkg_output::module_repository)
+                            .package(filename);
                 }
                 continue;
             }
             if(filename.extension() != "deb")
             {
-                wpkg_output::log("skip file %1 as its extension is not .deb.")
-                        .quoted_arg(filename)
-                    .debug(wpkg_output::debug_flags::debug_detail_config)
-                    .module(wpkg_output::module_repository)
-                    .package(filename);
+                WPKG_OUTPUT_IF_DEBUG(wpkg_output::debug_flags::debug_detail_config)
+                    wpkg_output::log("skip file %1 as its extension is not .deb.")
+                            .quoted_arg(filename)
+                        .debug(wpkg_output::debug_flags::debug_detail_config)
+                        .module(wpkg_output::module_repository)
+                        .package(filename);
                 continue;
             }
             std::string::size_type p(filename.basename().find_first_of('_'));
@@ -541,66 +546,56 @@ void wpkgar_repository::create_index(memfile::memory_file& index_file)
                 if(ar_info.get_file_type() == memfile::memory_file::file_info::regular_file
                 && ar_filename.basename() == "control")
                 {
-                    if(control_tar.is_compressed())
+                    // only decompress the control.tar up to the control file
+                    memfile::memory_file::decompressor control_stream(control_tar);
+                    memfile::memory_file::file_info ctrl_info;
+                    std::shared_ptr<memfile::memory_file> control(new memfile::memory_file);
+                    if(control_stream.find_tar("control", ctrl_info, control.get())
+                    && ctrl_info.get_file_type() == memfile::memory_file::file_info::regular_file)
                     {
-                        memfile::memory_file d;
-                        control_tar.copy(d);
-                        d.decompress(control_tar);
-                    }
-                    control_tar.dir_rewind();
-                    for(;;)
-                    {
-                        memfile::memory_file::file_info ctrl_info;
-                        std::shared_ptr<memfile::memory_file> control(new memfile::memory_file);
-                        if(!control_tar.dir_next(ctrl_info, control.get()))
+                        // here we want to use a mix of the data found in
+                        // info, ar_info, and control.
+                        wpkg_control::binary_control_file ctrl(std::shared_ptr<wpkg_control::control_file::control_file_state_t>(new wpkg_control::control_file::control_file_state_t));
+                        ctrl.set_input_file(&*control);
+                        ctrl.read();
+                        ctrl.set_input_file(NULL);
+                        memfile::memory_file::file_info idx_info;
+                        const std::string ctrl_name(path.append_child(filename.basename() + ".ctrl").path_only());
+                        wpkg_output::log("add package %1 to this repository index file.")
+                                .quoted_arg(ctrl_name)
+                            .module(wpkg_output::module_repository)
+                            .action("repository-index");
+                        idx_info.set_filename(ctrl_name);
+                        idx_info.set_file_type(memfile::memory_file::file_info::regular_file);
+                        idx_info.set_user("root");
+                        idx_info.set_group("root");
+                        idx_info.set_uid(0);
+                        idx_info.set_gid(0);
+                        idx_info.set_mode(0644);
+                        idx_info.set_mtime(info.get_mtime());
+                        if(ctrl.field_is_defined("Date"))
                         {
-                            break;
-                        }
-                        const wpkg_filename::uri_filename& ctrl_filename(ctrl_info.get_filename());
-                        if(ctrl_info.get_file_type() == memfile::memory_file::file_info::regular_file
-                        && ctrl_filename.basename() == "control")
-                        {
-                            // here we want to use a mix of the data found in
-                            // info, ar_info, and control.
-                            wpkg_control::binary_control_file ctrl(std::shared_ptr<wpkg_control::control_file::control_file_state_t>(new wpkg_control::control_file::control_file_state_t));
-                            ctrl.set_input_file(&*control);
-                            ctrl.read();
-                            ctrl.set_input_file(NULL);
-                            memfile::memory_file::file_info idx_info;
-                            const std::string ctrl_name(path.append_child(filename.basename() + ".ctrl").path_only());
-                            wpkg_output::log("add package %1 to this repository index file.")
-                                    .quoted_arg(ctrl_name)
-                                .module(wpkg_output::module_repository)
-                                .action("repository-index");
-                            idx_info.set_filename(ctrl_name);
-                            idx_info.set_file_type(memfile::memory_file::file_info::regular_file);
-                            idx_info.set_user("root");
-                            idx_info.set_group("root");
-                            idx_info.set_uid(0);
-                            idx_info.set_gid(0);
-                            idx_info.set_mode(0644);
-                            idx_info.set_mtime(info.get_mtime());
-                            if(ctrl.field_is_defined("Date"))
+                            std::string date(ctrl.get_field("Date"));
+                            struct tm time_info;
+                            if(strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S %z", &time_info) != NULL)
                             {
-                                std::string date(ctrl.get_field("Date"));
-                                struct tm time_info;
-                                if(strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S %z", &time_info) != NULL)
-                                {
-                                    // unfortunately the tar format does not support time64_t
-                                    idx_info.set_mtime(mktime(&time_info));
-                                }
+                                // unfortunately the tar format does not support time64_t
+                                idx_info.set_mtime(mktime(&time_info));
                             }
-                            ctrl.set_field("Index-Date", index_date);
-                            ctrl.set_field("Package-md5sum", data.md5sum());
-                            ctrl.set_field("Package-Size", data.size());
-                            ctrl.write(*control, wpkg_field::field_file::WRITE_MODE_FIELD_ONLY);
-                            idx_info.set_size(control->size());
-                            index_entry e;
-                            e.f_info = idx_info;
-                            e.f_control = control;
-                            map[ctrl_name] = e;
-                            break;
                         }
+                        ctrl.set_field("Index-Date", index_date);
+                        md5::raw_md5sum raw_md5;
+                        sha256::raw_sha256sum raw_sha256;
+                        data.raw_checksums(raw_md5, raw_sha256);
+                        ctrl.set_field("Package-md5sum", md5::md5sum::sum(raw_md5));
+                        ctrl.set_field("Package-sha256sum", sha256::sha256sum::sum(raw_sha256));
+                        ctrl.set_field("Package-Size", data.size());
+                        ctrl.write(*control, wpkg_field::field_file::WRITE_MODE_FIELD_ONLY);
+                        idx_info.set_size(control->size());
+                        index_entry e;
+                        e.f_info = idx_info;
+                        e.f_control = control;
+                        map[ctrl_name] = e;
                     }
                     break; // this is all.
                 }
@@ -632,19 +627,13 @@ void wpkgar_repository::create_index(memfile::memory_file& index_file)
  */
 void wpkgar_repository::load_index(const memfile::memory_file& file, entry_vector_t& entries)
 {
-    memfile::memory_file index_file;
-    file.copy(index_file);
-    if(index_file.is_compressed())
-    {
-        file.decompress(index_file);
-    }
-
-    index_file.dir_rewind();
+    // read the index as it gets decompressed
+    memfile::memory_file::decompressor index_tar(file);
     for(;;)
     {
         memfile::memory_file::file_info idx_info;
         std::shared_ptr<memfile::memory_file> control(new memfile::memory_file);
-        if(!index_file.dir_next(idx_info, control.get()))
+        if(!index_tar.next_tar(idx_info, control.get()))
         {
             break;
         }
@@ -1140,15 +1129,10 @@ const wpkgar_repository::wpkgar_package_list_t& wpkgar_repository::upgrade_list(
                 name = name.append_child("core/indexes/update-" + s.str() + ".index.gz");
                 memfile::memory_file index_file;
                 index_file.read_file(name);
-                if(index_file.is_compressed())
-                {
-                    memfile::memory_file d;
-                    index_file.copy(d);
-                    d.decompress(index_file);
-                }
 
                 // we have an index, go ahead and upgrade
-                upgrade_index(idx, index_file);
+                memfile::memory_file::decompressor index_tar(index_file);
+                upgrade_index(idx, index_tar);
             }
         }
     }
@@ -1163,16 +1147,16 @@ const wpkgar_repository::wpkgar_package_list_t& wpkgar_repository::upgrade_list(
  * whether the package is already installed.
  *
  * \param[in] i  The index in the f_update_index which we are working with.
- * \param[in[ index_file  The index file, a tarball with the repository index.
+ * \param[in,out] index_tar  The index file, a tarball with the repository index,
+ *                           read through a decompressor.
  */
-void wpkgar_repository::upgrade_index(size_t i, memfile::memory_file& index_file)
+void wpkgar_repository::upgrade_index(size_t i, memfile::memory_file::decompressor& index_tar)
 {
-    index_file.dir_rewind();
     for(;;)
     {
         memfile::memory_file::file_info info;
         memfile::memory_file data;
-        if(!index_file.dir_next(info, &data))
+        if(!index_tar.next_tar(info, &data))
         {
             break;
         }
@@ -158,7 +158,7 @@ private:
     bool next_source(source& src) const;
     void update_index(const wpkg_filename::uri_filename& uri);
     void save_index_list() const;
-    void upgrade_index(size_t i, memfile::memory_file& index_file);
+    void upgrade_index(size_t i, memfile::memory_file::decompressor& index_tar);
     bool is_installed_package(const std::string& name) const;
 
     wpkgar_manager::pointer_t           f_manager;
@@ -0,0 +1,504 @@
+/*    wpkgar_reverse_dependencies.cpp -- graph of the installed packages dependents
+ *    Copyright (C) 2012-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+
+/** \file
+ * \brief Implementation of the reverse dependency graph.
+ *
+ * The graph lists, for each installed package, the names of the packages
+ * it depends on and the names of the packages that depend on it. The
+ * parsed dependencies are saved in the core directory of the database
+ * and only the packages which control file changed since the last run
+ * get loaded and parsed again.
+ */
+#include    "libdebpackages/wpkgar_reverse_dependencies.h"
+#include    "libdebpackages/wpkg_dependencies.h"
+
+#include    <algorithm>
+#include    <stdlib.h>
+
+namespace wpkgar
+{
+
+
+namespace
+{
+
+/** \brief Convert a list of names to a cache field.
+ *
+ * Package names cannot include commas or spaces so the list is saved
+ * as a comma separated list. An empty list is saved as a dash so the
+ * number of fields on a line is always the same.
+ *
+ * \param[in] names  The list of names to convert.
+ *
+ * \return The list as one string.
+ */
+std::string names_to_field(const wpkgar_reverse_dependencies::name_list_t& names)
+{
+    if(names.empty())
+    {
+        return "-";
+    }
+    std::string result;
+    for(wpkgar_reverse_dependencies::name_list_t::const_iterator it(names.begin());
+                                                                 it != names.end();
+                                                                 ++it)
+    {
+        if(!result.empty())
+        {
+            result += ",";
+        }
+        result += *it;
+    }
+    return result;
+}
+
+
+/** \brief Convert a cache field back to a list of names.
+ *
+ * This function is the converse of names_to_field().
+ *
+ * \param[in] field  The comma separated list of names or a dash.
+ * \param[out] names  The list of names.
+ */
+void field_to_names(const std::string& field, wpkgar_reverse_dependencies::name_list_t& names)
+{
+    names.clear();
+    if(field == "-")
+    {
+        return;
+    }
+    std::string::size_type start(0);
+    for(;;)
+    {
+        const std::string::size_type pos(field.find(',', start));
+        if(pos == std::string::npos)
+        {
+            names.push_back(field.substr(start));
+            return;
+        }
+        names.push_back(field.substr(start, pos - start));
+        start = pos + 1;
+    }
+}
+
+
+/** \brief Add the dependencies of a field to a list of names.
+ *
+ * The field is parsed as a list of dependencies and the name of each
+ * dependency, including alternatives, is added to the \p names list.
+ *
+ * \param[in] manager  The manager used to read the field.
+ * \param[in] package  The name of the package to read the field from.
+ * \param[in] field_name  The name of the dependency field.
+ * \param[in,out] names  The list of names receiving the dependencies.
+ */
+void add_dependencies(wpkgar_manager::pointer_t manager, const std::string& package, const std::string& field_name, wpkgar_reverse_dependencies::name_list_t& names)
+{
+    if(!manager->field_is_defined(package, field_name))
+    {
+        return;
+    }
+    wpkg_dependencies::dependencies depends(manager->get_field(package, field_name));
+    for(int i(0); i < depends.size(); ++i)
+    {
+        const wpkg_dependencies::dependencies::dependency_t& d(depends.get_dependency(i));
+        if(d.f_name != package)
+        {
+            names.push_back(d.f_name);
+        }
+    }
+}
+
+
+/** \brief Sort a list of names and remove duplicates.
+ *
+ * \param[in,out] names  The list to clean up.
+ */
+void unique_names(wpkgar_reverse_dependencies::name_list_t& names)
+{
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+}
+
+
+/** \brief The empty list returned for unknown packages.
+ *
+ * The get_dependencies() and get_dependents() functions return a
+ * reference to a list of names. When a package has no entry in the
+ * graph this empty list is returned instead.
+ */
+const wpkgar_reverse_dependencies::name_list_t g_empty_list;
+
+} // no name namespace
+
+
+
+/** \class wpkgar_reverse_dependencies
+ * \brief Graph of the dependencies between installed packages.
+ *
+ * The removal process needs to know, for each package being removed,
+ * which installed packages depend on it. Searching the entire list of
+ * installed packages and parsing their dependency fields each time is
+ * slow on systems with many packages, especially in --autoremove which
+ * repeats that search for each package marked "auto".
+ *
+ * This class builds the graph once: for each installed package it
+ * keeps the list of packages it depends on (forward dependencies) and
+ * from those it computes the list of packages that depend on it (the
+ * dependents, also called reverse dependencies.) Looking up the
+ * dependents of a package is then proportional to the number of
+ * dependents instead of the number of installed packages.
+ *
+ * The forward dependencies of each package are saved in the core
+ * directory of the database along the size and modification time of
+ * the package control file. On the next run, a package which control
+ * file did not change is not loaded at all.
+ *
+ * Note that the graph uses package names only. The versions defined in
+ * the dependencies are ignored, just like the removal process does.
+ */
+
+
+/** \brief Initialize the reverse dependency graph.
+ *
+ * The constructor saves the manager. The graph is empty until the
+ * load() function gets called.
+ *
+ * \param[in] manager  The manager handling the database.
+ */
+wpkgar_reverse_dependencies::wpkgar_reverse_dependencies(wpkgar_manager::pointer_t manager)
+    : f_manager(manager)
+    //, f_loaded(false) -- auto-init
+    //, f_packages() -- auto-init
+    //, f_entries() -- auto-init
+    //, f_runtime_dependents() -- auto-init
+    //, f_all_dependents() -- auto-init
+    //, f_all_dependencies() -- auto-init
+{
+}
+
+
+/** \brief Get the path to the cache file.
+ *
+ * The cache is saved in the core directory of the database so it gets
+ * deleted along the database.
+ *
+ * \param[in] manager  The manager handling the database.
+ *
+ * \return The full path to the cache file.
+ */
+wpkg_filename::uri_filename wpkgar_reverse_dependencies::get_cache_filename(wpkgar_manager::pointer_t manager)
+{
+    return manager->get_database_path().append_child("core/reverse-dependencies.cache");
+}
+
+
+/** \brief Build the graph of the installed packages.
+ *
+ * This function lists the installed packages, reads the cache, and
+ * loads and parses the dependency fields of the packages that are not
+ * in the cache or which control file changed. The cache is then saved
+ * back if anything changed.
+ *
+ * The function can be called again to refresh the graph after packages
+ * were installed or removed.
+ */
+void wpkgar_reverse_dependencies::load()
+{
+    f_packages.clear();
+    f_entries.clear();
+    f_runtime_dependents.clear();
+    f_all_dependents.clear();
+    f_all_dependencies.clear();
+
+    package_entries_t cache;
+    bool changed(!read_cache(cache));
+
+    f_manager->list_installed_packages(f_packages);
+    const wpkg_filename::uri_filename database_path(f_manager->get_database_path());
+    for(name_list_t::const_iterator it(f_packages.begin());
+                                    it != f_packages.end();
+                                    ++it)
+    {
+        f_manager->check_interrupt();
+
+        package_entry_t entry;
+        wpkg_filename::uri_filename::file_stat s;
+        if(database_path.append_child(*it).append_child("control").os_stat(s) == 0)
+        {
+            entry.f_size = s.get_size();
+            entry.f_mtime = s.get_mtime();
+            entry.f_mtime_nano = s.get_mtime_nano();
+        }
+
+        package_entries_t::const_iterator c(cache.find(*it));
+        if(c != cache.end()
+        && c->second.f_size == entry.f_size
+        && c->second.f_mtime == entry.f_mtime
+        && c->second.f_mtime_nano == entry.f_mtime_nano)
+        {
+            entry.f_runtime = c->second.f_runtime;
+            entry.f_build = c->second.f_build;
+        }
+        else
+        {
+            parse_dependencies(*it, entry);
+            changed = true;
+        }
+        f_entries[*it] = entry;
+    }
+    if(cache.size() != f_entries.size())
+    {
+        // some packages were removed
+        changed = true;
+    }
+
+    // compute the reverse dependencies
+    for(package_entries_t::const_iterator it(f_entries.begin());
+                                          it != f_entries.end();
+                                          ++it)
+    {
+        name_list_t& all(f_all_dependencies[it->first]);
+        all = it->second.f_runtime;
+        all.insert(all.end(), it->second.f_build.begin(), it->second.f_build.end());
+        unique_names(all);
+
+        for(name_list_t::const_iterator r(it->second.f_runtime.begin());
+                                        r != it->second.f_runtime.end();
+                                        ++r)
+        {
+            f_runtime_dependents[*r].push_back(it->first);
+        }
+        for(name_list_t::const_iterator a(all.begin());
+                                        a != all.end();
+                                        ++a)
+        {
+            f_all_dependents[*a].push_back(it->first);
+        }
+    }
+
+    if(changed)
+    {
+        write_cache();
+    }
+
+    f_loaded = true;
+}
+
+
+/** \brief Check whether the graph was loaded.
+ *
+ * \return true once load() was called.
+ */
+bool wpkgar_reverse_dependencies::is_loaded() const
+{
+    return f_loaded;
+}
+
+
+/** \brief Get the list of installed packages.
+ *
+ * This function returns the list of installed packages as it was
+ * when load() was last called. The list is sorted.
+ *
+ * \return The list of installed package names.
+ */
+const wpkgar_reverse_dependencies::name_list_t& wpkgar_reverse_dependencies::get_packages() const
+{
+    return f_packages;
+}
+
+
+/** \brief Get the list of packages a package depends on.
+ *
+ * \param[in] name  The name of the package.
+ * \param[in] kind  Whether only the runtime dependencies (Pre-Depends and
+ *                  Depends) or all the dependencies are returned.
+ *
+ * \return The sorted list of dependencies, possibly empty.
+ */
+const wpkgar_reverse_dependencies::name_list_t& wpkgar_reverse_dependencies::get_dependencies(const std::string& name, dependency_kind_t kind) const
+{
+    if(kind == dependency_kind_runtime)
+    {
+        package_entries_t::const_iterator it(f_entries.find(name));
+        return it == f_entries.end() ? g_empty_list : it->second.f_runtime;
+    }
+    dependents_t::const_iterator it(f_all_dependencies.find(name));
+    return it == f_all_dependencies.end() ? g_empty_list : it->second;
+}
+
+
+/** \brief Get the list of packages that depend on a package.
+ *
+ * The package does not need to be installed. For example, a package
+ * with a status of config-files may still be listed as a dependency
+ * of other installed packages.
+ *
+ * \param[in] name  The name of the package.
+ * \param[in] kind  Whether only the runtime dependents or all the
+ *                  dependents are returned.
+ *
+ * \return The sorted list of dependents, possibly empty.
+ */
+const wpkgar_reverse_dependencies::name_list_t& wpkgar_reverse_dependencies::get_dependents(const std::string& name, dependency_kind_t kind) const
+{
+    const dependents_t& dependents(kind == dependency_kind_runtime ? f_runtime_dependents : f_all_dependents);
+    dependents_t::const_iterator it(dependents.find(name));
+    return it == dependents.end() ? g_empty_list : it->second;
+}
+
+
+/** \brief Read the cache file.
+ *
+ * Each line of the cache file defines one package:
+ *
+ * \code
+ * <name> <control size> <control mtime> <mtime nano> <runtime> <build>
+ * \endcode
+ *
+ * If the file cannot be read or a line is invalid, the whole cache is
+ * ignored.
+ *
+ * \param[out] cache  The entries read from the cache.
+ *
+ * \return true if the cache was read successfully.
+ */
+bool wpkgar_reverse_dependencies::read_cache(package_entries_t& cache) const
+{
+    const wpkg_filename::uri_filename filename(get_cache_filename(f_manager));
+    if(!filename.exists())
+    {
+        return false;
+    }
+
+    memfile::memory_file data;
+    try
+    {
+        data.read_file(filename);
+    }
+    catch(const memfile::memfile_exception&)
+    {
+        return false;
+    }
+
+    int offset(0);
+    std::string line;
+    while(data.read_line(offset, line))
+    {
+        if(line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::vector<std::string> fields;
+        std::string::size_type start(0);
+        for(;;)
+        {
+            const std::string::size_type pos(line.find(' ', start));
+            fields.push_back(line.substr(start, pos == std::string::npos ? std::string::npos : pos - start));
+            if(pos == std::string::npos)
+            {
+                break;
+            }
+            start = pos + 1;
+        }
+        if(fields.size() != 6 || fields[0].empty())
+        {
+            cache.clear();
+            return false;
+        }
+        package_entry_t& entry(cache[fields[0]]);
+        entry.f_size = static_cast<int64_t>(strtoll(fields[1].c_str(), NULL, 10));
+        entry.f_mtime = static_cast<int64_t>(strtoll(fields[2].c_str(), NULL, 10));
+        entry.f_mtime_nano = static_cast<uint64_t>(strtoull(fields[3].c_str(), NULL, 10));
+        field_to_names(fields[4], entry.f_runtime);
+        field_to_names(fields[5], entry.f_build);
+    }
+
+    return true;
+}
+
+
+/** \brief Save the forward dependencies in the cache file.
+ *
+ * The cache is an optimization only, if it cannot be saved (i.e. the
+ * database is read-only to this user) the error is ignored.
+ */
+void wpkgar_reverse_dependencies::write_cache() const
+{
+    memfile::memory_file data;
+    data.create(memfile::memory_file::file_format_other);
+    data.printf("# wpkg reverse dependencies cache -- do not edit\n");
+    for(package_entries_t::const_iterator it(f_entries.begin());
+                                          it != f_entries.end();
+                                          ++it)
+    {
+        data.printf("%s %lld %lld %llu %s %s\n",
+                it->first.c_str(),
+                static_cast<long long>(static_cast<int64_t>(it->second.f_size)),
+                static_cast<long long>(static_cast<int64_t>(it->second.f_mtime)),
+                static_cast<unsigned long long>(static_cast<uint64_t>(it->second.f_mtime_nano)),
+                names_to_field(it->second.f_runtime).c_str(),
+                names_to_field(it->second.f_build).c_str());
+    }
+
+    try
+    {
+        data.write_file(get_cache_filename(f_manager), true);
+    }
+    catch(const memfile::memfile_exception&)
+    {
+        // ignore, we'll recompute the dependencies next time
+    }
+}
+
+
+/** \brief Parse the dependency fields of one package.
+ *
+ * The runtime dependencies are defined by the Pre-Depends and Depends
+ * fields. The build dependencies are defined by the Build-Depends,
+ * Build-Depends-Arch, Build-Depends-Indep, and Built-Using fields.
+ *
+ * \param[in] name  The name of the installed package.
+ * \param[in,out] entry  The entry receiving the dependencies.
+ */
+void wpkgar_reverse_dependencies::parse_dependencies(const std::string& name, package_entry_t& entry) const
+{
+    f_manager->load_package(name);
+
+    entry.f_runtime.clear();
+    add_dependencies(f_manager, name, wpkg_control::control_file::field_predepends_factory_t::canonicalized_name(), entry.f_runtime);
+    add_dependencies(f_manager, name, wpkg_control::control_file::field_depends_factory_t::canonicalized_name(), entry.f_runtime);
+    unique_names(entry.f_runtime);
+
+    entry.f_build.clear();
+    add_dependencies(f_manager, name, wpkg_control::control_file::field_builddepends_factory_t::canonicalized_name(), entry.f_build);
+    add_dependencies(f_manager, name, wpkg_control::control_file::field_builddependsarch_factory_t::canonicalized_name(), entry.f_build);
+    add_dependencies(f_manager, name, wpkg_control::control_file::field_builddependsindep_factory_t::canonicalized_name(), entry.f_build);
+    add_dependencies(f_manager, name, wpkg_control::control_file::field_builtusing_factory_t::canonicalized_name(), entry.f_build);
+    unique_names(entry.f_build);
+}
+
+
+
+}   // namespace wpkgar
+// vim: ts=4 sw=4 et
@@ -0,0 +1,99 @@
+/*    wpkgar_reverse_dependencies.h -- graph of the installed packages dependents
+ *    Copyright (C) 2012-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+
+/** \file
+ * \brief Reverse dependency graph declaration.
+ *
+ * The removal functions need to know which installed packages depend on
+ * a given package. Instead of loading and parsing the dependency fields
+ * of all the installed packages each time the question is asked, this
+ * class builds a graph of the installed packages once and caches the
+ * parsed dependencies in the administration directory.
+ */
+#pragma once
+#ifndef WPKGAR_REVERSE_DEPENDENCIES_H
+#define WPKGAR_REVERSE_DEPENDENCIES_H
+#include    "wpkgar.h"
+
+#include <map>
+
+
+namespace wpkgar
+{
+
+
+
+class DEBIAN_PACKAGE_EXPORT wpkgar_reverse_dependencies
+{
+public:
+    typedef std::vector<std::string>    name_list_t;
+
+    enum dependency_kind_t
+    {
+        dependency_kind_runtime,    // Pre-Depends and Depends
+        dependency_kind_all         // runtime plus Build-Depends & co.
+    };
+
+                                    wpkgar_reverse_dependencies(wpkgar_manager::pointer_t manager);
+
+    void                            load();
+    bool                            is_loaded() const;
+    const name_list_t&              get_packages() const;
+    const name_list_t&              get_dependencies(const std::string& name, dependency_kind_t kind) const;
+    const name_list_t&              get_dependents(const std::string& name, dependency_kind_t kind) const;
+
+    static wpkg_filename::uri_filename get_cache_filename(wpkgar_manager::pointer_t manager);
+
+private:
+    struct package_entry_t
+    {
+        controlled_vars::zint64_t       f_size;
+        controlled_vars::zint64_t       f_mtime;
+        controlled_vars::zuint64_t      f_mtime_nano;
+        name_list_t                     f_runtime;
+        name_list_t                     f_build;
+    };
+    typedef std::map<std::string, package_entry_t>  package_entries_t;
+    typedef std::map<std::string, name_list_t>      dependents_t;
+
+    // disallow copying
+                                    wpkgar_reverse_dependencies(const wpkgar_reverse_dependencies& rhs);
+    wpkgar_reverse_dependencies&    operator = (const wpkgar_reverse_dependencies& rhs);
+
+    bool                            read_cache(package_entries_t& cache) const;
+    void                            write_cache() const;
+    void                            parse_dependencies(const std::string& name, package_entry_t& entry) const;
+
+    wpkgar_manager::pointer_t       f_manager;
+    controlled_vars::fbool_t        f_loaded;
+    name_list_t                     f_packages;
+    package_entries_t               f_entries;
+    dependents_t                    f_runtime_dependents;
+    dependents_t                    f_all_dependents;
+    dependents_t                    f_all_dependencies;
+};
+
+
+
+}   // namespace wpkgar
+#endif
+//#ifndef WPKGAR_REVERSE_DEPENDENCIES_H
+// vim: ts=4 sw=4 et
@@ -29,9 +29,14 @@
  *
  * The parser is 100% compatible with the C/C++ expression parser. The order
  * for all the operators is respected exactly.
+ *
+ * The expression is first compiled to a tree of nodes which is then
+ * executed. The compiled expression can be kept and executed again
+ * without parsing the expression each time.
  */
 #include	"libexpr/expr.h"
 
+#include	<algorithm>
 #include	<cmath>
 #include	<iostream>
 #include	<sstream>
@@ -104,23 +109,61 @@ long lrint(double flt)
 #endif
 
 
+/** \brief An expression compiled to a tree of nodes.
+ *
+ * The expr_evaluator::compile() function parses an expression once and
+ * saves the result in this object. The tree can then be executed any
+ * number of times with expr_evaluator::eval() without having to parse
+ * the expression again.
+ *
+ * The nodes reproduce exactly the operations that the parser used to
+ * apply while parsing so the result of an evaluation is the same.
+ */
+class compiled_expression
+{
+public:
+	struct node_t
+	{
+		node_t()
+			: f_op(0)
+			//, f_value -- auto-init
+			, f_function(expr_evaluator::FUNCTION_UNDEFINED)
+			, f_fetch(false)
+			//, f_children -- auto-init
+		{
+		}
+
+		int			f_op;		// NODE_... or operator token
+		variable		f_value;	// constants and identifier names
+		int			f_function;	// pre-resolved function identifier
+		bool			f_fetch;	// identifier value gets read
+		std::vector<node_t>	f_children;
+	};
+
+	node_t			f_root;
+};
+
+
 /** \brief The actual expression parser and execution stack.
  *
- * This class is the one that evaluates an expression and returns its
- * result in a variable. The expression is simply a string. The result
- * is put in a variable because it may be of any one type as supported
- * by the variable class.
+ * This class is the one that compiles an expression and executes the
+ * result. The expression is simply a string. The result is put in a
+ * variable because it may be of any one type as supported by the
+ * variable class.
  *
  * The evaluator is the class the user creates in order to evaluate
  * expressions. This is used so the user can define its own functions
- * via the call_function() virtual function.
+ * via the find_function() and call_function() virtual functions.
  */
 class expression
 {
 public:
+	typedef compiled_expression::node_t	node_t;
+
 	expression(expr_evaluator& evaluator);
 
-	void eval(const std::string& expr, variable& result);
+	void compile(const std::string& expr, compiled_expression& program);
+	static void execute(expr_evaluator& evaluator, const node_t& node, variable& result);
 
 private:
 	static const int TOK_ARROW		= 1000;
@@ -157,6 +200,22 @@ private:
 	static const int TOK_INTEGER		= 1103;
 	static const int TOK_FLOAT		= 1104;
 
+	// nodes that are not represented by their operator token
+	static const int NODE_EMPTY		= 2000;
+	static const int NODE_CONSTANT		= 2001;
+	static const int NODE_IDENTIFIER	= 2002;
+	static const int NODE_CALL		= 2003;
+	static const int NODE_COMMA		= 2004;
+	static const int NODE_CONDITIONAL	= 2005;
+	static const int NODE_LOGIC_NOT		= 2011;
+	static const int NODE_BITWISE_NOT	= 2012;
+	static const int NODE_PLUS		= 2013;
+	static const int NODE_NEGATE		= 2014;
+	static const int NODE_PRE_INCREMENT	= 2021;
+	static const int NODE_PRE_DECREMENT	= 2022;
+	static const int NODE_POST_INCREMENT	= 2023;
+	static const int NODE_POST_DECREMENT	= 2024;
+
 	int expr_getc();
 	void expr_ungetc(int c);
 	void next_token();
@@ -168,24 +227,25 @@ private:
 	void skip_c_comment();
 	void skip_cpp_comment();
 
-	void unary(variable& result);
-	void array_func(variable& result);
-	void postfix(variable& result);
-	void prefix(variable& result);
-	void multiplicative(variable& result);
-	void additive(variable& result);
-	void shift(variable& result);
-	void relational(variable& result);
-	void compare(variable& result);
-	void bitwise_and(variable& result);
-	void bitwise_xor(variable& result);
-	void bitwise_or(variable& result);
-	void logical_and(variable& result);
-	void logical_xor(variable& result);
-	void logical_or(variable& result);
-	void conditional(variable& result);
-	void assignment(variable& result);
-	void comma(variable& result);
+	node_t& binary(node_t& node, int op);
+	void unary(node_t& node);
+	void array_func(node_t& node);
+	void postfix(node_t& node);
+	void prefix(node_t& node);
+	void multiplicative(node_t& node);
+	void additive(node_t& node);
+	void shift(node_t& node);
+	void relational(node_t& node);
+	void compare(node_t& node);
+	void bitwise_and(node_t& node);
+	void bitwise_xor(node_t& node);
+	void bitwise_or(node_t& node);
+	void logical_and(node_t& node);
+	void logical_xor(node_t& node);
+	void logical_or(node_t& node);
+	void conditional(node_t& node);
+	void assignment(node_t& node);
+	void comma(node_t& node);
 
 	expression& operator = (const expression&)
 	{
@@ -824,41 +884,64 @@ void expression::next_token()
 	}
 }
 
-void expression::unary(variable& result)
+/** \brief Transform \p node in the left hand side of a binary operator.
+ *
+ * The current content of \p node is moved to its first child and
+ * \p op becomes the operator of \p node. The current token is skipped.
+ *
+ * \param[in,out] node  The node being transformed.
+ * \param[in] op  The operator of the node.
+ *
+ * \return The second child which has to be filled with the right hand side.
+ */
+expression::node_t& expression::binary(node_t& node, int op)
 {
-	variable value;
+	node_t lhs;
+	std::swap(lhs, node);
+	node.f_op = op;
+	node.f_children.resize(2);
+	std::swap(node.f_children[0], lhs);
+	next_token();
+	return node.f_children[1];
+}
 
+void expression::unary(node_t& node)
+{
 //std::cerr << "Unary with " << f_token << std::endl;
 
 	switch(f_token)
 	{
 	case '!':
 		next_token();
-		prefix(value);
-		result.logic_not(value);
+		node.f_op = NODE_LOGIC_NOT;
+		node.f_children.resize(1);
+		prefix(node.f_children[0]);
 		break;
 
 	case '~':
 		next_token();
-		prefix(value);
-		result.bitwise_not(value);
+		node.f_op = NODE_BITWISE_NOT;
+		node.f_children.resize(1);
+		prefix(node.f_children[0]);
 		break;
 
 	case '+':
 		next_token();
-		prefix(value);
-		result.pls(value);
+		node.f_op = NODE_PLUS;
+		node.f_children.resize(1);
+		prefix(node.f_children[0]);
 		break;
 
 	case '-':
 		next_token();
-		prefix(value);
-		result.neg(value);
+		node.f_op = NODE_NEGATE;
+		node.f_children.resize(1);
+		prefix(node.f_children[0]);
 		break;
 
 	case '(':
 		//next_token(); -- comma() calls this function already
-		comma(result);
+		comma(node);
 		if(f_token != ')')
 		{
 			std::stringstream msg;
@@ -876,54 +959,52 @@ void expression::unary(variable& result)
 		break;
 
 	case TOK_IDENTIFIER:
-		{
-			std::string name(f_var.get_name());
-			result.set_name(name);
-			next_token();
-			if(f_token != '=' && f_token != '(' && !f_evaluator.get(name, result))
-			{
-				throw undefined_variable("undefined variable \"" + name + "\" (1)");
-			}
-		}
+		node.f_op = NODE_IDENTIFIER;
+		node.f_value.set_name(f_var.get_name());
+		next_token();
+		node.f_fetch = f_token != '=' && f_token != '(';
 		break;
 
 	case TOK_STRING:
-		result = f_var;
+		// concatenate strings right away
+		node.f_op = NODE_CONSTANT;
+		node.f_value = f_var;
 		next_token();
 		while(f_token == TOK_STRING)
 		{
-			// concatenate
-			variable lhs(result);
-			result.add(lhs, f_var);
+			variable lhs(node.f_value);
+			node.f_value.add(lhs, f_var);
 			next_token();
 		}
 		break;
 
 	case TOK_INTEGER:
 	case TOK_FLOAT:
-		result = f_var;
+		node.f_op = NODE_CONSTANT;
+		node.f_value = f_var;
 		next_token();
 		break;
 
 	default:
 		// this includes ')', ';', EOF, etc.
+		node.f_op = NODE_EMPTY;
 		break;
 
 	}
 }
 
 
-void expression::array_func(variable& result)
+void expression::array_func(node_t& node)
 {
-	unary(result);
+	unary(node);
 
 	if(f_token == '(')
 	{
 		// skip the '('
-		next_token();
+		binary(node, NODE_CALL);
+		node.f_children.pop_back();
 
 		// function call
-		expr_evaluator::arglist list;
 		if(f_token != ')')
 		{
 			if(f_token == EOF)
@@ -932,9 +1013,8 @@ void expression::array_func(variable& result)
 			}
 			for(;;)
 			{
-				variable param;
-				assignment(param);
-				list.push_back(param);
+				node.f_children.push_back(node_t());
+				assignment(node.f_children.back());
 				if(f_token == ')')
 				{
 					break;
@@ -951,30 +1031,28 @@ void expression::array_func(variable& result)
 		// skip the ')'
 		next_token();
 
-		// call the function now
-		std::string name(result.get_name());
-		if(name.empty())
+		// resolve the function now if we already know its name
+		const node_t& function(node.f_children[0]);
+		if(function.f_op == NODE_IDENTIFIER)
 		{
-			throw syntax_error("a function name must be an identifier");
+			node.f_function = f_evaluator.find_function(function.f_value.get_name());
 		}
-		f_evaluator.call_function(name, list, result);
 	}
 }
 
 
-void expression::postfix(variable& result)
+void expression::postfix(node_t& node)
 {
-	array_func(result);
+	array_func(node);
 
-	long adjust;
 	switch(f_token)
 	{
 	case TOK_INCREMENT:
-		adjust = 1;
+		binary(node, NODE_POST_INCREMENT);
 		break;
 
 	case TOK_DECREMENT:
-		adjust = -1;
+		binary(node, NODE_POST_DECREMENT);
 		break;
 
 	default:
@@ -982,105 +1060,50 @@ void expression::postfix(variable& result)
 
 	}
 
-	next_token();
-	std::string name(result.get_name());
-	if(name.empty())
-	{
-		throw expected_a_variable("expected a variable to apply ++ or -- operator");
-	}
-	variable new_value, old_value, increment;
-	if(!f_evaluator.get(name, old_value))
-	{
-		// this should not be reached by coverage tests since
-		// TOK_IDENTIFIER already checked whether the variable existed
-		throw undefined_variable("undefined variable \"" + name + "\" (2)"); // LCOV_EXCL_LINE
-	}
-	increment.set(adjust);
-	new_value.add(old_value, increment);
-	f_evaluator.set(name, new_value);
-	// notice how result is not affected by the operation, only the variable
+	// binary() created an empty right hand side
+	node.f_children.pop_back();
 }
 
 
-void expression::prefix(variable& result)
+void expression::prefix(node_t& node)
 {
-	long adjust;
+	int op;
 	switch(f_token)
 	{
 	case TOK_INCREMENT:
-		adjust = 1;
+		op = NODE_PRE_INCREMENT;
 		next_token();
-		break;;
+		break;
 
 	case TOK_DECREMENT:
-		adjust = -1;
+		op = NODE_PRE_DECREMENT;
 		next_token();
 		break;
 
 	default:
-		adjust = 0;
-		break;
+		postfix(node);
+		return;
 
 	}
 
-	postfix(result);
-
-	if(adjust != 0)
-	{
-		std::string name(result.get_name());
-		if(name.empty())
-		{
-			throw expected_a_variable("expected a variable to apply ++ or -- operator");
-		}
-		variable old_value, increment;
-		if(!f_evaluator.get(name, old_value))
-		{
-			// this should not be reached by coverage tests since
-			// TOK_IDENTIFIER already checked whether the variable existed
-			throw undefined_variable("undefined variable \"" + name + "\" (3)"); // LCOV_EXCL_LINE
-		}
-		increment.set(adjust);
-		result.add(old_value, increment);
-		f_evaluator.set(name, result);
-		// notice how in this case we tweak result instead of new_value
-		// since the operation affects the result here
-	}
+	node.f_op = op;
+	node.f_children.resize(1);
+	postfix(node.f_children[0]);
 }
 
 
-void expression::multiplicative(variable& result)
+void expression::multiplicative(node_t& node)
 {
-	prefix(result);
+	prefix(node);
 
 	for(;;)
 	{
 		switch(f_token)
 		{
 		case '*':
-			{
-			variable lhs(result), rhs;
-			next_token();
-			prefix(rhs);
-			result.mul(lhs, rhs);
-			}
-			continue;
-
 		case '/':
-			{
-			variable lhs(result), rhs;
-			next_token();
-			prefix(rhs);
-			result.div(lhs, rhs);
-			}
-			continue;
-
 		case '%':
-			{
-			variable lhs(result), rhs;
-			next_token();
-			prefix(rhs);
-			result.mod(lhs, rhs);
-			}
+			prefix(binary(node, f_token));
 			continue;
 
 		default:;
@@ -1091,30 +1114,17 @@ void expression::multiplicative(variable& result)
 }
 
 
-void expression::additive(variable& result)
+void expression::additive(node_t& node)
 {
-	multiplicative(result);
+	multiplicative(node);
 
 	for(;;)
 	{
 		switch(f_token)
 		{
 		case '+':
-			{
-			variable lhs(result), rhs;
-			next_token();
-			multiplicative(rhs);
-			result.add(lhs, rhs);
-			}
-			continue;
-
 		case '-':
-			{
-			variable lhs(result), rhs;
-			next_token();
-			multiplicative(rhs);
-			result.sub(lhs, rhs);
-			}
+			multiplicative(binary(node, f_token));
 			continue;
 
 		default:;
@@ -1125,30 +1135,17 @@ void expression::additive(variable& result)
 }
 
 
-void expression::shift(variable& result)
+void expression::shift(node_t& node)
 {
-	additive(result);
+	additive(node);
 
 	for(;;)
 	{
 		switch(f_token)
 		{
 		case TOK_SHIFT_LEFT:	// <<
-			{
-			variable lhs(result), rhs;
-			next_token();
-			additive(rhs);
-			result.shl(lhs, rhs);
-			}
-			continue;
-
 		case TOK_SHIFT_RIGHT:	// >>
-			{
-			variable lhs(result), rhs;
-			next_token();
-			additive(rhs);
-			result.shr(lhs, rhs);
-			}
+			additive(binary(node, f_token));
 			continue;
 
 		default:;
@@ -1159,48 +1156,19 @@ void expression::shift(variable& result)
 }
 
 
-void expression::relational(variable& result)
+void expression::relational(node_t& node)
 {
-	shift(result);
+	shift(node);
 
 	for(;;)
 	{
 		switch(f_token)
 		{
 		case '<':
-			{
-			variable lhs(result), rhs;
-			next_token();
-			shift(rhs);
-			result.lt(lhs, rhs);
-			}
-			continue;
-
 		case TOK_LESS_EQUAL:	// <=
-			{
-			variable lhs(result), rhs;
-			next_token();
-			shift(rhs);
-			result.le(lhs, rhs);
-			}
-			continue;
-
 		case TOK_GREATER_EQUAL:	// >=
-			{
-			variable lhs(result), rhs;
-			next_token();
-			shift(rhs);
-			result.ge(lhs, rhs);
-			}
-			continue;
-
 		case '>':
-			{
-			variable lhs(result), rhs;
-			next_token();
-			shift(rhs);
-			result.gt(lhs, rhs);
-			}
+			shift(binary(node, f_token));
 			continue;
 
 		default:;
@@ -1211,30 +1179,17 @@ void expression::relational(variable& result)
 }
 
 
-void expression::compare(variable& result)
+void expression::compare(node_t& node)
 {
-	relational(result);
+	relational(node);
 
 	for(;;)
 	{
 		switch(f_token)
 		{
 		case TOK_EQUAL:	// ==
-			{
-			variable lhs(result), rhs;
-			next_token();
-			relational(rhs);
-			result.eq(lhs, rhs);
-			}
-			continue;
-
 		case TOK_NOT_EQUAL:	// !=
-			{
-			variable lhs(result), rhs;
-			next_token();
-			relational(rhs);
-			result.ne(lhs, rhs);
-			}
+			relational(binary(node, f_token));
 			continue;
 
 		default:;
@@ -1245,148 +1200,102 @@ void expression::compare(variable& result)
 }
 
 
-void expression::bitwise_and(variable& result)
+void expression::bitwise_and(node_t& node)
 {
-	compare(result);
+	compare(node);
 
-	while(f_token == '&') {
-		variable lhs(result), rhs;
-		next_token();
-		compare(rhs);
-
-		result.bitwise_and(lhs, rhs);
+	while(f_token == '&')
+	{
+		compare(binary(node, f_token));
 	}
 }
 
 
-void expression::bitwise_xor(variable& result)
+void expression::bitwise_xor(node_t& node)
 {
-	bitwise_and(result);
+	bitwise_and(node);
 
 	while(f_token == '^')
 	{
-		variable lhs(result), rhs;
-		next_token();
-		bitwise_and(rhs);
-
-		result.bitwise_xor(lhs, rhs);
+		bitwise_and(binary(node, f_token));
 	}
 }
 
 
-void expression::bitwise_or(variable& result)
+void expression::bitwise_or(node_t& node)
 {
-	bitwise_xor(result);
+	bitwise_xor(node);
 
 	while(f_token == '|')
 	{
-		variable lhs(result), rhs;
-		next_token();
-		bitwise_xor(rhs);
-
-		result.bitwise_or(lhs, rhs);
+		bitwise_xor(binary(node, f_token));
 	}
 }
 
 
-void expression::logical_and(variable& result)
+void expression::logical_and(node_t& node)
 {
-	bitwise_or(result);
+	bitwise_or(node);
 
 	while(f_token == TOK_LOGIC_AND)		// &&
 	{
-		variable lhs(result), rhs;
-		next_token();
-		bitwise_or(rhs);
-
-		result.logic_and(lhs, rhs);
+		bitwise_or(binary(node, f_token));
 	}
 }
 
 
-void expression::logical_xor(variable& result)
+void expression::logical_xor(node_t& node)
 {
-	logical_and(result);
+	logical_and(node);
 
 	while(f_token == TOK_LOGIC_XOR)		// ^^
 	{
-		variable lhs(result), rhs;
-		next_token();
-		logical_and(rhs);
-
-		result.logic_xor(lhs, rhs);
+		logical_and(binary(node, f_token));
 	}
 }
 
 
-void expression::logical_or(variable& result)
+void expression::logical_or(node_t& node)
 {
-	logical_xor(result);
+	logical_xor(node);
 
 	while(f_token == TOK_LOGIC_OR)		// ||
 	{
-		variable lhs(result), rhs;
-		next_token();
-		logical_xor(rhs);
-
-		result.logic_or(lhs, rhs);
+		logical_xor(binary(node, f_token));
 	}
 }
 
 
-void expression::conditional(variable& result)
+void expression::conditional(node_t& node)
 {
-	logical_or(result);
+	logical_or(node);
 
 	if(f_token == '?')
 	{
-		variable if_true, if_false, test;
-		long value;
+		node_t test;
+		std::swap(test, node);
+		node.f_op = NODE_CONDITIONAL;
+		node.f_children.resize(3);
+		std::swap(node.f_children[0], test);
 
-		// TODO: we should avoid evaluating these expressions
-		//	 depending on the value of result.
 		//next_token(); -- comma calls this function already
-		comma(if_true);
+		comma(node.f_children[1]);
 		if(f_token != ':')
 		{
 			throw syntax_error("expected ':' in conditional");
 		}
 		next_token();
-		assignment(if_false);
-		test.logic_not(result);
-		test.get(value);
-		if(value == 0) // WARNING: we use logic_not() so this is inverted
-		{
-			result = if_true;
-		}
-		else {
-			result = if_false;
-		}
+		assignment(node.f_children[2]);
 	}
 }
 
 
-void expression::assignment(variable& result)
+void expression::assignment(node_t& node)
 {
-	variable value, old_value, new_value;
-	std::string name;
-	int assign;
-
-	conditional(result);
+	conditional(node);
 
 	switch(f_token) {
 	case '=':
-		next_token();
-		assignment(value);
-		name = result.get_name();
-		if(name.empty())
-		{
-			throw expected_a_variable("expected a variable to apply the assignment operator (1)");
-		}
-		f_evaluator.set(name, value);
-		result = value;
-		break;
-
 	case TOK_ASSIGN_MUL:
 	case TOK_ASSIGN_DIV:
 	case TOK_ASSIGN_MOD:
@@ -1397,81 +1306,25 @@ void expression::assignment(variable& result)
 	case TOK_ASSIGN_AND:
 	case TOK_ASSIGN_XOR:
 	case TOK_ASSIGN_OR:
-		assign = f_token;
-		next_token();
-		assignment(value);
-		name = result.get_name();
-		if(name.empty())
-		{
-			throw expected_a_variable("expected a variable to apply the assignment operator (2)");
-		}
-		if(!f_evaluator.get(name, old_value))
-		{
-			// this should not be reached by coverage tests since
-			// TOK_IDENTIFIER already checked whether the variable existed
-			throw undefined_variable("undefined variable \"" + name + "\" (4)"); // LCOV_EXCL_LINE
-		}
-		switch(assign) {
-		case TOK_ASSIGN_MUL:
-			new_value.mul(old_value, value);
-			break;
-
-		case TOK_ASSIGN_DIV:
-			new_value.div(old_value, value);
-			break;
-
-		case TOK_ASSIGN_MOD:
-			new_value.mod(old_value, value);
-			break;
-
-		case TOK_ASSIGN_ADD:
-			new_value.add(old_value, value);
-			break;
-
-		case TOK_ASSIGN_SUB:
-			new_value.sub(old_value, value);
-			break;
-
-		case TOK_ASSIGN_SHL:
-			new_value.shl(old_value, value);
-			break;
-
-		case TOK_ASSIGN_SHR:
-			new_value.shr(old_value, value);
-			break;
-
-		case TOK_ASSIGN_AND:
-			new_value.bitwise_and(old_value, value);
-			break;
-
-		case TOK_ASSIGN_XOR:
-			new_value.bitwise_xor(old_value, value);
-			break;
-
-		case TOK_ASSIGN_OR:
-			new_value.bitwise_or(old_value, value);
-			break;
-
-		}
-		f_evaluator.set(name, new_value);
-		result = new_value;
+		assignment(binary(node, f_token));
 		break;
 
 	}
 }
 
 
-void expression::comma(variable& result)
+void expression::comma(node_t& node)
 {
+	node.f_op = NODE_COMMA;
 	do {
 		next_token();
-		result.reset();
-		assignment(result);
+		node.f_children.push_back(node_t());
+		assignment(node.f_children.back());
 	} while(f_token == ',');
 }
 
 
-void expression::eval(const std::string& expr, variable& result)
+void expression::compile(const std::string& expr, compiled_expression& program)
 {
 	//f_evaluator -- defined in constructor, do not reset between calls
 	f_token = EOF;
@@ -1482,7 +1335,8 @@ void expression::eval(const std::string& expr, variable& result)
 	f_line = 1;
 	f_character = 1;
 
-	comma(result);
+	program.f_root = node_t();
+	comma(program.f_root);
 
 	// allow any number of ';' at the end of the expression
 	bool has_semicolon(false);
@@ -1503,6 +1357,360 @@ void expression::eval(const std::string& expr, variable& result)
 }
 
 
+/** \brief Execute a compiled node.
+ *
+ * This function computes the result of \p node and its children. The
+ * operations are applied on the variables in the same order as the
+ * parser used to do it while parsing.
+ *
+ * \param[in] evaluator  The evaluator holding the variables and functions.
+ * \param[in] node  The node to execute.
+ * \param[in,out] result  The variable receiving the result.
+ */
+void expression::execute(expr_evaluator& evaluator, const node_t& node, variable& result)
+{
+	switch(node.f_op)
+	{
+	case NODE_EMPTY:
+		break;
+
+	case NODE_CONSTANT:
+		result = node.f_value;
+		break;
+
+	case NODE_IDENTIFIER:
+		{
+			std::string name(node.f_value.get_name());
+			result.set_name(name);
+			if(node.f_fetch && !evaluator.get(name, result))
+			{
+				throw undefined_variable("undefined variable \"" + name + "\" (1)");
+			}
+		}
+		break;
+
+	case NODE_COMMA:
+		for(std::vector<node_t>::const_iterator it(node.f_children.begin()); it != node.f_children.end(); ++it)
+		{
+			result.reset();
+			execute(evaluator, *it, result);
+		}
+		break;
+
+	case NODE_CALL:
+		{
+			execute(evaluator, node.f_children[0], result);
+			expr_evaluator::arglist list;
+			for(size_t idx(1); idx < node.f_children.size(); ++idx)
+			{
+				variable param;
+				execute(evaluator, node.f_children[idx], param);
+				list.push_back(param);
+			}
+
+			// call the function now
+			std::string name(result.get_name());
+			if(name.empty())
+			{
+				throw syntax_error("a function name must be an identifier");
+			}
+			if(node.f_function != expr_evaluator::FUNCTION_UNDEFINED)
+			{
+				evaluator.call_function(node.f_function, list, result);
+			}
+			else
+			{
+				evaluator.call_function(name, list, result);
+			}
+		}
+		break;
+
+	case NODE_LOGIC_NOT:
+	case NODE_BITWISE_NOT:
+	case NODE_PLUS:
+	case NODE_NEGATE:
+		{
+			variable value;
+			execute(evaluator, node.f_children[0], value);
+			switch(node.f_op)
+			{
+			case NODE_LOGIC_NOT:
+				result.logic_not(value);
+				break;
+
+			case NODE_BITWISE_NOT:
+				result.bitwise_not(value);
+				break;
+
+			case NODE_PLUS:
+				result.pls(value);
+				break;
+
+			default: // NODE_NEGATE
+				result.neg(value);
+				break;
+
+			}
+		}
+		break;
+
+	case NODE_POST_INCREMENT:
+	case NODE_POST_DECREMENT:
+		{
+			execute(evaluator, node.f_children[0], result);
+			std::string name(result.get_name());
+			if(name.empty())
+			{
+				throw expected_a_variable("expected a variable to apply ++ or -- operator");
+			}
+			variable new_value, old_value, increment;
+			if(!evaluator.get(name, old_value))
+			{
+				// this should not be reached by coverage tests since
+				// NODE_IDENTIFIER already checked whether the variable existed
+				throw undefined_variable("undefined variable \"" + name + "\" (2)"); // LCOV_EXCL_LINE
+			}
+			increment.set(node.f_op == NODE_POST_INCREMENT ? 1L : -1L);
+			new_value.add(old_value, increment);
+			evaluator.set(name, new_value);
+			// notice how result is not affected by the operation, only the variable
+		}
+		break;
+
+	case NODE_PRE_INCREMENT:
+	case NODE_PRE_DECREMENT:
+		{
+			execute(evaluator, node.f_children[0], result);
+			std::string name(result.get_name());
+			if(name.empty())
+			{
+				throw expected_a_variable("expected a variable to apply ++ or -- operator");
+			}
+			variable old_value, increment;
+			if(!evaluator.get(name, old_value))
+			{
+				// this should not be reached by coverage tests since
+				// NODE_IDENTIFIER already checked whether the variable existed
+				throw undefined_variable("undefined variable \"" + name + "\" (3)"); // LCOV_EXCL_LINE
+			}
+			increment.set(node.f_op == NODE_PRE_INCREMENT ? 1L : -1L);
+			result.add(old_value, increment);
+			evaluator.set(name, result);
+			// notice how in this case we tweak result instead of new_value
+			// since the operation affects the result here
+		}
+		break;
+
+	case NODE_CONDITIONAL:
+		{
+			execute(evaluator, node.f_children[0], result);
+
+			// TODO: we should avoid evaluating these expressions
+			//	 depending on the value of result.
+			variable if_true, if_false, test;
+			long value;
+			execute(evaluator, node.f_children[1], if_true);
+			execute(evaluator, node.f_children[2], if_false);
+			test.logic_not(result);
+			test.get(value);
+			if(value == 0) // WARNING: we use logic_not() so this is inverted
+			{
+				result = if_true;
+			}
+			else {
+				result = if_false;
+			}
+		}
+		break;
+
+	case '=':
+		{
+			execute(evaluator, node.f_children[0], result);
+			variable value;
+			execute(evaluator, node.f_children[1], value);
+			std::string name(result.get_name());
+			if(name.empty())
+			{
+				throw expected_a_variable("expected a variable to apply the assignment operator (1)");
+			}
+			evaluator.set(name, value);
+			result = value;
+		}
+		break;
+
+	case TOK_ASSIGN_MUL:
+	case TOK_ASSIGN_DIV:
+	case TOK_ASSIGN_MOD:
+	case TOK_ASSIGN_ADD:
+	case TOK_ASSIGN_SUB:
+	case TOK_ASSIGN_SHL:
+	case TOK_ASSIGN_SHR:
+	case TOK_ASSIGN_AND:
+	case TOK_ASSIGN_XOR:
+	case TOK_ASSIGN_OR:
+		{
+			execute(evaluator, node.f_children[0], result);
+			variable value, old_value, new_value;
+			execute(evaluator, node.f_children[1], value);
+			std::string name(result.get_name());
+			if(name.empty())
+			{
+				throw expected_a_variable("expected a variable to apply the assignment operator (2)");
+			}
+			if(!evaluator.get(name, old_value))
+			{
+				// this should not be reached by coverage tests since
+				// NODE_IDENTIFIER already checked whether the variable existed
+				throw undefined_variable("undefined variable \"" + name + "\" (4)"); // LCOV_EXCL_LINE
+			}
+			switch(node.f_op) {
+			case TOK_ASSIGN_MUL:
+				new_value.mul(old_value, value);
+				break;
+
+			case TOK_ASSIGN_DIV:
+				new_value.div(old_value, value);
+				break;
+
+			case TOK_ASSIGN_MOD:
+				new_value.mod(old_value, value);
+				break;
+
+			case TOK_ASSIGN_ADD:
+				new_value.add(old_value, value);
+				break;
+
+			case TOK_ASSIGN_SUB:
+				new_value.sub(old_value, value);
+				break;
+
+			case TOK_ASSIGN_SHL:
+				new_value.shl(old_value, value);
+				break;
+
+			case TOK_ASSIGN_SHR:
+				new_value.shr(old_value, value);
+				break;
+
+			case TOK_ASSIGN_AND:
+				new_value.bitwise_and(old_value, value);
+				break;
+
+			case TOK_ASSIGN_XOR:
+				new_value.bitwise_xor(old_value, value);
+				break;
+
+			case TOK_ASSIGN_OR:
+				new_value.bitwise_or(old_value, value);
+				break;
+
+			}
+			evaluator.set(name, new_value);
+			result = new_value;
+		}
+		break;
+
+	default:
+		{
+			// all the binary operators
+			execute(evaluator, node.f_children[0], result);
+			variable lhs(result), rhs;
+			execute(evaluator, node.f_children[1], rhs);
+			switch(node.f_op)
+			{
+			case '*':
+				result.mul(lhs, rhs);
+				break;
+
+			case '/':
+				result.div(lhs, rhs);
+				break;
+
+			case '%':
+				result.mod(lhs, rhs);
+				break;
+
+			case '+':
+				result.add(lhs, rhs);
+				break;
+
+			case '-':
+				result.sub(lhs, rhs);
+				break;
+
+			case TOK_SHIFT_LEFT:
+				result.shl(lhs, rhs);
+				break;
+
+			case TOK_SHIFT_RIGHT:
+				result.shr(lhs, rhs);
+				break;
+
+			case '<':
+				result.lt(lhs, rhs);
+				break;
+
+			case TOK_LESS_EQUAL:
+				result.le(lhs, rhs);
+				break;
+
+			case TOK_GREATER_EQUAL:
+				result.ge(lhs, rhs);
+				break;
+
+			case '>':
+				result.gt(lhs, rhs);
+				break;
+
+			case TOK_EQUAL:
+				result.eq(lhs, rhs);
+				break;
+
+			case TOK_NOT_EQUAL:
+				result.ne(lhs, rhs);
+				break;
+
+			case '&':
+				result.bitwise_and(lhs, rhs);
+				break;
+
+			case '^':
+				result.bitwise_xor(lhs, rhs);
+				break;
+
+			case '|':
+				result.bitwise_or(lhs, rhs);
+				break;
+
+			case TOK_LOGIC_AND:
+				result.logic_and(lhs, rhs);
+				break;
+
+			case TOK_LOGIC_XOR:
+				result.logic_xor(lhs, rhs);
+				break;
+
+			case TOK_LOGIC_OR:
+				result.logic_or(lhs, rhs);
+				break;
+
+			default:
+				// LCOV_EXCL_START
+				{
+					std::stringstream msg;
+					msg << "unknown node type " << node.f_op;
+					throw libexpr_runtime_error(msg.str());
+				}
+				// LCOV_EXCL_STOP
+
+			}
+		}
+		break;
+
+	}
+}
+
+
 
 /** \brief Clean up an expression evaluator.
  *
@@ -1517,8 +1725,48 @@ expr_evaluator::~expr_evaluator()
 
 void expr_evaluator::eval(const std::string& expr, variable& result)
 {
+	eval(compile(expr), result);
+}
+
+
+/** \brief Compile an expression.
+ *
+ * This function parses the expression once and returns the result as
+ * a program which can be executed any number of times with the eval()
+ * function. Function names are resolved with find_function() at this
+ * time.
+ *
+ * The program does not depend on the variables of the evaluator, only
+ * on its functions. It can be executed by any evaluator of the same
+ * type and by several threads at the same time.
+ *
+ * \exception syntax_error
+ * The expression is not valid.
+ *
+ * \param[in] expr  The expression to compile.
+ *
+ * \return The compiled expression.
+ */
+expr_evaluator::program_t expr_evaluator::compile(const std::string& expr)
+{
+	std::shared_ptr<compiled_expression> program(new compiled_expression);
 	expression e(*this);
-	e.eval(expr, result);
+	e.compile(expr, *program);
+	return program;
+}
+
+
+/** \brief Execute a compiled expression.
+ *
+ * This function computes the result of an expression compiled with
+ * the compile() function.
+ *
+ * \param[in] program  The compiled expression.
+ * \param[out] result  The variable receiving the result.
+ */
+void expr_evaluator::eval(const program_t& program, variable& result)
+{
+	expression::execute(*this, program->f_root, result);
 }
 
 
@@ -1791,66 +2039,78 @@ void func_time(expr_evaluator::arglist& /*list*/, variable& result)
 {
 	result.set(static_cast<long>(time(NULL)));
 }
-}	// namespace <noname>
 
-void expr_evaluator::call_function(std::string& name, arglist& list, variable& result)
-{
-	struct func_t {
-		const char *	f_name;
-		size_t		f_min;
-		size_t		f_max;
-		void		(*f_func)(arglist& list, variable& result);
-	};
+struct func_t {
+	const char *	f_name;
+	size_t		f_min;
+	size_t		f_max;
+	void		(*f_func)(expr_evaluator::arglist& list, variable& result);
+};
 
-	static const func_t functions[] = {
-		{ "acos",		1, 1, func_acos },
-		{ "acosh",		1, 1, func_acosh },
-		{ "asin",		1, 1, func_asin },
-		{ "asinh",		1, 1, func_asinh },
-		{ "atan",		1, 1, func_atan },
-		{ "atan2",		2, 2, func_atan2 },
-		{ "atanh",		1, 1, func_atanh },
-		{ "ceil",		1, 1, func_ceil },
-		{ "cos",		1, 1, func_cos },
-		{ "cosh",		1, 1, func_cosh },
-		{ "ctime",		1, 1, func_ctime },
-		{ "exp",		1, 1, func_exp },
-		{ "fabs",		1, 1, func_fabs },
-		{ "floor",		1, 1, func_floor },
-		{ "fmod",		2, 2, func_fmod },
-		{ "log",		1, 1, func_log },
-		{ "log10",		1, 1, func_log10 },
-		{ "lrint",		1, 1, func_lrint },
-		{ "pow",		2, 2, func_pow },
-		{ "rint",		1, 1, func_rint },
-		{ "shell",		1, 2, func_shell },
-		{ "sin",		1, 1, func_sin },
-		{ "sinh",		1, 1, func_sinh },
-		{ "sqrt",		1, 1, func_sqrt },
-		{ "strlen",		1, 1, func_strlen },
-		{ "tan",		1, 1, func_tan },
-		{ "tanh",		1, 1, func_tanh },
-		{ "time",		0, 0, func_time }
-	};
+const func_t g_functions[] = {
+	{ "acos",		1, 1, func_acos },
+	{ "acosh",		1, 1, func_acosh },
+	{ "asin",		1, 1, func_asin },
+	{ "asinh",		1, 1, func_asinh },
+	{ "atan",		1, 1, func_atan },
+	{ "atan2",		2, 2, func_atan2 },
+	{ "atanh",		1, 1, func_atanh },
+	{ "ceil",		1, 1, func_ceil },
+	{ "cos",		1, 1, func_cos },
+	{ "cosh",		1, 1, func_cosh },
+	{ "ctime",		1, 1, func_ctime },
+	{ "exp",		1, 1, func_exp },
+	{ "fabs",		1, 1, func_fabs },
+	{ "floor",		1, 1, func_floor },
+	{ "fmod",		2, 2, func_fmod },
+	{ "log",		1, 1, func_log },
+	{ "log10",		1, 1, func_log10 },
+	{ "lrint",		1, 1, func_lrint },
+	{ "pow",		2, 2, func_pow },
+	{ "rint",		1, 1, func_rint },
+	{ "shell",		1, 2, func_shell },
+	{ "sin",		1, 1, func_sin },
+	{ "sinh",		1, 1, func_sinh },
+	{ "sqrt",		1, 1, func_sqrt },
+	{ "strlen",		1, 1, func_strlen },
+	{ "tan",		1, 1, func_tan },
+	{ "tanh",		1, 1, func_tanh },
+	{ "time",		0, 0, func_time }
+};
+
+const int g_functions_count = static_cast<int>(sizeof(g_functions) / sizeof(g_functions[0]));
+}	// namespace <noname>
 
-	// find system functions to execute and call them with arglist
 
+/** \brief Search for a function.
+ *
+ * This function searches the functions that this evaluator supports
+ * and returns its identifier. The compile() function resolves the
+ * function names once with this function so executing the expression
+ * does not have to search for the function again.
+ *
+ * A derived evaluator which adds functions overrides this function and
+ * call_function(int, ...) and returns identifiers starting at
+ * FUNCTION_USER for its own functions. It calls this implementation
+ * for any other name.
+ *
+ * \param[in] name  The name of the function.
+ *
+ * \return The identifier of the function or FUNCTION_UNDEFINED.
+ */
+int expr_evaluator::find_function(const std::string& name) const
+{
 	int i, j, p, r;
 
 	i = 0;
-	j = sizeof(functions) / sizeof(functions[0]);
+	j = g_functions_count;
 	while(i < j) {
 		// get the center position of the current range
 		p = i + (j - i) / 2;
-		r = strcmp(name.c_str(), functions[p].f_name);
+		r = strcmp(name.c_str(), g_functions[p].f_name);
 		if(r == 0) {
-			// found it! verify the number of arguments
-			if(list.size() < functions[p].f_min
-			|| list.size() > functions[p].f_max) {
-				throw function_args("the invalid number of arguments was specified");
-			}
-			(*functions[p].f_func)(list, result);
-			return;
+			// found it!
+			return p;
 		}
 		if(r > 0) {
 			// move the range up (we already checked p so use p + 1)
@@ -1863,9 +2123,56 @@ void expr_evaluator::call_function(std::string& name, arglist& list, variable& r
 		}
 	}
 
-	std::stringstream msg;
-	msg << "cannot call undefined function \"" << name << "\"" << std::endl;
-	throw undefined_function(msg.str());
+	return FUNCTION_UNDEFINED;
+}
+
+
+/** \brief Call a function by identifier.
+ *
+ * This function calls the function with the identifier returned by
+ * find_function().
+ *
+ * \param[in] id  The identifier of the function.
+ * \param[in] list  The list of arguments.
+ * \param[out] result  The variable receiving the result of the function.
+ */
+void expr_evaluator::call_function(int id, arglist& list, variable& result)
+{
+	if(id < 0 || id >= g_functions_count)
+	{
+		std::stringstream msg;
+		msg << "cannot call undefined function #" << id << std::endl;
+		throw undefined_function(msg.str());
+	}
+
+	// verify the number of arguments
+	if(list.size() < g_functions[id].f_min
+	|| list.size() > g_functions[id].f_max) {
+		throw function_args("the invalid number of arguments was specified");
+	}
+	(*g_functions[id].f_func)(list, result);
+}
+
+
+/** \brief Call a function by name.
+ *
+ * This function searches for the function with find_function() and
+ * calls it with call_function(int, ...).
+ *
+ * \param[in] name  The name of the function.
+ * \param[in] list  The list of arguments.
+ * \param[out] result  The variable receiving the result of the function.
+ */
+void expr_evaluator::call_function(std::string& name, arglist& list, variable& result)
+{
+	const int id(find_function(name));
+	if(id == FUNCTION_UNDEFINED)
+	{
+		std::stringstream msg;
+		msg << "cannot call undefined function \"" << name << "\"" << std::endl;
+		throw undefined_function(msg.str());
+	}
+	call_function(id, list, result);
 }
 
 
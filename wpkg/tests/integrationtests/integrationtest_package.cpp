@@ -3348,6 +3348,89 @@ public:
         verify_installed_files("t5");
     }
 
+    void auto_remove_shared_dependencies()
+    {
+        // IMPORTANT: remember that all files are deleted between tests
+
+        wpkg_filename::uri_filename root(wpkg_tools::get_tmp_dir());
+        wpkg_filename::uri_filename target_path(root.append_child("target"));
+        wpkg_filename::uri_filename repository(root.append_child("repository"));
+
+        // auto-remove only removes the implicit packages that no live
+        // package needs anymore, directly or not:
+        //
+        //      create t1
+        //      create t2 which depends on t1
+        //      create t3 which depends on t1
+        //      create t4 which depends on t2
+        //      create t5 which depends on t3
+        //      install t4 which auto-installs t2 and t1
+        //      install t5 which auto-installs t3
+        //      remove t4
+        //      auto-remove, t2 is auto-removed, t1 is kept for t3
+        //      explicitly install t1
+        //      remove t5
+        //      auto-remove, t3 is auto-removed, t1 is kept since it
+        //      now is explicit
+        //
+
+        std::shared_ptr<wpkg_control::control_file> ctrl[6];
+        for(int i(1); i <= 5; ++i)
+        {
+            const std::string name("t" + std::to_string(i));
+            ctrl[i] = get_new_control_file(__FUNCTION__ + (" " + name));
+            ctrl[i]->set_field("Files", "conffiles\n"
+                    "/usr/bin/" + name + " 0123456789abcdef0123456789abcdef\n"
+                    "/usr/share/doc/" + name + "/copyright 0123456789abcdef0123456789abcdef\n"
+                    );
+            ctrl[i]->set_variable("INSTALL_PREOPTIONS", "--repository " + wpkg_util::make_safe_console_string(repository.path_only()));
+        }
+        ctrl[2]->set_field("Depends", "t1");
+        ctrl[3]->set_field("Depends", "t1");
+        ctrl[4]->set_field("Depends", "t2");
+        ctrl[5]->set_field("Depends", "t3");
+        for(int i(1); i <= 5; ++i)
+        {
+            create_package("t" + std::to_string(i), ctrl[i]);
+        }
+
+        auto autoremove = [&]()
+            {
+                std::string cmd(wpkg_tools::get_wpkg_tool());
+                cmd += " --root " + wpkg_util::make_safe_console_string(target_path.path_only());
+                cmd += " --autoremove ";
+                printf("Auto-Remove Command: \"%s\"\n", cmd.c_str());
+                fflush(stdout);
+                CATCH_REQUIRE(execute_cmd(cmd.c_str()) == 0);
+            };
+
+        install_package("t4", ctrl[4], 0);
+        install_package("t5", ctrl[5], 0);
+        for(int i(1); i <= 5; ++i)
+        {
+            verify_installed_files("t" + std::to_string(i));
+        }
+
+        // t1 is still needed by t3 (itself needed by t5)
+        remove_package("t4", ctrl[4]);
+        autoremove();
+        verify_installed_files("t1");
+        verify_removed_files("t2", ctrl[2]);
+        verify_installed_files("t3");
+        verify_removed_files("t4", ctrl[4]);
+        verify_installed_files("t5");
+
+        // once explicitly installed, t1 is not auto-removed anymore
+        install_package("t1", ctrl[1], 0);
+        remove_package("t5", ctrl[5]);
+        autoremove();
+        verify_installed_files("t1");
+        verify_removed_files("t2", ctrl[2]);
+        verify_removed_files("t3", ctrl[3]);
+        verify_removed_files("t4", ctrl[4]);
+        verify_removed_files("t5", ctrl[5]);
+    }
+
     void scripts_selection()
     {
         // IMPORTANT: remember that all files are deleted between tests
@@ -4271,6 +4354,19 @@ CATCH_TEST_CASE("PackageTests::auto_remove_with_spaces","PackageTests")
     test.auto_remove();
 }
 
+CATCH_TEST_CASE("PackageTests::auto_remove_shared_dependencies","PackageTests")
+{
+    PackageTests test;
+    test.auto_remove_shared_dependencies();
+}
+
+CATCH_TEST_CASE("PackageTests::auto_remove_shared_dependencies_with_spaces","PackageTests")
+{
+    PackageTests test;
+    raii_tmp_dir_with_space add_spaces;
+    test.auto_remove_shared_dependencies();
+}
+
 
 CATCH_TEST_CASE("PackageTests::scripts_selection","PackageTests")
 {
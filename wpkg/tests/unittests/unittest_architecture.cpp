@@ -678,5 +678,50 @@ CATCH_TEST_CASE( "ArchitectureUnitTests::verify_architecture", "ArchitectureUnit
 
 
 
+CATCH_TEST_CASE( "ArchitectureUnitTests::match_patterns", "ArchitectureUnitTests" )
+{
+    struct match_t
+    {
+        char const *    f_architecture;
+        char const *    f_pattern;
+        bool            f_match;
+        bool            f_match_ignoring_vendor;
+    };
+    match_t const matches[] =
+    {
+        { "linux-amd64",            "any-amd64",            true,   true  },
+        { "linux-amd64",            "linux-any",            true,   true  },
+        { "linux-amd64",            "any-i386",             false,  false },
+        { "linux-amd64",            "mswindows-any",        false,  false },
+        { "win64",                  "mswindows-amd64",      true,   true  },
+        { "linux-m2osw-amd64",      "linux-amd64",          true,   true  },
+        { "linux-m2osw-amd64",      "linux-foo-amd64",      false,  true  },
+        { "linux-m2osw-amd64",      "linux-m2osw-any",      true,   true  },
+        { "linux-m2osw-amd64",      "linux-foo-any",        false,  true  },
+        { "linux-m2osw-amd64",      "any-any-amd64",        true,   true  },
+        { "linux-i686",             "linux-i386",           true,   true  },
+        { "all",                    "linux-amd64",          false,  false },
+        { "source",                 "all",                  false,  false },
+    };
+
+    for(size_t i(0); i < sizeof(matches) / sizeof(matches[0]); ++i)
+    {
+        wpkg_architecture::architecture const arch(matches[i].f_architecture);
+        wpkg_architecture::architecture const pattern(matches[i].f_pattern);
+        CATCH_REQUIRE(arch.match(pattern, false) == matches[i].f_match);
+        CATCH_REQUIRE(pattern.match(arch, false) == matches[i].f_match);
+        CATCH_REQUIRE(arch.match(pattern, true) == matches[i].f_match_ignoring_vendor);
+        CATCH_REQUIRE((arch == pattern) == matches[i].f_match);
+    }
+
+    CATCH_REQUIRE(wpkg_architecture::architecture("source").is_source());
+    CATCH_REQUIRE(wpkg_architecture::architecture("any-any-i386").is_pattern());
+    CATCH_REQUIRE(!wpkg_architecture::architecture("linux-all-i386").is_pattern());
+    CATCH_REQUIRE(wpkg_architecture::architecture().empty());
+    CATCH_REQUIRE(!wpkg_architecture::architecture("all").empty());
+}
+
+
+
 
 // vim: ts=4 sw=4 et
@@ -263,4 +263,80 @@ CATCH_TEST_CASE( "ControlUnitTests::all_files_field", "ControlUnitTests" )
 
 
 
+CATCH_TEST_CASE( "ControlUnitTests::field_lookup", "ControlUnitTests" )
+{
+    std::shared_ptr<wpkg_control::control_file> ctrl(new wpkg_control::binary_control_file(std::shared_ptr<wpkg_control::control_file::control_file_state_t>(new wpkg_control::control_file::build_control_file_state_t)));
+
+    // factory fields are interned on registration, case insensitively
+    CATCH_REQUIRE(wpkg_field::field_file::find_field_id("Package", 7) != wpkg_field::field_file::FIELD_ID_UNDEFINED);
+    CATCH_REQUIRE(wpkg_field::field_file::find_field_id("pACKAGE", 7) == wpkg_field::field_file::find_field_id("Package", 7));
+    CATCH_REQUIRE(wpkg_field::field_file::find_field_id("Package/t1", 7) == wpkg_field::field_file::find_field_id("Package", 7));
+
+    ctrl->set_field("Version", "1.2.3");
+    ctrl->set_field("Depends", "t2");
+    ctrl->set_field("X-Unit-Test", "yes");
+    CATCH_REQUIRE(ctrl->number_of_fields() == 3);
+    CATCH_REQUIRE(ctrl->field_is_defined("version"));
+    CATCH_REQUIRE(ctrl->get_field("VERSION") == "1.2.3");
+    CATCH_REQUIRE(ctrl->get_field("x-unit-test") == "yes");
+    CATCH_REQUIRE(!ctrl->field_is_defined("Essential"));
+
+    // sub-package names fall back to the default field
+    CATCH_REQUIRE(ctrl->field_is_defined("Depends/t1"));
+    CATCH_REQUIRE(!ctrl->field_is_defined("Depends/t1", true));
+    CATCH_REQUIRE(ctrl->get_field("Depends/t1") == "t2");
+    ctrl->set_field("Depends/t1", "t3");
+    CATCH_REQUIRE(ctrl->get_field("Depends/t1") == "t3");
+    CATCH_REQUIRE(ctrl->get_field("Depends") == "t2");
+
+    // unknown base names get interned, sub-package names do not
+    CATCH_REQUIRE(wpkg_field::field_file::find_field_id("x-unit-TEST", 11) != wpkg_field::field_file::FIELD_ID_UNDEFINED);
+    CATCH_REQUIRE(wpkg_field::field_file::find_field_id("Depends/t1", 10) == wpkg_field::field_file::FIELD_ID_UNDEFINED);
+    CATCH_REQUIRE(ctrl->field_is_defined("DEPENDS/T1", true));
+    CATCH_REQUIRE(!ctrl->field_is_defined("Depends/t2", true));
+
+    // names are returned sorted
+    CATCH_REQUIRE(ctrl->number_of_fields() == 4);
+    CATCH_REQUIRE(ctrl->get_field_name(0) == "Depends");
+    CATCH_REQUIRE(ctrl->get_field_name(1) == "Depends/t1");
+    CATCH_REQUIRE(ctrl->get_field_name(2) == "Version");
+    CATCH_REQUIRE(ctrl->get_field_name(3) == "X-Unit-Test");
+    CATCH_REQUIRE_THROWS_AS(ctrl->get_field_name(4), std::overflow_error);
+
+    CATCH_REQUIRE(ctrl->delete_field("depends"));
+    CATCH_REQUIRE(!ctrl->delete_field("Depends"));
+    CATCH_REQUIRE(ctrl->number_of_fields() == 3);
+    CATCH_REQUIRE(!ctrl->field_is_defined("Depends"));
+    CATCH_REQUIRE(ctrl->get_field("Depends/t1") == "t3");
+    CATCH_REQUIRE(ctrl->get_field("X-Unit-Test") == "yes");
+    CATCH_REQUIRE(ctrl->get_field_name(0) == "Depends/t1");
+    CATCH_REQUIRE(ctrl->get_field_name(2) == "X-Unit-Test");
+}
+
+
+CATCH_TEST_CASE( "ControlUnitTests::field_substitution", "ControlUnitTests" )
+{
+    std::shared_ptr<wpkg_control::control_file> ctrl(new wpkg_control::binary_control_file(std::shared_ptr<wpkg_control::control_file::control_file_state_t>(new wpkg_control::control_file::build_control_file_state_t)));
+
+    ctrl->set_variable("name", "t1");
+    ctrl->set_field("Description", "Package ${V:name} for $(1 + 2) tests");
+    CATCH_REQUIRE(ctrl->get_field("Description") == "Package t1 for 3 tests");
+    CATCH_REQUIRE(ctrl->get_field("Description") == "Package t1 for 3 tests");
+
+    // the cached value gets recomputed when a variable changes
+    ctrl->set_variable("name", "t2");
+    CATCH_REQUIRE(ctrl->get_field("Description") == "Package t2 for 3 tests");
+
+    // or when a field it references changes
+    ctrl->set_field("Homepage", "http://www.example.com/");
+    ctrl->set_field("X-Reference", "see ${F:Homepage}");
+    CATCH_REQUIRE(ctrl->get_field("X-Reference") == "see http://www.example.com/");
+    ctrl->get_field_info("Homepage")->set_value("http://www.example.org/");
+    CATCH_REQUIRE(ctrl->get_field("X-Reference") == "see http://www.example.org/");
+    CATCH_REQUIRE(ctrl->delete_variable("name"));
+    ctrl->set_variable("name", "t3");
+    CATCH_REQUIRE(ctrl->get_field_info("Description")->get_transformed_value() == "Package t3 for 3 tests");
+}
+
+
 // vim: ts=4 sw=4 et
@@ -801,4 +801,34 @@ CATCH_TEST_CASE("ExprUnitTests::misc","ExprUnitTests")
 
 }
 
+CATCH_TEST_CASE("ExprUnitTests::compiled","ExprUnitTests")
+{
+    libexpr::expr_evaluator e;
+    libexpr::expr_evaluator::program_t program(e.compile("a * 3 + strlen(s)"));
+
+    // the same program is reused with different variable values
+    for(long i(0); i < 10; ++i)
+    {
+        libexpr::variable a;
+        a.set(i);
+        e.set("a", a);
+        libexpr::variable s;
+        s.set(std::string(static_cast<size_t>(i), 'x'));
+        e.set("s", s);
+
+        libexpr::variable result;
+        e.eval(program, result);
+        long value;
+        result.get(value);
+        CATCH_REQUIRE(value == i * 4);
+    }
+
+    // built-in functions resolve to an identifier
+    CATCH_REQUIRE(e.find_function("strlen") != libexpr::expr_evaluator::FUNCTION_UNDEFINED);
+    CATCH_REQUIRE(e.find_function("unknown_function") == libexpr::expr_evaluator::FUNCTION_UNDEFINED);
+
+    // syntax errors are detected at compile time
+    CATCH_REQUIRE_THROWS_AS(e.compile("(a = 5, a++"), libexpr::syntax_error);
+}
+
 // vim: ts=4 sw=4 et
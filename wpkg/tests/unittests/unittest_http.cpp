@@ -0,0 +1,757 @@
+/*    unittest_http.cpp
+ *    Copyright (C) 2012-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+
+#include "unittest_main.h"
+#include "libdebpackages/wpkg_http.h"
+#include "libdebpackages/wpkg_verify.h"
+#include "libdebpackages/wpkgar_download_cache.h"
+#include "libdebpackages/wpkgar_exception.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <catch.hpp>
+#if !defined(MO_WINDOWS)
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+
+namespace
+{
+
+/** \brief A small HTTP server used to test the client.
+ *
+ * The server listens on the loopback interface and answers a few
+ * hard coded paths. Each connection is served by its own thread so
+ * the client can keep several connections open.
+ */
+class http_stand_in
+{
+public:
+    http_stand_in()
+        : f_connections(0)
+        , f_requests(0)
+        , f_changing(0)
+        , f_stop(false)
+    {
+        for(int port(48300); port < 48400 && !f_server; ++port)
+        {
+            try
+            {
+                f_server.reset(new tcp_client_server::tcp_server("127.0.0.1", port, -1, true));
+            }
+            catch(const std::runtime_error&)
+            {
+                // port in use, try the next one
+            }
+        }
+        CATCH_REQUIRE(f_server);
+        f_thread = std::thread(&http_stand_in::run, this);
+    }
+
+    ~http_stand_in()
+    {
+        f_stop = true;
+        {
+            // wake up accept()
+            tcp_client_server::tcp_client wakeup("127.0.0.1", get_port());
+        }
+        f_thread.join();
+        std::lock_guard<std::mutex> lock(f_mutex);
+        for(size_t i(0); i < f_workers.size(); ++i)
+        {
+            f_workers[i].join();
+        }
+    }
+
+    int get_port() const
+    {
+        return f_server->get_port();
+    }
+
+    int get_connections() const
+    {
+        return f_connections;
+    }
+
+    int get_requests() const
+    {
+        return f_requests;
+    }
+
+private:
+    void run()
+    {
+        for(;;)
+        {
+            tcp_client_server::socket_t s(f_server->accept());
+            if(f_stop)
+            {
+                close_socket(s);
+                break;
+            }
+            ++f_connections;
+            std::lock_guard<std::mutex> lock(f_mutex);
+            f_workers.push_back(std::thread(&http_stand_in::serve, this, s));
+        }
+    }
+
+    void serve(tcp_client_server::socket_t s)
+    {
+        std::string input;
+        for(;;)
+        {
+            std::string::size_type end(input.find("\r\n\r\n"));
+            if(end == std::string::npos)
+            {
+                char buf[1024];
+                const int sz(static_cast<int>(::recv(s, buf, sizeof(buf), 0)));
+                if(sz <= 0)
+                {
+                    break;
+                }
+                input.append(buf, sz);
+                continue;
+            }
+            const std::string request(input.substr(0, end));
+            input.erase(0, end + 4);
+            ++f_requests;
+
+            const std::string::size_type space1(request.find(' '));
+            const std::string::size_type space2(request.find(' ', space1 + 1));
+            const std::string method(request.substr(0, space1));
+            const std::string path(request.substr(space1 + 1, space2 - space1 - 1));
+            bool close(false);
+            const std::string response(response_for(method, path, get_range(request), get_if_range(request), close));
+            if(::send(s, response.c_str(), response.length(), 0) != static_cast<int>(response.length()) || close)
+            {
+                break;
+            }
+        }
+        close_socket(s);
+    }
+
+    static int get_range(const std::string& request)
+    {
+        const std::string::size_type pos(request.find("\r\nRange: bytes="));
+        if(pos == std::string::npos)
+        {
+            return 0;
+        }
+        return atoi(request.c_str() + pos + 15);
+    }
+
+    static std::string get_if_range(const std::string& request)
+    {
+        const std::string::size_type pos(request.find("\r\nIf-Range: "));
+        if(pos == std::string::npos)
+        {
+            return std::string();
+        }
+        const std::string::size_type end(request.find("\r\n", pos + 2));
+        return request.substr(pos + 12, end == std::string::npos ? std::string::npos : end - pos - 12);
+    }
+
+public:
+    static std::string big_body(int start, int size)
+    {
+        std::string body(size, ' ');
+        for(int i(0); i < size; ++i)
+        {
+            body[i] = static_cast<char>((start + i) % 251);
+        }
+        return body;
+    }
+
+private:
+    std::string response_for(const std::string& method, const std::string& path, int range, const std::string& if_range, bool& close)
+    {
+        char port[16];
+        snprintf(port, sizeof(port), "%d", get_port());
+        if(path == "/changing")
+        {
+            // the file changes after the first request, which gets
+            // dropped after 1,000 bytes; the Range is honored unless
+            // the If-Range does not match
+            const int n(++f_changing);
+            const std::string etag(n == 1 ? "\"v1\"" : "\"v2\"");
+            const int start(n == 1 ? 0 : 7);
+            char header[256];
+            if(range > 0 && (if_range.empty() || if_range == etag))
+            {
+                snprintf(header, sizeof(header), "HTTP/1.1 206 Partial Content\r\nETag: %s\r\nContent-Range: bytes %d-199999/200000\r\nContent-Length: %d\r\n\r\n", etag.c_str(), range, 200000 - range);
+                return header + big_body(start + range, 200000 - range);
+            }
+            snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nETag: %s\r\nContent-Length: 200000\r\n\r\n", etag.c_str());
+            close = n == 1;
+            return header + big_body(start, n == 1 ? 1000 : 200000);
+        }
+        if(path == "/flaky" || path == "/broken")
+        {
+            // /flaky drops the first connection after 50,000 bytes
+            // /broken drops each connection after 1,000 bytes
+            close = true;
+            const int sent(path == "/flaky" ? (range == 0 ? 50000 : 200000 - range) : 1000);
+            char header[256];
+            if(range == 0)
+            {
+                snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: 200000\r\n\r\n");
+            }
+            else
+            {
+                snprintf(header, sizeof(header), "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %d-199999/200000\r\nContent-Length: %d\r\n\r\n", range, 200000 - range);
+            }
+            return header + big_body(range, std::min(sent, 200000 - range));
+        }
+        if(path == "/length")
+        {
+            return "HTTP/1.1 200 OK\r\nContent-Length: 11\r\nX-Test: a\r\nx-test:   b  \r\n\r\nhello world";
+        }
+        if(path == "/chunked")
+        {
+            return "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nchunk\r\n7;ext=1\r\ned body\r\n0\r\nTrailer: x\r\n\r\n";
+        }
+        if(path == "/big")
+        {
+            return "HTTP/1.1 200 OK\r\nContent-Length: 200000\r\n\r\n" + big_body(0, 200000);
+        }
+        if(path == "/head" && method == "HEAD")
+        {
+            return "HTTP/1.1 200 OK\r\nContent-Length: 1000\r\n\r\n";
+        }
+        if(path == "/redirect")
+        {
+            return std::string("HTTP/1.1 302 Found\r\nLocation: http://127.0.0.1:") + port + "/length\r\nContent-Length: 9\r\n\r\nredirect!";
+        }
+        if(path == "/close")
+        {
+            close = true;
+            return "HTTP/1.0 200 OK\r\n\r\nuntil closed";
+        }
+        return "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    }
+
+    static void close_socket(tcp_client_server::socket_t s)
+    {
+#if defined(MO_WINDOWS)
+        closesocket(s);
+#else
+        close(s);
+#endif
+    }
+
+    std::shared_ptr<tcp_client_server::tcp_server>  f_server;
+    std::thread                                     f_thread;
+    std::mutex                                      f_mutex;
+    std::vector<std::thread>                        f_workers;
+    std::atomic<int>                                f_connections;
+    std::atomic<int>                                f_requests;
+    std::atomic<int>                                f_changing;
+    std::atomic<bool>                               f_stop;
+};
+
+
+std::string body_to_string(const memfile::memory_file& body)
+{
+    std::string result(body.size(), ' ');
+    if(body.size() > 0)
+    {
+        body.read(&result[0], 0, body.size());
+    }
+    return result;
+}
+
+} // no name namespace
+
+
+CATCH_TEST_CASE("HttpUnitTests::keep_alive","HttpUnitTests")
+{
+    http_stand_in server;
+    {
+        wpkg_http::http_client client("127.0.0.1", server.get_port());
+
+        // Content-Length and fields
+        wpkg_http::http_response response;
+        memfile::memory_file body;
+        client.request(wpkg_http::http_request("/length"), response, body);
+        CATCH_REQUIRE(response.get_status() == 200);
+        CATCH_REQUIRE(response.get_protocol() == "HTTP/1.1");
+        CATCH_REQUIRE(response.get_content_length() == 11);
+        CATCH_REQUIRE(response.get_field("x-TEST") == "a, b");
+        CATCH_REQUIRE(body_to_string(body) == "hello world");
+        CATCH_REQUIRE(client.is_connected());
+
+        // chunked transfer encoding
+        client.request(wpkg_http::http_request("/chunked"), response, body);
+        CATCH_REQUIRE(response.get_status() == 200);
+        CATCH_REQUIRE(body_to_string(body) == "chunked body");
+
+        // a body larger than the input buffer
+        client.request(wpkg_http::http_request("/big"), response, body);
+        CATCH_REQUIRE(body.size() == 200000);
+        std::string big(body_to_string(body));
+        bool valid(true);
+        for(size_t i(0); i < big.length(); ++i)
+        {
+            valid = valid && big[i] == static_cast<char>(i % 251);
+        }
+        CATCH_REQUIRE(valid);
+
+        // several requests sent before reading the responses
+        client.send(wpkg_http::http_request("/length"));
+        client.send(wpkg_http::http_request("/head", "HEAD"));
+        client.send(wpkg_http::http_request("/chunked"));
+        client.send(wpkg_http::http_request("/missing"));
+        CATCH_REQUIRE(client.get_pending() == 4);
+        client.receive(response, body);
+        CATCH_REQUIRE(body_to_string(body) == "hello world");
+        client.receive(response, body);
+        CATCH_REQUIRE(response.get_content_length() == 1000);
+        CATCH_REQUIRE(body.size() == 0);
+        client.receive(response, body);
+        CATCH_REQUIRE(body_to_string(body) == "chunked body");
+        client.receive(response, body);
+        CATCH_REQUIRE(response.get_status() == 404);
+        CATCH_REQUIRE(body.size() == 0);
+        CATCH_REQUIRE(client.get_pending() == 0);
+
+        // all of that used a single connection
+        CATCH_REQUIRE(server.get_connections() == 1);
+        CATCH_REQUIRE(server.get_requests() == 7);
+
+        // a body which ends when the server closes the connection
+        client.request(wpkg_http::http_request("/close"), response, body);
+        CATCH_REQUIRE(response.get_protocol() == "HTTP/1.0");
+        CATCH_REQUIRE(body_to_string(body) == "until closed");
+        CATCH_REQUIRE(!client.is_connected());
+
+        // the next request opens a new connection
+        client.request(wpkg_http::http_request("/length"), response, body);
+        CATCH_REQUIRE(body_to_string(body) == "hello world");
+        CATCH_REQUIRE(server.get_connections() == 2);
+    }
+}
+
+
+CATCH_TEST_CASE("HttpUnitTests::read_file","HttpUnitTests")
+{
+    http_stand_in server;
+    {
+        char port[16];
+        snprintf(port, sizeof(port), "%d", server.get_port());
+        const std::string base(std::string("http://127.0.0.1:") + port);
+
+        memfile::memory_file file;
+        memfile::memory_file::file_info info;
+        file.read_file(base + "/big", &info);
+        CATCH_REQUIRE(file.size() == 200000);
+        CATCH_REQUIRE(info.get_size() == 200000);
+
+        // redirects follow the Location field
+        file.read_file(base + "/redirect");
+        CATCH_REQUIRE(body_to_string(file) == "hello world");
+
+        CATCH_REQUIRE_THROWS_AS(file.read_file(base + "/missing"), memfile::memfile_exception_io);
+
+        // the pool kept the connection alive between files
+        CATCH_REQUIRE(server.get_connections() == 1);
+        CATCH_REQUIRE(server.get_requests() == 4);
+
+        // close the idle connections before the server stops
+        wpkg_http::http_pool::instance().clear();
+    }
+}
+
+
+CATCH_TEST_CASE("HttpUnitTests::md5sums_verifier","HttpUnitTests")
+{
+    http_stand_in server;
+    {
+        char port[16];
+        snprintf(port, sizeof(port), "%d", server.get_port());
+        const std::string base(std::string("http://127.0.0.1:") + port);
+
+        const std::string body(http_stand_in::big_body(0, 200000));
+        memfile::memory_file big;
+        big.create(memfile::memory_file::file_format_other);
+        big.write(body.c_str(), 0, static_cast<int>(body.length()));
+        const std::string big_md5sum(big.md5sum());
+
+        // remote files cannot be streamed, the verifier loads them
+        wpkg_verify::md5sums_verifier verifier;
+        verifier.add_file(base + "/big", big_md5sum);
+        verifier.add_file(base + "/length", big_md5sum);
+        verifier.add_file(base + "/missing", big_md5sum);
+        verifier.run();
+        CATCH_REQUIRE(verifier.size() == 3);
+        CATCH_REQUIRE(verifier.get_entry(0).get_status() == wpkg_verify::md5sums_verifier::verify_status_valid);
+        CATCH_REQUIRE(verifier.get_entry(1).get_status() == wpkg_verify::md5sums_verifier::verify_status_invalid);
+        CATCH_REQUIRE(verifier.get_entry(2).get_status() == wpkg_verify::md5sums_verifier::verify_status_error);
+        CATCH_REQUIRE(wpkg_verify::md5sums_verifier::file_md5sum(base + "/big") == big_md5sum);
+
+        // close the idle connections before the server stops
+        wpkg_http::http_pool::instance().clear();
+    }
+}
+
+
+CATCH_TEST_CASE("HttpUnitTests::download_cache","HttpUnitTests")
+{
+    http_stand_in server;
+    {
+        char port[16];
+        snprintf(port, sizeof(port), "%d", server.get_port());
+        const std::string base(std::string("http://127.0.0.1:") + port);
+
+        wpkg_filename::uri_filename cache_path(wpkg_filename::uri_filename(test_common::wpkg_tools::get_tmp_dir()).append_child("download-cache"));
+        cache_path.os_unlink_rf();
+
+        wpkgar::wpkgar_download_cache cache(cache_path);
+        memfile::memory_file file;
+
+        // without expectations the file is downloaded each time
+        cache.read_file(base + "/big", file);
+        CATCH_REQUIRE(file.size() == 200000);
+        CATCH_REQUIRE(cache.is_cached(base + "/big"));
+        const std::string md5sum(file.md5sum());
+        cache.read_file(base + "/big", file);
+        CATCH_REQUIRE(server.get_requests() == 2);
+
+        // with a matching expectation the cached copy is used
+        cache.set_expected(base + "/big", md5sum, 200000);
+        cache.read_file(base + "/big", file);
+        CATCH_REQUIRE(file.size() == 200000);
+        CATCH_REQUIRE(file.md5sum() == md5sum);
+        CATCH_REQUIRE(server.get_requests() == 2);
+
+        // unless a refresh is requested
+        cache.read_file(base + "/big", file, true);
+        CATCH_REQUIRE(server.get_requests() == 3);
+
+        // a cached copy with a matching md5sum but another sha256sum is
+        // not used and the download is refused
+        const std::string sha256sum(file.sha256sum());
+        cache.set_expected(base + "/big", md5sum, 200000, std::string(64, '0'));
+        CATCH_REQUIRE_THROWS_AS(cache.read_file(base + "/big", file), wpkgar::wpkgar_exception_invalid);
+        CATCH_REQUIRE(server.get_requests() == 4);
+        CATCH_REQUIRE(!cache.is_cached(base + "/big"));
+
+        // with the right sha256sum it gets downloaded and cached again
+        cache.set_expected(base + "/big", md5sum, 200000, sha256sum);
+        cache.read_file(base + "/big", file);
+        CATCH_REQUIRE(server.get_requests() == 5);
+        cache.read_file(base + "/big", file);
+        CATCH_REQUIRE(file.sha256sum() == sha256sum);
+        CATCH_REQUIRE(server.get_requests() == 5);
+
+        // a download which does not match the expectation is refused
+        cache.set_expected(base + "/length", "0123456789abcdef0123456789abcdef", 11);
+        CATCH_REQUIRE_THROWS_AS(cache.read_file(base + "/length", file), wpkgar::wpkgar_exception_invalid);
+        CATCH_REQUIRE(!cache.is_cached(base + "/length"));
+
+        // a new cache object reads the index saved by the first one
+        {
+            wpkgar::wpkgar_download_cache offline(cache_path);
+            offline.set_offline(true);
+            offline.read_file(base + "/big", file);
+            CATCH_REQUIRE(file.md5sum() == md5sum);
+            CATCH_REQUIRE_THROWS_AS(offline.read_file(base + "/chunked", file), wpkgar::wpkgar_exception_io);
+            CATCH_REQUIRE(server.get_requests() == 6);
+        }
+
+        // the least recently used file gets evicted
+        cache.set_max_size(200010);
+        cache.read_file(base + "/chunked", file);
+        CATCH_REQUIRE(cache.is_cached(base + "/chunked"));
+        CATCH_REQUIRE(!cache.is_cached(base + "/big"));
+        CATCH_REQUIRE(cache.get_total_size() == 12);
+
+        cache.clear();
+        CATCH_REQUIRE(cache.get_total_size() == 0);
+        CATCH_REQUIRE(!cache.is_cached(base + "/chunked"));
+
+        // close the idle connections before the server stops
+        wpkg_http::http_pool::instance().clear();
+    }
+}
+
+
+CATCH_TEST_CASE("HttpUnitTests::shared_download_cache","HttpUnitTests")
+{
+    http_stand_in server;
+    {
+        char port[16];
+        snprintf(port, sizeof(port), "%d", server.get_port());
+        const std::string base(std::string("http://127.0.0.1:") + port);
+
+        wpkg_filename::uri_filename cache_path(wpkg_filename::uri_filename(test_common::wpkg_tools::get_tmp_dir()).append_child("shared-cache"));
+        cache_path.os_unlink_rf();
+
+        memfile::memory_file file;
+        std::string big_md5sum;
+        {
+            // two processes using the same cache; b reads the (empty)
+            // index before a saves its file
+            wpkgar::wpkgar_download_cache a(cache_path);
+            wpkgar::wpkgar_download_cache b(cache_path);
+            CATCH_REQUIRE(!b.is_cached(base + "/big"));
+            a.read_file(base + "/big", file);
+            big_md5sum = file.md5sum();
+            b.read_file(base + "/chunked", file);
+            CATCH_REQUIRE(b.is_cached(base + "/big"));
+        }
+        {
+            // the index includes the files of both
+            wpkgar::wpkgar_download_cache c(cache_path);
+            CATCH_REQUIRE(c.is_cached(base + "/big"));
+            CATCH_REQUIRE(c.is_cached(base + "/chunked"));
+            CATCH_REQUIRE(c.get_total_size() == 200012);
+
+            // the data of a dropped connection counts in the total size
+            c.set_expected(base + "/broken", big_md5sum, 200000);
+            CATCH_REQUIRE_THROWS_AS(c.read_file(base + "/broken", file), memfile::memfile_exception_io);
+            CATCH_REQUIRE(!c.is_cached(base + "/broken"));
+            const int64_t part_size(1000 * memfile::memory_file::HTTP_RESUME_ATTEMPTS);
+            CATCH_REQUIRE(c.get_total_size() == 200012 + part_size);
+
+            // and it gets evicted first
+            c.set_max_size(200000 + 12 + 11);
+            c.read_file(base + "/length", file);
+            CATCH_REQUIRE(c.get_total_size() == 200000 + 12 + 11);
+            CATCH_REQUIRE(c.is_cached(base + "/big"));
+            CATCH_REQUIRE(c.is_cached(base + "/chunked"));
+            CATCH_REQUIRE(c.is_cached(base + "/length"));
+
+            // then the least recently used file
+            c.set_max_size(200000 + 11);
+            c.read_file(base + "/chunked", file);
+            CATCH_REQUIRE(!c.is_cached(base + "/big"));
+            CATCH_REQUIRE(c.get_total_size() == 12 + 11);
+
+            // clear() also removes the partial downloads
+            CATCH_REQUIRE_THROWS_AS(c.read_file(base + "/broken", file), memfile::memfile_exception_io);
+            CATCH_REQUIRE(c.get_total_size() == 12 + 11 + part_size);
+            c.clear();
+            CATCH_REQUIRE(c.get_total_size() == 0);
+        }
+        {
+            // both store the same file at the same time; the threads
+            // do not use Catch, the results are checked after join()
+            wpkgar::wpkgar_download_cache a(cache_path);
+            wpkgar::wpkgar_download_cache b(cache_path);
+            std::atomic<int> stored(0);
+            std::vector<std::thread> threads;
+            threads.push_back(std::thread([&a, &base, &stored]()
+                {
+                    try
+                    {
+                        memfile::memory_file data;
+                        a.read_file(base + "/big", data);
+                        stored += data.size() == 200000 ? 1 : 0;
+                    }
+                    catch(const std::exception&)
+                    {
+                    }
+                }));
+            threads.push_back(std::thread([&b, &base, &stored]()
+                {
+                    try
+                    {
+                        memfile::memory_file data;
+                        b.read_file(base + "/big", data);
+                        stored += data.size() == 200000 ? 1 : 0;
+                    }
+                    catch(const std::exception&)
+                    {
+                    }
+                }));
+            for(size_t i(0); i < threads.size(); ++i)
+            {
+                threads[i].join();
+            }
+            CATCH_REQUIRE(stored == 2);
+
+            wpkgar::wpkgar_download_cache c(cache_path);
+            CATCH_REQUIRE(c.is_cached(base + "/big"));
+            CATCH_REQUIRE(c.get_total_size() == 200000);
+            c.read_file(base + "/big", file);
+            CATCH_REQUIRE(file.md5sum() == big_md5sum);
+
+            // no temporary file was left behind
+            memfile::memory_file dir;
+            dir.dir_rewind(cache_path, false);
+            memfile::memory_file::file_info info;
+            while(dir.dir_next(info))
+            {
+                const std::string name(info.get_basename());
+                CATCH_REQUIRE(name.find(".tmp") == std::string::npos);
+            }
+        }
+
+        // close the idle connections before the server stops
+        wpkg_http::http_pool::instance().clear();
+    }
+}
+
+
+CATCH_TEST_CASE("HttpUnitTests::stale_partial_download","HttpUnitTests")
+{
+    http_stand_in server;
+    {
+        char port[16];
+        snprintf(port, sizeof(port), "%d", server.get_port());
+        const std::string base(std::string("http://127.0.0.1:") + port);
+
+        wpkg_filename::uri_filename cache_path(wpkg_filename::uri_filename(test_common::wpkg_tools::get_tmp_dir()).append_child("stale-cache"));
+        cache_path.os_unlink_rf();
+
+        // a partial file saved from an older version of the file
+        const std::string uri(base + "/changing");
+        md5::md5sum key;
+        key.push_back(reinterpret_cast<const uint8_t *>(uri.c_str()), uri.length());
+        const wpkg_filename::uri_filename partial(cache_path.append_child(key.sum() + ".part"));
+        memfile::memory_file old;
+        old.create(memfile::memory_file::file_format_other);
+        const std::string old_data(http_stand_in::big_body(0, 1000));
+        old.write(old_data.c_str(), 0, static_cast<int>(old_data.length()));
+        old.write_file(partial, true);
+
+        memfile::memory_file expected;
+        expected.create(memfile::memory_file::file_format_other);
+        const std::string new_data(http_stand_in::big_body(7, 200000));
+        expected.write(new_data.c_str(), 0, static_cast<int>(new_data.length()));
+
+        // the resumed file does not match the md5sum so the cache
+        // discards the partial file and downloads the whole file
+        wpkgar::wpkgar_download_cache cache(cache_path);
+        cache.set_expected(uri, expected.md5sum(), 200000);
+        memfile::memory_file file;
+        cache.read_file(uri, file);
+        CATCH_REQUIRE(file.compare(expected) == 0);
+        CATCH_REQUIRE(server.get_requests() == 2);
+        CATCH_REQUIRE(!partial.exists());
+        CATCH_REQUIRE(cache.is_cached(uri));
+
+        // close the idle connections before the server stops
+        wpkg_http::http_pool::instance().clear();
+    }
+}
+
+
+CATCH_TEST_CASE("HttpUnitTests::prefetch","HttpUnitTests")
+{
+    http_stand_in server;
+    {
+        char port[16];
+        snprintf(port, sizeof(port), "%d", server.get_port());
+        const std::string base(std::string("http://127.0.0.1:") + port);
+
+        wpkg_filename::uri_filename cache_path(wpkg_filename::uri_filename(test_common::wpkg_tools::get_tmp_dir()).append_child("prefetch-cache"));
+        cache_path.os_unlink_rf();
+
+        {
+            wpkgar::wpkgar_download_cache cache(cache_path);
+            wpkgar::wpkgar_download_cache::uri_list_t uris;
+            uris.push_back(base + "/big");
+            uris.push_back(base + "/chunked");
+            uris.push_back(base + "/length");
+            uris.push_back(base + "/missing");
+            uris.push_back(base + "/close");
+            cache.prefetch(uris, 2);
+
+            // the files are returned by the prefetch threads
+            memfile::memory_file file;
+            cache.read_file(base + "/chunked", file);
+            CATCH_REQUIRE(body_to_string(file) == "chunked body");
+            cache.read_file(base + "/length", file);
+            CATCH_REQUIRE(body_to_string(file) == "hello world");
+            cache.read_file(base + "/big", file);
+            CATCH_REQUIRE(file.size() == 200000);
+            CATCH_REQUIRE(server.get_requests() >= 3);
+
+            // a failed prefetch gets reported by read_file()
+            CATCH_REQUIRE_THROWS_AS(cache.read_file(base + "/missing", file), memfile::memfile_exception_io);
+
+            // never more than 2 connections at a time; the /close one
+            // may not have been read and the destructor waits for it
+            CATCH_REQUIRE(server.get_connections() <= 4);
+        }
+
+        // close the idle connections before the server stops
+        wpkg_http::http_pool::instance().clear();
+    }
+}
+
+
+CATCH_TEST_CASE("HttpUnitTests::resume","HttpUnitTests")
+{
+    http_stand_in server;
+    {
+        char port[16];
+        snprintf(port, sizeof(port), "%d", server.get_port());
+        const std::string base(std::string("http://127.0.0.1:") + port);
+
+        wpkg_filename::uri_filename partial(wpkg_filename::uri_filename(test_common::wpkg_tools::get_tmp_dir()).append_child("resume/file.part"));
+        partial.os_unlink();
+
+        memfile::memory_file big;
+        big.read_file(base + "/big");
+
+        // the dropped connection gets resumed with a Range field
+        memfile::memory_file file;
+        file.resume_file(base + "/flaky", partial, 200000);
+        CATCH_REQUIRE(file.size() == 200000);
+        CATCH_REQUIRE(file.compare(big) == 0);
+        CATCH_REQUIRE(server.get_requests() == 3);
+        CATCH_REQUIRE(!partial.exists());
+
+        // too many failures save the data received so far
+        CATCH_REQUIRE_THROWS_AS(file.resume_file(base + "/broken", partial, 200000), memfile::memfile_exception_io);
+        CATCH_REQUIRE(partial.exists());
+        memfile::memory_file saved;
+        saved.read_file(partial);
+        CATCH_REQUIRE(saved.size() == 1000 * memfile::memory_file::HTTP_RESUME_ATTEMPTS);
+
+        // and the next call starts from there
+        CATCH_REQUIRE_THROWS_AS(file.resume_file(base + "/broken", partial, 200000), memfile::memfile_exception_io);
+        saved.read_file(partial);
+        CATCH_REQUIRE(saved.size() == 2000 * memfile::memory_file::HTTP_RESUME_ATTEMPTS);
+
+        // a server which supports ranges completes the file
+        file.resume_file(base + "/flaky", partial, 200000);
+        CATCH_REQUIRE(file.compare(big) == 0);
+        CATCH_REQUIRE(!partial.exists());
+
+        // the file changed while resuming: the If-Range field makes the
+        // server send the new version from the start
+        file.resume_file(base + "/changing", partial, 200000);
+        CATCH_REQUIRE(body_to_string(file) == http_stand_in::big_body(7, 200000));
+        CATCH_REQUIRE(!partial.exists());
+
+        // close the idle connections before the server stops
+        wpkg_http::http_pool::instance().clear();
+    }
+}
+
+// vim: ts=4 sw=4 et
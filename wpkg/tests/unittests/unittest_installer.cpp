@@ -28,7 +28,9 @@
 #include "libdebpackages/installer/flags.h"
 #include "libdebpackages/installer/package_list.h"
 
+#include <atomic>
 #include <iostream>
+#include <thread>
 
 #include <catch.hpp>
 
@@ -65,6 +67,8 @@ public:
     ~InstallerUnitTests();
 
     void install_simple_package();
+    void reader_does_not_wait_for_install();
+    void select_greatest_version();
     void test_disk_t();
     void test_disk_list_t();
 
@@ -208,6 +212,205 @@ CATCH_TEST_CASE( "InstallerUnitTests::install_package", "InstallerUnitTests" )
 }
 
 
+namespace
+{
+
+/** \brief Read the status of a package as another process would.
+ *
+ * The reader runs in a separate thread with its own manager. Catch is
+ * not thread safe so it only saves its results.
+ */
+class status_reader
+{
+public:
+    status_reader(const wpkg_filename::uri_filename& root_path, const wpkg_filename::uri_filename& database_path)
+        : f_root_path(root_path)
+        , f_database_path(database_path)
+        , f_done(false)
+        , f_status(wpkgar_manager::no_package)
+        //, f_error("") -- auto-init
+        //, f_thread() -- auto-init
+    {
+    }
+
+    ~status_reader()
+    {
+        // never destroy a joinable thread, that would terminate the tests
+        join();
+    }
+
+    void start(const std::string& package_name)
+    {
+        f_thread = std::thread([this, package_name]()
+            {
+                try
+                {
+                    wpkgar_manager::pointer_t manager( new wpkgar_manager );
+                    manager->set_root_path     ( f_root_path     );
+                    manager->set_database_path ( f_database_path );
+                    wpkgar::wpkgar_lock shared_lock( manager, "Listing", wpkgar::wpkgar_lock::lock_mode_shared );
+                    manager->load_package( package_name );
+                    f_status = manager->package_status( package_name );
+                }
+                catch(const std::exception& e)
+                {
+                    f_error = e.what();
+                }
+                f_done = true;
+            });
+    }
+
+    void join()
+    {
+        if(f_thread.joinable())
+        {
+            f_thread.join();
+        }
+    }
+
+    bool is_done() const
+    {
+        return f_done;
+    }
+
+    wpkgar_manager::package_status_t get_status() const
+    {
+        return f_status;
+    }
+
+    const std::string& get_error() const
+    {
+        return f_error;
+    }
+
+private:
+    const wpkg_filename::uri_filename   f_root_path;
+    const wpkg_filename::uri_filename   f_database_path;
+    std::atomic<bool>                   f_done;
+    wpkgar_manager::package_status_t    f_status;
+    std::string                         f_error;
+    std::thread                         f_thread;
+};
+
+} // no name namespace
+
+
+void InstallerUnitTests::reader_does_not_wait_for_install()
+{
+    control_file_pointer_t ctrl(get_new_control_file(__FUNCTION__));
+    ctrl->set_field("Files", "conffiles\n"
+                             "/etc/t3.conf 0123456789abcdef0123456789abcdef\n"
+                             "/usr/bin/t3 0123456789abcdef0123456789abcdef\n"
+                             "/usr/share/doc/t3/copyright 0123456789abcdef0123456789abcdef\n"
+                    );
+    create_package( "t3", ctrl, 0 );
+
+    wpkgar_install::pointer_t installer( new wpkgar_install(f_manager) );
+    installer->set_installing();
+    wpkg_filename::uri_filename package_name( get_package_file_name( "t3", ctrl ) );
+    installer->get_package_list()->add_package( package_name.full_path() );
+
+    std::shared_ptr<wpkgar::wpkgar_lock> the_lock( new wpkgar::wpkgar_lock( f_manager, "Installing unit test package..." ) );
+
+    CATCH_REQUIRE( installer->validate() );
+    CATCH_REQUIRE( installer->pre_configure() );
+    const int i( installer->unpack() );
+    CATCH_REQUIRE( i >= 0 );
+
+    // a reader (i.e. wpkg --list) started while the package is being
+    // installed does not wait, it sees the last committed status
+    {
+        status_reader reader( get_target_path(), get_database_path() );
+        reader.start( "t3" );
+        reader.join();
+        CATCH_REQUIRE( reader.get_error().empty() );
+        CATCH_REQUIRE( reader.get_status() == wpkgar_manager::unpacked );
+    }
+
+    // a reader only waits while a package gets committed
+    {
+        status_reader reader( get_target_path(), get_database_path() );
+        bool waited(false);
+        {
+            wpkgar::wpkgar_database_lock commit( *f_manager, true );
+            reader.start( "t3" );
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            waited = !reader.is_done();
+        }
+        reader.join();
+        CATCH_REQUIRE( waited );
+        CATCH_REQUIRE( reader.get_error().empty() );
+        CATCH_REQUIRE( reader.get_status() == wpkgar_manager::unpacked );
+    }
+
+    CATCH_REQUIRE( installer->configure(i) );
+    CATCH_REQUIRE( installer->unpack() == wpkgar_install::WPKGAR_EOP );
+
+    // the reader sees the package installed as soon as it is configured,
+    // even though we did not release the database lock yet
+    {
+        status_reader reader( get_target_path(), get_database_path() );
+        reader.start( "t3" );
+        reader.join();
+        CATCH_REQUIRE( reader.get_error().empty() );
+        CATCH_REQUIRE( reader.get_status() == wpkgar_manager::installed );
+    }
+    the_lock.reset();
+}
+
+
+CATCH_TEST_CASE( "InstallerUnitTests::reader_does_not_wait_for_install", "InstallerUnitTests" )
+{
+    InstallerUnitTests instut;
+    instut.reader_does_not_wait_for_install();
+}
+
+
+void InstallerUnitTests::select_greatest_version()
+{
+    // two versions of t1 in the repository; in alphabetical order 1.9
+    // comes after 1.10
+    control_file_pointer_t ctrl(get_new_control_file(__FUNCTION__));
+    ctrl->set_field("Files", "conffiles\n"
+                             "/usr/bin/t1 0123456789abcdef0123456789abcdef\n"
+                    );
+    ctrl->set_field("Version", "1.9");
+    create_package( "t1", ctrl );
+    ctrl->set_field("Version", "1.10");
+    create_package( "t1", ctrl );
+    init_database(); // this updates the index in the repository.
+
+    // make the repository a source and load its index
+    memfile::memory_file sources;
+    sources.create(memfile::memory_file::file_format_other);
+    sources.printf("wpkg %s ./\n", get_repository().path_only().c_str());
+    sources.write_file(get_database_path().append_child("core/sources.list"));
+    {
+        wpkgar_repository repository( f_manager );
+        repository.update();
+    }
+
+    // a package name without a version selects the greatest version
+    package_list::pointer_t pkg_list( new package_list( f_manager ) );
+    pkg_list->add_package( "t1" );
+    CATCH_REQUIRE( pkg_list->count() == 1 );
+    CATCH_REQUIRE( pkg_list->get_package_list()[0].get_version() == "1.10" );
+
+    // unless a version is specified
+    package_list::pointer_t pkg_list_19( new package_list( f_manager ) );
+    pkg_list_19->add_package( "t1", "1.9" );
+    CATCH_REQUIRE( pkg_list_19->count() == 1 );
+    CATCH_REQUIRE( pkg_list_19->get_package_list()[0].get_version() == "1.9" );
+}
+
+
+CATCH_TEST_CASE( "InstallerUnitTests::select_greatest_version", "InstallerUnitTests" )
+{
+    InstallerUnitTests instut;
+    instut.select_greatest_version();
+}
+
+
 void InstallerUnitTests::test_disk_t()
 {
     installer::details::disk_t d( "/" );
@@ -26,6 +26,8 @@
 #include <catch.hpp>
 
 #include <iostream>
+#include <thread>
+#include <vector>
 
 
 // seed: 1367790804
@@ -131,5 +133,545 @@ CATCH_TEST_CASE("MemfileUnitTests::compression9","MemfileUnitTests")
     compression(9);
 }
 
+CATCH_TEST_CASE("MemfileUnitTests::md5sum","MemfileUnitTests")
+{
+    // RFC 1321 test suite
+    const char *vectors[][2] = {
+        { "", "d41d8cd98f00b204e9800998ecf8427e" },
+        { "a", "0cc175b9c0f1b6a831c399e269772661" },
+        { "abc", "900150983cd24fb0d6963f7d28e17f72" },
+        { "message digest", "f96b697d7cb7938d525a2f31aaf161d0" },
+        { "abcdefghijklmnopqrstuvwxyz", "c3fcd3d76192e4007dfb496cca67e13b" },
+        { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", "d174ab98d277d9f5a5611c2c9f419d9f" },
+        { "12345678901234567890123456789012345678901234567890123456789012345678901234567890", "57edf4a22be3c955ac49da2e2107b67a" }
+    };
+    const int vectors_count(static_cast<int>(sizeof(vectors) / sizeof(vectors[0])));
+    for(int i(0); i < vectors_count; ++i)
+    {
+        md5::md5sum sum;
+        sum.push_back(reinterpret_cast<const uint8_t *>(vectors[i][0]), strlen(vectors[i][0]));
+        CATCH_REQUIRE(sum.sum() == vectors[i][1]);
+
+        // same result when pushed one byte at a time
+        md5::md5sum bytes;
+        for(const char *s(vectors[i][0]); *s != '\0'; ++s)
+        {
+            bytes.push_back(reinterpret_cast<const uint8_t *>(s), 1);
+        }
+        CATCH_REQUIRE(bytes.sum() == vectors[i][1]);
+    }
+
+    CATCH_REQUIRE(md5::md5sum::multi_lanes() >= 1);
+
+    // push_back_multi() must give the same results as push_back() for
+    // any number of md5sums and any mix of sizes and starting positions
+    std::vector<uint8_t> data(70000);
+    for(size_t j(0); j < data.size(); ++j)
+    {
+        data[j] = static_cast<uint8_t>(rand());
+    }
+    for(int count(1); count <= 11; ++count)
+    {
+        std::vector<md5::md5sum> multi(count);
+        std::vector<md5::md5sum> single(count);
+        std::vector<md5::md5sum *> sums(count);
+        std::vector<const uint8_t *> ptrs(count);
+        std::vector<size_t> sizes(count);
+        for(int i(0); i < count; ++i)
+        {
+            // some md5sums start in the middle of a block
+            if(i % 4 == 3)
+            {
+                multi[i].push_back(&data[0], i * 5);
+                single[i].push_back(&data[0], i * 5);
+            }
+            sums[i] = &multi[i];
+            ptrs[i] = &data[i * 97];
+            sizes[i] = i % 2 == 0 ? 64 * 1000 : static_cast<size_t>(rand() % 65000);
+        }
+        md5::md5sum::push_back_multi(&sums[0], &ptrs[0], &sizes[0], count);
+        for(int i(0); i < count; ++i)
+        {
+            single[i].push_back(ptrs[i], sizes[i]);
+            CATCH_REQUIRE(multi[i].size() == single[i].size());
+            CATCH_REQUIRE(multi[i].sum() == single[i].sum());
+        }
+    }
+}
+
+
+CATCH_TEST_CASE("MemfileUnitTests::sha256sum","MemfileUnitTests")
+{
+    // FIPS 180-2 examples
+    const char *vectors[][2] = {
+        { "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        { "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" }
+    };
+    const int vectors_count(static_cast<int>(sizeof(vectors) / sizeof(vectors[0])));
+    for(int i(0); i < vectors_count; ++i)
+    {
+        sha256::sha256sum sum;
+        sum.push_back(reinterpret_cast<const uint8_t *>(vectors[i][0]), strlen(vectors[i][0]));
+        CATCH_REQUIRE(sum.sum() == vectors[i][1]);
+
+        // same result when pushed one byte at a time
+        sha256::sha256sum bytes;
+        for(const char *s(vectors[i][0]); *s != '\0'; ++s)
+        {
+            bytes.push_back(reinterpret_cast<const uint8_t *>(s), 1);
+        }
+        CATCH_REQUIRE(bytes.sum() == vectors[i][1]);
+    }
+
+    // one million 'a' pushed in chunks which are not a multiple of 64
+    {
+        std::vector<uint8_t> a(1000, 'a');
+        sha256::sha256sum sum;
+        for(int i(0); i < 1000; ++i)
+        {
+            sum.push_back(&a[0], a.size());
+        }
+        CATCH_REQUIRE(sum.sum() == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    }
+
+    // a memory file computes both checksums in one pass
+    {
+        memfile::memory_file file;
+        file.create(memfile::memory_file::file_format_other);
+        std::vector<char> buf(200000);
+        for(size_t j(0); j < buf.size(); ++j)
+        {
+            buf[j] = static_cast<char>(rand());
+        }
+        file.write(&buf[0], 0, static_cast<int>(buf.size()));
+        md5::raw_md5sum raw_md5;
+        sha256::raw_sha256sum raw_sha256;
+        file.raw_checksums(raw_md5, raw_sha256);
+        CATCH_REQUIRE(md5::md5sum::sum(raw_md5) == file.md5sum());
+        CATCH_REQUIRE(sha256::sha256sum::sum(raw_sha256) == file.sha256sum());
+        sha256::sha256sum sum;
+        sum.push_back(reinterpret_cast<const uint8_t *>(&buf[0]), buf.size());
+        CATCH_REQUIRE(sum.sum() == file.sha256sum());
+    }
+}
+
+
+CATCH_TEST_CASE("MemfileUnitTests::read_line","MemfileUnitTests")
+{
+    const int block_size(memfile::memory_file::block_manager::BLOCK_MANAGER_BUFFER_SIZE);
+
+    // a long line crossing a block boundary, a "\r\n" split between
+    // two blocks, all three types of newlines, and no final newline
+    std::string long_line(block_size - 10, 'a');
+    long_line += "0123456789ABCDEF";
+    std::string split_line(block_size * 2 - static_cast<int>(long_line.length()) - 1 - 1, 'b');
+    const std::string data(long_line + "\n" + split_line + "\r\nunix\nmac\rwindows\r\n\nlast");
+    CATCH_REQUIRE(data[block_size * 2 - 1] == '\r');
+    CATCH_REQUIRE(data[block_size * 2] == '\n');
+
+    memfile::memory_file file;
+    file.create(memfile::memory_file::file_format_other);
+    file.write(data.c_str(), 0, static_cast<int>(data.length()));
+
+    const char *expected[] = { long_line.c_str(), split_line.c_str(), "unix", "mac", "windows", "", "last" };
+    const int expected_count(static_cast<int>(sizeof(expected) / sizeof(expected[0])));
+
+    // string version
+    {
+        int offset(0);
+        std::string line;
+        for(int i(0); i < expected_count; ++i)
+        {
+            CATCH_REQUIRE(file.read_line(offset, line));
+            CATCH_REQUIRE(line == expected[i]);
+        }
+        CATCH_REQUIRE(offset == file.size());
+        CATCH_REQUIRE(!file.read_line(offset, line));
+        CATCH_REQUIRE(line.empty());
+    }
+
+    // in place version
+    {
+        int offset(0);
+        std::string buffer;
+        const char *line;
+        int length;
+        for(int i(0); i < expected_count; ++i)
+        {
+            CATCH_REQUIRE(file.read_line(offset, line, length, buffer));
+            CATCH_REQUIRE(std::string(line, length) == expected[i]);
+
+            // only the line crossing a block boundary gets copied
+            CATCH_REQUIRE((line == buffer.data()) == (i == 0));
+        }
+        CATCH_REQUIRE(offset == file.size());
+        CATCH_REQUIRE(!file.read_line(offset, line, length, buffer));
+        CATCH_REQUIRE(length == 0);
+    }
+}
+
+
+CATCH_TEST_CASE("MemfileUnitTests::shared_members","MemfileUnitTests")
+{
+    const int block_size(memfile::memory_file::block_manager::BLOCK_MANAGER_BUFFER_SIZE);
+
+    // files of various sizes so some cross block boundaries in the tarball
+    const int sizes[] = { 0, 1, 511, 512, block_size - 300, block_size * 2 + 17, 1000 };
+    const int sizes_count(static_cast<int>(sizeof(sizes) / sizeof(sizes[0])));
+    std::vector<std::string> contents;
+    memfile::memory_file tar;
+    tar.create(memfile::memory_file::file_format_tar);
+    for(int i(0); i < sizes_count; ++i)
+    {
+        std::string content;
+        for(int j(0); j < sizes[i]; ++j)
+        {
+            content += static_cast<char>('a' + (i + j) % 26);
+        }
+        contents.push_back(content);
+
+        memfile::memory_file data;
+        data.create(memfile::memory_file::file_format_other);
+        data.write(content.c_str(), 0, static_cast<int>(content.length()));
+        memfile::memory_file::file_info info;
+        info.set_filename("file" + std::to_string(i));
+        info.set_mode(0644);
+        info.set_user("Administrator");
+        info.set_group("Administrators");
+        info.set_size(data.size());
+        tar.append_file(info, data);
+    }
+    tar.end_archive();
+    const std::string tar_md5sum(tar.md5sum());
+
+    // the members share the blocks of the tarball
+    for(int pass(0); pass < 2; ++pass)
+    {
+        tar.dir_rewind();
+        memfile::memory_file::file_info info;
+        memfile::memory_file data;
+        for(int i(0); i < sizes_count; ++i)
+        {
+            CATCH_REQUIRE(tar.dir_next(info, &data));
+            CATCH_REQUIRE(info.get_filename() == "file" + std::to_string(i));
+            CATCH_REQUIRE(data.size() == sizes[i]);
+            std::vector<char> buf(sizes[i] + 1);
+            CATCH_REQUIRE(data.read(&buf[0], 0, sizes[i]) == sizes[i]);
+            CATCH_REQUIRE(std::string(&buf[0], sizes[i]) == contents[i]);
+
+            md5::md5sum sum;
+            sum.push_back(reinterpret_cast<const uint8_t *>(contents[i].c_str()), contents[i].length());
+            CATCH_REQUIRE(data.md5sum() == sum.sum());
+
+            // modifying a member does not modify the tarball
+            if(pass == 0 && sizes[i] > 0)
+            {
+                data.write("XYZ", 0, 3);
+                data.write("tail", data.size() + 5, 4);
+                CATCH_REQUIRE(data.size() == std::max(sizes[i], 3) + 9);
+            }
+        }
+        CATCH_REQUIRE(!tar.dir_next(info, &data));
+        CATCH_REQUIRE(tar.md5sum() == tar_md5sum);
+    }
+
+    // modifying the tarball does not modify a member
+    {
+        tar.dir_rewind();
+        memfile::memory_file::file_info info;
+        memfile::memory_file data;
+        for(int i(0); i < 6; ++i)
+        {
+            CATCH_REQUIRE(tar.dir_next(info, &data));
+        }
+        std::vector<char> zeroes(tar.size(), 0);
+        tar.write(&zeroes[0], 0, tar.size());
+        CATCH_REQUIRE(data.size() == sizes[5]);
+        std::vector<char> buf(sizes[5]);
+        data.read(&buf[0], 0, sizes[5]);
+        CATCH_REQUIRE(std::string(&buf[0], sizes[5]) == contents[5]);
+    }
+}
+
+
+CATCH_TEST_CASE("MemfileUnitTests::dir_find","MemfileUnitTests")
+{
+    const memfile::memory_file::file_format_t formats[] = { memfile::memory_file::file_format_tar, memfile::memory_file::file_format_ar };
+    for(size_t f(0); f < sizeof(formats) / sizeof(formats[0]); ++f)
+    {
+        const bool is_tar(formats[f] == memfile::memory_file::file_format_tar);
+        memfile::memory_file archive;
+        archive.create(formats[f]);
+        const char *names[] = { "control", "md5sums", "postinst", "conffiles" };
+        const int names_count(static_cast<int>(sizeof(names) / sizeof(names[0])));
+        for(int i(0); i <= names_count; ++i)
+        {
+            if(i == names_count)
+            {
+                // search before the archive is complete to verify that
+                // the index gets updated when the archive grows
+                memfile::memory_file::file_info info;
+                CATCH_REQUIRE(archive.dir_find("md5sums", info));
+                CATCH_REQUIRE(!archive.dir_find("shlibs", info));
+            }
+            memfile::memory_file data;
+            data.create(memfile::memory_file::file_format_other);
+            const std::string content(i == names_count ? "shared libraries\n" : std::string("content of ") + names[i] + "\n");
+            data.write(content.c_str(), 0, static_cast<int>(content.length()));
+            memfile::memory_file::file_info info;
+            info.set_filename(i == names_count ? "shlibs" : (is_tar && i == 0 ? std::string("./") + names[i] : std::string(names[i])));
+            info.set_mode(0644);
+            info.set_user("Administrator");
+            info.set_group("Administrators");
+            info.set_size(data.size());
+            archive.append_file(info, data);
+        }
+        archive.end_archive();
+
+        // dir_find() does not change the dir_next() position
+        archive.dir_rewind();
+        memfile::memory_file::file_info first;
+        CATCH_REQUIRE(archive.dir_next(first));
+        for(int repeat(0); repeat < 2; ++repeat)
+        {
+            for(int i(names_count - 1); i >= 0; --i)
+            {
+                memfile::memory_file::file_info info;
+                memfile::memory_file data;
+                CATCH_REQUIRE(archive.dir_find(names[i], info, &data));
+                const std::string content(std::string("content of ") + names[i] + "\n");
+                CATCH_REQUIRE(data.size() == static_cast<int>(content.length()));
+                std::vector<char> buf(data.size());
+                data.read(&buf[0], 0, data.size());
+                CATCH_REQUIRE(std::string(&buf[0], buf.size()) == content);
+            }
+            memfile::memory_file::file_info info;
+            CATCH_REQUIRE(archive.dir_find("shlibs", info));
+            CATCH_REQUIRE(info.get_size() == 17);
+            CATCH_REQUIRE(!archive.dir_find("templates", info));
+        }
+        memfile::memory_file::file_info second;
+        CATCH_REQUIRE(archive.dir_next(second));
+        CATCH_REQUIRE(second.get_filename() == "md5sums");
+    }
+}
+
+
+CATCH_TEST_CASE("MemfileUnitTests::block_pool","MemfileUnitTests")
+{
+    const int block_size(memfile::memory_file::block_manager::BLOCK_MANAGER_BUFFER_SIZE);
+
+    // blocks are recycled without being cleared, make sure that gaps
+    // still read as zeroes
+    auto check_gaps = [block_size]()
+    {
+        for(int repeat(0); repeat < 10; ++repeat)
+        {
+            {
+                memfile::memory_file dirty;
+                dirty.create(memfile::memory_file::file_format_other);
+                std::vector<char> garbage(block_size * 3, static_cast<char>(0xA5));
+                dirty.write(&garbage[0], 0, static_cast<int>(garbage.size()));
+            }
+            memfile::memory_file file;
+            file.create(memfile::memory_file::file_format_other);
+            const int offset(block_size + 123 + repeat * 1000);
+            file.write("end", offset, 3);
+            if(file.size() != offset + 3)
+            {
+                return false;
+            }
+            std::vector<char> buf(offset + 3);
+            file.read(&buf[0], 0, offset + 3);
+            for(int i(0); i < offset; ++i)
+            {
+                if(buf[i] != 0)
+                {
+                    return false;
+                }
+            }
+            if(memcmp(&buf[offset], "end", 3) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    CATCH_REQUIRE(check_gaps());
+
+    // the pool is shared between threads
+    std::vector<int> results(4, 0);
+    std::vector<std::thread> threads;
+    for(size_t i(0); i < results.size(); ++i)
+    {
+        threads.push_back(std::thread([&results, i, check_gaps]()
+            {
+                results[i] = check_gaps() ? 1 : 0;
+            }));
+    }
+    for(size_t i(0); i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+    for(size_t i(0); i < results.size(); ++i)
+    {
+        CATCH_REQUIRE(results[i] == 1);
+    }
+}
+
+
+CATCH_TEST_CASE("MemfileUnitTests::copy_and_move","MemfileUnitTests")
+{
+    const int block_size(memfile::memory_file::block_manager::BLOCK_MANAGER_BUFFER_SIZE);
+
+    memfile::memory_file source;
+    source.create(memfile::memory_file::file_format_other);
+    std::vector<char> data(block_size * 2 + 77);
+    for(size_t i(0); i < data.size(); ++i)
+    {
+        data[i] = static_cast<char>(rand());
+    }
+    source.write(&data[0], 0, static_cast<int>(data.size()));
+
+    // the copy shares the blocks but writing to it does not affect the source
+    memfile::memory_file copy;
+    source.copy(copy);
+    CATCH_REQUIRE(copy.get_format() == memfile::memory_file::file_format_other);
+    CATCH_REQUIRE(copy.compare(source) == 0);
+    copy.write("changed", block_size + 5, 7);
+    CATCH_REQUIRE(copy.compare(source) != 0);
+    std::vector<char> buf(data.size());
+    CATCH_REQUIRE(source.read(&buf[0], 0, static_cast<int>(buf.size())) == static_cast<int>(data.size()));
+    CATCH_REQUIRE(buf == data);
+
+    // moving takes the data over and resets the source
+    memfile::memory_file moved(std::move(source));
+    CATCH_REQUIRE(moved.get_format() == memfile::memory_file::file_format_other);
+    CATCH_REQUIRE(moved.size() == static_cast<int>(data.size()));
+    CATCH_REQUIRE(source.get_format() == memfile::memory_file::file_format_undefined);
+    CATCH_REQUIRE(moved.read(&buf[0], 0, static_cast<int>(buf.size())) == static_cast<int>(data.size()));
+    CATCH_REQUIRE(buf == data);
+
+    memfile::memory_file assigned;
+    assigned.create(memfile::memory_file::file_format_other);
+    assigned.write("old", 0, 3);
+    assigned = std::move(moved);
+    CATCH_REQUIRE(assigned.size() == static_cast<int>(data.size()));
+    CATCH_REQUIRE(moved.get_format() == memfile::memory_file::file_format_undefined);
+
+    // the copy-then-decompress idiom
+    memfile::memory_file compressed;
+    assigned.compress(compressed, memfile::memory_file::file_format_gz);
+    memfile::memory_file d(std::move(compressed));
+    d.decompress(compressed);
+    CATCH_REQUIRE(compressed.compare(assigned) == 0);
+}
+
+
+CATCH_TEST_CASE("MemfileUnitTests::decompressor","MemfileUnitTests")
+{
+    // a tarball with small and large files and a GNU long filename
+    memfile::memory_file archive;
+    archive.create(memfile::memory_file::file_format_tar);
+    const std::string long_name(std::string("usr/share/doc/") + std::string(150, 'n') + "/copyright");
+    const std::string names[] = { "./control", long_name, "data.bin", "md5sums" };
+    const int sizes[] = { 123, 5000, 200000, 0 };
+    const int names_count(static_cast<int>(sizeof(names) / sizeof(names[0])));
+    std::vector<std::vector<char> > contents(names_count);
+    for(int i(0); i < names_count; ++i)
+    {
+        contents[i].resize(sizes[i]);
+        for(int j(0); j < sizes[i]; ++j)
+        {
+            contents[i][j] = static_cast<char>(rand());
+        }
+        memfile::memory_file data;
+        data.create(memfile::memory_file::file_format_other);
+        if(sizes[i] > 0)
+        {
+            data.write(&contents[i][0], 0, sizes[i]);
+        }
+        memfile::memory_file::file_info info;
+        info.set_filename(names[i]);
+        info.set_mode(0644);
+        info.set_user("Administrator");
+        info.set_group("Administrators");
+        info.set_size(sizes[i]);
+        archive.append_file(info, data);
+    }
+    archive.end_archive();
+
+    const memfile::memory_file::file_format_t formats[] = { memfile::memory_file::file_format_tar, memfile::memory_file::file_format_gz, memfile::memory_file::file_format_bz2 };
+    for(size_t f(0); f < sizeof(formats) / sizeof(formats[0]); ++f)
+    {
+        memfile::memory_file source;
+        if(formats[f] == memfile::memory_file::file_format_tar)
+        {
+            archive.copy(source);
+        }
+        else
+        {
+            archive.compress(source, formats[f]);
+        }
+
+        // raw reading returns the uncompressed tarball
+        {
+            memfile::memory_file::decompressor stream(source);
+            CATCH_REQUIRE(stream.skip(1000) == 1000);
+            CATCH_REQUIRE(stream.tell() == 1000);
+            std::vector<char> buf(archive.size());
+            CATCH_REQUIRE(stream.read(&buf[0], 5000) == 5000);
+            std::vector<char> expected(5000);
+            archive.read(&expected[0], 1000, 5000);
+            CATCH_REQUIRE(memcmp(&buf[0], &expected[0], 5000) == 0);
+            const int left(archive.size() - 6000);
+            CATCH_REQUIRE(stream.read(&buf[0], static_cast<int>(buf.size())) == left);
+            CATCH_REQUIRE(stream.tell() == archive.size());
+            CATCH_REQUIRE(stream.read(&buf[0], 10) == 0);
+        }
+
+        // iterate through the files
+        {
+            memfile::memory_file::decompressor stream(source);
+            archive.dir_rewind();
+            for(int i(0); i < names_count; ++i)
+            {
+                memfile::memory_file::file_info info;
+                memfile::memory_file data;
+                CATCH_REQUIRE(stream.next_tar(info, &data));
+                memfile::memory_file::file_info expected_info;
+                memfile::memory_file expected_data;
+                CATCH_REQUIRE(archive.dir_next(expected_info, &expected_data));
+                CATCH_REQUIRE(info.get_filename() == expected_info.get_filename());
+                CATCH_REQUIRE(info.get_size() == sizes[i]);
+                CATCH_REQUIRE(data.size() == sizes[i]);
+                CATCH_REQUIRE(data.compare(expected_data) == 0);
+            }
+            memfile::memory_file::file_info info;
+            CATCH_REQUIRE(!stream.next_tar(info));
+        }
+
+        // search a file, skipping the data of the others
+        {
+            memfile::memory_file::decompressor stream(source);
+            memfile::memory_file::file_info info;
+            memfile::memory_file data;
+            CATCH_REQUIRE(stream.find_tar("data.bin", info, &data));
+            CATCH_REQUIRE(data.size() == sizes[2]);
+            std::vector<char> buf(sizes[2]);
+            data.read(&buf[0], 0, sizes[2]);
+            CATCH_REQUIRE(buf == contents[2]);
+            CATCH_REQUIRE(!stream.find_tar("control", info, &data));
+        }
+        {
+            memfile::memory_file::decompressor stream(source);
+            memfile::memory_file::file_info info;
+            CATCH_REQUIRE(stream.find_tar("control", info));
+            CATCH_REQUIRE(info.get_size() == sizes[0]);
+        }
+    }
+}
+
 
 // vim: ts=4 sw=4 et
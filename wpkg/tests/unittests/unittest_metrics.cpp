@@ -0,0 +1,287 @@
+/*    unittest_metrics.cpp
+ *    Copyright (C) 2013-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+
+#include "libdebpackages/wpkg_metrics.h"
+
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+#include <catch.hpp>
+
+
+namespace
+{
+
+/** \brief Capture the metrics events.
+ *
+ * The constructor registers a raw log listener, which enables the
+ * metrics, and resets the phases and counters. The destructor removes
+ * all the listeners.
+ */
+class capture_metrics
+{
+public:
+    capture_metrics()
+    {
+        wpkg_output::get_output()->register_raw_log_listener(
+                [this]( const wpkg_output::message_t& msg )
+                {
+                    if(msg.get_module() == wpkg_output::module_metrics)
+                    {
+                        f_events.push_back(msg.get_raw_message());
+                        f_packages.push_back(msg.get_package_name());
+                    }
+                });
+        wpkg_metrics::reset();
+    }
+
+    ~capture_metrics()
+    {
+        wpkg_output::get_output()->clear_listeners();
+        wpkg_metrics::reset();
+    }
+
+    std::vector<std::string>    f_events;
+    std::vector<std::string>    f_packages;
+};
+
+
+bool starts_with(const std::string& str, const std::string& prefix)
+{
+    return str.compare(0, prefix.length(), prefix) == 0;
+}
+
+
+bool contains(const std::string& str, const std::string& part)
+{
+    return str.find(part) != std::string::npos;
+}
+
+
+/** \brief Find the line of the report starting with \p prefix.
+ *
+ * \return The rest of the line or "<missing>".
+ */
+std::string report_line(const std::string& report, const std::string& prefix)
+{
+    std::istringstream in(report);
+    std::string line;
+    while(std::getline(in, line))
+    {
+        if(starts_with(line, prefix))
+        {
+            return line.substr(prefix.length());
+        }
+    }
+    return "<missing>";
+}
+
+
+void sleep_ms(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+
+void profiled_inner()
+{
+    wpkg_metrics::profile_scope scope("unittest_inner");
+    sleep_ms(5);
+}
+
+
+void profiled_outer(int depth)
+{
+    wpkg_metrics::profile_scope scope("unittest_outer");
+    if(depth > 0)
+    {
+        profiled_outer(depth - 1);
+    }
+    else
+    {
+        sleep_ms(5);
+        profiled_inner();
+    }
+}
+
+} // no name namespace
+
+
+CATCH_TEST_CASE("MetricsUnitTests::disabled","MetricsUnitTests")
+{
+    wpkg_output::get_output()->clear_listeners();
+    wpkg_metrics::reset();
+
+    // without a listener nothing gets measured
+    CATCH_REQUIRE(!wpkg_metrics::is_enabled());
+    {
+        wpkg_metrics::phase_timer timer(wpkg_metrics::phase_unpack, "t1");
+        wpkg_metrics::add_to_counter(wpkg_metrics::counter_files_written, 3);
+    }
+    CATCH_REQUIRE(wpkg_metrics::get_phase_count(wpkg_metrics::phase_unpack) == 0);
+    CATCH_REQUIRE(wpkg_metrics::get_counter(wpkg_metrics::counter_files_written) == 0);
+
+    // invalid phases and counters
+    CATCH_REQUIRE_THROWS_AS(wpkg_metrics::phase_to_string(wpkg_metrics::phase_max), std::overflow_error);
+    CATCH_REQUIRE_THROWS_AS(wpkg_metrics::counter_to_string(wpkg_metrics::counter_max), std::overflow_error);
+    CATCH_REQUIRE_THROWS_AS(wpkg_metrics::get_counter(wpkg_metrics::counter_max), std::overflow_error);
+    CATCH_REQUIRE_THROWS_AS(wpkg_metrics::get_phase_count(wpkg_metrics::phase_max), std::overflow_error);
+}
+
+
+CATCH_TEST_CASE("MetricsUnitTests::phase_events","MetricsUnitTests")
+{
+    capture_metrics capture;
+    CATCH_REQUIRE(wpkg_metrics::is_enabled());
+
+    {
+        wpkg_metrics::phase_timer timer(wpkg_metrics::phase_unpack, "t\"1");
+    }
+    {
+        wpkg_metrics::phase_timer timer(wpkg_metrics::phase_unpack);
+    }
+    {
+        wpkg_metrics::phase_timer timer(wpkg_metrics::phase_scripts, "t2");
+    }
+
+    // one JSON line per completed phase
+    CATCH_REQUIRE(capture.f_events.size() == 3);
+    CATCH_REQUIRE(starts_with(capture.f_events[0], "{\"event\":\"phase\",\"phase\":\"unpack\",\"package\":\"t\\\"1\",\"wall_us\":"));
+    CATCH_REQUIRE(contains(capture.f_events[0], ",\"cpu_us\":"));
+    CATCH_REQUIRE(*capture.f_events[0].rbegin() == '}');
+    CATCH_REQUIRE(capture.f_packages[0] == "t\"1");
+    CATCH_REQUIRE(starts_with(capture.f_events[1], "{\"event\":\"phase\",\"phase\":\"unpack\",\"wall_us\":"));
+    CATCH_REQUIRE(capture.f_packages[1].empty());
+    CATCH_REQUIRE(starts_with(capture.f_events[2], "{\"event\":\"phase\",\"phase\":\"scripts\",\"package\":\"t2\","));
+
+    CATCH_REQUIRE(wpkg_metrics::get_phase_count(wpkg_metrics::phase_unpack) == 2);
+    CATCH_REQUIRE(wpkg_metrics::get_phase_count(wpkg_metrics::phase_scripts) == 1);
+    CATCH_REQUIRE(wpkg_metrics::get_phase_count(wpkg_metrics::phase_download) == 0);
+
+    // the phase is timed even if an exception gets propagated
+    try
+    {
+        wpkg_metrics::phase_timer timer(wpkg_metrics::phase_download);
+        throw std::runtime_error("download failed");
+    }
+    catch(const std::runtime_error&)
+    {
+    }
+    CATCH_REQUIRE(wpkg_metrics::get_phase_count(wpkg_metrics::phase_download) == 1);
+    CATCH_REQUIRE(capture.f_events.size() == 4);
+}
+
+
+CATCH_TEST_CASE("MetricsUnitTests::summary","MetricsUnitTests")
+{
+    capture_metrics capture;
+
+    {
+        wpkg_metrics::phase_timer timer(wpkg_metrics::phase_validation);
+    }
+    {
+        wpkg_metrics::phase_timer timer(wpkg_metrics::phase_configure, "t1");
+    }
+    {
+        wpkg_metrics::phase_timer timer(wpkg_metrics::phase_configure, "t2");
+    }
+    wpkg_metrics::add_to_counter(wpkg_metrics::counter_files_written, 3);
+    wpkg_metrics::add_to_counter(wpkg_metrics::counter_files_written);
+    wpkg_metrics::add_to_counter(wpkg_metrics::counter_cache_hits);
+    CATCH_REQUIRE(wpkg_metrics::get_counter(wpkg_metrics::counter_files_written) == 4);
+
+    const std::string summary(wpkg_metrics::get_summary());
+    CATCH_REQUIRE(starts_with(summary, "{\"event\":\"summary\",\"phases\":{\"validation\":{\"count\":1,"));
+    CATCH_REQUIRE(contains(summary, "\"configure\":{\"count\":2,"));
+    CATCH_REQUIRE(contains(summary, "\"download\":{\"count\":0,\"wall_us\":0,\"cpu_us\":0}"));
+    CATCH_REQUIRE(contains(summary, "\"counters\":{\"bytes_downloaded\":0,"));
+    CATCH_REQUIRE(contains(summary, "\"files_written\":4,"));
+    CATCH_REQUIRE(contains(summary, "\"cache_hits\":1,"));
+    CATCH_REQUIRE(contains(summary, "\"cache_misses\":0}}"));
+
+    // emit_summary() sends the same JSON line
+    capture.f_events.clear();
+    wpkg_metrics::emit_summary();
+    CATCH_REQUIRE(capture.f_events.size() == 1);
+    CATCH_REQUIRE(capture.f_events[0] == summary);
+
+    // reset() clears everything
+    wpkg_metrics::reset();
+    CATCH_REQUIRE(wpkg_metrics::get_phase_count(wpkg_metrics::phase_configure) == 0);
+    CATCH_REQUIRE(wpkg_metrics::get_phase_wall_time(wpkg_metrics::phase_configure) == 0);
+    CATCH_REQUIRE(wpkg_metrics::get_counter(wpkg_metrics::counter_files_written) == 0);
+    CATCH_REQUIRE(contains(wpkg_metrics::get_summary(), "\"configure\":{\"count\":0,\"wall_us\":0,\"cpu_us\":0}"));
+}
+
+
+CATCH_TEST_CASE("MetricsUnitTests::profile_report","MetricsUnitTests")
+{
+    // scopes do not record anything unless the profiler runs
+    CATCH_REQUIRE(!wpkg_metrics::is_profiling());
+    profiled_outer(0);
+    CATCH_REQUIRE(report_line(wpkg_metrics::get_profile_report(100), "unittest_outer ") == "<missing>");
+
+    wpkg_metrics::set_profiling(true);
+    CATCH_REQUIRE(wpkg_metrics::is_profiling());
+    profiled_outer(0);
+    profiled_outer(1);
+    wpkg_metrics::add_to_counter(wpkg_metrics::counter_bytes_written, 7);
+    wpkg_metrics::set_profiling(false);
+
+    const std::string report(wpkg_metrics::get_profile_report(100));
+
+    // folded stacks: "<scope>;<scope>;... <self time>"
+    const uint64_t outer_self(std::stoull(report_line(report, "unittest_outer ")));
+    const uint64_t inner_self(std::stoull(report_line(report, "unittest_outer;unittest_inner ")));
+    const uint64_t recursive_self(std::stoull(report_line(report, "unittest_outer;unittest_outer ")));
+    const uint64_t recursive_inner_self(std::stoull(report_line(report, "unittest_outer;unittest_outer;unittest_inner ")));
+    CATCH_REQUIRE(outer_self >= 5000);
+    CATCH_REQUIRE(inner_self >= 5000);
+    CATCH_REQUIRE(recursive_self >= 5000);
+    CATCH_REQUIRE(recursive_inner_self >= 5000);
+
+    // the top scopes: name calls total_us self_us; the recursive call
+    // is not counted twice in the total
+    std::istringstream outer(report_line(report, "# unittest_outer "));
+    uint64_t calls(0), total(0), self(0);
+    outer >> calls >> total >> self;
+    CATCH_REQUIRE(calls == 3);
+    CATCH_REQUIRE(self == outer_self + recursive_self);
+    CATCH_REQUIRE(total >= self + inner_self + recursive_inner_self);
+    CATCH_REQUIRE(total < 2 * (self + inner_self + recursive_inner_self));
+
+    std::istringstream inner(report_line(report, "# unittest_inner "));
+    inner >> calls >> total >> self;
+    CATCH_REQUIRE(calls == 2);
+    CATCH_REQUIRE(self == inner_self + recursive_inner_self);
+    CATCH_REQUIRE(total == self);
+
+    // the counters are updated while the profiler runs
+    CATCH_REQUIRE(report_line(report, "# bytes_written ") != "<missing>");
+    CATCH_REQUIRE(std::stoull(report_line(report, "# bytes_written ")) >= 7);
+
+    // the number of top scopes is limited
+    CATCH_REQUIRE(contains(wpkg_metrics::get_profile_report(1), "# top 1 scopes"));
+    CATCH_REQUIRE(report_line(wpkg_metrics::get_profile_report(0), "# unittest_") == "<missing>");
+}
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,519 @@
+/*    unittest_output.cpp
+ *    Copyright (C) 2013-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+
+#include "libdebpackages/wpkg_output.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <catch.hpp>
+
+
+namespace
+{
+
+/** \brief Capture the messages sent to the output object.
+ *
+ * The constructor registers a raw log listener and the destructor
+ * removes all the listeners so each test starts with a clean output.
+ */
+class capture_output
+{
+public:
+    capture_output()
+    {
+        wpkg_output::get_output()->register_raw_log_listener(
+                [this]( const wpkg_output::message_t& msg )
+                {
+                    std::lock_guard<std::mutex> lock(f_mutex);
+                    f_messages.push_back(msg.get_raw_message());
+                });
+    }
+
+    ~capture_output()
+    {
+        auto output( wpkg_output::get_output() );
+        output->clear_listeners();
+        output->reset_error_count();
+    }
+
+    std::vector<std::string> get_messages() const
+    {
+        std::lock_guard<std::mutex> lock(f_mutex);
+        return f_messages;
+    }
+
+private:
+    mutable std::mutex          f_mutex;
+    std::vector<std::string>    f_messages;
+};
+
+/** \brief Send the messages through the asynchronous writer.
+ *
+ * The destructor goes back to synchronous output which first writes
+ * the pending messages. Create this object after the capture_output
+ * so it gets destroyed first.
+ */
+class async_output
+{
+public:
+    async_output(size_t capacity, wpkg_output::output::overflow_policy_t policy)
+    {
+        wpkg_output::get_output()->set_asynchronous(true, capacity, policy);
+    }
+
+    ~async_output()
+    {
+        wpkg_output::get_output()->set_asynchronous(false);
+    }
+};
+
+
+/** \brief Block the writer thread.
+ *
+ * The listener blocks the writer thread when it receives the "block"
+ * message and until release() gets called. While blocked, the slot
+ * of that message and the slots of the following messages stay busy
+ * so the tests can fill the buffer.
+ */
+class writer_gate
+{
+public:
+    writer_gate()
+    {
+        wpkg_output::get_output()->register_raw_log_listener(
+                [this]( const wpkg_output::message_t& msg )
+                {
+                    if(msg.get_raw_message() == "block")
+                    {
+                        f_blocked = true;
+                        while(!f_released)
+                        {
+                            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        }
+                    }
+                });
+    }
+
+    void block()
+    {
+        wpkg_output::log("block")
+            .level(wpkg_output::level_info);
+        while(!f_blocked)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void release()
+    {
+        f_released = true;
+    }
+
+private:
+    std::atomic<bool>   f_blocked{false};
+    std::atomic<bool>   f_released{false};
+};
+
+
+void log_info(const std::string& msg)
+{
+    wpkg_output::log(msg)
+        .level(wpkg_output::level_info);
+}
+
+} // no name namespace
+
+
+CATCH_TEST_CASE("OutputUnitTests::silence_thread","OutputUnitTests")
+{
+    capture_output capture;
+    wpkg_output::get_output()->reset_error_count();
+
+    // Catch is not thread safe so the worker only saves its results
+    bool silenced(false);
+    bool still_silenced(false);
+    std::thread worker([&silenced, &still_silenced]()
+        {
+            wpkg_output::silence_thread silence;
+            silenced = wpkg_output::silence_thread::is_silenced();
+            wpkg_output::log("discarded error")
+                .level(wpkg_output::level_error);
+            {
+                wpkg_output::silence_thread nested;
+                wpkg_output::log("discarded warning")
+                    .level(wpkg_output::level_warning);
+            }
+            // still silenced after the nested object is gone
+            still_silenced = wpkg_output::silence_thread::is_silenced();
+            wpkg_output::log("discarded info")
+                .level(wpkg_output::level_info);
+        });
+    worker.join();
+    CATCH_REQUIRE(silenced);
+    CATCH_REQUIRE(still_silenced);
+
+    // the other threads are not affected
+    CATCH_REQUIRE(!wpkg_output::silence_thread::is_silenced());
+    CATCH_REQUIRE(wpkg_output::get_output_error_count() == 0);
+    CATCH_REQUIRE(capture.get_messages().empty());
+
+    wpkg_output::log("kept")
+        .level(wpkg_output::level_info);
+    CATCH_REQUIRE(capture.get_messages().size() == 1);
+    CATCH_REQUIRE(capture.get_messages()[0] == "kept");
+}
+
+
+CATCH_TEST_CASE("OutputUnitTests::async_order","OutputUnitTests")
+{
+    capture_output capture;
+    std::vector<std::string> expected;
+    {
+        async_output async(16, wpkg_output::output::overflow_policy_block);
+        CATCH_REQUIRE(wpkg_output::get_output()->get_asynchronous());
+
+        // many more messages than the buffer can hold at once
+        for(int i(0); i < 1000; ++i)
+        {
+            const std::string msg("message " + std::to_string(i));
+            expected.push_back(msg);
+            log_info(msg);
+        }
+
+        // once flush() returns, everything was delivered
+        wpkg_output::get_output()->flush();
+        CATCH_REQUIRE(capture.get_messages() == expected);
+        CATCH_REQUIRE(wpkg_output::get_output()->get_dropped_count() == 0);
+
+        log_info("last");
+        expected.push_back("last");
+    }
+
+    // going back to synchronous output writes the pending messages
+    CATCH_REQUIRE(!wpkg_output::get_output()->get_asynchronous());
+    CATCH_REQUIRE(capture.get_messages() == expected);
+}
+
+
+CATCH_TEST_CASE("OutputUnitTests::async_policy_block","OutputUnitTests")
+{
+    capture_output capture;
+    writer_gate gate;
+    async_output async(4, wpkg_output::output::overflow_policy_block);
+
+    gate.block();
+    log_info("1");
+    log_info("2");
+    log_info("3");
+
+    // the buffer is full, the next log() waits for the writer
+    std::atomic<bool> done(false);
+    std::thread producer([&done]()
+        {
+            wpkg_output::log("4")
+                .level(wpkg_output::level_debug);
+            done = true;
+        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CATCH_REQUIRE(!done);
+
+    gate.release();
+    producer.join();
+    wpkg_output::get_output()->flush();
+
+    const std::vector<std::string> expected{ "block", "1", "2", "3", "4" };
+    CATCH_REQUIRE(capture.get_messages() == expected);
+    CATCH_REQUIRE(wpkg_output::get_output()->get_dropped_count() == 0);
+}
+
+
+CATCH_TEST_CASE("OutputUnitTests::async_policy_drop_debug","OutputUnitTests")
+{
+    capture_output capture;
+    writer_gate gate;
+    async_output async(4, wpkg_output::output::overflow_policy_drop_debug);
+
+    gate.block();
+    log_info("1");
+    log_info("2");
+    log_info("3");
+
+    // the buffer is full, debug messages get dropped
+    wpkg_output::log("dropped")
+        .level(wpkg_output::level_debug);
+    wpkg_output::log("also dropped")
+        .debug(wpkg_output::debug_flags::debug_basics);
+    CATCH_REQUIRE(wpkg_output::get_output()->get_dropped_count() == 2);
+
+    gate.release();
+    wpkg_output::get_output()->flush();
+
+    // once there is room again, debug messages go through
+    wpkg_output::log("kept")
+        .level(wpkg_output::level_debug);
+    wpkg_output::get_output()->flush();
+
+    const std::vector<std::string> expected{ "block", "1", "2", "3", "kept" };
+    CATCH_REQUIRE(capture.get_messages() == expected);
+    CATCH_REQUIRE(wpkg_output::get_output()->get_dropped_count() == 2);
+}
+
+
+CATCH_TEST_CASE("OutputUnitTests::async_policy_drop","OutputUnitTests")
+{
+    capture_output capture;
+    writer_gate gate;
+    async_output async(4, wpkg_output::output::overflow_policy_drop);
+
+    gate.block();
+    log_info("1");
+    log_info("2");
+    log_info("3");
+
+    // the buffer is full, anything below level_error gets dropped
+    wpkg_output::log("dropped warning")
+        .level(wpkg_output::level_warning);
+    log_info("dropped info");
+    wpkg_output::log("dropped debug")
+        .level(wpkg_output::level_debug);
+    CATCH_REQUIRE(wpkg_output::get_output()->get_dropped_count() == 3);
+
+    // errors are not dropped, they wait for the writer
+    std::atomic<bool> done(false);
+    std::thread producer([&done]()
+        {
+            wpkg_output::log("error")
+                .level(wpkg_output::level_error);
+            done = true;
+        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CATCH_REQUIRE(!done);
+
+    gate.release();
+    producer.join();
+
+    // log() does not return before the error was delivered
+    const std::vector<std::string> expected{ "block", "1", "2", "3", "error" };
+    CATCH_REQUIRE(capture.get_messages() == expected);
+    CATCH_REQUIRE(wpkg_output::get_output()->get_dropped_count() == 3);
+}
+
+
+CATCH_TEST_CASE("OutputUnitTests::async_synchronous_fallback","OutputUnitTests")
+{
+    capture_output capture;
+    writer_gate gate;
+    async_output async(16, wpkg_output::output::overflow_policy_block);
+
+    // errors are written before log() returns
+    gate.block();
+    log_info("1");
+    std::atomic<bool> done(false);
+    std::thread producer([&done]()
+        {
+            wpkg_output::log("error")
+                .level(wpkg_output::level_error);
+            done = true;
+        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CATCH_REQUIRE(!done);
+    gate.release();
+    producer.join();
+    {
+        const std::vector<std::string> expected{ "block", "1", "error" };
+        CATCH_REQUIRE(capture.get_messages() == expected);
+    }
+
+    // a listener which logs a message runs in the writer thread; that
+    // message gets delivered synchronously instead of being queued
+    wpkg_output::get_output()->register_raw_log_listener(
+            []( const wpkg_output::message_t& msg )
+            {
+                if(msg.get_raw_message() == "echo")
+                {
+                    wpkg_output::log("from listener")
+                        .level(wpkg_output::level_info);
+                }
+            });
+    log_info("echo");
+    log_info("2");
+    wpkg_output::get_output()->flush();
+    {
+        const std::vector<std::string> expected{ "block", "1", "error", "echo", "from listener", "2" };
+        CATCH_REQUIRE(capture.get_messages() == expected);
+    }
+    CATCH_REQUIRE(wpkg_output::get_output()->get_dropped_count() == 0);
+}
+
+
+CATCH_TEST_CASE("OutputUnitTests::async_user_listeners","OutputUnitTests")
+{
+    capture_output capture;
+    writer_gate gate;
+
+    // the user and progress listeners are only called by this thread
+    const std::thread::id main_thread(std::this_thread::get_id());
+    std::vector<std::string> user_messages;
+    bool other_thread(false);
+    wpkg_output::get_output()->register_user_log_listener(
+            [&]( const wpkg_output::message_t& msg )
+            {
+                other_thread = other_thread || std::this_thread::get_id() != main_thread;
+                user_messages.push_back(msg.get_raw_message());
+            });
+    std::vector<uint64_t> progress;
+    wpkg_output::get_output()->register_progress_listener(
+            [&]( const wpkg_output::progress_record_t& record )
+            {
+                other_thread = other_thread || std::this_thread::get_id() != main_thread;
+                progress.push_back(record.get_current_progress());
+            });
+    async_output async(16, wpkg_output::output::overflow_policy_block);
+
+    // while the writer is blocked, the user listeners still get the
+    // messages before log() returns
+    gate.block();
+    log_info("1");
+    {
+        const std::vector<std::string> expected{ "block", "1" };
+        CATCH_REQUIRE(user_messages == expected);
+    }
+    wpkg_output::progress_record_t record;
+    record.set_current_progress(3);
+    record.set_progress_max(10);
+    wpkg_output::get_output()->progress(record);
+    CATCH_REQUIRE(progress.size() == 1);
+    CATCH_REQUIRE(progress[0] == 3);
+    CATCH_REQUIRE(capture.get_messages().size() == 1);
+
+    gate.release();
+    wpkg_output::get_output()->flush();
+    {
+        const std::vector<std::string> expected{ "block", "1" };
+        CATCH_REQUIRE(capture.get_messages() == expected);
+    }
+    CATCH_REQUIRE(!other_thread);
+}
+
+
+CATCH_TEST_CASE("OutputUnitTests::debug_flags","OutputUnitTests")
+{
+    auto output( wpkg_output::get_output() );
+    output->clear_listeners();
+    output->set_debug_flags(wpkg_output::debug_flags::debug_none);
+    output->set_log_debug_flags(wpkg_output::debug_flags::debug_all);
+
+    // nobody listens
+    CATCH_REQUIRE(!wpkg_output::is_debug_enabled(wpkg_output::debug_flags::debug_basics));
+    CATCH_REQUIRE(!wpkg_output::is_debug_enabled(wpkg_output::debug_flags::debug_all));
+
+    // the user listeners accept the flags given to set_debug_flags()
+    output->set_debug_flags(wpkg_output::debug_flags::debug_basics);
+    CATCH_REQUIRE(wpkg_output::is_debug_enabled(wpkg_output::debug_flags::debug_basics));
+    CATCH_REQUIRE(!wpkg_output::is_debug_enabled(wpkg_output::debug_flags::debug_detail_files));
+    output->set_debug_flags(wpkg_output::debug_flags::debug_none);
+
+    {
+        // a raw log listener accepts everything by default
+        capture_output capture;
+        CATCH_REQUIRE(wpkg_output::is_debug_enabled(wpkg_output::debug_flags::debug_detail_files));
+        CATCH_REQUIRE(wpkg_output::is_debug_enabled(wpkg_output::debug_flags::debug_metrics));
+
+        // unless restricted with set_log_debug_flags()
+        output->set_log_debug_flags(wpkg_output::debug_flags::debug_detail_files);
+        CATCH_REQUIRE(output->get_log_debug_flags() == wpkg_output::debug_flags::debug_detail_files);
+        CATCH_REQUIRE(wpkg_output::is_debug_enabled(wpkg_output::debug_flags::debug_detail_files));
+        CATCH_REQUIRE(!wpkg_output::is_debug_enabled(wpkg_output::debug_flags::debug_detail_config));
+        CATCH_REQUIRE(wpkg_output::is_debug_enabled(wpkg_output::debug_flags::debug_detail_files
+                                                  | wpkg_output::debug_flags::debug_detail_config));
+
+        wpkg_output::log("files")
+            .debug(wpkg_output::debug_flags::debug_detail_files);
+        wpkg_output::log("config")
+            .debug(wpkg_output::debug_flags::debug_detail_config);
+        wpkg_output::log("info")
+            .level(wpkg_output::level_info);
+
+        // only the debug messages matching the log flags get through,
+        // the other levels are not affected
+        const std::vector<std::string> expected{ "files", "info" };
+        CATCH_REQUIRE(capture.get_messages() == expected);
+    }
+
+    // the flags get recomputed when the listeners are removed
+    CATCH_REQUIRE(!wpkg_output::is_debug_enabled(wpkg_output::debug_flags::debug_detail_files));
+    output->set_log_debug_flags(wpkg_output::debug_flags::debug_all);
+}
+
+
+CATCH_TEST_CASE("OutputUnitTests::debug_early_out","OutputUnitTests")
+{
+    auto output( wpkg_output::get_output() );
+    output->set_debug_flags(wpkg_output::debug_flags::debug_none);
+    output->set_log_debug_flags(wpkg_output::debug_flags::debug_basics);
+
+    capture_output capture;
+    std::vector<std::string> user_messages;
+    output->register_user_log_listener(
+            [&user_messages]( const wpkg_output::message_t& msg )
+            {
+                user_messages.push_back(msg.get_raw_message());
+            });
+    std::vector<uint64_t> progress;
+    output->register_progress_listener(
+            [&progress]( const wpkg_output::progress_record_t& record )
+            {
+                progress.push_back(record.get_current_progress());
+            });
+
+    // the arguments of a disabled statement are not even computed
+    int computed(0);
+    WPKG_OUTPUT_IF_DEBUG(wpkg_output::debug_flags::debug_detail_files)
+        wpkg_output::log("skipped %1")
+                .arg(++computed)
+            .debug(wpkg_output::debug_flags::debug_detail_files);
+    CATCH_REQUIRE(computed == 0);
+    WPKG_OUTPUT_IF_DEBUG(wpkg_output::debug_flags::debug_basics)
+        wpkg_output::log("kept %1")
+                .arg(++computed)
+            .debug(wpkg_output::debug_flags::debug_basics);
+    CATCH_REQUIRE(computed == 1);
+
+    // a debug message nobody listens to is dropped by ~log() but its
+    // progress record is still sent
+    wpkg_output::progress_record_t record;
+    record.set_current_progress(5);
+    record.set_progress_max(10);
+    wpkg_output::log("dropped")
+            .progress(record)
+        .debug(wpkg_output::debug_flags::debug_detail_config);
+
+    const std::vector<std::string> expected{ "kept 1" };
+    CATCH_REQUIRE(capture.get_messages() == expected);
+    CATCH_REQUIRE(user_messages.empty());
+    CATCH_REQUIRE(progress == std::vector<uint64_t>{ 5 });
+
+    output->set_log_debug_flags(wpkg_output::debug_flags::debug_all);
+}
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,219 @@
+/*    unittest_reverse_dependencies.cpp
+ *    Copyright (C) 2013-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+
+#include "unittest_main.h"
+
+#include "libdebpackages/wpkgar_reverse_dependencies.h"
+
+#include <catch.hpp>
+
+#if defined(MO_WINDOWS)
+#   include <sys/utime.h>
+#else
+#   include <utime.h>
+#endif
+
+using namespace test_common;
+using namespace wpkgar;
+
+
+class ReverseDependenciesUnitTests : public wpkg_tools
+{
+public:
+    ReverseDependenciesUnitTests();
+
+    void cache_invalidation();
+
+private:
+    typedef wpkgar_reverse_dependencies::name_list_t name_list_t;
+
+    wpkgar_manager::pointer_t       new_manager() const;
+    name_list_t                     get_dependents(const std::string& name) const;
+    std::string                     read_file(const wpkg_filename::uri_filename& filename) const;
+    void                            write_file(const wpkg_filename::uri_filename& filename, const std::string& data, time_t mtime) const;
+    void                            create_and_install(const std::string& name, const std::string& depends);
+};
+
+
+ReverseDependenciesUnitTests::ReverseDependenciesUnitTests()
+    : wpkg_tools()
+{
+    init_database();
+}
+
+
+/** \brief Create a new manager.
+ *
+ * The manager caches the packages it loads so each check uses a new
+ * manager, just like a new run of wpkg would.
+ */
+wpkgar_manager::pointer_t ReverseDependenciesUnitTests::new_manager() const
+{
+    wpkgar_manager::pointer_t manager( new wpkgar_manager );
+    manager->set_root_path     ( get_target_path()   );
+    manager->set_database_path ( get_database_path() );
+    return manager;
+}
+
+
+ReverseDependenciesUnitTests::name_list_t ReverseDependenciesUnitTests::get_dependents(const std::string& name) const
+{
+    wpkgar_reverse_dependencies graph( new_manager() );
+    graph.load();
+    CATCH_REQUIRE( graph.is_loaded() );
+    return graph.get_dependents( name, wpkgar_reverse_dependencies::dependency_kind_runtime );
+}
+
+
+std::string ReverseDependenciesUnitTests::read_file(const wpkg_filename::uri_filename& filename) const
+{
+    memfile::memory_file data;
+    data.read_file(filename);
+    std::string result(data.size(), '\0');
+    data.read(&result[0], 0, data.size());
+    return result;
+}
+
+
+/** \brief Replace a file and give it the specified modification time.
+ */
+void ReverseDependenciesUnitTests::write_file(const wpkg_filename::uri_filename& filename, const std::string& data, time_t mtime) const
+{
+    memfile::memory_file file;
+    file.create(memfile::memory_file::file_format_other);
+    file.write(data.c_str(), 0, static_cast<int>(data.length()));
+    file.write_file(filename);
+
+#if defined(MO_WINDOWS)
+    struct _utimbuf times;
+    times.actime = mtime;
+    times.modtime = mtime;
+    CATCH_REQUIRE( _wutime(filename.os_filename().get_os_string().c_str(), &times) == 0 );
+#else
+    struct utimbuf times;
+    times.actime = mtime;
+    times.modtime = mtime;
+    CATCH_REQUIRE( utime(filename.os_filename().get_os_string().c_str(), &times) == 0 );
+#endif
+}
+
+
+void ReverseDependenciesUnitTests::create_and_install(const std::string& name, const std::string& depends)
+{
+    control_file_pointer_t ctrl(get_new_control_file(name));
+    ctrl->set_field("Files", "conffiles\n"
+                             "/usr/bin/" + name + " 0123456789abcdef0123456789abcdef\n"
+                    );
+    if(!depends.empty())
+    {
+        ctrl->set_field("Depends", depends);
+    }
+    create_package(name, ctrl);
+    install_package(name, ctrl, 0);
+}
+
+
+void ReverseDependenciesUnitTests::cache_invalidation()
+{
+    create_and_install("r1", "");
+    create_and_install("r3", "");
+    create_and_install("r2", "r1");
+
+    const wpkg_filename::uri_filename cache_filename(wpkgar_reverse_dependencies::get_cache_filename(new_manager()));
+    const wpkg_filename::uri_filename r2_control(get_database_path().append_child("r2/control"));
+
+    // the first load creates the cache
+    cache_filename.os_unlink();
+    CATCH_REQUIRE( get_dependents("r1") == name_list_t{ "r2" } );
+    CATCH_REQUIRE( get_dependents("r3").empty() );
+    CATCH_REQUIRE( cache_filename.exists() );
+
+    // when the control file did not change the cache is trusted, so
+    // tweaking the cache shows up in the graph
+    const std::string cache(read_file(cache_filename));
+    {
+        std::string fake(cache);
+        const std::string::size_type pos(fake.find("\nr2 "));
+        CATCH_REQUIRE( pos != std::string::npos );
+        const std::string::size_type end(fake.find('\n', pos + 1));
+        const std::string::size_type deps(fake.rfind(" r1 ", end));
+        CATCH_REQUIRE( deps != std::string::npos );
+        CATCH_REQUIRE( deps > pos );
+        fake[deps + 2] = '3';
+        write_file(cache_filename, fake, time(nullptr));
+    }
+    CATCH_REQUIRE( get_dependents("r1").empty() );
+    CATCH_REQUIRE( get_dependents("r3") == name_list_t{ "r2" } );
+
+    // restore the valid cache
+    write_file(cache_filename, cache, time(nullptr));
+    CATCH_REQUIRE( get_dependents("r1") == name_list_t{ "r2" } );
+
+    wpkg_filename::uri_filename::file_stat s;
+    CATCH_REQUIRE( r2_control.os_stat(s) == 0 );
+    const time_t original_mtime(s.get_mtime());
+    const std::string control(read_file(r2_control));
+    const std::string::size_type depends(control.find("Depends: r1\n"));
+    CATCH_REQUIRE( depends != std::string::npos );
+
+    // stale cache: same size, different mtime
+    {
+        std::string same_size(control);
+        same_size[depends + 10] = '3';
+        write_file(r2_control, same_size, original_mtime + 10);
+    }
+    CATCH_REQUIRE( get_dependents("r1").empty() );
+    CATCH_REQUIRE( get_dependents("r3") == name_list_t{ "r2" } );
+
+    // stale cache: same mtime, different size
+    {
+        std::string bigger(control);
+        bigger.replace(depends, 12, "Depends: r1, r3\n");
+        write_file(r2_control, bigger, original_mtime + 10);
+    }
+    CATCH_REQUIRE( get_dependents("r1") == name_list_t{ "r2" } );
+    CATCH_REQUIRE( get_dependents("r3") == name_list_t{ "r2" } );
+
+    // a package that disappeared from the database is dropped from the
+    // graph and the cache (a purged package stays in the database with
+    // a not-installed status so we delete its directory instead)
+    get_database_path().append_child("r2").os_unlink_rf();
+    CATCH_REQUIRE( get_dependents("r1").empty() );
+    CATCH_REQUIRE( get_dependents("r3").empty() );
+    CATCH_REQUIRE( read_file(cache_filename).find("\nr2 ") == std::string::npos );
+
+    // an invalid cache is ignored and replaced
+    write_file(cache_filename, "r4 invalid\n", time(nullptr));
+    create_and_install("r4", "r3");
+    CATCH_REQUIRE( get_dependents("r1").empty() );
+    CATCH_REQUIRE( get_dependents("r3") == name_list_t{ "r4" } );
+    CATCH_REQUIRE( read_file(cache_filename).find("\nr4 ") != std::string::npos );
+}
+
+
+CATCH_TEST_CASE( "ReverseDependenciesUnitTests::cache_invalidation", "ReverseDependenciesUnitTests" )
+{
+    ReverseDependenciesUnitTests rdut;
+    rdut.cache_invalidation();
+}
+
+
+// vim: ts=4 sw=4 et
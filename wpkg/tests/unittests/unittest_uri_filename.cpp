@@ -1660,6 +1660,67 @@ CATCH_TEST_CASE("URIFilenameUnitTests::common_segments","URIFilenameUnitTests")
 }
 
 
+namespace
+{
+    const char *append_child_samples[][3] =
+    {
+        // parent, child, expected full path
+        { "/usr",                   "bin",                  "/usr/bin" },
+        { "/usr/",                  "bin",                  "/usr/bin" },
+        { "/usr///",                "///bin",               "/usr/bin" },
+        { "/",                      "etc",                  "/etc" },
+        { "/",                      "/etc/",                "/etc/" },
+        { "usr/share",              "doc/wpkg/README.gz",   "usr/share/doc/wpkg/README.gz" },
+        { "usr/share",              "doc//wpkg\\copyright", "usr/share/doc/wpkg/copyright" },
+        { "tmp",                    "archive.tar.bz2",      "tmp/archive.tar.bz2" },
+        { "tmp",                    ".hidden",              "tmp/.hidden" },
+        { "tmp",                    "..",                   "tmp/.." },
+        { "tmp",                    "dir/",                 "tmp/dir/" },
+        { "tmp",                    "",                     "tmp/" },
+        { "C:/Program Files",       "wpkg/wpkg.exe",        "C:/Program Files/wpkg/wpkg.exe" },
+        { "http://m2osw.com/repo",  "index.tar.gz",         "http://m2osw.com/repo/index.tar.gz" },
+        { "file:///opt/repo",       "sample_1.0_all.deb",   "/opt/repo/sample_1.0_all.deb" },
+        { ".",                      "control",              "control" }
+    };
+}
+
+
+CATCH_TEST_CASE("URIFilenameUnitTests::append_child","URIFilenameUnitTests")
+{
+    for(size_t i(0); i < sizeof(append_child_samples) / sizeof(append_child_samples[0]); ++i)
+    {
+        wpkg_filename::uri_filename parent(append_child_samples[i][0]);
+        wpkg_filename::uri_filename result(parent.append_child(append_child_samples[i][1]));
+        wpkg_filename::uri_filename expected(append_child_samples[i][2]);
+        ASSERT_MESSAGE("got: \"" + result.full_path() + "\", expected: \"" + append_child_samples[i][2] + "\"", result.full_path() == append_child_samples[i][2]);
+
+        // the result must be exactly what a full parse generates
+        CATCH_REQUIRE(result.original_filename() == expected.original_filename());
+        CATCH_REQUIRE(result.path_type() == expected.path_type());
+        CATCH_REQUIRE(result.path_scheme() == expected.path_scheme());
+        CATCH_REQUIRE(result.path_only() == expected.path_only());
+        CATCH_REQUIRE(result.dirname() == expected.dirname());
+        CATCH_REQUIRE(result.basename() == expected.basename());
+        CATCH_REQUIRE(result.extension() == expected.extension());
+        CATCH_REQUIRE(result.previous_extension() == expected.previous_extension());
+        CATCH_REQUIRE(result.msdos_drive() == expected.msdos_drive());
+        CATCH_REQUIRE(result.get_decode() == expected.get_decode());
+        CATCH_REQUIRE(result.is_deb() == expected.is_deb());
+        CATCH_REQUIRE(result.is_absolute() == expected.is_absolute());
+        CATCH_REQUIRE(result.segment_size() == expected.segment_size());
+        for(int j(0); j < result.segment_size(); ++j)
+        {
+            CATCH_REQUIRE(result.segment(j) == expected.segment(j));
+        }
+    }
+
+    // invalid MS-Windows names are still caught
+    wpkg_filename::uri_filename parent("/tmp");
+    CATCH_REQUIRE_THROWS_AS(parent.append_child("sub/con"), wpkg_filename::wpkg_filename_exception_parameter);
+    CATCH_REQUIRE_THROWS_AS(parent.append_child("bad<name"), wpkg_filename::wpkg_filename_exception_parameter);
+}
+
+
 /** \brief Generate a random filename.
  *
  * This function generates a long random filename composed of digits
@@ -0,0 +1,91 @@
+/*    unittest_verify.cpp
+ *    Copyright (C) 2013-2015  Made to Order Software Corporation
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *    Authors
+ *    Alexis Wilke   alexis@m2osw.com
+ */
+
+#include "unittest_main.h"
+#include "libdebpackages/wpkg_verify.h"
+
+#include <stdlib.h>
+#include <catch.hpp>
+
+#include <vector>
+
+
+CATCH_TEST_CASE("VerifyUnitTests::md5sums_verifier","VerifyUnitTests")
+{
+    wpkg_filename::uri_filename tmpdir(test_common::wpkg_tools::get_tmp_dir());
+    wpkg_filename::uri_filename dir(tmpdir.append_child("md5sums_verifier"));
+    dir.os_mkdir_p();
+
+    // files of various sizes, including empty and multi-chunk files
+    const int sizes[] = { 0, 1, 63, 64, 65, 4096, 1024 * 1024, 1024 * 1024 + 17, 3 * 1024 * 1024 - 5 };
+    const int count(static_cast<int>(sizeof(sizes) / sizeof(sizes[0])));
+    std::vector<std::string> md5sums;
+    for(int i(0); i < count; ++i)
+    {
+        memfile::memory_file file;
+        file.create(memfile::memory_file::file_format_other);
+        std::vector<char> buf(sizes[i] + 1);
+        for(int j(0); j < sizes[i]; ++j)
+        {
+            buf[j] = static_cast<char>(rand());
+        }
+        file.write(&buf[0], 0, sizes[i]);
+        file.write_file(dir.append_child(std::string("file") + static_cast<char>('a' + i)));
+        md5sums.push_back(file.md5sum());
+    }
+
+    for(int jobs(1); jobs <= 4; jobs += 3)
+    {
+        wpkg_verify::md5sums_verifier verifier;
+        verifier.set_jobs(jobs);
+        for(int i(0); i < count; ++i)
+        {
+            // corrupt one expected md5sum out of three
+            std::string expected(md5sums[i]);
+            if(i % 3 == 2)
+            {
+                expected[0] = expected[0] == '0' ? '1' : '0';
+            }
+            verifier.add_file(dir.append_child(std::string("file") + static_cast<char>('a' + i)), expected);
+        }
+        verifier.add_file(dir.append_child("missing"), md5sums[0]);
+        verifier.run();
+
+        CATCH_REQUIRE(verifier.size() == static_cast<size_t>(count + 1));
+        for(int i(0); i < count; ++i)
+        {
+            const wpkg_verify::md5sums_verifier::file_entry& entry(verifier.get_entry(i));
+            CATCH_REQUIRE(entry.get_md5sum() == md5sums[i]);
+            CATCH_REQUIRE(entry.get_status() == (i % 3 == 2
+                            ? wpkg_verify::md5sums_verifier::verify_status_invalid
+                            : wpkg_verify::md5sums_verifier::verify_status_valid));
+        }
+        CATCH_REQUIRE(verifier.get_entry(count).get_status() == wpkg_verify::md5sums_verifier::verify_status_error);
+        CATCH_REQUIRE(!verifier.get_entry(count).get_error().empty());
+    }
+
+    // the static helpers give the same result
+    CATCH_REQUIRE(wpkg_verify::md5sums_verifier::file_md5sum(dir.append_child("filee")) == md5sums[4]);
+    CATCH_REQUIRE_THROWS_AS(wpkg_verify::md5sums_verifier::file_md5sum(dir.append_child("missing")), memfile::memfile_exception_io);
+}
+
+
+// vim: ts=4 sw=4 et
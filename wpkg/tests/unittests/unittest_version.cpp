@@ -313,6 +313,105 @@ CATCH_TEST_CASE("VersionUnitTests::invalid_versions","VersionUnitTests")
 }
 
 
+CATCH_TEST_CASE("VersionUnitTests::compare_versions","VersionUnitTests")
+{
+    struct compare_t
+    {
+        char const *    f_left;
+        char const *    f_right;
+        int             f_result;
+    };
+    compare_t const compares[] =
+    {
+        { "1.0",            "1.0",              0 },
+        { "1.0",            "1",                0 },
+        { "1.0",            "1.0.0-0",          0 },
+        { "1.3.",           "1.3",              0 },
+        { "1.9",            "1.10",            -1 },
+        { "1.0~rc1",        "1.0+rc1",         -1 },
+        { "1.0a",           "1.0+",            -1 },
+        { "1.0+",           "1.0",              1 },
+        { "1:0.5",          "2.0",              1 },
+        { "1;0.5",          "1:0.5",            0 },
+        { "1.0-2",          "1.0-10",          -1 },
+        { "1.0-a",          "1.0-b",           -1 },
+        { "2.0A",           "2.0a",             0 },
+        { "3.00001",        "3.1",              0 },
+        { "3.123456789012", "3.123456789013",  -1 },
+    };
+
+    for(size_t i(0); i < sizeof(compares) / sizeof(compares[0]); ++i)
+    {
+        debian_version::value l;
+        debian_version::value r;
+        CATCH_REQUIRE(l.set(compares[i].f_left));
+        CATCH_REQUIRE(r.set(compares[i].f_right));
+        ASSERT_MESSAGE(std::string(compares[i].f_left) + " <=> " + compares[i].f_right, l.compare(r) == compares[i].f_result);
+        CATCH_REQUIRE(r.compare(l) == -compares[i].f_result);
+
+        // the C API gives the same results
+        debian_version_handle_t hl(string_to_debian_version(compares[i].f_left, NULL, 0));
+        debian_version_handle_t hr(string_to_debian_version(compares[i].f_right, NULL, 0));
+        CATCH_REQUIRE(debian_versions_compare(hl, hr) == compares[i].f_result);
+        delete_debian_version(hl);
+        delete_debian_version(hr);
+    }
+
+    // canonicalization
+    {
+        debian_version::value v;
+        CATCH_REQUIRE(v.set("0:01.2.0.0-0"));
+        CATCH_REQUIRE(v.to_string() == "1.2");
+        CATCH_REQUIRE(v.set("3;1.0-Rc1"));
+        CATCH_REQUIRE(v.to_string() == "3:1-rc1");
+    }
+
+    // errors
+    {
+        debian_version::value v;
+        char const *error_msg(NULL);
+        CATCH_REQUIRE(!v.set("1.0-", &error_msg));
+        CATCH_REQUIRE(strcmp(error_msg, "empty revision") == 0);
+        CATCH_REQUIRE(!v.is_valid());
+    }
+
+    // versions too long for the internal buffer
+    {
+        std::string const base(debian_version::value::BUFFER_SIZE * 2, '1');
+        debian_version::value l;
+        debian_version::value r;
+        CATCH_REQUIRE(l.set(base + ".1"));
+        CATCH_REQUIRE(r.set(base + ".2"));
+        CATCH_REQUIRE(l < r);
+        CATCH_REQUIRE(l.to_string() == base + ".1");
+    }
+}
+
+
+CATCH_TEST_CASE("VersionUnitTests::sort_versions","VersionUnitTests")
+{
+    std::vector<std::string> const strings = { "1.10", "1:0.1", "1.9", "1.9+b1", "1.9-1", "0.5" };
+    std::vector<debian_version::value> versions(strings.size());
+    for(size_t i(0); i < strings.size(); ++i)
+    {
+        CATCH_REQUIRE(versions[i].set(strings[i]));
+    }
+
+    debian_version::sort(versions);
+    char const *expected[] = { "0.5", "1.9", "1.9-1", "1.9+b1", "1.10", "1:0.1" };
+    for(size_t i(0); i < versions.size(); ++i)
+    {
+        CATCH_REQUIRE(versions[i].to_string() == expected[i]);
+    }
+
+    CATCH_REQUIRE(debian_version::find_max(strings) == 1);
+    CATCH_REQUIRE(debian_version::find_max(versions) == versions.size() - 1);
+    CATCH_REQUIRE(debian_version::find_max(std::vector<std::string>()) == debian_version::value::npos);
+    CATCH_REQUIRE_THROWS_AS(debian_version::find_max(std::vector<std::string>({ "1.0", "-3" })), std::invalid_argument);
+}
+
+
+
 
 
 
@@ -248,8 +248,7 @@ int dar(int argc, char *argv[])
         m.read_file(archive);
         if(m.is_compressed())
         {
-            memfile::memory_file d;
-            m.copy(d);
+            memfile::memory_file d(std::move(m));
             d.decompress(m);
         }
         if(m.get_format() != memfile::memory_file::file_format_ar
@@ -775,6 +775,8 @@ int main(int argc, char *argv[])
     };
 
     wpkg_output::output::get_output().lock()->register_raw_log_listener( log_message );
+    // log_message() never prints debug messages
+    wpkg_output::output::get_output().lock()->set_log_debug_flags( wpkg_output::debug_flags::debug_none );
 
     std::vector<std::string> configuration_files;
     advgetopt::getopt opt(argc, argv, options, configuration_files, "");
@@ -846,7 +848,7 @@ int main(int argc, char *argv[])
     if(max == 0)
     {
         // if no .deb, try to check for installed packages instead
-        wpkgar::wpkgar_lock lock_wpkg( g_manager, "Listing" );
+        wpkgar::wpkgar_lock lock_wpkg( g_manager, "Listing", wpkgar::wpkgar_lock::lock_mode_shared );
         wpkgar::wpkgar_manager::package_list_t list;
         g_manager->list_installed_packages(list);
         for(wpkgar::wpkgar_manager::package_list_t::const_iterator it(list.begin());
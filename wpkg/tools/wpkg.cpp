@@ -28,13 +28,16 @@
  * libdebpackages library.
  */
 #include    "libdebpackages/wpkgar_build.h"
+#include    "libdebpackages/wpkgar_download_cache.h"
 #include    "libdebpackages/wpkgar_install.h"
 #include    "libdebpackages/wpkgar_remove.h"
 #include    "libdebpackages/wpkgar_repository.h"
 #include    "libdebpackages/wpkgar_tracker.h"
 #include    "libdebpackages/wpkg_util.h"
 #include    "libdebpackages/wpkg_copyright.h"
+#include    "libdebpackages/wpkg_metrics.h"
 #include    "libdebpackages/wpkg_stream.h"
+#include    "libdebpackages/wpkg_verify.h"
 #include    "libdebpackages/advgetopt.h"
 #include    "libdebpackages/debian_packages.h"
 #include    "libdebpackages/debian_version.h"
@@ -48,6 +51,7 @@
 #include    <errno.h>
 #include    <signal.h>
 #include    <algorithm>
+#include    <atomic>
 #ifdef MO_WINDOWS
 #   include    <time.h>
 #else
@@ -104,6 +108,20 @@ public:
 wpkg_interrupt interrupt;
 
 
+/** \brief Print the profiler report.
+ *
+ * When --profile is used, this function is registered with atexit() so
+ * the report gets printed in stderr however wpkg exits. The folded stacks
+ * can be given as is to a flame graph generator; the other lines start
+ * with a '#'.
+ */
+void print_profile()
+{
+    wpkg_metrics::set_profiling(false);
+    fprintf(stderr, "%s", wpkg_metrics::get_profile_report(20).c_str());
+}
+
+
 
 /** \brief Handling of the library output.
  *
@@ -145,7 +163,7 @@ private:
     std::string                             f_output_filename;
     wpkg_stream::fstream                    f_output;
     wpkg_output::level_t                    f_log_level;
-    mutable wpkg_output::level_t            f_highest_level;
+    mutable std::atomic<wpkg_output::level_t> f_highest_level;
     output_format_t                         f_format;
 };
 
@@ -195,7 +213,10 @@ void tool_output::log_message(const wpkg_output::message_t& msg) const
 {
     if(f_output.good())
     {
-        std::string message(msg.get_full_message(false));
+        // metrics are JSON lines, keep them as is so tools can parse them
+        std::string message(msg.get_module() == wpkg_output::module_metrics
+                    ? msg.get_raw_message()
+                    : msg.get_full_message(false));
         f_output.write(message.c_str(), message.length());
         if(message.length() > 0 && message[message.length() - 1] != '\n')
         {
@@ -208,9 +229,11 @@ void tool_output::output_message( const wpkg_output::message_t& msg ) const
 {
     const wpkg_output::level_t level = msg.get_level();
     //
-    if(level > f_highest_level)
+    // messages may be emitted by several threads
+    wpkg_output::level_t highest(f_highest_level);
+    while(level > highest && !f_highest_level.compare_exchange_weak(highest, level))
     {
-        f_highest_level = level;
+        // highest was reloaded by compare_exchange_weak()
     }
     if(wpkg_output::compare_levels(level, f_log_level) >= 0
     || (msg.get_debug_flags() & wpkg_output::debug_flags::debug_progress) != 0)
@@ -378,6 +401,7 @@ public:
     bool verbose() const;
     bool dry_run(bool msg = true) const;
     int zlevel() const;
+    int jobs() const;
     memfile::memory_file::file_format_t compressor() const;
 
     void add_filename(const std::string& option, const std::string& repository_filename);
@@ -396,6 +420,7 @@ private:
     controlled_vars::flbool_t               f_verbose;
     controlled_vars::flbool_t               f_dry_run;
     zlevel_t                                f_zlevel;
+    controlled_vars::zint32_t               f_jobs;
     wpkg_output::debug_flags::safe_debug_t  f_debug_flags;
     memfile::memory_file::file_format_t     f_compressor;
     std::string                             f_option;
@@ -1166,6 +1191,14 @@ const advgetopt::getopt::option wpkg_options[] =
         "field-variables",
         advgetopt::getopt::required_multiple_argument
     },
+    {
+        '\0',
+        advgetopt::getopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE | advgetopt::getopt::GETOPT_FLAG_CONFIGURATION_FILE,
+        "download-cache-size",
+        "256",
+        "maximum size in Mb of the cache of files downloaded from remote repositories (0 to not save downloaded files)",
+        advgetopt::getopt::required_argument
+    },
     {
         '\0',
         advgetopt::getopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE | advgetopt::getopt::GETOPT_FLAG_CONFIGURATION_FILE,
@@ -1366,6 +1399,14 @@ const advgetopt::getopt::option wpkg_options[] =
         "let wpkg know that it is interactive",
         advgetopt::getopt::required_argument
     },
+    {
+        'j',
+        advgetopt::getopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE | advgetopt::getopt::GETOPT_FLAG_CONFIGURATION_FILE,
+        "jobs",
+        "1",
+        "number of files verified concurrently by --audit and --md5sums-check; 0 uses one job per processor",
+        advgetopt::getopt::required_argument
+    },
     {
         '\0',
         advgetopt::getopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE | advgetopt::getopt::GETOPT_FLAG_CONFIGURATION_FILE,
@@ -1534,6 +1575,14 @@ const advgetopt::getopt::option wpkg_options[] =
         "show numbers instead of user/group names and mode flags",
         advgetopt::getopt::no_argument
     },
+    {
+        '\0',
+        advgetopt::getopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE | advgetopt::getopt::GETOPT_FLAG_CONFIGURATION_FILE,
+        "offline",
+        NULL,
+        "do not download anything, files from remote repositories must be available in the download cache",
+        advgetopt::getopt::no_argument
+    },
     {
         '\0',
         advgetopt::getopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE | advgetopt::getopt::GETOPT_FLAG_CONFIGURATION_FILE,
@@ -1582,6 +1631,14 @@ const advgetopt::getopt::option wpkg_options[] =
         "while building a package, warn about paths that are over this length (range 64 to 65536); to get an error instead of a warning use --enforce-path-length-limit instead",
         advgetopt::getopt::required_argument
     },
+    {
+        '\0',
+        0,
+        "profile",
+        NULL,
+        "time the main functions of the library and print the resulting folded stacks (flame graph input) and the most expensive functions in stderr on exit",
+        advgetopt::getopt::no_argument
+    },
     {
         'q',
         advgetopt::getopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE | advgetopt::getopt::GETOPT_FLAG_CONFIGURATION_FILE,
@@ -2155,6 +2212,7 @@ const help_t advanced_help[] =
         "   010000    Trigger activation and processing (not implemented in wpkg).\n"
         "   020000    Detailed output for each trigger (not implemented in wpkg).\n"
         "   040000    All output about each trigger (not implemented in wpkg).\n"
+        "   100000    Timings and counters as JSON lines (always saved with --log-output).\n"
         "All those flags can be merged (added together)."
     },
     {
@@ -2241,6 +2299,7 @@ command_line::command_line(int argc, char *argv[], std::vector<std::string> conf
     //, f_verbose(false) -- auto-init
     //, f_dry_run(false) -- auto-init
     , f_zlevel(9)
+    //, f_jobs(0) -- auto-init
     //, f_debug_flags(debug_none)
     , f_compressor(memfile::memory_file::file_format_best)
     , f_option("filename")
@@ -2654,6 +2713,9 @@ command_line::command_line(int argc, char *argv[], std::vector<std::string> conf
     // compression level (1-9)
     f_zlevel = f_opt.get_long("zlevel", 0, 1, 9);
 
+    // number of files verified concurrently (0 means one per processor)
+    f_jobs = static_cast<int32_t>(f_opt.get_long("jobs", 0, 0, 1024));
+
     // compressor name (none, best, gzip, bzip2, xz, lzma)
     if(f_opt.is_defined("compressor"))
     {
@@ -2719,6 +2781,12 @@ command_line::command_line(int argc, char *argv[], std::vector<std::string> conf
     }
     output->set_debug_flags(f_debug_flags);
 
+    // without a log file the raw log listener has nothing to do with
+    // debug messages so do not even format those
+    output->set_log_debug_flags(g_output.get_output_file().empty()
+                    ? wpkg_output::debug_flags::debug_none
+                    : wpkg_output::debug_flags::debug_all);
+
     // user wants JSON or XML output?
     if(f_opt.is_defined("output-json"))
     {
@@ -2734,6 +2802,21 @@ command_line::command_line(int argc, char *argv[], std::vector<std::string> conf
         g_output.set_format(tool_output::output_format_t::format_xml);
     }
 
+    // write the log file from a separate thread so it does not slow
+    // down the work itself; this has to happen once the output is
+    // fully setup since the tool_output fields are not protected
+    if(!g_output.get_output_file().empty())
+    {
+        output->set_asynchronous(true);
+    }
+
+    // profile the library functions and print a report on exit
+    if(f_opt.is_defined("profile"))
+    {
+        wpkg_metrics::set_profiling(true);
+        atexit(print_profile);
+    }
+
     // if the default files is turn on, keep the temporary files
     if(f_debug_flags & wpkg_output::debug_flags::debug_detail_files)
     {
@@ -2876,6 +2959,11 @@ int command_line::zlevel() const
     return f_zlevel;
 }
 
+int command_line::jobs() const
+{
+    return f_jobs;
+}
+
 memfile::memory_file::file_format_t command_line::compressor() const
 {
     return f_compressor;
@@ -2959,6 +3047,11 @@ void init_manager(command_line& cl, wpkgar::wpkgar_manager::pointer_t manager, c
     manager->set_root_path(cl.opt().get_string("root"));
     manager->set_inst_path(cl.opt().get_string("instdir"));
     manager->set_database_path(cl.opt().get_string("admindir"));
+    {
+        std::shared_ptr<wpkgar::wpkgar_download_cache> cache(manager->get_download_cache());
+        cache->set_max_size(cl.opt().get_long("download-cache-size", 0, 0, 1024 * 1024) * 1024LL * 1024LL);
+        cache->set_offline(cl.opt().is_defined("offline"));
+    }
 
     std::shared_ptr<wpkgar::wpkgar_tracker> tracker;
     if(cl.opt().is_defined("tracking-journal"))
@@ -3221,6 +3314,7 @@ void install(command_line& cl, const wpkg_filename::uri_filename package_name =
     wpkgar::wpkgar_install::pointer_t installer( new wpkgar::wpkgar_install(manager) );
     init_installer(cl, manager, installer, option, package_name);
     installer->set_installing();
+    installer->set_prefetch(!cl.dry_run(false));
 
     wpkgar::wpkgar_lock lock_wpkg(manager, "Installing");
 
@@ -3440,6 +3534,7 @@ void unpack(command_line& cl)
     wpkgar::wpkgar_install::pointer_t installer( new wpkgar::wpkgar_install(manager) );
     init_installer(cl, manager, installer, "unpack");
     installer->set_unpacking();
+    installer->set_prefetch(!cl.dry_run(false));
 
     wpkgar::wpkgar_lock lock_wpkg(manager, "Installing");
     if(installer->validate() && !cl.dry_run())
@@ -4027,7 +4122,7 @@ void audit(command_line& cl)
         wpkgar::wpkgar_manager::pointer_t manager( new wpkgar::wpkgar_manager );
         init_manager(cl, manager, "audit");
         // auditing is very similar to listing so at this point we use that status
-        wpkgar::wpkgar_lock lock_wpkg(manager, "Listing");
+        wpkgar::wpkgar_lock lock_wpkg(manager, "Listing", wpkgar::wpkgar_lock::lock_mode_shared);
         wpkgar::wpkgar_manager::package_list_t list;
         manager->list_installed_packages(list);
 
@@ -4108,11 +4203,17 @@ void audit(command_line& cl)
                     manager->get_wpkgar_file(*it, wpkgar_file);
                     wpkgar_file->set_package_path(package_path);
                     wpkgar_file->dir_rewind();
+
+                    // the files are not loaded here, the verifier streams
+                    // them from disk, possibly in parallel, once we know
+                    // about all of them
+                    wpkg_verify::md5sums_verifier verifier;
+                    verifier.set_jobs(cl.jobs());
+                    std::vector<std::string> verified_filenames;
                     for(;;)
                     {
                         memfile::memory_file::file_info info;
-                        memfile::memory_file data;
-                        if(!wpkgar_file->dir_next(info, &data))
+                        if(!wpkgar_file->dir_next(info))
                         {
                             break;
                         }
@@ -4127,26 +4228,15 @@ void audit(command_line& cl)
                                     const wpkg_filename::uri_filename fullname(package_path.append_child(filename));
                                     //printf("%s: %s\n", it->c_str(), fullname.c_str());
                                     filename.erase(0, 1);
-                                    if(md5sums.find(filename) != md5sums.end())
+                                    wpkg_util::md5sums_map_t::iterator m5(md5sums.find(filename));
+                                    if(m5 != md5sums.end())
                                     {
-                                        std::string sum(data.md5sum());
-                                        if(md5sums[filename] != sum)
-                                        {
-                                            if(!manager->is_conffile(*it, filename))
-                                            {
-                                                printf("%s: file \"%s\" md5sum differs\n",
-                                                        it->c_str(),
-                                                        fullname.original_filename().c_str());
-                                                ++err;
-                                            }
-                                            else if(cl.verbose())
-                                            {
-                                                printf("%s: configuration file \"%s\" was modified\n", it->c_str(), fullname.original_filename().c_str());
-                                            }
-                                        }
+                                        verifier.add_file(fullname, m5->second);
+                                        verified_filenames.push_back(filename);
+
                                         // remove the entry so we can err in case some
                                         // md5sums were not used up (why are they defined?)
-                                        md5sums.erase(md5sums.find(filename));
+                                        md5sums.erase(m5);
                                     }
                                     else
                                     {
@@ -4166,6 +4256,39 @@ void audit(command_line& cl)
                             }
                         }
                     }
+                    verifier.run();
+                    const size_t count(verifier.size());
+                    for(size_t idx(0); idx < count; ++idx)
+                    {
+                        const wpkg_verify::md5sums_verifier::file_entry& entry(verifier.get_entry(idx));
+                        switch(entry.get_status())
+                        {
+                        case wpkg_verify::md5sums_verifier::verify_status_valid:
+                            break;
+
+                        case wpkg_verify::md5sums_verifier::verify_status_invalid:
+                            if(!manager->is_conffile(*it, verified_filenames[idx]))
+                            {
+                                printf("%s: file \"%s\" md5sum differs\n",
+                                        it->c_str(),
+                                        entry.get_filename().original_filename().c_str());
+                                ++err;
+                            }
+                            else if(cl.verbose())
+                            {
+                                printf("%s: configuration file \"%s\" was modified\n", it->c_str(), entry.get_filename().original_filename().c_str());
+                            }
+                            break;
+
+                        default:
+                            printf("%s: file \"%s\" could not be read\n",
+                                    it->c_str(),
+                                    entry.get_filename().original_filename().c_str());
+                            ++err;
+                            break;
+
+                        }
+                    }
                     if(!md5sums.empty())
                     {
                         for(wpkg_util::md5sums_map_t::const_iterator m5(md5sums.begin());
@@ -4525,24 +4648,16 @@ void canonicalize_version(command_line& cl, const std::string& optname)
             cl.opt().get_program_name().c_str(), optname.c_str());
         exit(1);
     }
-    char err[256];
+    const char *err(NULL);
     std::string org(cl.opt().get_string(optname, 0));
-    debian_version_handle_t v(string_to_debian_version(org.c_str(), err, sizeof(err)));
-    if(v == NULL)
+    debian_version::value v;
+    if(!v.set(org, &err))
     {
         fprintf(stderr, "error:%s: version \"%s\" is not a valid Debian version: %s.\n",
                 cl.opt().get_program_name().c_str(), org.c_str(), err);
         exit(1);
     }
-    char version[256];
-    int r(debian_version_to_string(v, version, sizeof(version)));
-    if(r == -1)
-    {
-        fprintf(stderr, "error:%s: version \"%s\" could not be canonicalized (too long? %d).\n",
-                cl.opt().get_program_name().c_str(), org.c_str(), errno);
-        exit(1);
-    }
-    printf("%s\n", version);
+    printf("%s\n", v.to_string().c_str());
 }
 
 void compare_versions(command_line& cl)
@@ -4554,28 +4669,28 @@ void compare_versions(command_line& cl)
         exit(255);
     }
 
-    char err[256];
+    const char *err(NULL);
     std::string v1(cl.opt().get_string("compare-versions", 0));
     std::string v2(cl.opt().get_string("compare-versions", 2));
     int c(0);
     if(!v1.empty() && !v2.empty())
     {
-        debian_version_handle_t a(string_to_debian_version(v1.c_str(), err, sizeof(err)));
-        if(a == NULL)
+        debian_version::value a;
+        if(!a.set(v1, &err))
         {
             fprintf(stderr, "error:%s: version \"%s\" is not a valid Debian version: %s.\n",
                     cl.opt().get_program_name().c_str(), v1.c_str(), err);
             exit(255);
         }
-        debian_version_handle_t b(string_to_debian_version(v2.c_str(), err, sizeof(err)));
-        if(b == NULL)
+        debian_version::value b;
+        if(!b.set(v2, &err))
         {
             fprintf(stderr, "error:%s: version \"%s\" is not a valid Debian version: %s.\n",
                     cl.opt().get_program_name().c_str(), v2.c_str(), err);
             exit(255);
         }
 
-        c = debian_versions_compare(a, b);
+        c = a.compare(b);
     }
     else
     {
@@ -5916,7 +6031,7 @@ void list(command_line& cl)
 
     wpkgar::wpkgar_manager::pointer_t manager( new wpkgar::wpkgar_manager );
     init_manager(cl, manager, "list");
-    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing");
+    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing", wpkgar::wpkgar_lock::lock_mode_shared);
     wpkgar::wpkgar_manager::package_list_t the_list;
     manager->list_installed_packages(the_list);
 
@@ -6056,7 +6171,7 @@ void list_all(command_line& cl)
 
     wpkgar::wpkgar_manager::pointer_t manager( new wpkgar::wpkgar_manager );
     init_manager(cl, manager, "list-all");
-    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing");
+    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing", wpkgar::wpkgar_lock::lock_mode_shared);
     wpkgar::wpkgar_manager::package_list_t list;
     manager->list_installed_packages(list);
 
@@ -6109,7 +6224,7 @@ void listfiles(command_line& cl)
     }
     wpkgar::wpkgar_manager::pointer_t manager( new wpkgar::wpkgar_manager );
     init_manager(cl, manager, "listfiles");
-    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing");
+    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing", wpkgar::wpkgar_lock::lock_mode_shared);
 
     bool first(true);
     for(int i(0); i < max; ++i)
@@ -6166,7 +6281,7 @@ void list_index_packages(command_line& cl)
     }
     wpkgar::wpkgar_manager::pointer_t manager( new wpkgar::wpkgar_manager );
     init_manager(cl, manager, "list-index-packages");
-    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing");
+    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing", wpkgar::wpkgar_lock::lock_mode_shared);
 
     for(int i(0); i < max; ++i)
     {
@@ -6205,7 +6320,7 @@ void list_sources(command_line& cl)
     }
     wpkgar::wpkgar_manager::pointer_t manager( new wpkgar::wpkgar_manager );
     init_manager(cl, manager, "list-sources");
-    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing");
+    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing", wpkgar::wpkgar_lock::lock_mode_shared);
 
     for(int i(0); i < max; ++i)
     {
@@ -6291,39 +6406,65 @@ void md5sums_check(command_line& cl)
     wpkg_util::md5sums_map_t md5sums;
     wpkg_util::parse_md5sums(md5sums, md5sums_file);
 
-    // now check the specified files
+    // now check the specified files; entries[i] is the index of the
+    // verifier entry of the i-th file or -1 if the file is not listed
+    wpkg_verify::md5sums_verifier verifier;
+    verifier.set_jobs(cl.jobs());
+    std::vector<int> entries;
     for(int i(0); i < max; ++i)
     {
         std::string filename(cl.opt().get_string("filename", i));
         wpkg_util::md5sums_map_t::const_iterator it(md5sums.find(filename));
         if(it == md5sums.end())
+        {
+            entries.push_back(-1);
+        }
+        else
+        {
+            entries.push_back(static_cast<int>(verifier.size()));
+            verifier.add_file(filename, it->second);
+        }
+    }
+    verifier.run();
+
+    // report the results in the order the files were specified
+    for(int i(0); i < max; ++i)
+    {
+        if(entries[i] == -1)
         {
             // this file does not exist in the md5sums file
             wpkg_output::log("file %1 is not defined in your list of md5sums")
-                    .quoted_arg(filename)
+                    .quoted_arg(cl.opt().get_string("filename", i))
                 .level(wpkg_output::level_warning)
                 .action("audit-validation");
+            continue;
         }
-        else
+        const wpkg_verify::md5sums_verifier::file_entry& entry(verifier.get_entry(entries[i]));
+        switch(entry.get_status())
         {
-            memfile::memory_file file;
-            file.read_file(filename);
-            std::string loaded_file_md5sum(file.md5sum());
-            if(it->second == loaded_file_md5sum)
-            {
-                wpkg_output::log("%1 is valid")
-                        .quoted_arg(filename)
-                    .action("audit-validation");
-            }
-            else
-            {
-                wpkg_output::log("the md5sum (%1) of file %2 does not match the one found (%3) in your list of md5sums")
-                        .arg(it->second)
-                        .quoted_arg(filename)
-                        .arg(loaded_file_md5sum)
-                    .level(wpkg_output::level_error)
-                    .action("audit-validation");
-            }
+        case wpkg_verify::md5sums_verifier::verify_status_valid:
+            wpkg_output::log("%1 is valid")
+                    .quoted_arg(entry.get_filename())
+                .action("audit-validation");
+            break;
+
+        case wpkg_verify::md5sums_verifier::verify_status_invalid:
+            wpkg_output::log("the md5sum (%1) of file %2 does not match the one found (%3) in your list of md5sums")
+                    .arg(entry.get_expected_md5sum())
+                    .quoted_arg(entry.get_filename())
+                    .arg(entry.get_md5sum())
+                .level(wpkg_output::level_error)
+                .action("audit-validation");
+            break;
+
+        default:
+            wpkg_output::log("file %1 could not be read: %2")
+                    .quoted_arg(entry.get_filename())
+                    .arg(entry.get_error())
+                .level(wpkg_output::level_error)
+                .action("audit-validation");
+            break;
+
         }
     }
 }
@@ -6332,7 +6473,7 @@ void print_architecture(command_line& cl)
 {
     wpkgar::wpkgar_manager::pointer_t manager( new wpkgar::wpkgar_manager );
     init_manager(cl, manager, "print-architecture");
-    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing");
+    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing", wpkgar::wpkgar_lock::lock_mode_shared);
     manager->load_package("core");
     std::string architecture(manager->get_field("core", "Architecture"));
     printf("%s\n", architecture.c_str());
@@ -6617,7 +6758,7 @@ void search(command_line& cl)
     }
     wpkgar::wpkgar_manager::pointer_t manager( new wpkgar::wpkgar_manager );
     init_manager(cl, manager, "search");
-    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing");
+    wpkgar::wpkgar_lock lock_wpkg(manager, "Listing", wpkgar::wpkgar_lock::lock_mode_shared);
     wpkgar::wpkgar_manager::package_list_t list;
     manager->list_installed_packages(list);
 
@@ -7362,6 +7503,7 @@ int main(int argc, char *argv[])
         {
             fprintf(stderr, "wpkg:error: %s\n", e.what());
         }
+        wpkg_metrics::emit_summary();
         output->clear_listeners();
         exit(1);
     }
@@ -7373,6 +7515,7 @@ int main(int argc, char *argv[])
         throw;
     }
 
+    wpkg_metrics::emit_summary();
     output->clear_listeners();
     return g_output.exit_code();
 }